@@ -26,6 +26,8 @@
 #include "messagebox.h"
 #include "preferences.h"
 #include "synchtimer.h"
+#include "metrics.h"
+#include "trace.h"
 #include "kalarmsettings.h"
 #include "kalarmdirsettings.h"
 
@@ -47,7 +49,9 @@
 #include <AkonadiCore/itemcreatejob.h>
 #include <AkonadiCore/itemmodifyjob.h>
 #include <AkonadiCore/itemdeletejob.h>
+#include <AkonadiCore/itemfetchjob.h>
 #include <AkonadiCore/itemfetchscope.h>
+#include <AkonadiCore/transactionsequence.h>
 #include <AkonadiWidgets/agenttypedialog.h>
 
 #include <KLocalizedString>
@@ -95,6 +99,7 @@ AkonadiModel* AkonadiModel::instance()
 AkonadiModel::AkonadiModel(ChangeRecorder* monitor, QObject* parent)
     : EntityTreeModel(monitor, parent),
       mMonitor(monitor),
+      mReloadChangedCount(0),
       mResourcesChecked(false),
       mMigrating(false)
 {
@@ -115,15 +120,7 @@ AkonadiModel::AkonadiModel(ChangeRecorder* monitor, QObject* parent)
     AttributeFactory::registerAttribute<CompatibilityAttribute>();
     AttributeFactory::registerAttribute<EventAttribute>();
 
-    if (!mTextIcon)
-    {
-        mTextIcon    = new QPixmap(QIcon::fromTheme(QStringLiteral("dialog-information")).pixmap(16, 16));
-        mFileIcon    = new QPixmap(QIcon::fromTheme(QStringLiteral("document-open")).pixmap(16, 16));
-        mCommandIcon = new QPixmap(QIcon::fromTheme(QStringLiteral("system-run")).pixmap(16, 16));
-        mEmailIcon   = new QPixmap(QIcon::fromTheme(QStringLiteral("mail-unread")).pixmap(16, 16));
-        mAudioIcon   = new QPixmap(QIcon::fromTheme(QStringLiteral("audio-x-generic")).pixmap(16, 16));
-        mIconSize = mTextIcon->size().expandedTo(mFileIcon->size()).expandedTo(mCommandIcon->size()).expandedTo(mEmailIcon->size()).expandedTo(mAudioIcon->size());
-    }
+    initIcons();
 
 #ifdef __GNUC__
 #warning Only want to monitor collection properties, not content, when this becomes possible
@@ -316,214 +313,227 @@ QVariant AkonadiModel::data(const QModelIndex& index, int role) const
             const KAEvent event(this->event(item));
             if (!event.isValid())
                 return QVariant();
-            if (role == AlarmActionsRole)
-                return event.actionTypes();
-            if (role == AlarmSubActionRole)
-                return event.actionSubType();
             bool calendarColour = false;
-            switch (column)
+            const QVariant value = eventData(event, column, role, &calendarColour);
+            if (value.isValid())
+                return value;
+            if (calendarColour)
             {
-                case TimeColumn:
-                    switch (role)
-                    {
-                        case Qt::BackgroundRole:
-                            calendarColour = true;
-                            break;
-                        case Qt::DisplayRole:
-                            if (event.expired())
-                                return AlarmTime::alarmTimeText(event.startDateTime());
-                            return AlarmTime::alarmTimeText(event.nextTrigger(KAEvent::DISPLAY_TRIGGER));
-                        case SortRole:
-                        {
-                            DateTime due;
-                            if (event.expired())
-                                due = event.startDateTime();
-                            else
-                                due = event.nextTrigger(KAEvent::DISPLAY_TRIGGER);
-                            return due.isValid() ? due.effectiveKDateTime().toUtc().dateTime()
-                                                 : QDateTime(QDate(9999,12,31), QTime(0,0,0));
-                        }
-                        default:
-                            break;
-                    }
+                Collection parent = item.parentCollection();
+                const QColor colour = backgroundColor(parent);
+                if (colour.isValid())
+                    return colour;
+            }
+        }
+    }
+    return EntityTreeModel::data(index, role);
+}
+
+/******************************************************************************
+* Return the data for a given role and column, which is derived from an alarm
+* item's event.
+* If the calendar's background colour should be used, 'calendarColour' is set
+* true and an invalid value is returned.
+*/
+QVariant AkonadiModel::eventData(const KAEvent& event, int column, int role, bool* calendarColour)
+{
+    if (role == AlarmActionsRole)
+        return event.actionTypes();
+    if (role == AlarmSubActionRole)
+        return event.actionSubType();
+    switch (column)
+    {
+        case TimeColumn:
+            switch (role)
+            {
+                case Qt::BackgroundRole:
+                    *calendarColour = true;
                     break;
-                case TimeToColumn:
-                    switch (role)
-                    {
-                        case Qt::BackgroundRole:
-                            calendarColour = true;
-                            break;
-                        case Qt::DisplayRole:
-                            if (event.expired())
-                                return QString();
-                            return AlarmTime::timeToAlarmText(event.nextTrigger(KAEvent::DISPLAY_TRIGGER));
-                        case SortRole:
-                        {
-                            if (event.expired())
-                                return -1;
-                            const DateTime due = event.nextTrigger(KAEvent::DISPLAY_TRIGGER);
-                            const KDateTime now = KDateTime::currentUtcDateTime();
-                            if (due.isDateOnly())
-                                return now.date().daysTo(due.date()) * 1440;
-                            return (now.secsTo(due.effectiveKDateTime()) + 59) / 60;
-                        }
-                    }
+                case Qt::DisplayRole:
+                    if (event.expired())
+                        return AlarmTime::alarmTimeText(event.startDateTime());
+                    return AlarmTime::alarmTimeText(event.nextTrigger(KAEvent::DISPLAY_TRIGGER));
+                case SortRole:
+                {
+                    DateTime due;
+                    if (event.expired())
+                        due = event.startDateTime();
+                    else
+                        due = event.nextTrigger(KAEvent::DISPLAY_TRIGGER);
+                    return due.isValid() ? due.effectiveKDateTime().toUtc().dateTime()
+                                         : QDateTime(QDate(9999,12,31), QTime(0,0,0));
+                }
+                default:
                     break;
-                case RepeatColumn:
-                    switch (role)
-                    {
-                        case Qt::BackgroundRole:
-                            calendarColour = true;
-                            break;
-                        case Qt::DisplayRole:
-                            return repeatText(event);
-                        case Qt::TextAlignmentRole:
-                            return Qt::AlignHCenter;
-                        case SortRole:
-                            return repeatOrder(event);
-                    }
+            }
+            break;
+        case TimeToColumn:
+            switch (role)
+            {
+                case Qt::BackgroundRole:
+                    *calendarColour = true;
                     break;
-                case ColourColumn:
-                    switch (role)
-                    {
-                        case Qt::BackgroundRole:
-                        {
-                            const KAEvent::Actions type = event.actionTypes();
-                            if (type & KAEvent::ACT_DISPLAY)
-                                return event.bgColour();
-                            if (type == KAEvent::ACT_COMMAND)
-                            {
-                                if (event.commandError() != KAEvent::CMD_NO_ERROR)
-                                    return QColor(Qt::red);
-                            }
-                            break;
-                        }
-                        case Qt::ForegroundRole:
-                            if (event.commandError() != KAEvent::CMD_NO_ERROR)
-                            {
-                                if (event.actionTypes() == KAEvent::ACT_COMMAND)
-                                    return QColor(Qt::white);
-                                QColor colour = Qt::red;
-                                int r, g, b;
-                                event.bgColour().getRgb(&r, &g, &b);
-                                if (r > 128  &&  g <= 128  &&  b <= 128)
-                                    colour = QColor(Qt::white);
-                                return colour;
-                            }
-                            break;
-                        case Qt::DisplayRole:
-                            if (event.commandError() != KAEvent::CMD_NO_ERROR)
-                                return QLatin1String("!");
-                            break;
-                        case SortRole:
-                        {
-                            const unsigned i = (event.actionTypes() == KAEvent::ACT_DISPLAY)
-                                               ? event.bgColour().rgb() : 0;
-                            return QStringLiteral("%1").arg(i, 6, 10, QLatin1Char('0'));
-                        }
-                        default:
-                            break;
-                    }
+                case Qt::DisplayRole:
+                    if (event.expired())
+                        return QString();
+                    return AlarmTime::timeToAlarmText(event.nextTrigger(KAEvent::DISPLAY_TRIGGER));
+                case SortRole:
+                {
+                    if (event.expired())
+                        return -1;
+                    const DateTime due = event.nextTrigger(KAEvent::DISPLAY_TRIGGER);
+                    const KDateTime now = KDateTime::currentUtcDateTime();
+                    if (due.isDateOnly())
+                        return now.date().daysTo(due.date()) * 1440;
+                    return (now.secsTo(due.effectiveKDateTime()) + 59) / 60;
+                }
+            }
+            break;
+        case RepeatColumn:
+            switch (role)
+            {
+                case Qt::BackgroundRole:
+                    *calendarColour = true;
                     break;
-                case TypeColumn:
-                    switch (role)
+                case Qt::DisplayRole:
+                    return repeatText(event);
+                case Qt::TextAlignmentRole:
+                    return Qt::AlignHCenter;
+                case SortRole:
+                    return repeatOrder(event);
+            }
+            break;
+        case ColourColumn:
+            switch (role)
+            {
+                case Qt::BackgroundRole:
+                {
+                    const KAEvent::Actions type = event.actionTypes();
+                    if (type & KAEvent::ACT_DISPLAY)
+                        return event.bgColour();
+                    if (type == KAEvent::ACT_COMMAND)
                     {
-                        case Qt::BackgroundRole:
-                            calendarColour = true;
-                            break;
-                        case Qt::DecorationRole:
-                        {
-                            QVariant v;
-                            v.setValue(*eventIcon(event));
-                            return v;
-                        }
-                        case Qt::TextAlignmentRole:
-                            return Qt::AlignHCenter;
-                        case Qt::SizeHintRole:
-                            return mIconSize;
-                        case Qt::AccessibleTextRole:
-#ifdef __GNUC__
-#warning Implement accessibility
-#endif
-                            return QString();
-                        case ValueRole:
-                            return static_cast<int>(event.actionSubType());
-                        case SortRole:
-                            return QStringLiteral("%1").arg(event.actionSubType(), 2, 10, QLatin1Char('0'));
+                        if (event.commandError() != KAEvent::CMD_NO_ERROR)
+                            return QColor(Qt::red);
                     }
                     break;
-                case TextColumn:
-                    switch (role)
+                }
+                case Qt::ForegroundRole:
+                    if (event.commandError() != KAEvent::CMD_NO_ERROR)
                     {
-                        case Qt::BackgroundRole:
-                            calendarColour = true;
-                            break;
-                        case Qt::DisplayRole:
-                        case SortRole:
-                            return AlarmText::summary(event, 1);
-                        case Qt::ToolTipRole:
-                            return AlarmText::summary(event, 10);
-                        default:
-                            break;
+                        if (event.actionTypes() == KAEvent::ACT_COMMAND)
+                            return QColor(Qt::white);
+                        QColor colour = Qt::red;
+                        int r, g, b;
+                        event.bgColour().getRgb(&r, &g, &b);
+                        if (r > 128  &&  g <= 128  &&  b <= 128)
+                            colour = QColor(Qt::white);
+                        return colour;
                     }
                     break;
-                case TemplateNameColumn:
-                    switch (role)
-                    {
-                        case Qt::BackgroundRole:
-                            calendarColour = true;
-                            break;
-                        case Qt::DisplayRole:
-                            return event.templateName();
-                        case SortRole:
-                            return event.templateName().toUpper();
-                    }
+                case Qt::DisplayRole:
+                    if (event.commandError() != KAEvent::CMD_NO_ERROR)
+                        return QLatin1String("!");
                     break;
+                case SortRole:
+                {
+                    const unsigned i = (event.actionTypes() == KAEvent::ACT_DISPLAY)
+                                       ? event.bgColour().rgb() : 0;
+                    return QStringLiteral("%1").arg(i, 6, 10, QLatin1Char('0'));
+                }
                 default:
                     break;
             }
-
+            break;
+        case TypeColumn:
             switch (role)
             {
-                case Qt::ForegroundRole:
-                    if (!event.enabled())
-                           return Preferences::disabledColour();
-                    if (event.expired())
-                           return Preferences::archivedColour();
-                    break;   // use the default for normal active alarms
-                case Qt::ToolTipRole:
-                    // Show the last command execution error message
-                    switch (event.commandError())
-                    {
-                        case KAEvent::CMD_ERROR:
-                            return i18nc("@info:tooltip", "Command execution failed");
-                        case KAEvent::CMD_ERROR_PRE:
-                            return i18nc("@info:tooltip", "Pre-alarm action execution failed");
-                        case KAEvent::CMD_ERROR_POST:
-                            return i18nc("@info:tooltip", "Post-alarm action execution failed");
-                        case KAEvent::CMD_ERROR_PRE_POST:
-                            return i18nc("@info:tooltip", "Pre- and post-alarm action execution failed");
-                        default:
-                        case KAEvent::CMD_NO_ERROR:
-                            break;
-                    }
+                case Qt::BackgroundRole:
+                    *calendarColour = true;
                     break;
-                case EnabledRole:
-                    return event.enabled();
+                case Qt::DecorationRole:
+                {
+                    QVariant v;
+                    v.setValue(*eventIcon(event));
+                    return v;
+                }
+                case Qt::TextAlignmentRole:
+                    return Qt::AlignHCenter;
+                case Qt::SizeHintRole:
+                    return iconSize();
+                case Qt::AccessibleTextRole:
+#ifdef __GNUC__
+#warning Implement accessibility
+#endif
+                    return QString();
+                case ValueRole:
+                    return static_cast<int>(event.actionSubType());
+                case SortRole:
+                    return QStringLiteral("%1").arg(event.actionSubType(), 2, 10, QLatin1Char('0'));
+            }
+            break;
+        case TextColumn:
+            switch (role)
+            {
+                case Qt::BackgroundRole:
+                    *calendarColour = true;
+                    break;
+                case Qt::DisplayRole:
+                case SortRole:
+                    return AlarmText::summary(event, 1);
+                case Qt::ToolTipRole:
+                    return AlarmText::summary(event, 10);
                 default:
                     break;
             }
+            break;
+        case TemplateNameColumn:
+            switch (role)
+            {
+                case Qt::BackgroundRole:
+                    *calendarColour = true;
+                    break;
+                case Qt::DisplayRole:
+                    return event.templateName();
+                case SortRole:
+                    return event.templateName().toUpper();
+            }
+            break;
+        default:
+            break;
+    }
 
-            if (calendarColour)
+    switch (role)
+    {
+        case Qt::ForegroundRole:
+            if (!event.enabled())
+                   return Preferences::disabledColour();
+            if (event.expired())
+                   return Preferences::archivedColour();
+            break;   // use the default for normal active alarms
+        case Qt::ToolTipRole:
+            // Show the last command execution error message
+            switch (event.commandError())
             {
-                Collection parent = item.parentCollection();
-                const QColor colour = backgroundColor(parent);
-                if (colour.isValid())
-                    return colour;
+                case KAEvent::CMD_ERROR:
+                    return i18nc("@info:tooltip", "Command execution failed");
+                case KAEvent::CMD_ERROR_PRE:
+                    return i18nc("@info:tooltip", "Pre-alarm action execution failed");
+                case KAEvent::CMD_ERROR_POST:
+                    return i18nc("@info:tooltip", "Post-alarm action execution failed");
+                case KAEvent::CMD_ERROR_PRE_POST:
+                    return i18nc("@info:tooltip", "Pre- and post-alarm action execution failed");
+                default:
+                case KAEvent::CMD_NO_ERROR:
+                    break;
             }
-        }
+            break;
+        case EnabledRole:
+            return event.enabled();
+        default:
+            break;
     }
-    return EntityTreeModel::data(index, role);
+    return QVariant();
 }
 
 /******************************************************************************
@@ -762,6 +772,7 @@ static bool checkItem_isActive(const Item& item)
 
 void AkonadiModel::slotUpdateTimeTo()
 {
+    KALARM_TRACE_SCOPE("model", "updateTimeTo");
     signalDataChanged(&checkItem_isActive, TimeToColumn, TimeToColumn, QModelIndex());
 }
 
@@ -980,7 +991,7 @@ QString AkonadiModel::readOnlyTooltip(const Collection& collection)
 /******************************************************************************
 * Return the repetition text.
 */
-QString AkonadiModel::repeatText(const KAEvent& event) const
+QString AkonadiModel::repeatText(const KAEvent& event)
 {
     QString repeatText = event.recurrenceText(true);
     if (repeatText.isEmpty())
@@ -991,7 +1002,7 @@ QString AkonadiModel::repeatText(const KAEvent& event) const
 /******************************************************************************
 * Return a string for sorting the repetition column.
 */
-QString AkonadiModel::repeatOrder(const KAEvent& event) const
+QString AkonadiModel::repeatOrder(const KAEvent& event)
 {
     int repeatOrder = 0;
     int repeatInterval = 0;
@@ -1027,11 +1038,37 @@ QString AkonadiModel::repeatOrder(const KAEvent& event) const
     return QStringLiteral("%1%2").arg(static_cast<char>('0' + repeatOrder)).arg(repeatInterval, 8, 10, QLatin1Char('0'));
 }
 
+/******************************************************************************
+* Create the icons for the alarm action types, if not already done.
+*/
+void AkonadiModel::initIcons()
+{
+    if (!mTextIcon)
+    {
+        mTextIcon    = new QPixmap(QIcon::fromTheme(QStringLiteral("dialog-information")).pixmap(16, 16));
+        mFileIcon    = new QPixmap(QIcon::fromTheme(QStringLiteral("document-open")).pixmap(16, 16));
+        mCommandIcon = new QPixmap(QIcon::fromTheme(QStringLiteral("system-run")).pixmap(16, 16));
+        mEmailIcon   = new QPixmap(QIcon::fromTheme(QStringLiteral("mail-unread")).pixmap(16, 16));
+        mAudioIcon   = new QPixmap(QIcon::fromTheme(QStringLiteral("audio-x-generic")).pixmap(16, 16));
+        mIconSize = mTextIcon->size().expandedTo(mFileIcon->size()).expandedTo(mCommandIcon->size()).expandedTo(mEmailIcon->size()).expandedTo(mAudioIcon->size());
+    }
+}
+
+/******************************************************************************
+* Return the size of the alarm action type icons.
+*/
+QSize AkonadiModel::iconSize()
+{
+    initIcons();
+    return mIconSize;
+}
+
 /******************************************************************************
 * Return the icon associated with the event's action.
 */
-QPixmap* AkonadiModel::eventIcon(const KAEvent& event) const
+QPixmap* AkonadiModel::eventIcon(const KAEvent& event)
 {
+    initIcons();
     switch (event.actionTypes())
     {
         case KAEvent::ACT_EMAIL:
@@ -1161,6 +1198,152 @@ void AkonadiModel::reload()
     }
 }
 
+/******************************************************************************
+* Bring the events held by AlarmCalendar up to date with any items which have
+* changed in Akonadi storage since they were loaded into the model.
+* Each populated collection's item IDs and revisions are fetched (without
+* payloads), and compared with those held by the model. Only the items which
+* have been added or changed are then fetched with their payloads. Changes are
+* notified by the eventChanged() and eventsToBeRemoved() signals, and
+* reloadChangedDone() is emitted once all collections have been checked.
+*/
+void AkonadiModel::reloadChanged()
+{
+    KALARM_TRACE_SCOPE("model", "reloadChanged");
+    if (!mReloadChangedJobs.isEmpty())
+        return;   // already in progress
+    qCDebug(KALARM_LOG);
+    mReloadChangedCount = 0;
+    const Collection::List collections = mMonitor->collectionsMonitored();
+    foreach (const Collection& collection, collections)
+    {
+        if (!data(collectionIndex(collection), IsPopulatedRole).toBool())
+            continue;   // the collection is still being loaded
+        ItemFetchJob* job = new ItemFetchJob(collection);
+        job->fetchScope().fetchFullPayload(false);
+        job->fetchScope().setFetchModificationTime(false);
+        job->fetchScope().setAncestorRetrieval(ItemFetchScope::None);
+        connect(job, &KJob::result, this, &AkonadiModel::reloadChangedJobDone);
+        mReloadChangedJobs[job] = collection;
+    }
+    if (mReloadChangedJobs.isEmpty())
+        Q_EMIT reloadChangedDone(0);
+}
+
+/******************************************************************************
+* Called when an item fetch job started by reloadChanged() has fetched the item
+* IDs and revisions in a collection.
+* Notify the removal of items which no longer exist, and fetch the payloads of
+* items which have been added or changed.
+*/
+void AkonadiModel::reloadChangedJobDone(KJob* j)
+{
+    const Collection collection = mReloadChangedJobs.take(j);
+    if (j->error())
+    {
+        // Fall back to reloading the whole collection
+        qCWarning(KALARM_LOG) << "Collection" << collection.id() << "item fetch error:" << j->errorString();
+        reloadCollection(collection);
+    }
+    else
+    {
+        // Find the revisions of the items currently in the model
+        QHash<Item::Id, int> revisions;
+        QHash<Item::Id, int> rows;
+        const QModelIndex collectionIx = modelIndexForCollection(this, collection);
+        for (int row = 0, count = rowCount(collectionIx);  row < count;  ++row)
+        {
+            const Item item = index(row, 0, collectionIx).data(ItemRole).value<Item>();
+            if (item.isValid())
+            {
+                revisions[item.id()] = item.revision();
+                rows[item.id()] = row;
+            }
+        }
+
+        // Find items which have been added or changed
+        Item::List changed;
+        const Item::List items = static_cast<ItemFetchJob*>(j)->items();
+        for (int i = 0, end = items.count();  i < end;  ++i)
+        {
+            QHash<Item::Id, int>::iterator it = revisions.find(items[i].id());
+            if (it == revisions.end())
+                changed += Item(items[i].id());
+            else
+            {
+                if (it.value() != items[i].revision())
+                    changed += Item(items[i].id());
+                revisions.erase(it);
+            }
+        }
+
+        // Any items left in 'revisions' have been removed
+        if (!revisions.isEmpty())
+        {
+            EventList removed;
+            for (QHash<Item::Id, int>::ConstIterator it = revisions.constBegin();  it != revisions.constEnd();  ++it)
+                removed += eventList(collectionIx, rows[it.key()], rows[it.key()]);
+            Q_EMIT eventsToBeRemoved(removed);
+        }
+
+        const int changes = changed.count() + revisions.count();
+        if (changes)
+        {
+            qCDebug(KALARM_LOG) << "Collection" << collection.id() << ":" << changes << "changed items";
+            mReloadChangedCount += changes;
+        }
+        if (!changed.isEmpty())
+        {
+            ItemFetchJob* job = new ItemFetchJob(changed);
+            job->fetchScope().fetchFullPayload(true);
+            job->fetchScope().setAncestorRetrieval(ItemFetchScope::None);
+            connect(job, &KJob::result, this, &AkonadiModel::reloadChangedItemsJobDone);
+            mReloadChangedJobs[job] = collection;
+        }
+    }
+    if (mReloadChangedJobs.isEmpty())
+    {
+        qCDebug(KALARM_LOG) << "Completed:" << mReloadChangedCount << "changed items";
+        Q_EMIT reloadChangedDone(mReloadChangedCount);
+    }
+}
+
+/******************************************************************************
+* Called when an item fetch job started by reloadChanged() has fetched the
+* items in a collection which have been added or changed.
+* Notify the new contents of each item.
+*/
+void AkonadiModel::reloadChangedItemsJobDone(KJob* j)
+{
+    const Collection collection = mReloadChangedJobs.take(j);
+    if (j->error())
+    {
+        // Fall back to reloading the whole collection
+        qCWarning(KALARM_LOG) << "Collection" << collection.id() << "changed item fetch error:" << j->errorString();
+        reloadCollection(collection);
+    }
+    else
+    {
+        const Item::List items = static_cast<ItemFetchJob*>(j)->items();
+        for (int i = 0, end = items.count();  i < end;  ++i)
+        {
+            if (!items[i].hasPayload<KAEvent>())
+                continue;
+            KAEvent evnt = items[i].payload<KAEvent>();
+            if (!evnt.isValid())
+                continue;
+            evnt.setItemId(items[i].id());
+            evnt.setCollectionId(collection.id());
+            Q_EMIT eventChanged(Event(evnt, collection));
+        }
+    }
+    if (mReloadChangedJobs.isEmpty())
+    {
+        qCDebug(KALARM_LOG) << "Completed:" << mReloadChangedCount << "changed items";
+        Q_EMIT reloadChangedDone(mReloadChangedCount);
+    }
+}
+
 /******************************************************************************
 * Called when a collection modification job has completed.
 * Checks for any error.
@@ -1324,20 +1507,54 @@ AkonadiModel::Result AkonadiModel::addEvent(KAEvent* event, CalEvent::Type type,
 
 /******************************************************************************
 * Add events to a specified Collection.
-* Events which are scheduled to be added to the collection are updated with
-* their Akonadi item ID.
-* The caller must connect to the itemDone() signal to check whether events
-* have been added successfully. Note that the first signal may be emitted
-* before this function returns.
-* Reply = true if item creation has been scheduled for all events,
-*       = false if at least one item creation failed to be scheduled.
+* The events are all added in a single Akonadi transaction, so that either all
+* or none of them are added. Any event whose item cannot be created is left out
+* of the transaction, without preventing the others from being added.
+* The events are updated with their Akonadi item ID.
+* The caller must connect to the eventsAddDone() signal to find out whether the
+* transaction has been committed, and the IDs of the items created. The
+* itemDone() signal is also emitted for each item once the outcome is known.
+* Reply = the transaction job, or null if no event's item could be created.
 */
-bool AkonadiModel::addEvents(const KAEvent::List& events, Collection& collection)
-{
-    bool ok = true;
+KJob* AkonadiModel::addEvents(const KAEvent::List& events, Collection& collection)
+{
+    if (events.isEmpty())
+        return nullptr;
+    qCDebug(KALARM_LOG) << "Count:" << events.count();
+    Item::List items;
+    QVector<int> indexes;   // index into 'events' of each item
+    items.reserve(events.count());
+    indexes.reserve(events.count());
     for (int i = 0, count = events.count();  i < count;  ++i)
-        ok = ok && addEvent(*events[i], collection);
-    return ok;
+    {
+        Item item;
+        if (!events[i]->setItemPayload(item, collection.contentMimeTypes()))
+        {
+            qCWarning(KALARM_LOG) << "Invalid mime type for collection:" << events[i]->id();
+            continue;
+        }
+        events[i]->setItemId(item.id());
+        items += item;
+        indexes += i;
+    }
+    if (items.isEmpty())
+        return nullptr;
+
+    // Don't report the outcome of the individual item creation jobs, since
+    // they are only final once the transaction has been committed or rolled
+    // back.
+    TransactionSequence* transaction = new TransactionSequence(this);
+    connect(transaction, &KJob::result, this, &AkonadiModel::transactionJobDone);
+    Transaction& data = mPendingTransactions[transaction];
+    data.itemIds.fill(-1, events.count());
+    data.timer.start();
+    for (int i = 0, count = items.count();  i < count;  ++i)
+    {
+        ItemCreateJob* job = new ItemCreateJob(items[i], collection, transaction);
+        connect(job, &ItemCreateJob::result, this, &AkonadiModel::transactionItemJobDone);
+        mTransactionItemJobs[job] = qMakePair(static_cast<KJob*>(transaction), indexes[i]);
+    }
+    return transaction;
 }
 
 /******************************************************************************
@@ -1362,7 +1579,7 @@ bool AkonadiModel::addEvent(KAEvent& event, Collection& collection)
 qCDebug(KALARM_LOG)<<"-> item id="<<item.id();
     ItemCreateJob* job = new ItemCreateJob(item, collection);
     connect(job, &ItemCreateJob::result, this, &AkonadiModel::itemJobDone);
-    mPendingItemJobs[job] = item.id();
+    addPendingItemJob(job, item.id());
     job->start();
 qCDebug(KALARM_LOG)<<"...exiting";
     return true;
@@ -1400,6 +1617,29 @@ qCDebug(KALARM_LOG)<<"item id="<<item.id()<<", revision="<<item.revision();
     return true;
 }
 
+/******************************************************************************
+* Update an event whose item may not yet have been loaded into the model, e.g.
+* one which was fetched individually before its collection was loaded.
+* The event retains its existing Akonadi item ID.
+* Reply = true if item update has been scheduled.
+*/
+bool AkonadiModel::updateUnloadedEvent(KAEvent& event, const Collection& collection)
+{
+    if (itemIndex(event.itemId()).isValid())
+        return updateEvent(event);
+    qCDebug(KALARM_LOG) << "item id=" << event.itemId();
+    if (event.itemId() < 0  ||  !collection.isValid())
+        return false;
+    Item item(event.itemId());
+    if (!event.setItemPayload(item, collection.contentMimeTypes()))
+    {
+        qCWarning(KALARM_LOG) << "Invalid mime type for collection";
+        return false;
+    }
+    queueItemModifyJob(item);
+    return true;
+}
+
 /******************************************************************************
 * Delete an event from its collection.
 */
@@ -1421,7 +1661,54 @@ bool AkonadiModel::deleteEvent(Akonadi::Item::Id itemId)
     const Item item = ix.data(ItemRole).value<Item>();
     ItemDeleteJob* job = new ItemDeleteJob(item);
     connect(job, &ItemDeleteJob::result, this, &AkonadiModel::itemJobDone);
-    mPendingItemJobs[job] = itemId;
+    addPendingItemJob(job, itemId);
+    job->start();
+    return true;
+}
+
+/******************************************************************************
+* Delete an event whose item may not yet have been loaded into the model, e.g.
+* one which was fetched individually before its collection was loaded.
+*/
+bool AkonadiModel::deleteUnloadedEvent(Akonadi::Item::Id itemId)
+{
+    if (itemIndex(itemId).isValid())
+        return deleteEvent(itemId);
+    qCDebug(KALARM_LOG) << itemId;
+    if (itemId < 0)
+        return false;
+    ItemDeleteJob* job = new ItemDeleteJob(Item(itemId));
+    connect(job, &ItemDeleteJob::result, this, &AkonadiModel::itemJobDone);
+    addPendingItemJob(job, itemId);
+    job->start();
+    return true;
+}
+
+/******************************************************************************
+* Delete a number of events' items from their collections, using a single job.
+* Items which are not yet in the model (e.g. events fetched individually at
+* start-up) are deleted by ID.
+*/
+bool AkonadiModel::deleteItems(const QVector<Item::Id>& itemIds)
+{
+    qCDebug(KALARM_LOG) << itemIds.count();
+    Item::List items;
+    for (int i = 0, end = itemIds.count();  i < end;  ++i)
+    {
+        const QModelIndex ix = itemIndex(itemIds[i]);
+        if (ix.isValid())
+        {
+            if (!mCollectionsDeleting.contains(ix.data(ParentCollectionRole).value<Collection>().id()))
+                items += ix.data(ItemRole).value<Item>();
+        }
+        else if (itemIds[i] >= 0)
+            items += Item(itemIds[i]);
+    }
+    if (items.isEmpty())
+        return false;
+    ItemDeleteJob* job = new ItemDeleteJob(items);
+    connect(job, &ItemDeleteJob::result, this, &AkonadiModel::itemJobDone);
+    addPendingItemJob(job, -1);
     job->start();
     return true;
 }
@@ -1462,12 +1749,21 @@ void AkonadiModel::queueItemModifyJob(const Item& item)
             ItemModifyJob* job = new ItemModifyJob(newItem);
             job->disableRevisionCheck();
             connect(job, &ItemModifyJob::result, this, &AkonadiModel::itemJobDone);
-            mPendingItemJobs[job] = item.id();
+            addPendingItemJob(job, item.id());
             qCDebug(KALARM_LOG) << "Executing Modify job for item" << item.id() << ", revision=" << newItem.revision();
         }
     }
 }
 
+/******************************************************************************
+* Note a pending item creation/modification/deletion job, and when it started.
+*/
+void AkonadiModel::addPendingItemJob(KJob* job, Item::Id itemId)
+{
+    mPendingItemJobs[job] = itemId;
+    mItemJobTimers[job].start();
+}
+
 /******************************************************************************
 * Called when an item job has completed.
 * Checks for any error.
@@ -1487,6 +1783,15 @@ void AkonadiModel::itemJobDone(KJob* j)
     }
     const QByteArray jobClass = j->metaObject()->className();
     qCDebug(KALARM_LOG) << jobClass;
+    const QHash<KJob*, QElapsedTimer>::iterator tit = mItemJobTimers.find(j);
+    if (tit != mItemJobTimers.end())
+    {
+        const QString operation = (jobClass == "Akonadi::ItemCreateJob") ? QStringLiteral("create")
+                                : (jobClass == "Akonadi::ItemModifyJob") ? QStringLiteral("modify") : QStringLiteral("delete");
+        Metrics::observe("kalarm_calendar_save_seconds", tit.value().elapsed() / 1000.0,
+                         Metrics::label("backend", QStringLiteral("akonadi")) + QLatin1Char(',') + Metrics::label("operation", operation));
+        mItemJobTimers.erase(tit);
+    }
     if (j->error())
     {
         QString errMsg;
@@ -1535,6 +1840,72 @@ void AkonadiModel::itemJobDone(KJob* j)
     }*/
 }
 
+/******************************************************************************
+* Called when an item creation job within an addEvents() transaction has
+* completed. Note the ID of the new item; success is only reported once the
+* transaction has been committed.
+*/
+void AkonadiModel::transactionItemJobDone(KJob* j)
+{
+    const QHash<KJob*, QPair<KJob*, int> >::iterator it = mTransactionItemJobs.find(j);
+    if (it == mTransactionItemJobs.end())
+        return;
+    KJob* transaction = it.value().first;
+    const int index = it.value().second;
+    mTransactionItemJobs.erase(it);
+    if (j->error())
+    {
+        // The transaction will be rolled back
+        qCWarning(KALARM_LOG) << "Item creation failed:" << j->errorString();
+        return;
+    }
+    const QHash<KJob*, Transaction>::iterator tit = mPendingTransactions.find(transaction);
+    if (tit != mPendingTransactions.end())
+    {
+        // Prevent modification of the item until it is fully initialised.
+        const Item::Id itemId = static_cast<ItemCreateJob*>(j)->item().id();
+        tit.value().itemIds[index] = itemId;
+        mItemsBeingCreated << itemId;
+    }
+}
+
+/******************************************************************************
+* Called when an addEvents() transaction has been committed or rolled back.
+* Report the outcome for each of its items.
+*/
+void AkonadiModel::transactionJobDone(KJob* j)
+{
+    const QHash<KJob*, Transaction>::iterator it = mPendingTransactions.find(j);
+    if (it == mPendingTransactions.end())
+        return;
+    QVector<Item::Id> itemIds = it.value().itemIds;
+    Metrics::observe("kalarm_calendar_save_seconds", it.value().timer.elapsed() / 1000.0,
+                     Metrics::label("backend", QStringLiteral("akonadi")) + QLatin1Char(',') + Metrics::label("operation", QStringLiteral("create")));
+    mPendingTransactions.erase(it);
+    const bool ok = !j->error();
+    if (!ok)
+    {
+        // None of the items exist, so don't wait for them to be initialised.
+        for (int i = 0, count = itemIds.count();  i < count;  ++i)
+        {
+            if (itemIds[i] >= 0)
+            {
+                mItemsBeingCreated.removeAll(itemIds[i]);
+                itemIds[i] = -1;
+            }
+        }
+    }
+    for (int i = 0, count = itemIds.count();  i < count;  ++i)
+        Q_EMIT itemDone(itemIds[i], itemIds[i] >= 0);
+    Q_EMIT eventsAddDone(j, itemIds, ok);
+    if (!ok)
+    {
+        const QString errMsg = i18nc("@info", "Failed to create alarms.");
+        qCCritical(KALARM_LOG) << errMsg << itemIds.count() << ":" << j->errorString();
+        KAMessageBox::detailedError(MainWindow::mainMainWindow(), errMsg, j->errorString());
+    }
+}
+
 /******************************************************************************
 * Check whether there are any ItemModifyJobs waiting for a specified item, and
 * if so execute the first one provided its creation has completed. This
@@ -1573,7 +1944,7 @@ qCDebug(KALARM_LOG)<<"No more jobs queued";
         ItemModifyJob* job = new ItemModifyJob(qitem);
         job->disableRevisionCheck();
         connect(job, &ItemModifyJob::result, this, &AkonadiModel::itemJobDone);
-        mPendingItemJobs[job] = qitem.id();
+        addPendingItemJob(job, qitem.id());
         qCDebug(KALARM_LOG) << "Executing queued Modify job for item" << qitem.id() << ", revision=" << qitem.revision();
     }
 }
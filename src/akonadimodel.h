@@ -31,6 +31,8 @@
 
 #include <QSize>
 #include <QColor>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QMap>
 #include <QQueue>
 
@@ -136,6 +138,13 @@ class AkonadiModel : public Akonadi::EntityTreeModel
         /** Reload all collections' data from Akonadi storage (not from the backend). */
         void reload();
 
+        /** Fetch from Akonadi storage only those items which have been added,
+         *  changed or removed since they were loaded into the model, and notify
+         *  them by eventChanged() and eventsToBeRemoved(). This is done
+         *  asynchronously; reloadChangedDone() is emitted when it has completed.
+         */
+        void reloadChanged();
+
         /** Return whether calendar migration/creation at initialisation has completed. */
         bool isMigrationCompleted() const;
 
@@ -167,12 +176,19 @@ class AkonadiModel : public Akonadi::EntityTreeModel
 #endif
 
         bool  addEvent(KAEvent&, Akonadi::Collection&);
-        bool  addEvents(const KAEvent::List&, Akonadi::Collection&);
+        KJob* addEvents(const KAEvent::List&, Akonadi::Collection&);
         bool  updateEvent(KAEvent& event);
         bool  updateEvent(Akonadi::Item::Id oldId, KAEvent& newEvent);
         bool  deleteEvent(const KAEvent& event);
         bool  deleteEvent(Akonadi::Item::Id itemId);
 
+        /** Update or delete an event whose item may not yet be in the model,
+         *  because it was fetched individually before its collection loaded.
+         */
+        bool  updateUnloadedEvent(KAEvent&, const Akonadi::Collection&);
+        bool  deleteUnloadedEvent(Akonadi::Item::Id itemId);
+        bool  deleteItems(const QVector<Akonadi::Item::Id>&);
+
         /** Check whether a collection is stored in the current KAlarm calendar format. */
         static bool isCompatible(const Akonadi::Collection&);
 
@@ -203,7 +219,15 @@ class AkonadiModel : public Akonadi::EntityTreeModel
 
         static CalEvent::Types types(const Akonadi::Collection&);
 
-        static QSize iconSize()  { return mIconSize; }
+        static QSize iconSize();
+
+        /** Return the data for an alarm item which is derived from its event,
+         *  for the item data roles of the alarm columns.
+         *  @param calendarColour  set true if the calendar's background colour
+         *                         should be used, in which case an invalid
+         *                         value is returned.
+         */
+        static QVariant eventData(const KAEvent&, int column, int role, bool* calendarColour);
 
     Q_SIGNALS:
         /** Signal emitted when a collection has been added to the model. */
@@ -243,6 +267,22 @@ class AkonadiModel : public Akonadi::EntityTreeModel
          */
         void itemDone(Akonadi::Item::Id, bool status = true);
 
+        /** Signal emitted when Akonadi has committed or rolled back the
+         *  transaction started by addEvents().
+         *  @param transaction  the job returned by addEvents()
+         *  @param itemIds      Akonadi IDs of the new items, in the order of the
+         *                      events passed to addEvents(), or -1 if not created
+         *  @param status       true if the transaction was committed, false if
+         *                      it was rolled back so that no items were created
+         */
+        void eventsAddDone(KJob* transaction, const QVector<Akonadi::Item::Id>& itemIds, bool status);
+
+        /** Signal emitted when reloadChanged() has completed.
+         *  @param changes  number of items which were found to have been
+         *                  added, changed or removed
+         */
+        void reloadChangedDone(int changes);
+
         /** Signal emitted when calendar migration/creation has completed. */
         void migrationCompleted();
 
@@ -271,6 +311,10 @@ class AkonadiModel : public Akonadi::EntityTreeModel
         void slotEmitEventChanged();
         void modifyCollectionJobDone(KJob*);
         void itemJobDone(KJob*);
+        void transactionItemJobDone(KJob*);
+        void transactionJobDone(KJob*);
+        void reloadChangedJobDone(KJob*);
+        void reloadChangedItemsJobDone(KJob*);
 
     private:
         struct CalData   // data per collection
@@ -287,6 +331,12 @@ class AkonadiModel : public Akonadi::EntityTreeModel
             Akonadi::Collection::Id id;
             QString                 displayName;
         };
+        struct Transaction   // data for addEvents() transaction in progress
+        {
+            QVector<Akonadi::Item::Id> itemIds;   // IDs of items created so far, or -1
+            QElapsedTimer              timer;     // when the transaction started
+        };
+
         struct CollTypeData  // data for configuration dialog for collection creation job
         {
             CollTypeData() : parent(nullptr), alarmType(CalEvent::EMPTY) {}
@@ -302,13 +352,15 @@ class AkonadiModel : public Akonadi::EntityTreeModel
         void      setCollectionChanged(const Akonadi::Collection&, const QSet<QByteArray>&, bool rowInserted);
         void      queueItemModifyJob(const Akonadi::Item&);
         void      checkQueuedItemModifyJob(const Akonadi::Item&);
+        void      addPendingItemJob(KJob*, Akonadi::Item::Id);
 #if 0
         void     getChildEvents(const QModelIndex& parent, CalEvent::Type, KAEvent::List&) const;
 #endif
         QColor    backgroundColor_p(const Akonadi::Collection&) const;
-        QString   repeatText(const KAEvent&) const;
-        QString   repeatOrder(const KAEvent&) const;
-        QPixmap*  eventIcon(const KAEvent&) const;
+        static void     initIcons();
+        static QString  repeatText(const KAEvent&);
+        static QString  repeatOrder(const KAEvent&);
+        static QPixmap* eventIcon(const KAEvent&);
         QString   whatsThisText(int column) const;
         EventList eventList(const QModelIndex& parent, int start, int end);
 
@@ -328,6 +380,11 @@ class AkonadiModel : public Akonadi::EntityTreeModel
         QMap<KJob*, CollJobData> mPendingCollectionJobs;  // pending collection creation/deletion jobs, with collection ID & name
         QMap<KJob*, CollTypeData> mPendingColCreateJobs;  // default alarm type for pending collection creation jobs
         QMap<KJob*, Akonadi::Item::Id> mPendingItemJobs;  // pending item creation/deletion jobs, with event ID
+        QHash<KJob*, QElapsedTimer> mItemJobTimers;       // start times of pending item jobs
+        QHash<KJob*, Transaction> mPendingTransactions;   // pending addEvents() transactions
+        QHash<KJob*, QPair<KJob*, int> > mTransactionItemJobs;  // item creation jobs in transactions, with transaction & event index
+        QMap<KJob*, Akonadi::Collection> mReloadChangedJobs;  // pending reloadChanged() item fetch jobs, with collection
+        int                mReloadChangedCount;   // number of changed items found so far by reloadChanged()
         QMap<Akonadi::Item::Id, Akonadi::Item> mItemModifyJobQueue;  // pending item modification jobs, invalid item = queue empty but job active
         QList<QString>     mCollectionsBeingCreated;  // path names of new collections being created by migrator
         QList<Akonadi::Collection::Id> mCollectionIdsBeingCreated;  // ids of new collections being created by migrator
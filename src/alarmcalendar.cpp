@@ -20,6 +20,8 @@
 
 #include "kalarm.h"
 #include "alarmcalendar.h"
+#include "alarmcalendar_p.h"
+#include "calendarfile.h"
 
 #include "collectionmodel.h"
 #include "filedialog.h"
@@ -27,8 +29,15 @@
 #include "kalarmapp.h"
 #include "mainwindow.h"
 #include "messagebox.h"
+#include "metrics.h"
 #include "preferences.h"
+#include "schedulersnapshot.h"
+#include "trace.h"
 
+#include <kalarmcal/collectionattribute.h>
+
+#include <AkonadiCore/itemfetchjob.h>
+#include <AkonadiCore/itemfetchscope.h>
 #include <KCalCore/MemoryCalendar>
 #include <KCalCore/ICalFormat>
 
@@ -38,8 +47,14 @@
 #include <KJobWidgets>
 #include <kfileitem.h>
 #include <KSharedConfig>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QProgressDialog>
+#include <QRunnable>
+#include <QSet>
 #include <QTemporaryFile>
 #include <QStandardPaths>
+#include <QTimer>
 #include <QTimeZone>
 #include "kalarm_debug.h"
 
@@ -47,10 +62,13 @@ using namespace Akonadi;
 using namespace KCalCore;
 using namespace KAlarmCal;
 
-static KACalendar::Compat fix(const KCalCore::FileStorage::Ptr&);
+static bool calendarsPopulated();
 
 static const QString displayCalendarName = QStringLiteral("displaying.ics");
 static const Collection::Id DISPLAY_COL_ID = -1;   // collection ID used for displaying calendar
+static const int SAVE_DELAY = 1000;   // milliseconds to wait before a delayed save, to batch up changes
+static const int IMPORT_BATCH_SIZE = 200;   // number of imported alarms to add to Akonadi in each transaction
+static const int SNAPSHOT_INTERVAL = 10 * 60 * 1000;   // milliseconds between scheduler snapshot writes
 
 AlarmCalendar* AlarmCalendar::mResourcesCalendar = nullptr;
 AlarmCalendar* AlarmCalendar::mDisplayCalendar = nullptr;
@@ -86,6 +104,8 @@ bool AlarmCalendar::initialiseCalendars()
 */
 void AlarmCalendar::terminateCalendars()
 {
+    if (mResourcesCalendar)
+        mResourcesCalendar->saveSnapshot();
     delete mResourcesCalendar;
     mResourcesCalendar = nullptr;
     delete mDisplayCalendar;
@@ -121,6 +141,11 @@ AlarmCalendar::AlarmCalendar()
     :
       mCalType(RESOURCES),
       mEventType(CalEvent::EMPTY),
+      mSaveTimer(nullptr),
+      mDelayedSave(false),
+      mSnapshot(new SchedulerSnapshot),
+      mSnapshotTimer(new QTimer(this)),
+      mSnapshotDirty(false),
       mOpen(false),
       mUpdateCount(0),
       mUpdateSave(false),
@@ -131,7 +156,18 @@ AlarmCalendar::AlarmCalendar()
     connect(model, &AkonadiModel::eventsToBeRemoved, this, &AlarmCalendar::slotEventsToBeRemoved);
     connect(model, &AkonadiModel::eventChanged, this, &AlarmCalendar::slotEventChanged);
     connect(model, &AkonadiModel::collectionStatusChanged, this, &AlarmCalendar::slotCollectionStatusChanged);
+    connect(model, &AkonadiModel::eventsAddDone, this, &AlarmCalendar::slotEventsAddDone);
     Preferences::connect(SIGNAL(askResourceChanged(bool)), this, SLOT(setAskResource(bool)));
+
+    // Read the alarms which were pending when KAlarm last exited, so that they
+    // can be scheduled before Akonadi has finished loading the calendars.
+    if (!mSnapshot->load()  ||  mSnapshot->isEmpty())
+    {
+        delete mSnapshot;
+        mSnapshot = nullptr;
+    }
+    connect(mSnapshotTimer, &QTimer::timeout, this, &AlarmCalendar::slotSnapshotTimer);
+    mSnapshotTimer->start(SNAPSHOT_INTERVAL);
 }
 
 /******************************************************************************
@@ -140,6 +176,11 @@ AlarmCalendar::AlarmCalendar()
 AlarmCalendar::AlarmCalendar(const QString& path, CalEvent::Type type)
     :
       mEventType(type),
+      mSaveTimer(nullptr),
+      mDelayedSave(false),
+      mSnapshot(nullptr),
+      mSnapshotTimer(nullptr),
+      mSnapshotDirty(false),
       mOpen(false),
       mUpdateCount(0),
       mUpdateSave(false),
@@ -166,6 +207,7 @@ AlarmCalendar::AlarmCalendar(const QString& path, CalEvent::Type type)
 AlarmCalendar::~AlarmCalendar()
 {
     close();
+    delete mSnapshot;
 }
 
 /******************************************************************************
@@ -237,6 +279,7 @@ bool AlarmCalendar::open()
 */
 int AlarmCalendar::load()
 {
+    KALARM_TRACE_SCOPE("calendar", "load");
     if (mCalType == RESOURCES)
     {
     }
@@ -267,7 +310,7 @@ int AlarmCalendar::load()
         }
         mCalendarStorage->calendar()->setTimeZone(Preferences::qTimeZone(true));
         mCalendarStorage->setFileName(filename);
-        if (!mCalendarStorage->load())
+        if (!CalendarFile::load(mCalendarStorage))
         {
             // Check if the file is zero length
             if (mUrl.isLocalFile()) {
@@ -294,7 +337,6 @@ int AlarmCalendar::load()
                 QFile::remove(mLocalFile);
             }
         mLocalFile = filename;
-        fix(mCalendarStorage);   // convert events to current KAlarm format for when calendar is saved
         updateDisplayKAEvents();
     }
     mOpen = true;
@@ -323,6 +365,7 @@ bool AlarmCalendar::reload()
 */
 bool AlarmCalendar::saveCal(const QString& newFile)
 {
+    KALARM_TRACE_SCOPE("calendar", "saveCal");
     if (mCalType == RESOURCES)
         return true;
     if (!mCalendarStorage)
@@ -332,6 +375,8 @@ bool AlarmCalendar::saveCal(const QString& newFile)
             return false;
 
         qCDebug(KALARM_LOG) << "\"" << newFile << "\"," << mEventType;
+        QElapsedTimer timer;
+        timer.start();
         QString saveFilename = newFile.isNull() ? mLocalFile : newFile;
         if (mCalType == LOCAL_VCAL  &&  newFile.isNull()  &&  mUrl.isLocalFile())
             saveFilename = mICalUrl.toLocalFile();
@@ -366,6 +411,8 @@ bool AlarmCalendar::saveCal(const QString& newFile)
             mUrl  = mICalUrl;
             mCalType = LOCAL_ICAL;
         }
+        Metrics::observe("kalarm_calendar_save_seconds", timer.elapsed() / 1000.0,
+                         Metrics::label("backend", QStringLiteral("file")) + QLatin1Char(',') + Metrics::label("operation", QStringLiteral("save")));
         Q_EMIT calendarSaved(this);
     }
 
@@ -378,6 +425,14 @@ bool AlarmCalendar::saveCal(const QString& newFile)
 */
 void AlarmCalendar::close()
 {
+    if (mSaveTimer)
+        mSaveTimer->stop();
+    if (mDelayedSave)
+    {
+        // Write any changes which are waiting for a delayed save
+        mDelayedSave = false;
+        endUpdate();
+    }
     if (mCalType != RESOURCES)
     {
         if (!mLocalFile.isEmpty())
@@ -432,25 +487,13 @@ void AlarmCalendar::updateDisplayKAEvents()
     if (!cal)
         return;
 
-    Event::List kcalevents = cal->rawEvents();
-    for (i = 0, end = kcalevents.count();  i < end;  ++i)
+    events = CalendarFile::readEvents(cal->rawEvents());
+    for (i = 0, end = events.count();  i < end;  ++i)
     {
-        Event::Ptr kcalevent = kcalevents[i];
-        if (kcalevent->alarms().isEmpty())
-            continue;    // ignore events without alarms
-
-        KAEvent* event = new KAEvent(kcalevent);
-        if (!event->isValid())
-        {
-            qCWarning(KALARM_LOG) << "Ignoring unusable event" << kcalevent->uid();
-            delete event;
-            continue;    // ignore events without usable alarms
-        }
+        KAEvent* event = events[i];
         event->setCollectionId(key);
-        events += event;
-        mEventMap[EventId(key, kcalevent->uid())] = event;
+        mEventMap[EventId(key, event->id())] = event;
     }
-
 }
 
 /******************************************************************************
@@ -481,6 +524,8 @@ void AlarmCalendar::removeKAEvents(Collection::Id key, bool closing, CalEvent::T
             if (remove)
             {
                 mEventMap.remove(EventId(key, event->id()));
+                unindexTemplate(event);
+                mArchiveIndex.remove(EventId(key, event->id()));
                 delete event;
                 removed = true;
             }
@@ -490,8 +535,14 @@ void AlarmCalendar::removeKAEvents(Collection::Id key, bool closing, CalEvent::T
         if (empty)
             mResourceMap.erase(rit);
     }
+    if (types & CalEvent::ARCHIVED)
+    {
+        // Remove archived events which are held only as records
+        mArchiveIndex.removeCollection(key);
+    }
     if (removed)
     {
+        mSnapshotDirty = true;
         mEarliestAlarm.remove(key);
         // Emit signal only if we're not in the process of closing the calendar
         if (!closing  &&  mOpen)
@@ -541,6 +592,29 @@ void AlarmCalendar::slotEventChanged(const AkonadiModel::Event& event)
         return;
     }
 
+    QHash<EventId, KDateTime>::Iterator pit = mPrefetchedEvents.find(event.eventId());
+    if (pit != mPrefetchedEvents.end())
+    {
+        // The event was fetched individually before its calendar was loaded.
+        // Ignore any copy which is not later than the one fetched, since it
+        // may have been read before the alarm was rescheduled.
+        if (event.event.nextTrigger(KAEvent::ALL_TRIGGER).effectiveKDateTime() <= pit.value())
+            return;
+        mPrefetchedEvents.erase(pit);
+    }
+
+    if (!mEventMap.contains(event.eventId()))
+    {
+        if (event.event.category() == CalEvent::ARCHIVED)
+        {
+            // Hold archived events only as compact records, and fetch the
+            // full event from AkonadiModel if and when it is needed.
+            mArchiveIndex.insert(event.eventId(), event.event.itemId(), event.event.createdDateTime().date(), nullptr);
+            return;
+        }
+        mArchiveIndex.remove(event.eventId());
+    }
+
     bool added = true;
     bool updated = false;
     KAEventMap::Iterator it = mEventMap.find(event.eventId());
@@ -556,7 +630,11 @@ void AlarmCalendar::slotEventChanged(const AkonadiModel::Event& event)
             updated = true;
         }
         else
+        {
+            unindexTemplate(storedEvent);
+            mArchiveIndex.remove(event.eventId());
             delete storedEvent;
+        }
         added = false;
     }
     if (!updated)
@@ -581,6 +659,108 @@ void AlarmCalendar::slotEventsToBeRemoved(const AkonadiModel::EventList& events)
             qCCritical(KALARM_LOG) << "Inconsistent AkonadiModel::Event: event:" << events[i].event.collectionId() << ", collection" << events[i].collection.id();
         else if (mEventMap.contains(events[i].eventId()))
             deleteEventInternal(events[i].event, events[i].collection, false);
+        else
+            mArchiveIndex.remove(events[i].eventId());
+    }
+}
+
+/******************************************************************************
+* Check the alarms recorded in the snapshot written when KAlarm last exited,
+* until the calendars have been fully loaded. Any of these alarms which are due
+* but have not yet been loaded are fetched individually from Akonadi.
+* Reply = earliest future trigger time of a snapshot alarm not yet loaded,
+*       = invalid if none, or once the calendars have been loaded.
+*/
+KDateTime AlarmCalendar::checkSnapshot()
+{
+    if (!mSnapshot)
+        return KDateTime();
+    if (calendarsPopulated())
+    {
+        // All alarms have now been loaded, so the snapshot is no longer needed
+        qCDebug(KALARM_LOG) << "Calendars loaded: discarding scheduler snapshot";
+        delete mSnapshot;
+        mSnapshot = nullptr;
+        mPrefetchedEvents.clear();
+        saveSnapshot();
+        return KDateTime();
+    }
+    QVector<qint64> due;
+    const qint64 next = mSnapshot->checkDue(KDateTime::currentUtcDateTime().toTime_t(), mEventMap, due);
+    for (int i = 0, end = due.count();  i < end;  ++i)
+        prefetchEvent(due[i]);
+    if (next < 0)
+        return KDateTime();
+    KDateTime dt;
+    dt.setTime_t(next);
+    return dt;
+}
+
+/******************************************************************************
+* Write a snapshot of the pending alarms, if they have changed since the last
+* snapshot. Nothing is written until all calendars have been loaded.
+*/
+void AlarmCalendar::saveSnapshot()
+{
+    if (mCalType != RESOURCES  ||  !mSnapshotDirty  ||  mSnapshot  ||  !calendarsPopulated())
+        return;
+    if (SchedulerSnapshot::save(events(CalEvent::ACTIVE)))
+        mSnapshotDirty = false;
+}
+
+/******************************************************************************
+* Called periodically to write a snapshot of the pending alarms.
+*/
+void AlarmCalendar::slotSnapshotTimer()
+{
+    if (mSnapshot)
+        checkSnapshot();   // discard the start-up snapshot if calendars are now loaded
+    saveSnapshot();
+}
+
+/******************************************************************************
+* Fetch an event from Akonadi before its calendar has been loaded.
+*/
+void AlarmCalendar::prefetchEvent(Item::Id itemId)
+{
+    qCDebug(KALARM_LOG) << itemId;
+    ItemFetchJob* job = new ItemFetchJob(Item(itemId), this);
+    job->fetchScope().fetchFullPayload();
+    job->fetchScope().setAncestorRetrieval(ItemFetchScope::Parent);
+    connect(job, &ItemFetchJob::result, this, &AlarmCalendar::slotPrefetchDone);
+}
+
+/******************************************************************************
+* Called when an event has been fetched from Akonadi before its calendar has
+* been loaded. Add it to the calendar so that it can be triggered.
+*/
+void AlarmCalendar::slotPrefetchDone(KJob* j)
+{
+    if (j->error())
+    {
+        qCWarning(KALARM_LOG) << "Error fetching alarm:" << j->errorString();
+        return;
+    }
+    const Item::List items = static_cast<ItemFetchJob*>(j)->items();
+    for (int i = 0, count = items.count();  i < count;  ++i)
+    {
+        const Item& item = items[i];
+        if (!item.hasPayload<KAEvent>())
+            continue;
+        const Collection collection = AkonadiModel::instance()->collectionById(item.parentCollection().id());
+        if (!collection.isValid())
+            continue;
+        KAEvent event = item.payload<KAEvent>();
+        if (!event.isValid())
+            continue;
+        event.setItemId(item.id());
+        event.setCollectionId(collection.id());
+        const AkonadiModel::Event akEvent(event, collection);
+        if (mEventMap.contains(akEvent.eventId()))
+            continue;   // its calendar has been loaded in the meantime
+        qCDebug(KALARM_LOG) << "Fetched" << event.id();
+        slotEventChanged(akEvent);
+        mPrefetchedEvents[akEvent.eventId()] = event.nextTrigger(KAEvent::ALL_TRIGGER).effectiveKDateTime();
     }
 }
 
@@ -639,80 +819,237 @@ bool AlarmCalendar::importAlarms(QWidget* parent, Collection* collection)
         qCDebug(KALARM_LOG) << "--- Downloaded to" << filename;
     }
 
-    // Read the calendar and add its alarms to the current calendars
-    MemoryCalendar::Ptr cal(new MemoryCalendar(Preferences::qTimeZone(true)));
-    FileStorage::Ptr calStorage(new FileStorage(cal, filename));
-    success = calStorage->load();
-    if (!success)
+    // Read the calendar and add its alarms to the current calendars.
+    // This is done in worker threads, showing progress while it runs.
+    AlarmImport import(filename, collection);
+    QProgressDialog progress(parent);
+    progress.setLabelText(i18nc("@info", "Importing alarms..."));
+    progress.setRange(0, 0);
+    progress.setAutoReset(false);
+    progress.setAutoClose(false);
+    progress.setWindowModality(Qt::WindowModal);
+    progress.setMinimumDuration(500);
+    connect(&progress, &QProgressDialog::canceled, &import, &AlarmImport::cancel);
+    connect(&import, &AlarmImport::eventCount, &progress, &QProgressDialog::setMaximum);
+    connect(&import, &AlarmImport::progress, &progress, &QProgressDialog::setValue);
+    progress.setValue(0);
+    success = import.exec();
+    progress.close();
+    if (!import.loaded())
     {
         qCDebug(KALARM_LOG) << "Error loading calendar '" << filename <<"'";
         KAMessageBox::error(parent, xi18nc("@info", "Could not load calendar <filename>%1</filename>.", url.toDisplayString()));
     }
-    else
+    if (!local)
+        QFile::remove(filename);
+    return success;
+}
+
+namespace
+{
+
+/*=============================================================================
+= Worker thread tasks for AlarmImport.
+=============================================================================*/
+class ImportLoadTask : public QRunnable
+{
+    public:
+        explicit ImportLoadTask(AlarmImport* import) : mImport(import) {}
+        void run() override   { mImport->load(); }
+    private:
+        AlarmImport* mImport;
+};
+
+class ImportConvertTask : public QRunnable
+{
+    public:
+        ImportConvertTask(AlarmImport* import, int start, int end)
+            : mImport(import), mStart(start), mEnd(end) {}
+        void run() override   { mImport->convert(mStart, mEnd); }
+    private:
+        AlarmImport* mImport;
+        int          mStart;
+        int          mEnd;
+};
+
+}
+
+/*=============================================================================
+= Class AlarmImport
+= Imports the alarms from a calendar file into KAlarm's calendars.
+=============================================================================*/
+
+AlarmImport::AlarmImport(const QString& filename, Collection* collection, QObject* parent)
+    : QObject(parent),
+      mFilename(filename),
+      mTimeZone(Preferences::qTimeZone(true)),
+      mCollection(collection && collection->isValid() ? collection : nullptr),
+      mWantedTypes(mCollection ? CalEvent::types(mCollection->contentMimeTypes())
+                               : CalEvent::ACTIVE | CalEvent::ARCHIVED | CalEvent::TEMPLATE),
+      mCompat(KACalendar::Current),
+      mLoaded(false),
+      mSuccess(true)
+{
+    // The worker threads emit these signals, so ensure that they are
+    // processed in the main thread.
+    connect(this, &AlarmImport::batchReady, this, &AlarmImport::submitBatches, Qt::QueuedConnection);
+    connect(AkonadiModel::instance(), &AkonadiModel::eventsAddDone, this, &AlarmImport::slotEventsAdded);
+}
+
+AlarmImport::~AlarmImport()
+{
+    cancel();
+    mPool.waitForDone();
+    for (int i = 0, end = mBatches.count();  i < end;  ++i)
     {
-        KACalendar::Compat caltype = fix(calStorage);
-        CalEvent::Types wantedTypes = collection && collection->isValid() ? CalEvent::types(collection->contentMimeTypes()) : CalEvent::EMPTY;
-        Collection activeColl, archiveColl, templateColl;
-        Event::List events = cal->rawEvents();
-        for (int i = 0, end = events.count();  i < end;  ++i)
+        for (Batch::ConstIterator it = mBatches[i].constBegin();  it != mBatches[i].constEnd();  ++it)
+            qDeleteAll(it.value());
+    }
+}
+
+/******************************************************************************
+* Perform the import, and wait until it completes or is cancelled.
+* Reply = true if all alarms in the calendar were successfully imported
+*       = false if any alarms failed to be imported.
+*/
+bool AlarmImport::exec()
+{
+    QEventLoop loop;
+    connect(this, &AlarmImport::finished, &loop, &QEventLoop::quit, Qt::QueuedConnection);
+    mTasks.store(1);
+    mPool.start(new ImportLoadTask(this));
+    loop.exec();
+    mPool.waitForDone();
+    submitBatches();   // add any alarms which have not yet been processed
+    mEvents.clear();
+    if (mCalendar)
+        mCalendar->close();
+    if (!mTransactions.isEmpty())
+    {
+        // Wait until Akonadi has committed or rolled back every batch.
+        QEventLoop addLoop;
+        connect(this, &AlarmImport::transactionsDone, &addLoop, &QEventLoop::quit);
+        addLoop.exec();
+    }
+    return mLoaded  &&  mSuccess  &&  !isCancelled();
+}
+
+/******************************************************************************
+* Called when an Akonadi transaction has completed. If it was one of the
+* batches submitted by this import, note whether it succeeded.
+*/
+void AlarmImport::slotEventsAdded(KJob* transaction, const QVector<Item::Id>& itemIds, bool status)
+{
+    if (!mTransactions.remove(transaction))
+        return;
+    if (!status  ||  itemIds.contains(-1))
+        mSuccess = false;
+    if (mTransactions.isEmpty())
+        Q_EMIT transactionsDone();
+}
+
+/******************************************************************************
+* Read the calendar file, and start worker tasks to convert its events.
+* Called in a worker thread.
+*/
+void AlarmImport::load()
+{
+    mCalendar = MemoryCalendar::Ptr(new MemoryCalendar(mTimeZone));
+    FileStorage::Ptr calStorage(new FileStorage(mCalendar, mFilename));
+    mLoaded = CalendarFile::load(calStorage, &mCompat);
+    if (mLoaded)
+    {
+        mEvents = mCalendar->rawEvents();
+        Q_EMIT eventCount(mEvents.count());
+
+        // Convert the events in parallel, in batches
+        for (int i = 0, count = mEvents.count();  i < count  &&  !isCancelled();  i += IMPORT_BATCH_SIZE)
         {
-            Event::Ptr event = events[i];
-            if (event->alarms().isEmpty()  ||  !KAEvent(event).isValid())
-                continue;    // ignore events without alarms, or usable alarms
-            CalEvent::Type type = CalEvent::status(event);
-            if (type == CalEvent::TEMPLATE)
-            {
-                // If we know the event was not created by KAlarm, don't treat it as a template
-                if (caltype == KACalendar::Incompatible)
-                    type = CalEvent::ACTIVE;
-            }
-            Collection* coll;
-            if (collection  &&  collection->isValid())
-            {
-                if (!(type & wantedTypes))
-                    continue;
-                coll = collection;
-            }
-            else
-            {
-                switch (type)
-                {
-                    case CalEvent::ACTIVE:    coll = &activeColl;  break;
-                    case CalEvent::ARCHIVED:  coll = &archiveColl;  break;
-                    case CalEvent::TEMPLATE:  coll = &templateColl;  break;
-                    default:  continue;
-                }
-                if (!coll->isValid())
-                    *coll = CollectionControlModel::destination(type);
-            }
+            mTasks.ref();
+            mPool.start(new ImportConvertTask(this, i, qMin(i + IMPORT_BATCH_SIZE, count)));
+        }
+    }
+    taskDone();
+}
 
-            Event::Ptr newev(new Event(*event));
+/******************************************************************************
+* Convert a range of the events read from the calendar file into KAEvents, and
+* queue them to be added to Akonadi by the main thread.
+* The calendar's events are not modified, so that they can safely be read by
+* more than one thread.
+* Called in a worker thread.
+*/
+void AlarmImport::convert(int start, int end)
+{
+    Batch batch;
+    if (!isCancelled())
+        batch = CalendarFile::importEvents(mEvents, start, end, mCompat, mWantedTypes);
+    mProcessed.fetchAndAddOrdered(end - start);
+    {
+        QMutexLocker locker(&mMutex);
+        mBatches += batch;
+    }
+    Q_EMIT batchReady();
+    taskDone();
+}
+
+/******************************************************************************
+* Called when a worker task has completed.
+*/
+void AlarmImport::taskDone()
+{
+    if (!mTasks.deref())
+        Q_EMIT finished();
+}
 
-            // If there is a display alarm without display text, use the event
-            // summary text instead.
-            if (type == CalEvent::ACTIVE  &&  !newev->summary().isEmpty())
+/******************************************************************************
+* Add the alarms which have been converted by the worker threads to Akonadi.
+* Each batch of alarms for a collection is added in a single transaction.
+*/
+void AlarmImport::submitBatches()
+{
+    QList<Batch> batches;
+    {
+        QMutexLocker locker(&mMutex);
+        batches.swap(mBatches);
+    }
+    for (int i = 0, end = batches.count();  i < end;  ++i)
+    {
+        for (Batch::ConstIterator it = batches[i].constBegin();  it != batches[i].constEnd();  ++it)
+        {
+            if (!isCancelled())
             {
-                const Alarm::List& alarms = newev->alarms();
-                for (int ai = 0, aend = alarms.count();  ai < aend;  ++ai)
-                {
-                    Alarm::Ptr alarm = alarms[ai];
-                    if (alarm->type() == Alarm::Display  &&  alarm->text().isEmpty())
-                        alarm->setText(newev->summary());
-                }
-                newev->setSummary(QString());   // KAlarm only uses summary for template names
+                Collection* coll = destination(it.key());
+                KJob* job = (coll  &&  coll->isValid()) ? AkonadiModel::instance()->addEvents(it.value(), *coll) : nullptr;
+                if (job)
+                    mTransactions.insert(job);
+                else
+                    mSuccess = false;
             }
-
-            // Give the event a new ID and add it to the calendars
-            newev->setUid(CalEvent::uid(CalFormat::createUniqueId(), type));
-            KAEvent* newEvent = new KAEvent(newev);
-            if (!AkonadiModel::instance()->addEvent(*newEvent, *coll))
-                success = false;
+            qDeleteAll(it.value());
         }
+    }
+    Q_EMIT progress(processed());
+}
 
+/******************************************************************************
+* Return the collection to add imported alarms of a given type to.
+*/
+Collection* AlarmImport::destination(CalEvent::Type type)
+{
+    if (mCollection)
+        return mCollection;
+    Collection* coll;
+    switch (type)
+    {
+        case CalEvent::ACTIVE:    coll = &mActiveColl;  break;
+        case CalEvent::ARCHIVED:  coll = &mArchiveColl;  break;
+        case CalEvent::TEMPLATE:  coll = &mTemplateColl;  break;
+        default:  return nullptr;
     }
-    if (!local)
-        QFile::remove(filename);
-    return success;
+    if (!coll->isValid())
+        *coll = CollectionControlModel::destination(type);
+    return coll;
 }
 
 /******************************************************************************
@@ -739,80 +1076,23 @@ bool AlarmCalendar::exportAlarms(const KAEvent::List& events, QWidget* parent)
     }
     qCDebug(KALARM_LOG) << url.toDisplayString();
 
-    MemoryCalendar::Ptr calendar(new MemoryCalendar(Preferences::qTimeZone(true)));
-    FileStorage::Ptr calStorage(new FileStorage(calendar, file));
-    if (append  &&  !calStorage->load())
+    switch (CalendarFile::exportToFile(file, append, events, Preferences::qTimeZone(true)))
     {
-        KIO::UDSEntry uds;
-        auto statJob = KIO::stat(url, KIO::StatJob::SourceSide, 2);
-        KJobWidgets::setWindow(statJob, parent);
-        statJob->exec();
-        KFileItem fi(statJob->statResult(), url);
-        if (fi.size())
-        {
-            qCCritical(KALARM_LOG) << "Error loading calendar file" << file << "for append";
+        case CalendarFile::EXPORT_OK:
+        case CalendarFile::EXPORT_NONE:
+            return true;
+        case CalendarFile::EXPORT_BAD_APPEND:
             KAMessageBox::error(MainWindow::mainMainWindow(),
                                 xi18nc("@info", "Error loading calendar to append to:<nl/><filename>%1</filename>", url.toDisplayString()));
             return false;
-        }
-    }
-    KACalendar::setKAlarmVersion(calendar);
-
-    // Add the alarms to the calendar
-    bool success = true;
-    bool exported = false;
-    for (int i = 0, end = events.count();  i < end;  ++i)
-    {
-        const KAEvent* event = events[i];
-        Event::Ptr kcalEvent(new Event);
-        CalEvent::Type type = event->category();
-        QString id = CalEvent::uid(kcalEvent->uid(), type);
-        kcalEvent->setUid(id);
-        event->updateKCalEvent(kcalEvent, KAEvent::UID_IGNORE);
-        if (calendar->addEvent(kcalEvent))
-            exported = true;
-        else
-            success = false;
-    }
-
-    if (exported)
-    {
-        // One or more alarms have been exported to the calendar.
-        // Save the calendar to file.
-        QTemporaryFile* tempFile = nullptr;
-        bool local = url.isLocalFile();
-        if (!local)
-        {
-            tempFile = new QTemporaryFile;
-            file = tempFile->fileName();
-        }
-        calStorage->setFileName(file);
-        calStorage->setSaveFormat(new ICalFormat);
-        if (!calStorage->save())
-        {
-            qCCritical(KALARM_LOG) << file << ": failed";
+        case CalendarFile::EXPORT_WRITE_ERROR:
             KAMessageBox::error(MainWindow::mainMainWindow(),
                                 xi18nc("@info", "Failed to save new calendar to:<nl/><filename>%1</filename>", url.toDisplayString()));
-            success = false;
-        }
-        else if (!local)
-        {
-            QFile qFile(file);
-            qFile.open(QIODevice::ReadOnly);
-            auto uploadJob = KIO::storedPut(&qFile, url, -1);
-            KJobWidgets::setWindow(uploadJob, parent);
-            if (!uploadJob->exec())
-            {
-                qCCritical(KALARM_LOG) << file << ": upload failed";
-                KAMessageBox::error(MainWindow::mainMainWindow(),
-                                    xi18nc("@info", "Cannot upload new calendar to:<nl/><filename>%1</filename>", url.toDisplayString()));
-                success = false;
-            }
-        }
-        delete tempFile;
+            return false;
+        case CalendarFile::EXPORT_FAILED_ALARMS:
+        default:
+            return false;
     }
-    calendar->close();
-    return success;
 }
 
 /******************************************************************************
@@ -855,6 +1135,57 @@ bool AlarmCalendar::save()
         return saveCal();
 }
 
+/******************************************************************************
+* Save the calendar, batching up a burst of changes (e.g. when many alarms are
+* displayed at once) into fewer writes to the file.
+* The first change in a burst is saved at once, so that the displaying calendar
+* is up to date before the caller goes on to update the alarm in its resource
+* calendar. Changes made within SAVE_DELAY of the last save are saved together
+* when the delay expires; the delayed save is implemented as a group of
+* calendar update calls, so any other save() calls made in the meantime are
+* also included in it.
+* Note that this method has no effect for Akonadi calendars.
+*/
+void AlarmCalendar::saveDelayed()
+{
+    if (mCalType == RESOURCES)
+        return;
+    if (!mSaveTimer)
+    {
+        mSaveTimer = new QTimer(this);
+        mSaveTimer->setSingleShot(true);
+        connect(mSaveTimer, &QTimer::timeout, this, &AlarmCalendar::slotSaveTimer);
+    }
+    if (!mSaveTimer->isActive())
+    {
+        // This is the first change in a burst
+        mSaveTimer->start(SAVE_DELAY);
+        save();
+        return;
+    }
+    if (!mDelayedSave)
+    {
+        mDelayedSave = true;
+        startUpdate();
+    }
+    mUpdateSave = true;
+}
+
+/******************************************************************************
+* Called when the delay for a delayed save has expired.
+* Save any changes made during the delay, and continue batching changes for a
+* further delay period.
+*/
+void AlarmCalendar::slotSaveTimer()
+{
+    if (mDelayedSave)
+    {
+        mDelayedSave = false;
+        endUpdate();
+        mSaveTimer->start(SAVE_DELAY);
+    }
+}
+
 /******************************************************************************
 * This method must only be called from the main KAlarm queue processing loop,
 * to prevent asynchronous calendar operations interfering with one another.
@@ -863,9 +1194,56 @@ bool AlarmCalendar::save()
 */
 void AlarmCalendar::purgeEvents(const KAEvent::List& events)
 {
-    for (int i = 0, end = events.count();  i < end;  ++i)
+    KALARM_TRACE_SCOPE("calendar", "purgeEvents");
+    if (mCalType != RESOURCES)
     {
-        deleteEventInternal(*events[i]);
+        for (int i = 0, end = events.count();  i < end;  ++i)
+            deleteEventInternal(*events[i]);
+    }
+    else
+    {
+        // Remove the events from the lookup tables, and then compact each
+        // affected collection's event list in a single pass, rather than
+        // removing the events from it one by one.
+        QSet<KAEvent*> purged;
+        QSet<Collection::Id> keys;
+        QVector<Item::Id> itemIds;
+        for (int i = 0, end = events.count();  i < end;  ++i)
+        {
+            KAEvent* ev = events[i];
+            KAEventMap::Iterator it = mEventMap.find(EventId(*ev));
+            if (it == mEventMap.end()  ||  it.value() != ev)
+            {
+                // It's not an instance held by the calendar
+                deleteEventInternal(*ev);
+                continue;
+            }
+            mEventMap.erase(it);
+            unindexTemplate(ev);
+            mArchiveIndex.remove(EventId(*ev));
+            purged += ev;
+            keys += ev->collectionId();
+            itemIds += ev->itemId();
+        }
+        if (!purged.isEmpty())
+        {
+            mSnapshotDirty = true;
+            foreach (Collection::Id key, keys)
+            {
+                KAEvent::List& list = mResourceMap[key];
+                int j = 0;
+                for (int i = 0, end = list.count();  i < end;  ++i)
+                {
+                    if (!purged.contains(list[i]))
+                        list[j++] = list[i];
+                }
+                list.resize(j);
+                if (purged.contains(mEarliestAlarm.value(key, (KAEvent*)nullptr)))
+                    findEarliestAlarm(AkonadiModel::instance()->collectionById(key));
+            }
+            AkonadiModel::instance()->deleteItems(itemIds);
+            qDeleteAll(purged);
+        }
     }
     if (mHaveDisabledAlarms)
         checkForDisabledAlarms();
@@ -986,6 +1364,93 @@ bool AlarmCalendar::addEvent(KAEvent& evnt, QWidget* promptParent, bool useEvent
 }
 
 
+/******************************************************************************
+* Add new active events to a resource calendar collection. All the events are
+* created in a single Akonadi transaction, which is much faster than adding
+* them individually when there are many.
+* This method only starts the transaction. When Akonadi has committed or rolled
+* it back, eventsAdded() is emitted with the outcome for each event: each event
+* which was added has a new unique ID and its Akonadi item ID, while any which
+* could not be added, including any which is not an active alarm, is unchanged,
+* with an invalid item ID. As for addEvent(), the events are added to the
+* calendar once they have been inserted into AkonadiModel.
+* Reply = the transaction job, to identify it in eventsAdded()
+*       = null if no event could be added, in which case eventsAdded() is not
+*         emitted.
+*/
+KJob* AlarmCalendar::addEvents(const QVector<KAEvent>& events, Collection& collection)
+{
+    if (!mOpen  ||  mCalType != RESOURCES)
+        return nullptr;
+    if (!CollectionControlModel::isEnabled(collection, CalEvent::ACTIVE))
+        return nullptr;
+    qCDebug(KALARM_LOG) << events.count();
+
+    // Check every event before changing any of them.
+    PendingAdd data;
+    data.original = events;
+    data.events   = events;
+    data.indexes.reserve(events.count());
+    for (int i = 0, end = events.count();  i < end;  ++i)
+    {
+        data.events[i].setItemId(-1);
+        if (events[i].category() == CalEvent::ACTIVE)
+            data.indexes += i;
+        else
+            qCWarning(KALARM_LOG) << "Not an active alarm:" << events[i].id();
+    }
+    if (data.indexes.isEmpty())
+        return nullptr;
+
+    KAEvent::List list;
+    list.reserve(data.indexes.count());
+    for (int i = 0, end = data.indexes.count();  i < end;  ++i)
+    {
+        KAEvent& event = data.events[data.indexes[i]];
+        event.setEventId(CalFormat::createUniqueId());
+        list += &event;
+    }
+    KJob* job = AkonadiModel::instance()->addEvents(list, collection);
+    if (job)
+        mPendingAdds.insert(job, data);
+    return job;
+}
+
+/******************************************************************************
+* Called when an Akonadi transaction has been committed or rolled back.
+* If it was started by addEvents(), report the outcome for each event, and
+* restore any which were not added.
+*/
+void AlarmCalendar::slotEventsAddDone(KJob* transaction, const QVector<Item::Id>& itemIds, bool status)
+{
+    QHash<KJob*, PendingAdd>::Iterator it = mPendingAdds.find(transaction);
+    if (it == mPendingAdds.end())
+        return;
+    PendingAdd data = it.value();
+    mPendingAdds.erase(it);
+    int added = 0;
+    bool haveDisabled = false;
+    for (int i = 0, end = data.indexes.count();  i < end;  ++i)
+    {
+        const int index = data.indexes[i];
+        const Item::Id itemId = (status  &&  i < itemIds.count()) ? itemIds[i] : -1;
+        if (itemId < 0)
+        {
+            data.events[index] = data.original[index];
+            data.events[index].setItemId(-1);
+            continue;
+        }
+        data.events[index].setItemId(itemId);
+        if (!data.events[index].enabled())
+            haveDisabled = true;
+        ++added;
+    }
+    qCDebug(KALARM_LOG) << "Added" << added << "of" << data.events.count();
+    if (haveDisabled)
+        checkForDisabledAlarms(true, false);
+    Q_EMIT eventsAdded(transaction, data.events);
+}
+
 /******************************************************************************
 * Internal method to add an already checked event to the calendar.
 * mEventMap takes ownership of the KAEvent.
@@ -996,11 +1461,16 @@ void AlarmCalendar::addNewEvent(const Collection& collection, KAEvent* event, bo
 {
     Collection::Id key = collection.isValid() ? collection.id() : -1;
     event->setCollectionId(key);
+    mSnapshotDirty = true;
     if (!replace)
     {
         mResourceMap[key] += event;
         mEventMap[EventId(key, event->id())] = event;
     }
+    if (event->category() == CalEvent::TEMPLATE  ||  replace)
+        indexTemplate(event);
+    if (event->category() == CalEvent::ARCHIVED  ||  replace)
+        indexArchived(event);
     if (collection.isValid()  &&  (AkonadiModel::types(collection) & CalEvent::ACTIVE)
     &&  event->category() == CalEvent::ACTIVE)
     {
@@ -1094,9 +1564,18 @@ KAEvent* AlarmCalendar::updateEvent(const KAEvent* evnt)
     {
         KAEvent newEvnt(*evnt);
         newEvnt.setItemId(evnt->itemId());
-        if (AkonadiModel::instance()->updateEvent(newEvnt))
+        // An event which was fetched individually at start-up may not yet
+        // be in AkonadiModel.
+        AkonadiModel* model = AkonadiModel::instance();
+        const bool ok = isPrefetched(EventId(newEvnt))
+                      ? model->updateUnloadedEvent(newEvnt, model->collectionById(newEvnt.collectionId()))
+                      : model->updateEvent(newEvnt);
+        if (ok)
         {
             *kaevnt = newEvnt;
+            indexTemplate(kaevnt);
+            indexArchived(kaevnt);
+            mSnapshotDirty = true;
             return kaevnt;
         }
     }
@@ -1189,16 +1668,20 @@ CalEvent::Type AlarmCalendar::deleteEventInternal(const QString& eventID, const
     {
         KAEvent* ev = it.value();
         mEventMap.erase(it);
+        mSnapshotDirty = true;
         KAEvent::List& events = mResourceMap[key];
         int i = events.indexOf(ev);
         if (i >= 0)
             events.remove(i);
+        unindexTemplate(ev);
+        mArchiveIndex.remove(EventId(key, id));
         delete ev;
         if (mEarliestAlarm[key] == ev)
             findEarliestAlarm(collection);
     }
     else
     {
+        mArchiveIndex.remove(EventId(key, id));
         for (EarliestMap::Iterator eit = mEarliestAlarm.begin();  eit != mEarliestAlarm.end();  ++eit)
         {
             KAEvent* ev = eit.value();
@@ -1219,7 +1702,10 @@ CalEvent::Type AlarmCalendar::deleteEventInternal(const QString& eventID, const
     {
         // It's an Akonadi event
         CalEvent::Type s = paramEvent.category();
-        if (AkonadiModel::instance()->deleteEvent(paramEvent))
+        const bool ok = mPrefetchedEvents.remove(EventId(paramEvent))
+                      ? AkonadiModel::instance()->deleteUnloadedEvent(paramEvent.itemId())
+                      : AkonadiModel::instance()->deleteEvent(paramEvent);
+        if (ok)
             status = s;
     }
     return status;
@@ -1241,6 +1727,23 @@ KAEvent* AlarmCalendar::event(const EventId& uniqueID, bool checkDuplicates)
         // The collection isn't known, but use the event ID if it is
         // unique among all collections.
         KAEvent::List list = events(eventId);
+        EventId archivedId;
+        const QList<Collection::Id> collections = mArchiveIndex.collections();
+        for (int i = 0, end = collections.count();  i < end;  ++i)
+        {
+            const EventId id(collections[i], eventId);
+            if (mArchiveIndex.contains(id)  &&  !mArchiveIndex.value(id).event)
+            {
+                if (!list.isEmpty()  ||  !archivedId.isEmpty())
+                {
+                    qCWarning(KALARM_LOG) << "Multiple events found with ID" << eventId;
+                    return nullptr;
+                }
+                archivedId = id;
+            }
+        }
+        if (!archivedId.isEmpty())
+            return materialiseArchived(archivedId);
         if (list.count() > 1)
         {
             qCWarning(KALARM_LOG) << "Multiple events found with ID" << eventId;
@@ -1252,7 +1755,7 @@ KAEvent* AlarmCalendar::event(const EventId& uniqueID, bool checkDuplicates)
     }
     KAEventMap::ConstIterator it = mEventMap.constFind(uniqueID);
     if (it == mEventMap.constEnd())
-        return nullptr;
+        return materialiseArchived(uniqueID);
     return it.value();
 }
 
@@ -1272,17 +1775,158 @@ Event::Ptr AlarmCalendar::kcalEvent(const QString& uniqueID)
 * Find the alarm template with the specified name.
 * Reply = 0 if not found.
 */
-KAEvent* AlarmCalendar::templateEvent(const QString& templateName)
+KAEvent* AlarmCalendar::templateEvent(const QString& templateName) const
+{
+    return mTemplateIndex.event(templateName);
+}
+
+/******************************************************************************
+* Add or update an alarm template in the template name index.
+* If the event is no longer a template, it is removed from the index.
+*/
+void AlarmCalendar::indexTemplate(KAEvent* event)
+{
+    if (mTemplateIndex.index(event))
+        Q_EMIT templatesChanged();
+}
+
+/******************************************************************************
+* Remove an alarm template from the template name index.
+*/
+void AlarmCalendar::unindexTemplate(KAEvent* event)
+{
+    if (mTemplateIndex.unindex(event))
+        Q_EMIT templatesChanged();
+}
+
+/******************************************************************************
+* Add or update a materialised archived alarm in the archive records.
+* If the event is no longer archived, it is removed from the records.
+*/
+void AlarmCalendar::indexArchived(KAEvent* event)
 {
-    if (templateName.isEmpty())
+    const EventId id(*event);
+    if (event->category() != CalEvent::ARCHIVED)
+        mArchiveIndex.remove(id);
+    else
+        mArchiveIndex.insert(id, event->itemId(), event->createdDateTime().date(), event);
+}
+
+/******************************************************************************
+* Return the full event for an archived alarm, fetching it from AkonadiModel
+* and adding it to mEventMap if it is currently held only as a record.
+* Once materialised, the event is held like any other event until it is
+* deleted or replaced, so that the returned pointer remains valid for as long
+* as a pointer returned for an active alarm would.
+* Reply = null if the event is not an archived alarm, or can't be fetched.
+*/
+KAEvent* AlarmCalendar::materialiseArchived(const EventId& id)
+{
+    if (!mArchiveIndex.contains(id))
         return nullptr;
-    KAEvent::List eventlist = events(CalEvent::TEMPLATE);
-    for (int i = 0, end = eventlist.count();  i < end;  ++i)
+    const ArchiveIndex::Record record = mArchiveIndex.value(id);
+    if (record.event)
+        return record.event;
+    AkonadiModel* model = AkonadiModel::instance();
+    const KAEvent evnt = model->event(record.itemId);
+    if (!evnt.isValid()  ||  evnt.id() != id.eventId())
     {
-        if (eventlist[i]->templateName() == templateName)
-            return eventlist[i];
+        qCWarning(KALARM_LOG) << "Archived event" << id << "not found";
+        return nullptr;
     }
-    return nullptr;
+    qCDebug(KALARM_LOG) << id;
+    KAEvent* event = new KAEvent(evnt);
+    addNewEvent(model->collectionById(id.collectionId()), event);
+    return event;
+}
+
+/******************************************************************************
+* Return copies of the archived events in a collection which are held only as
+* records, and which are therefore not returned by events(). The copies are
+* fetched from AkonadiModel, and are not retained by the calendar.
+*/
+QVector<KAEvent> AlarmCalendar::archivedRecordEvents(const Collection& collection) const
+{
+    QVector<KAEvent> result;
+    const QVector<EventId> ids = mArchiveIndex.ids(collection.id());
+    if (ids.isEmpty())
+        return result;
+    AkonadiModel* model = AkonadiModel::instance();
+    result.reserve(ids.count());
+    for (int i = 0, end = ids.count();  i < end;  ++i)
+    {
+        const ArchiveIndex::Record record = mArchiveIndex.value(ids[i]);
+        if (record.event)
+            continue;    // it's already in mEventMap
+        const KAEvent event = model->event(record.itemId);
+        if (event.isValid())
+            result += event;
+    }
+    return result;
+}
+
+/******************************************************************************
+* Delete archived events in a collection which were created before a specified
+* date, oldest first. If 'cutoff' is invalid, all archived events in the
+* collection are deleted.
+* At most 'maxCount' events are deleted.
+* Reply = number of events deleted.
+*/
+int AlarmCalendar::purgeArchived(Collection::Id id, const QDate& cutoff, int maxCount)
+{
+    KALARM_TRACE_SCOPE("calendar", "purgeArchived");
+    const QVector<EventId> ids = mArchiveIndex.expired(id, cutoff, maxCount);
+    if (ids.isEmpty())
+        return 0;
+
+    // Materialised events are deleted along with their KAEvent instances,
+    // while records only need their Akonadi items to be deleted.
+    KAEvent::List events;
+    QVector<Item::Id> itemIds;
+    for (int i = 0, count = ids.count();  i < count;  ++i)
+    {
+        const ArchiveIndex::Record record = mArchiveIndex.value(ids[i]);
+        if (record.event)
+            events += record.event;
+        else
+        {
+            itemIds += record.itemId;
+            mArchiveIndex.remove(ids[i]);
+        }
+    }
+    if (!events.isEmpty())
+        purgeEvents(events);
+    if (!itemIds.isEmpty())
+        AkonadiModel::instance()->deleteItems(itemIds);
+    return ids.count();
+}
+
+/******************************************************************************
+* Return the number of events in each collection, by category.
+* Archived events are counted whether or not they have been materialised.
+*/
+QMap<Collection::Id, QMap<CalEvent::Type, int> > AlarmCalendar::eventCounts() const
+{
+    QMap<Collection::Id, QMap<CalEvent::Type, int> > counts;
+    for (ResourceMap::ConstIterator rit = mResourceMap.constBegin();  rit != mResourceMap.constEnd();  ++rit)
+    {
+        QMap<CalEvent::Type, int>& collectionCounts = counts[rit.key()];
+        const KAEvent::List& events = rit.value();
+        for (int i = 0, end = events.count();  i < end;  ++i)
+        {
+            const CalEvent::Type category = events[i]->category();
+            if (category != CalEvent::ARCHIVED)
+                ++collectionCounts[category];
+        }
+    }
+    const QList<Collection::Id> collections = mArchiveIndex.collections();
+    for (int i = 0, end = collections.count();  i < end;  ++i)
+    {
+        const int count = mArchiveIndex.count(collections[i]);
+        if (count)
+            counts[collections[i]][CalEvent::ARCHIVED] = count;
+    }
+    return counts;
 }
 
 /******************************************************************************
@@ -1307,6 +1951,8 @@ KAEvent::List AlarmCalendar::events(const QString& uniqueId) const
 /******************************************************************************
 * Return all events in the calendar which contain alarms.
 * Optionally the event type can be filtered, using an OR of event types.
+* Archived events which are held only as records are not included; use
+* archivedRecordEvents() to fetch them.
 */
 KAEvent::List AlarmCalendar::events(const Collection& collection, CalEvent::Types type) const
 {
@@ -1494,6 +2140,7 @@ void AlarmCalendar::findEarliestAlarm(const Collection& collection)
 
 void AlarmCalendar::findEarliestAlarm(Collection::Id key)
 {
+    KALARM_TRACE_SCOPE("calendar", "findEarliestAlarm");
     EarliestMap::Iterator eit = mEarliestAlarm.find(key);
     if (eit != mEarliestAlarm.end())
         eit.value() = nullptr;
@@ -1584,17 +2231,22 @@ void AlarmCalendar::adjustStartOfDay()
 }
 
 /******************************************************************************
-* Find the version of KAlarm which wrote the calendar file, and do any
-* necessary conversions to the current format.
+* Return whether all enabled Akonadi collections have been loaded.
 */
-KACalendar::Compat fix(const FileStorage::Ptr& fileStorage)
+bool calendarsPopulated()
 {
-    QString versionString;
-    int version = KACalendar::updateVersion(fileStorage, versionString);
-    if (version == KACalendar::IncompatibleFormat)
-        return KACalendar::Incompatible;  // calendar was created by another program, or an unknown version of KAlarm
-    return KACalendar::Current;
+    AkonadiModel* model = AkonadiModel::instance();
+    if (!model->isCollectionTreeFetched())
+        return false;
+    const Collection::List cols = CollectionControlModel::instance()->collections();
+    for (int i = 0, count = cols.count();  i < count;  ++i)
+    {
+        if (!model->data(model->collectionIndex(cols[i].id()), AkonadiModel::IsPopulatedRole).toBool()
+        &&  cols[i].hasAttribute<CollectionAttribute>()
+        &&  cols[i].attribute<CollectionAttribute>()->enabled() != CalEvent::EMPTY)
+            return false;
+    }
+    return true;
 }
 
-
 // vim: et sw=4:
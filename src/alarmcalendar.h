@@ -22,7 +22,9 @@
 #define ALARMCALENDAR_H
 
 #include "akonadimodel.h"
+#include "archiveindex.h"
 #include "eventid.h"
+#include "templateindex.h"
 
 #include <kalarmcal/kaevent.h>
 
@@ -30,11 +32,17 @@
 #include <KCalCore/FileStorage>
 #include <KCalCore/Event>
 
+#include <QDate>
 #include <QHash>
+#include <QMap>
 #include <QObject>
 #include <QUrl>
 
 
+class QTimer;
+class KJob;
+class SchedulerSnapshot;
+
 using namespace KAlarmCal;
 
 
@@ -53,6 +61,7 @@ class AlarmCalendar : public QObject
         int                   load();
         bool                  reload();
         bool                  save();
+        void                  saveDelayed();
         void                  close();
         void                  startUpdate();
         bool                  endUpdate();
@@ -63,24 +72,32 @@ class AlarmCalendar : public QObject
         KAEvent::List         atLoginAlarms() const;
         KCalCore::Event::Ptr  kcalEvent(const QString& uniqueID);   // if Akonadi, display calendar only
         KAEvent*              event(const EventId& uniqueId, bool checkDuplicates = false);
-        KAEvent*              templateEvent(const QString& templateName);
+        KAEvent*              templateEvent(const QString& templateName) const;
+        QStringList           templateNames() const  { return mTemplateIndex.names(); }
         KAEvent::List         events(const QString& uniqueId) const;
         KAEvent::List         events(CalEvent::Types s = CalEvent::EMPTY) const  { return events(Akonadi::Collection(), s); }
         KAEvent::List         events(const Akonadi::Collection&, CalEvent::Types = CalEvent::EMPTY) const;
+        QVector<KAEvent>      archivedRecordEvents(const Akonadi::Collection&) const;
+        QMap<Akonadi::Collection::Id, QMap<CalEvent::Type, int> > eventCounts() const;
         KCalCore::Event::List kcalEvents(CalEvent::Type s = CalEvent::EMPTY);   // display calendar only
         bool                  eventReadOnly(Akonadi::Item::Id) const;
         Akonadi::Collection   collectionForEvent(Akonadi::Item::Id) const;
         bool                  addEvent(KAEvent&, QWidget* promptparent = nullptr, bool useEventID = false, Akonadi::Collection* = nullptr, bool noPrompt = false, bool* cancelled = nullptr);
+        KJob*                 addEvents(const QVector<KAEvent>&, Akonadi::Collection&);
         bool                  modifyEvent(const EventId& oldEventId, KAEvent& newEvent);
         KAEvent*              updateEvent(const KAEvent&);
         KAEvent*              updateEvent(const KAEvent*);
         bool                  deleteEvent(const KAEvent&, bool save = false);
         bool                  deleteDisplayEvent(const QString& eventID, bool save = false);
         void                  purgeEvents(const KAEvent::List&);
+        int                   purgeArchived(Akonadi::Collection::Id, const QDate& cutoff, int maxCount);
         bool                  isOpen();
         QString               path() const           { return (mCalType == RESOURCES) ? QString() : mUrl.toDisplayString(); }
         QString               urlString() const      { return (mCalType == RESOURCES) ? QString() : mUrl.toString(); }
         void                  adjustStartOfDay();
+        KDateTime             checkSnapshot();
+        bool                  isPrefetched(const EventId& id) const  { return mPrefetchedEvents.contains(id); }
+        void                  saveSnapshot();
 
         static bool           initialiseCalendars();
         static void           terminateCalendars();
@@ -96,16 +113,35 @@ class AlarmCalendar : public QObject
         void                  haveDisabledAlarmsChanged(bool haveDisabled);
         void                  atLoginEventAdded(const KAEvent&);
         void                  calendarSaved(AlarmCalendar*);
+        void                  templatesChanged();
+        /** Emitted when a group add started by addEvents() has completed.
+         *  @param transaction  the job returned by addEvents()
+         *  @param events       the events passed to addEvents(). Each one which was
+         *                      added has its new ID and a valid item ID; each one
+         *                      which was not added is unchanged, with an invalid
+         *                      item ID.
+         */
+        void                  eventsAdded(KJob* transaction, const QVector<KAEvent>& events);
 
     private Q_SLOTS:
         void                  setAskResource(bool ask);
+        void                  slotSaveTimer();
+        void                  slotSnapshotTimer();
+        void                  slotPrefetchDone(KJob*);
         void                  slotCollectionStatusChanged(const Akonadi::Collection&, AkonadiModel::Change,
                                                           const QVariant& value, bool inserted);
         void                  slotEventsAdded(const AkonadiModel::EventList&);
         void                  slotEventsToBeRemoved(const AkonadiModel::EventList&);
         void                  slotEventChanged(const AkonadiModel::Event&);
+        void                  slotEventsAddDone(KJob* transaction, const QVector<Akonadi::Item::Id>& itemIds, bool status);
     private:
         enum CalType { RESOURCES, LOCAL_ICAL, LOCAL_VCAL };
+        struct PendingAdd   // data for addEvents() transaction in progress
+        {
+            QVector<KAEvent>  events;     // the events, with their new IDs
+            QVector<KAEvent>  original;   // the events as passed to addEvents()
+            QVector<int>      indexes;    // index into 'events' of each event in the transaction
+        };
         typedef QMap<Akonadi::Collection::Id, KAEvent::List> ResourceMap;  // id = invalid for display calendar
         typedef QMap<Akonadi::Collection::Id, KAEvent*> EarliestMap;
         typedef QHash<EventId, KAEvent*> KAEventMap;  // indexed by collection and event UID
@@ -126,6 +162,11 @@ class AlarmCalendar : public QObject
         void                  findEarliestAlarm(Akonadi::Collection::Id);  //deprecated
         void                  checkForDisabledAlarms();
         void                  checkForDisabledAlarms(bool oldEnabled, bool newEnabled);
+        void                  prefetchEvent(Akonadi::Item::Id);
+        void                  indexTemplate(KAEvent*);
+        void                  unindexTemplate(KAEvent*);
+        void                  indexArchived(KAEvent*);
+        KAEvent*              materialiseArchived(const EventId&);
 
         static AlarmCalendar* mResourcesCalendar;  // the calendar resources
         static AlarmCalendar* mDisplayCalendar;    // the display calendar
@@ -134,12 +175,21 @@ class AlarmCalendar : public QObject
         ResourceMap           mResourceMap;
         KAEventMap            mEventMap;           // lookup of all events by UID
         EarliestMap           mEarliestAlarm;      // alarm with earliest trigger time, by resource
+        TemplateIndex         mTemplateIndex;      // lookup of alarm templates by name
+        ArchiveIndex          mArchiveIndex;       // archived events, materialised or not, by creation date
+        QHash<KJob*, PendingAdd> mPendingAdds;     // addEvents() transactions in progress
         QList<QString>        mPendingAlarms;      // IDs of alarms which are currently being processed after triggering
         QUrl                  mUrl;                // URL of current calendar file
         QUrl                  mICalUrl;            // URL of iCalendar file
         QString               mLocalFile;          // calendar file, or local copy if it's a remote file
         CalType               mCalType;            // what type of calendar mCalendar is (resources/ical/vcal)
         CalEvent::Type        mEventType;         // what type of events the calendar file is for
+        QTimer*               mSaveTimer;          // timer for delayed save, or null
+        bool                  mDelayedSave;        // changes are waiting for mSaveTimer to be saved
+        SchedulerSnapshot*    mSnapshot;           // pending alarms at last exit, until calendars are loaded
+        QHash<EventId, KDateTime> mPrefetchedEvents; // events fetched individually before being loaded, with trigger time
+        QTimer*               mSnapshotTimer;      // timer for periodic snapshot writes, or null
+        bool                  mSnapshotDirty;      // pending alarms have changed since the last snapshot
         bool                  mOpen;               // true if the calendar file is open
         int                   mUpdateCount;        // nesting level of group of calendar update calls
         bool                  mUpdateSave;         // save() was called while mUpdateCount > 0
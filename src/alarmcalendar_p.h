@@ -0,0 +1,112 @@
+/*
+ *  alarmcalendar_p.h  -  KAlarm calendar import
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef ALARMCALENDAR_P_H
+#define ALARMCALENDAR_P_H
+
+#include "calendarfile.h"
+
+#include <kalarmcal/kacalendar.h>
+#include <kalarmcal/kaevent.h>
+
+#include <AkonadiCore/collection.h>
+#include <AkonadiCore/item.h>
+#include <KCalCore/Event>
+#include <KCalCore/MemoryCalendar>
+
+#include <QAtomicInt>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QThreadPool>
+#include <QTimeZone>
+#include <QVector>
+
+class KJob;
+
+using namespace KAlarmCal;
+
+/*=============================================================================
+= Class AlarmImport
+= Imports the alarms from a calendar file into KAlarm's calendars.
+= The file is parsed, and its events converted to KAEvents, by worker threads.
+= The converted alarms are passed back in batches to the main thread, which
+= adds each batch to Akonadi in a single transaction.
+=============================================================================*/
+class AlarmImport : public QObject
+{
+        Q_OBJECT
+    public:
+        AlarmImport(const QString& filename, Akonadi::Collection* collection, QObject* parent = nullptr);
+        ~AlarmImport();
+        bool    exec();
+        bool    loaded() const      { return mLoaded; }
+        int     processed() const   { return mProcessed.load(); }
+        bool    isCancelled() const { return mCancelled.load(); }
+
+        // Methods called by the worker threads
+        void    load();
+        void    convert(int start, int end);
+
+    public Q_SLOTS:
+        void    cancel()            { mCancelled.store(1); }
+
+    Q_SIGNALS:
+        void    eventCount(int count);   // emitted when the file has been parsed
+        void    progress(int processed);
+        void    batchReady();            // internal: converted alarms are waiting
+        void    finished();              // internal: all worker tasks have completed
+        void    transactionsDone();      // internal: all submitted batches have been committed or rolled back
+
+    private Q_SLOTS:
+        void    submitBatches();
+        void    slotEventsAdded(KJob* transaction, const QVector<Akonadi::Item::Id>&, bool status);
+
+    private:
+        typedef CalendarFile::Batch Batch;   // converted alarms, by alarm type
+
+        Akonadi::Collection* destination(CalEvent::Type);
+        void    taskDone();
+
+        QString                     mFilename;
+        QTimeZone                   mTimeZone;      // time zone to use when parsing the file
+        Akonadi::Collection*        mCollection;    // collection to import into, or null for default
+        CalEvent::Types             mWantedTypes;   // alarm types to import
+        Akonadi::Collection         mActiveColl;    // default collection for active alarms
+        Akonadi::Collection         mArchiveColl;   // default collection for archived alarms
+        Akonadi::Collection         mTemplateColl;  // default collection for alarm templates
+        KCalCore::MemoryCalendar::Ptr mCalendar;    // the calendar read from the file
+        KCalCore::Event::List       mEvents;        // the events read from the file
+        KACalendar::Compat          mCompat;        // compatibility of the file with KAlarm
+        QThreadPool                 mPool;          // worker threads
+        QMutex                      mMutex;         // protects mBatches
+        QList<Batch>                mBatches;       // converted alarms waiting to be added to Akonadi
+        QSet<KJob*>                 mTransactions;  // Akonadi transactions not yet committed or rolled back
+        QAtomicInt                  mTasks;         // number of worker tasks still to complete
+        QAtomicInt                  mProcessed;     // number of events converted so far
+        QAtomicInt                  mCancelled;     // the import has been cancelled
+        bool                        mLoaded;        // the file was parsed successfully
+        bool                        mSuccess;       // all alarms have been added successfully
+};
+
+#endif // ALARMCALENDAR_P_H
+
+// vim: et sw=4:
@@ -0,0 +1,155 @@
+/*
+ *  archiveindextest.cpp  -  test the archived alarm creation date index
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "archiveindex.h"
+
+#include <QTest>
+
+namespace
+{
+const qint64 ARCHIVE = 3;
+const qint64 OTHER_ARCHIVE = 4;
+const QDate FIRST_DATE(2015, 1, 1);
+}
+
+class ArchiveIndexTest : public QObject
+{
+        Q_OBJECT
+    private Q_SLOTS:
+        void purgeInBatches();
+        void purgeAll();
+        void updateAndRemove();
+        void removeCollection();
+};
+
+/******************************************************************************
+* Add 'count' archived alarms to a collection, one created on each day from
+* 'first' onwards, in an order unrelated to their dates.
+*/
+static void addArchived(ArchiveIndex& index, qint64 collectionId, const QDate& first, int count)
+{
+    for (int i = 0;  i < count;  ++i)
+    {
+        const int day = (i * 7) % count;   // count must not be a multiple of 7
+        index.insert(EventId(collectionId, QStringLiteral("archived-%1").arg(day)), 1000 + day, first.addDays(day), nullptr);
+    }
+}
+
+/******************************************************************************
+* Expired alarms are purged in batches of PURGE_BATCH_SIZE, oldest first,
+* leaving alarms created on or after the cutoff date and alarms in other
+* collections.
+*/
+void ArchiveIndexTest::purgeInBatches()
+{
+    QCOMPARE(ArchiveIndex::PURGE_BATCH_SIZE, 500);
+    ArchiveIndex index;
+    addArchived(index, ARCHIVE, FIRST_DATE, 1500);
+    addArchived(index, OTHER_ARCHIVE, FIRST_DATE, 100);
+    const QDate cutoff = FIRST_DATE.addDays(1200);   // 1200 alarms have expired
+
+    QVector<int> batchSizes;
+    QDate latest;
+    for (;;)
+    {
+        const QVector<EventId> ids = index.expired(ARCHIVE, cutoff, ArchiveIndex::PURGE_BATCH_SIZE);
+        if (ids.isEmpty())
+            break;
+        batchSizes += ids.count();
+        for (int i = 0, end = ids.count();  i < end;  ++i)
+        {
+            QCOMPARE(ids[i].collectionId(), ARCHIVE);
+            const QDate created = index.value(ids[i]).created;
+            QVERIFY(created < cutoff);
+            QVERIFY(!latest.isValid()  ||  created >= latest);
+            latest = created;
+            QVERIFY(index.remove(ids[i]));
+        }
+        if (ids.count() < ArchiveIndex::PURGE_BATCH_SIZE)
+            break;   // as purgeArchive() does, stop once a batch is not full
+    }
+    QCOMPARE(batchSizes, QVector<int>() << 500 << 500 << 200);
+    QCOMPARE(index.count(ARCHIVE), 300);
+    QCOMPARE(index.count(OTHER_ARCHIVE), 100);
+    QVERIFY(index.expired(ARCHIVE, cutoff, ArchiveIndex::PURGE_BATCH_SIZE).isEmpty());
+}
+
+/******************************************************************************
+* With an invalid cutoff date, all alarms in the collection are expired.
+*/
+void ArchiveIndexTest::purgeAll()
+{
+    ArchiveIndex index;
+    addArchived(index, ARCHIVE, FIRST_DATE, 40);
+    QCOMPARE(index.expired(ARCHIVE, QDate(), ArchiveIndex::PURGE_BATCH_SIZE).count(), 40);
+    QCOMPARE(index.expired(ARCHIVE, QDate(), 10).count(), 10);
+    const QVector<EventId> ids = index.ids(ARCHIVE);
+    QCOMPARE(ids.count(), 40);
+    QCOMPARE(ids.first(), EventId(ARCHIVE, QStringLiteral("archived-0")));
+    QCOMPARE(ids.last(), EventId(ARCHIVE, QStringLiteral("archived-39")));
+}
+
+/******************************************************************************
+* Updating a record re-indexes it under its new creation date. Removing the
+* last record in a collection removes the collection.
+*/
+void ArchiveIndexTest::updateAndRemove()
+{
+    ArchiveIndex index;
+    const EventId id(ARCHIVE, QStringLiteral("archived"));
+    index.insert(id, 10, FIRST_DATE, nullptr);
+    QCOMPARE(index.expired(ARCHIVE, FIRST_DATE.addDays(1), 10).count(), 1);
+
+    KAEvent event;
+    index.insert(id, 11, FIRST_DATE.addDays(5), &event);
+    QCOMPARE(index.count(ARCHIVE), 1);
+    QVERIFY(index.expired(ARCHIVE, FIRST_DATE.addDays(1), 10).isEmpty());
+    QCOMPARE(index.expired(ARCHIVE, FIRST_DATE.addDays(6), 10).count(), 1);
+    const ArchiveIndex::Record record = index.value(id);
+    QCOMPARE(record.itemId, qint64(11));
+    QCOMPARE(record.created, FIRST_DATE.addDays(5));
+    QCOMPARE(record.event, &event);
+
+    QVERIFY(index.remove(id));
+    QVERIFY(!index.remove(id));
+    QVERIFY(!index.contains(id));
+    QCOMPARE(index.count(ARCHIVE), 0);
+    QVERIFY(index.collections().isEmpty());
+}
+
+/******************************************************************************
+* Removing a collection removes all its records, and only its records.
+*/
+void ArchiveIndexTest::removeCollection()
+{
+    ArchiveIndex index;
+    addArchived(index, ARCHIVE, FIRST_DATE, 20);
+    addArchived(index, OTHER_ARCHIVE, FIRST_DATE, 20);
+    index.removeCollection(ARCHIVE);
+    QCOMPARE(index.count(ARCHIVE), 0);
+    QVERIFY(!index.contains(EventId(ARCHIVE, QStringLiteral("archived-0"))));
+    QVERIFY(index.contains(EventId(OTHER_ARCHIVE, QStringLiteral("archived-0"))));
+    QCOMPARE(index.collections(), QList<qint64>() << OTHER_ARCHIVE);
+}
+
+QTEST_GUILESS_MAIN(ArchiveIndexTest)
+
+#include "archiveindextest.moc"
+
+// vim: et sw=4:
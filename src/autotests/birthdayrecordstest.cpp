@@ -0,0 +1,208 @@
+/*
+ *  birthdayrecordstest.cpp  -  test the records of contacts' birthday alarms
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "birthdayrecords.h"
+
+#include <QTest>
+
+namespace
+{
+const QString UID  = QStringLiteral("contact-uid-1");
+const QString TEXT = QStringLiteral("Birthday: Ann Smith");
+const QDate   BIRTHDAY(1980, 3, 14);
+}
+
+class BirthdayRecordsTest : public QObject
+{
+        Q_OBJECT
+    private Q_SLOTS:
+        void createsForNewContact();
+        void updatesOnChange();
+        void followsContactByUid();
+        void retiresRemovedContact();
+        void holdsChangesWhileCreating();
+        void deletesIfRemovedWhileCreating();
+        void createFailure();
+};
+
+/******************************************************************************
+* A contact without a record needs an alarm to be created; once its record is
+* stored, it can be found by UID and by item ID.
+*/
+void BirthdayRecordsTest::createsForNewContact()
+{
+    BirthdayRecords records;
+    BirthdayRecords::Record record;
+    QCOMPARE(records.contactChanged(UID, 10, TEXT, BIRTHDAY, record), BirthdayRecords::CREATE);
+    QCOMPARE(record.itemId, qint64(10));
+    QCOMPARE(record.text, TEXT);
+    QCOMPARE(record.birthday, BIRTHDAY);
+    QVERIFY(record.eventId.isEmpty());
+    QVERIFY(!records.contains(UID));
+
+    record.eventId = QStringLiteral("event-1");
+    records.insert(UID, record);
+    QVERIFY(records.contains(UID));
+    QCOMPARE(records.count(), 1);
+    QCOMPARE(records.uidForItem(10), UID);
+    QCOMPARE(records.contactChanged(UID, 10, TEXT, BIRTHDAY, record), BirthdayRecords::NONE);
+}
+
+/******************************************************************************
+* A change to the contact's name or birthday requires its existing alarm to be
+* updated. The stored record is only changed once the caller stores it.
+*/
+void BirthdayRecordsTest::updatesOnChange()
+{
+    BirthdayRecords records;
+    BirthdayRecords::Record record;
+    records.contactChanged(UID, 10, TEXT, BIRTHDAY, record);
+    record.eventId = QStringLiteral("event-1");
+    records.insert(UID, record);
+
+    const QString newText = QStringLiteral("Birthday: Ann Jones");
+    QCOMPARE(records.contactChanged(UID, 10, newText, BIRTHDAY, record), BirthdayRecords::UPDATE);
+    QCOMPARE(record.eventId, QStringLiteral("event-1"));
+    QCOMPARE(record.text, newText);
+    QCOMPARE(records.value(UID).text, TEXT);
+
+    record.eventId = QStringLiteral("event-2");
+    records.insert(UID, record);
+    QCOMPARE(records.value(UID).eventId, QStringLiteral("event-2"));
+    QCOMPARE(records.contactChanged(UID, 10, newText, BIRTHDAY.addDays(1), record), BirthdayRecords::UPDATE);
+    QCOMPARE(record.birthday, BIRTHDAY.addDays(1));
+}
+
+/******************************************************************************
+* Records are keyed on the contact's UID, so a contact whose Akonadi item ID
+* changes keeps its alarm, and is found by its new item ID.
+*/
+void BirthdayRecordsTest::followsContactByUid()
+{
+    BirthdayRecords records;
+    BirthdayRecords::Record record;
+    records.contactChanged(UID, 10, TEXT, BIRTHDAY, record);
+    record.eventId = QStringLiteral("event-1");
+    records.insert(UID, record);
+
+    QCOMPARE(records.contactChanged(UID, 20, TEXT, BIRTHDAY, record), BirthdayRecords::NONE);
+    QCOMPARE(records.uidForItem(20), UID);
+    QVERIFY(records.uidForItem(10).isEmpty());
+    QCOMPARE(records.value(UID).eventId, QStringLiteral("event-1"));
+    QCOMPARE(records.count(), 1);
+}
+
+/******************************************************************************
+* A removed contact's record is removed, and its alarm must be deleted.
+*/
+void BirthdayRecordsTest::retiresRemovedContact()
+{
+    BirthdayRecords records;
+    BirthdayRecords::Record record;
+    records.contactChanged(UID, 10, TEXT, BIRTHDAY, record);
+    record.eventId = QStringLiteral("event-1");
+    records.insert(UID, record);
+
+    BirthdayRecords::Record removed;
+    QCOMPARE(records.contactRemoved(UID, removed), BirthdayRecords::DELETE);
+    QCOMPARE(removed.eventId, QStringLiteral("event-1"));
+    QVERIFY(!records.contains(UID));
+    QVERIFY(records.uidForItem(10).isEmpty());
+    QCOMPARE(records.contactRemoved(UID, removed), BirthdayRecords::NONE);
+}
+
+/******************************************************************************
+* Changes to a contact whose alarm is being created are held back, and are
+* returned as an update once the alarm has been created.
+*/
+void BirthdayRecordsTest::holdsChangesWhileCreating()
+{
+    BirthdayRecords records;
+    BirthdayRecords::Record record;
+    records.contactChanged(UID, 10, TEXT, BIRTHDAY, record);
+    records.creating(UID, record);
+    QVERIFY(records.isCreating(UID));
+
+    const QString newText = QStringLiteral("Birthday: Ann Jones");
+    BirthdayRecords::Record changed;
+    QCOMPARE(records.contactChanged(UID, 11, newText, BIRTHDAY, changed), BirthdayRecords::WAIT);
+
+    BirthdayRecords::Record created;
+    QCOMPARE(records.created(UID, QStringLiteral("event-1"), created), BirthdayRecords::UPDATE);
+    QVERIFY(!records.isCreating(UID));
+    QCOMPARE(created.eventId, QStringLiteral("event-1"));
+    QCOMPARE(created.text, newText);
+    QCOMPARE(records.value(UID).text, TEXT);
+    QCOMPARE(records.value(UID).eventId, QStringLiteral("event-1"));
+    QCOMPARE(records.uidForItem(11), UID);
+
+    // Without changes, the created alarm is simply recorded
+    const QString uid2 = QStringLiteral("contact-uid-2");
+    records.contactChanged(uid2, 30, TEXT, BIRTHDAY, record);
+    records.creating(uid2, record);
+    QCOMPARE(records.created(uid2, QStringLiteral("event-2"), created), BirthdayRecords::NONE);
+    QCOMPARE(records.value(uid2).eventId, QStringLiteral("event-2"));
+}
+
+/******************************************************************************
+* A contact which is removed while its alarm is being created has its alarm
+* deleted once it has been created, unless the contact reappears meanwhile.
+*/
+void BirthdayRecordsTest::deletesIfRemovedWhileCreating()
+{
+    BirthdayRecords records;
+    BirthdayRecords::Record record;
+    records.contactChanged(UID, 10, TEXT, BIRTHDAY, record);
+    records.creating(UID, record);
+    BirthdayRecords::Record removed;
+    QCOMPARE(records.contactRemoved(UID, removed), BirthdayRecords::WAIT);
+
+    BirthdayRecords::Record created;
+    QCOMPARE(records.created(UID, QStringLiteral("event-1"), created), BirthdayRecords::DELETE);
+    QCOMPARE(created.eventId, QStringLiteral("event-1"));
+    QVERIFY(!records.contains(UID));
+
+    records.contactChanged(UID, 10, TEXT, BIRTHDAY, record);
+    records.creating(UID, record);
+    QCOMPARE(records.contactRemoved(UID, removed), BirthdayRecords::WAIT);
+    QCOMPARE(records.contactChanged(UID, 10, TEXT, BIRTHDAY, record), BirthdayRecords::WAIT);
+    QCOMPARE(records.created(UID, QStringLiteral("event-2"), created), BirthdayRecords::NONE);
+    QCOMPARE(records.value(UID).eventId, QStringLiteral("event-2"));
+}
+
+/******************************************************************************
+* If an alarm can't be created, the contact is treated as having no alarm.
+*/
+void BirthdayRecordsTest::createFailure()
+{
+    BirthdayRecords records;
+    BirthdayRecords::Record record;
+    records.contactChanged(UID, 10, TEXT, BIRTHDAY, record);
+    records.creating(UID, record);
+    records.createFailed(UID);
+    QVERIFY(!records.isCreating(UID));
+    QVERIFY(!records.contains(UID));
+    QCOMPARE(records.contactChanged(UID, 10, TEXT, BIRTHDAY, record), BirthdayRecords::CREATE);
+}
+
+QTEST_GUILESS_MAIN(BirthdayRecordsTest)
+
+#include "birthdayrecordstest.moc"
+
+// vim: et sw=4:
@@ -0,0 +1,210 @@
+/*
+ *  calendarexporttest.cpp  -  test exporting alarms to a calendar file
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "calendarfile.h"
+
+#include <KCalCore/ICalFormat>
+#include <KCalCore/MemoryCalendar>
+
+#include <QColor>
+#include <QFile>
+#include <QFont>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QTimeZone>
+
+using namespace KCalCore;
+
+namespace
+{
+const QByteArray EXISTING_EVENT = "BEGIN:VEVENT\r\n"
+                                  "UID:existing-1\r\n"
+                                  "DTSTAMP:20170101T000000Z\r\n"
+                                  "DTSTART:20170102T100000Z\r\n"
+                                  "SUMMARY:Existing\r\n"
+                                  "END:VEVENT\r\n";
+}
+
+/******************************************************************************
+* Create alarms to export, with fixed IDs.
+*/
+static KAEvent::List makeEvents(int count)
+{
+    KAEvent::List events;
+    for (int i = 0;  i < count;  ++i)
+    {
+        KAEvent* event = new KAEvent(KDateTime(QDate(2030, 1, 1), QTime(10, i % 60), KDateTime::UTC),
+                                     QStringLiteral("Alarm %1").arg(i), Qt::white, Qt::black,
+                                     QFont(), KAEvent::MESSAGE, 0, KAEvent::DEFAULT_FONT);
+        event->setEventId(QStringLiteral("export-%1").arg(i));
+        event->endChanges();
+        events += event;
+    }
+    return events;
+}
+
+/******************************************************************************
+* Return the UIDs of the events in a calendar file, or an empty list if it
+* can't be parsed.
+*/
+static QStringList eventUids(const QByteArray& ical)
+{
+    MemoryCalendar::Ptr calendar(new MemoryCalendar(QTimeZone::utc()));
+    ICalFormat format;
+    if (!format.fromRawString(calendar, ical))
+        return QStringList();
+    QStringList uids;
+    const Event::List events = calendar->rawEvents();
+    for (int i = 0, end = events.count();  i < end;  ++i)
+        uids += events[i]->uid();
+    uids.sort();
+    return uids;
+}
+
+static QByteArray readFile(const QString& fileName)
+{
+    QFile file(fileName);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+static void writeFile(const QString& fileName, const QByteArray& data)
+{
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write(data);
+}
+
+class CalendarExportTest : public QObject
+{
+        Q_OBJECT
+    private Q_SLOTS:
+        void newFile();
+        void appendSplicesBeforeEnd();
+        void appendToEmptyFile();
+        void appendToBadFileLeavesItUnchanged();
+        void nothingToExportLeavesFileUnchanged();
+};
+
+/******************************************************************************
+* Exporting to a new file writes a complete calendar containing every alarm,
+* across several export chunks.
+*/
+void CalendarExportTest::newFile()
+{
+    QTemporaryDir dir;
+    const QString fileName = dir.path() + QStringLiteral("/new.ics");
+    KAEvent::List events = makeEvents(450);
+    int exported = 0;
+    QCOMPARE(CalendarFile::exportToFile(fileName, false, events, QTimeZone::utc(), &exported), CalendarFile::EXPORT_OK);
+    QCOMPARE(exported, 450);
+
+    const QByteArray ical = readFile(fileName);
+    QVERIFY(ical.startsWith(CalendarFile::header(QTimeZone::utc())));
+    QVERIFY(ical.endsWith("END:VCALENDAR\r\n"));
+    QCOMPARE(ical.count("END:VCALENDAR"), 1);
+    QCOMPARE(eventUids(ical).count(), 450);
+    qDeleteAll(events);
+}
+
+/******************************************************************************
+* Appending to an existing calendar keeps its contents byte for byte, and
+* inserts the alarms before its END:VCALENDAR line.
+*/
+void CalendarExportTest::appendSplicesBeforeEnd()
+{
+    QTemporaryDir dir;
+    const QString fileName = dir.path() + QStringLiteral("/append.ics");
+    const QByteArray before = CalendarFile::header(QTimeZone::utc()) + EXISTING_EVENT;
+    writeFile(fileName, before + "END:VCALENDAR\r\n");
+
+    KAEvent::List events = makeEvents(3);
+    int exported = 0;
+    QCOMPARE(CalendarFile::exportToFile(fileName, true, events, QTimeZone::utc(), &exported), CalendarFile::EXPORT_OK);
+    QCOMPARE(exported, 3);
+
+    const QByteArray ical = readFile(fileName);
+    QVERIFY(ical.startsWith(before));
+    QVERIFY(ical.endsWith("END:VCALENDAR\r\n"));
+    QCOMPARE(ical.count("END:VCALENDAR"), 1);
+    QCOMPARE(ical.count("BEGIN:VCALENDAR"), 1);
+    QCOMPARE(eventUids(ical), QStringList() << QStringLiteral("existing-1") << QStringLiteral("export-0")
+                                            << QStringLiteral("export-1") << QStringLiteral("export-2"));
+    qDeleteAll(events);
+}
+
+/******************************************************************************
+* Appending to an empty file writes a complete new calendar.
+*/
+void CalendarExportTest::appendToEmptyFile()
+{
+    QTemporaryDir dir;
+    const QString fileName = dir.path() + QStringLiteral("/empty.ics");
+    writeFile(fileName, "\r\n");
+    KAEvent::List events = makeEvents(1);
+    QCOMPARE(CalendarFile::exportToFile(fileName, true, events, QTimeZone::utc()), CalendarFile::EXPORT_OK);
+    const QByteArray ical = readFile(fileName);
+    QVERIFY(ical.startsWith(CalendarFile::header(QTimeZone::utc())));
+    QCOMPARE(eventUids(ical), QStringList() << QStringLiteral("export-0"));
+    qDeleteAll(events);
+}
+
+/******************************************************************************
+* A file without an END:VCALENDAR line at the start of a line can't be
+* appended to, and is left unchanged.
+*/
+void CalendarExportTest::appendToBadFileLeavesItUnchanged()
+{
+    QTemporaryDir dir;
+    const QString fileName = dir.path() + QStringLiteral("/bad.ics");
+    const QByteArray contents = "Not a calendar\r\n";
+    writeFile(fileName, contents);
+    KAEvent::List events = makeEvents(2);
+    int exported = -1;
+    QCOMPARE(CalendarFile::exportToFile(fileName, true, events, QTimeZone::utc(), &exported), CalendarFile::EXPORT_BAD_APPEND);
+    QCOMPARE(exported, 0);
+    QCOMPARE(readFile(fileName), contents);
+
+    const QByteArray truncated = CalendarFile::header(QTimeZone::utc()) + EXISTING_EVENT + "XEND:VCALENDAR\r\n";
+    writeFile(fileName, truncated);
+    QCOMPARE(CalendarFile::exportToFile(fileName, true, events, QTimeZone::utc()), CalendarFile::EXPORT_BAD_APPEND);
+    QCOMPARE(readFile(fileName), truncated);
+    qDeleteAll(events);
+}
+
+/******************************************************************************
+* If there are no alarms to export, the save is cancelled and the existing
+* file is left unchanged.
+*/
+void CalendarExportTest::nothingToExportLeavesFileUnchanged()
+{
+    QTemporaryDir dir;
+    const QString fileName = dir.path() + QStringLiteral("/unchanged.ics");
+    const QByteArray contents = CalendarFile::header(QTimeZone::utc()) + EXISTING_EVENT + "END:VCALENDAR\r\n";
+    writeFile(fileName, contents);
+    QCOMPARE(CalendarFile::exportToFile(fileName, true, KAEvent::List(), QTimeZone::utc()), CalendarFile::EXPORT_NONE);
+    QCOMPARE(readFile(fileName), contents);
+    QCOMPARE(CalendarFile::exportToFile(fileName, false, KAEvent::List(), QTimeZone::utc()), CalendarFile::EXPORT_NONE);
+    QCOMPARE(readFile(fileName), contents);
+}
+
+QTEST_GUILESS_MAIN(CalendarExportTest)
+
+#include "calendarexporttest.moc"
+
+// vim: et sw=4:
@@ -0,0 +1,238 @@
+/*
+ *  calendarimporttest.cpp  -  test converting calendar events for import
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "calendarfile.h"
+
+#include <QColor>
+#include <QFont>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSet>
+#include <QTest>
+#include <QThreadPool>
+
+using namespace KCalCore;
+
+/******************************************************************************
+* Create a calendar event as KAlarm would write it, for an alarm of a given
+* type.
+*/
+static Event::Ptr makeKCalEvent(const QString& id, CalEvent::Type type)
+{
+    KAEvent event(KDateTime(QDate(2030, 1, 1), QTime(10, 0), KDateTime::UTC),
+                  QStringLiteral("Text %1").arg(id), Qt::white, Qt::black,
+                  QFont(), KAEvent::MESSAGE, 0, KAEvent::DEFAULT_FONT);
+    event.setEventId(id);
+    if (type == CalEvent::TEMPLATE)
+        event.setTemplate(QStringLiteral("Template %1").arg(id));
+    else
+        event.setCategory(type);
+    event.endChanges();
+    Event::Ptr kcalEvent(new Event);
+    kcalEvent->setUid(CalEvent::uid(event.id(), type));
+    event.updateKCalEvent(kcalEvent, KAEvent::UID_IGNORE);
+    return kcalEvent;
+}
+
+/*=============================================================================
+= Class ImportRange
+= Converts one range of events, in the same way as an AlarmImport worker task.
+=============================================================================*/
+class ImportRange : public QRunnable
+{
+    public:
+        ImportRange(const Event::List& events, int start, int end, QMutex* mutex, QList<CalendarFile::Batch>* batches)
+            : mEvents(events), mStart(start), mEnd(end), mMutex(mutex), mBatches(batches) {}
+        void run() override
+        {
+            const CalendarFile::Batch batch = CalendarFile::importEvents(mEvents, mStart, mEnd, KACalendar::Current, CalEvent::ACTIVE | CalEvent::ARCHIVED | CalEvent::TEMPLATE);
+            QMutexLocker locker(mMutex);
+            *mBatches += batch;
+        }
+
+    private:
+        const Event::List&          mEvents;
+        int                         mStart;
+        int                         mEnd;
+        QMutex*                     mMutex;
+        QList<CalendarFile::Batch>* mBatches;
+};
+
+static void deleteBatch(const CalendarFile::Batch& batch)
+{
+    for (CalendarFile::Batch::ConstIterator it = batch.constBegin();  it != batch.constEnd();  ++it)
+        qDeleteAll(it.value());
+}
+
+class CalendarImportTest : public QObject
+{
+        Q_OBJECT
+    private Q_SLOTS:
+        void givesNewIdsByType();
+        void filtersWantedTypes();
+        void incompatibleTemplatesAreActive();
+        void usesSummaryForDisplayText();
+        void workersConvertEachEventOnce();
+};
+
+/******************************************************************************
+* Each imported alarm has a new unique ID of its own type, and is returned
+* under its type. The source events are not modified.
+*/
+void CalendarImportTest::givesNewIdsByType()
+{
+    Event::List events;
+    events << makeKCalEvent(QStringLiteral("a1"), CalEvent::ACTIVE)
+           << makeKCalEvent(QStringLiteral("a2"), CalEvent::ACTIVE)
+           << makeKCalEvent(QStringLiteral("x1"), CalEvent::ARCHIVED)
+           << makeKCalEvent(QStringLiteral("t1"), CalEvent::TEMPLATE);
+    QStringList originalUids;
+    for (int i = 0, end = events.count();  i < end;  ++i)
+        originalUids += events[i]->uid();
+
+    const CalendarFile::Batch batch = CalendarFile::importEvents(events, 0, events.count(), KACalendar::Current,
+                                                                 CalEvent::ACTIVE | CalEvent::ARCHIVED | CalEvent::TEMPLATE);
+    QCOMPARE(batch.value(CalEvent::ACTIVE).count(), 2);
+    QCOMPARE(batch.value(CalEvent::ARCHIVED).count(), 1);
+    QCOMPARE(batch.value(CalEvent::TEMPLATE).count(), 1);
+    QSet<QString> ids;
+    for (CalendarFile::Batch::ConstIterator it = batch.constBegin();  it != batch.constEnd();  ++it)
+    {
+        for (int i = 0, end = it.value().count();  i < end;  ++i)
+        {
+            const KAEvent* event = it.value()[i];
+            QCOMPARE(event->category(), it.key());
+            QVERIFY(!originalUids.contains(event->id()));
+            ids += event->id();
+        }
+    }
+    QCOMPARE(ids.count(), 4);
+    for (int i = 0, end = events.count();  i < end;  ++i)
+        QCOMPARE(events[i]->uid(), originalUids[i]);
+    deleteBatch(batch);
+}
+
+/******************************************************************************
+* Only the wanted alarm types are imported, and only from the given range.
+*/
+void CalendarImportTest::filtersWantedTypes()
+{
+    Event::List events;
+    events << makeKCalEvent(QStringLiteral("a1"), CalEvent::ACTIVE)
+           << makeKCalEvent(QStringLiteral("x1"), CalEvent::ARCHIVED)
+           << makeKCalEvent(QStringLiteral("a2"), CalEvent::ACTIVE)
+           << makeKCalEvent(QStringLiteral("a3"), CalEvent::ACTIVE);
+    CalendarFile::Batch batch = CalendarFile::importEvents(events, 0, events.count(), KACalendar::Current, CalEvent::ACTIVE);
+    QCOMPARE(batch.keys(), QList<CalEvent::Type>() << CalEvent::ACTIVE);
+    QCOMPARE(batch.value(CalEvent::ACTIVE).count(), 3);
+    deleteBatch(batch);
+
+    batch = CalendarFile::importEvents(events, 1, 3, KACalendar::Current, CalEvent::ACTIVE | CalEvent::ARCHIVED);
+    QCOMPARE(batch.value(CalEvent::ACTIVE).count(), 1);
+    QCOMPARE(batch.value(CalEvent::ARCHIVED).count(), 1);
+    deleteBatch(batch);
+}
+
+/******************************************************************************
+* Templates in a calendar which was not written by KAlarm are imported as
+* active alarms.
+*/
+void CalendarImportTest::incompatibleTemplatesAreActive()
+{
+    Event::List events;
+    events << makeKCalEvent(QStringLiteral("t1"), CalEvent::TEMPLATE);
+    const CalendarFile::Batch batch = CalendarFile::importEvents(events, 0, 1, KACalendar::Incompatible, CalEvent::ACTIVE);
+    QCOMPARE(batch.value(CalEvent::ACTIVE).count(), 1);
+    QVERIFY(!batch.contains(CalEvent::TEMPLATE));
+    deleteBatch(batch);
+}
+
+/******************************************************************************
+* A display alarm without text, in an event from another application, takes
+* the event's summary as its text. Events without alarms are ignored.
+*/
+void CalendarImportTest::usesSummaryForDisplayText()
+{
+    Event::Ptr event(new Event);
+    event->setDtStart(QDateTime(QDate(2030, 1, 1), QTime(9, 0), Qt::UTC));
+    event->setSummary(QStringLiteral("Meeting"));
+    Alarm::Ptr alarm = event->newAlarm();
+    alarm->setDisplayAlarm(QString());
+    alarm->setTime(QDateTime(QDate(2030, 1, 1), QTime(9, 0), Qt::UTC));
+    alarm->setEnabled(true);
+    Event::Ptr noAlarm(new Event);
+    noAlarm->setDtStart(QDateTime(QDate(2030, 1, 1), QTime(9, 0), Qt::UTC));
+    noAlarm->setSummary(QStringLiteral("No alarm"));
+
+    const Event::List events = Event::List() << event << noAlarm;
+    const CalendarFile::Batch batch = CalendarFile::importEvents(events, 0, events.count(), KACalendar::Incompatible, CalEvent::ACTIVE);
+    QCOMPARE(batch.value(CalEvent::ACTIVE).count(), 1);
+    QCOMPARE(batch.value(CalEvent::ACTIVE)[0]->message(), QStringLiteral("Meeting"));
+    QCOMPARE(event->summary(), QStringLiteral("Meeting"));   // the source event is unchanged
+    deleteBatch(batch);
+}
+
+/******************************************************************************
+* When ranges of the same event list are converted concurrently by several
+* workers, every event is converted exactly once, with unique new IDs.
+*/
+void CalendarImportTest::workersConvertEachEventOnce()
+{
+    const int count = 1000;
+    const int rangeSize = 64;
+    Event::List events;
+    events.reserve(count);
+    for (int i = 0;  i < count;  ++i)
+        events += makeKCalEvent(QStringLiteral("e%1").arg(i), (i % 10) ? CalEvent::ACTIVE : CalEvent::ARCHIVED);
+
+    QMutex mutex;
+    QList<CalendarFile::Batch> batches;
+    QThreadPool pool;
+    pool.setMaxThreadCount(4);
+    for (int start = 0;  start < count;  start += rangeSize)
+        pool.start(new ImportRange(events, start, qMin(start + rangeSize, count), &mutex, &batches));
+    pool.waitForDone();
+
+    QCOMPARE(batches.count(), (count + rangeSize - 1) / rangeSize);
+    QSet<QString> ids;
+    int active = 0;
+    int archived = 0;
+    for (int b = 0, bend = batches.count();  b < bend;  ++b)
+    {
+        const KAEvent::List a = batches[b].value(CalEvent::ACTIVE);
+        const KAEvent::List x = batches[b].value(CalEvent::ARCHIVED);
+        active   += a.count();
+        archived += x.count();
+        for (int i = 0, end = a.count();  i < end;  ++i)
+            ids += a[i]->id();
+        for (int i = 0, end = x.count();  i < end;  ++i)
+            ids += x[i]->id();
+        deleteBatch(batches[b]);
+    }
+    QCOMPARE(active, 900);
+    QCOMPARE(archived, 100);
+    QCOMPARE(ids.count(), count);
+}
+
+QTEST_GUILESS_MAIN(CalendarImportTest)
+
+#include "calendarimporttest.moc"
+
+// vim: et sw=4:
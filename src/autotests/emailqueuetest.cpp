@@ -0,0 +1,281 @@
+/*
+ *  emailqueuetest.cpp  -  test the ordering and retrying of queued emails
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "emailqueue.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTest>
+
+/*=============================================================================
+= Class StandInTransport
+= Stands in for an SMTP server. It only records which emails it has been asked
+= to send; the test decides when, and how, each send completes.
+= KAlarm's own part of sending an email ends at the Transport interface: the
+= SMTP conversation itself is done by KMailTransport's jobs. So a stand-in for
+= the transport exercises all of KAlarm's queuing, ordering, retry and spool
+= logic, and allows every outcome of a send to be produced on demand.
+=============================================================================*/
+class StandInTransport : public EmailQueue::Transport
+{
+    public:
+        StandInTransport()  { clock.start(); }
+        void startSend(quint64 id) override
+        {
+            started << id;
+            startTimes[id] = clock.elapsed();
+        }
+
+        QList<quint64>         started;      // emails in the order sending was started
+        QHash<quint64, qint64> startTimes;   // time each email was last started
+        QElapsedTimer          clock;
+};
+
+class EmailQueueTest : public QObject
+{
+        Q_OBJECT
+    private Q_SLOTS:
+        void sendsUpToWorkerLimit();
+        void keepsPerRecipientOrder();
+        void separateTransportsDoNotBlock();
+        void retriesWithBackoff();
+        void failsAfterRetries();
+        void restoresSpooledEmails();
+        void cancelRemovesSpoolFile();
+};
+
+/******************************************************************************
+* No more than the configured number of emails are sent at once, and the next
+* is started as soon as one completes.
+*/
+void EmailQueueTest::sendsUpToWorkerLimit()
+{
+    StandInTransport transport;
+    EmailQueue queue(&transport);
+    queue.setWorkers(2);
+    QSignalSpy finished(&queue, &EmailQueue::finished);
+    const quint64 a = queue.enqueue(1, QStringList() << QStringLiteral("a@example.com"));
+    const quint64 b = queue.enqueue(1, QStringList() << QStringLiteral("b@example.com"));
+    const quint64 c = queue.enqueue(1, QStringList() << QStringLiteral("c@example.com"));
+    QVERIFY(transport.started.isEmpty());   // sending starts from the event loop
+    QTRY_COMPARE(transport.started, QList<quint64>() << a << b);
+
+    queue.sendDone(b, true);
+    QCOMPARE(transport.started, QList<quint64>() << a << b << c);
+    QCOMPARE(finished.count(), 1);
+    QCOMPARE(finished.at(0).at(0).value<quint64>(), b);
+    QCOMPARE(finished.at(0).at(1).toBool(), true);
+
+    queue.sendDone(a, true);
+    queue.sendDone(c, true);
+    QCOMPARE(queue.count(), 0);
+    QCOMPARE(queue.statistics().sent, 3);
+    QCOMPARE(queue.statistics().failed, 0);
+}
+
+/******************************************************************************
+* An email is not sent until every earlier email to any of its recipients has
+* completed, but emails to other recipients can overtake it.
+*/
+void EmailQueueTest::keepsPerRecipientOrder()
+{
+    StandInTransport transport;
+    EmailQueue queue(&transport);
+    queue.setWorkers(3);
+    const quint64 a = queue.enqueue(1, QStringList() << QStringLiteral("x@example.com"));
+    const quint64 b = queue.enqueue(1, QStringList() << QStringLiteral("y@example.com") << QStringLiteral("X@Example.com"));
+    const quint64 c = queue.enqueue(1, QStringList() << QStringLiteral("z@example.com"));
+    QTRY_COMPARE(transport.started, QList<quint64>() << a << c);
+
+    queue.sendDone(c, true);
+    QCOMPARE(transport.started, QList<quint64>() << a << c);   // b still waits for a
+    queue.sendDone(a, true);
+    QCOMPARE(transport.started, QList<quint64>() << a << c << b);
+}
+
+/******************************************************************************
+* Each transport has its own queue and worker limit.
+*/
+void EmailQueueTest::separateTransportsDoNotBlock()
+{
+    StandInTransport transport;
+    EmailQueue queue(&transport);
+    queue.setWorkers(1);
+    const QStringList to(QStringLiteral("x@example.com"));
+    const quint64 a = queue.enqueue(1, to);
+    const quint64 b = queue.enqueue(2, to);
+    QTRY_COMPARE(transport.started.count(), 2);
+    QVERIFY(transport.started.contains(a));
+    QVERIFY(transport.started.contains(b));
+}
+
+/******************************************************************************
+* A failed send is retried after the retry delay, which doubles for each
+* attempt, and later emails to the same recipient wait for it.
+*/
+void EmailQueueTest::retriesWithBackoff()
+{
+    StandInTransport transport;
+    EmailQueue queue(&transport);
+    queue.setWorkers(2);
+    queue.setRetries(2);
+    queue.setRetryDelay(50);
+    QSignalSpy finished(&queue, &EmailQueue::finished);
+    const QStringList to(QStringLiteral("x@example.com"));
+    const quint64 a = queue.enqueue(1, to);
+    const quint64 b = queue.enqueue(1, to);
+    QTRY_COMPARE(transport.started, QList<quint64>() << a);
+
+    qint64 failTime = transport.clock.elapsed();
+    queue.sendDone(a, false, QStringLiteral("Connection refused"));
+    QCOMPARE(transport.started.count(), 1);      // neither a nor b is started at once
+    QTRY_COMPARE(transport.started.count(), 2);
+    QCOMPARE(transport.started.last(), a);
+    QVERIFY(transport.startTimes[a] - failTime >= 50);
+    QCOMPARE(queue.attempts(a), 2);
+
+    failTime = transport.clock.elapsed();
+    queue.sendDone(a, false, QStringLiteral("Connection refused"));
+    QTRY_COMPARE(transport.started.count(), 3);
+    QCOMPARE(transport.started.last(), a);
+    QVERIFY(transport.startTimes[a] - failTime >= 100);
+
+    queue.sendDone(a, true);
+    QCOMPARE(transport.started.last(), b);
+    QCOMPARE(finished.count(), 1);
+    QCOMPARE(finished.at(0).at(1).toBool(), true);
+    QCOMPARE(queue.statistics().retries, 2);
+    QCOMPARE(queue.statistics().sent, 1);
+}
+
+/******************************************************************************
+* Once all retries have failed, the failure is reported with the transport's
+* error, and the next email to the same recipient is sent.
+*/
+void EmailQueueTest::failsAfterRetries()
+{
+    StandInTransport transport;
+    EmailQueue queue(&transport);
+    queue.setRetries(1);
+    queue.setRetryDelay(10);
+    QSignalSpy finished(&queue, &EmailQueue::finished);
+    const QStringList to(QStringLiteral("x@example.com"));
+    const quint64 a = queue.enqueue(1, to);
+    const quint64 b = queue.enqueue(1, to);
+    QTRY_COMPARE(transport.started, QList<quint64>() << a);
+    queue.sendDone(a, false, QStringLiteral("550 Mailbox unavailable"));
+    QTRY_COMPARE(transport.started, QList<quint64>() << a << a);
+    queue.sendDone(a, false, QStringLiteral("550 Mailbox unavailable"));
+
+    QCOMPARE(finished.count(), 1);
+    QCOMPARE(finished.at(0).at(0).value<quint64>(), a);
+    QCOMPARE(finished.at(0).at(1).toBool(), false);
+    QCOMPARE(finished.at(0).at(2).toString(), QStringLiteral("550 Mailbox unavailable"));
+    QCOMPARE(transport.started.last(), b);
+    QCOMPARE(queue.statistics().failed, 1);
+    QCOMPARE(queue.count(), 1);
+}
+
+/******************************************************************************
+* Emails which have not been sent when the queue is destroyed, whether still
+* being sent, waiting, or waiting to retry, are restored from the spool
+* directory by a new queue, in their original order and with their data.
+* Emails which have been sent are not restored.
+*/
+void EmailQueueTest::restoresSpooledEmails()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QStringList to(QStringLiteral("x@example.com"));
+    const QStringList other(QStringLiteral("y@example.com"));
+    {
+        StandInTransport transport;
+        EmailQueue queue(&transport);
+        queue.setSpoolDirectory(dir.path());
+        queue.setWorkers(2);
+        queue.setRetries(1);
+        queue.setRetryDelay(60000);
+        const quint64 a = queue.enqueue(1, to, "first");
+        queue.enqueue(1, to, "second");
+        const quint64 c = queue.enqueue(2, other, "third");
+        const quint64 d = queue.enqueue(3, other, "fourth");
+        QTRY_COMPARE(transport.started.count(), 3);
+        QCOMPARE(queue.data(a), QByteArray("first"));
+        queue.sendDone(c, true);
+        queue.sendDone(d, false, QStringLiteral("Connection refused"));   // now waiting to retry
+        QCOMPARE(QDir(dir.path()).entryList(QDir::Files).count(), 3);
+    }
+
+    StandInTransport transport;
+    EmailQueue queue(&transport);
+    queue.setSpoolDirectory(dir.path());
+    queue.setWorkers(2);
+    const QList<quint64> ids = queue.restore();
+    QCOMPARE(ids.count(), 3);
+    QCOMPARE(queue.data(ids[0]), QByteArray("first"));
+    QCOMPARE(queue.data(ids[1]), QByteArray("second"));
+    QCOMPARE(queue.data(ids[2]), QByteArray("fourth"));
+    QCOMPARE(queue.restore().count(), 0);    // files of queued emails are not restored again
+    QTRY_COMPARE(transport.started.count(), 2);
+    QVERIFY(transport.started.contains(ids[0]));
+    QVERIFY(transport.started.contains(ids[2]));
+
+    queue.sendDone(ids[0], true);
+    QCOMPARE(transport.started.last(), ids[1]);   // recipient order is kept
+    queue.sendDone(ids[1], true);
+    queue.sendDone(ids[2], true);
+    QCOMPARE(queue.count(), 0);
+    QCOMPARE(QDir(dir.path()).entryList(QDir::Files).count(), 0);
+}
+
+/******************************************************************************
+* A cancelled email is removed from the queue and the spool directory without
+* being sent, and later emails to the same recipient are no longer held up.
+*/
+void EmailQueueTest::cancelRemovesSpoolFile()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    StandInTransport transport;
+    EmailQueue queue(&transport);
+    queue.setSpoolDirectory(dir.path());
+    QSignalSpy finished(&queue, &EmailQueue::finished);
+    const QStringList to(QStringLiteral("x@example.com"));
+    const quint64 a = queue.enqueue(1, to, "first");
+    const quint64 b = queue.enqueue(1, to, "second");
+    const quint64 c = queue.enqueue(1, to, "third");
+    QTRY_COMPARE(transport.started, QList<quint64>() << a);
+
+    queue.cancel(a);     // being sent, so it can't be cancelled
+    QCOMPARE(queue.count(), 3);
+    queue.cancel(b);
+    QCOMPARE(queue.count(), 2);
+    QCOMPARE(QDir(dir.path()).entryList(QDir::Files).count(), 2);
+    queue.sendDone(a, true);
+    QCOMPARE(transport.started, QList<quint64>() << a << c);
+    QCOMPARE(finished.count(), 1);
+}
+
+QTEST_GUILESS_MAIN(EmailQueueTest)
+
+#include "emailqueuetest.moc"
+
+// vim: et sw=4:
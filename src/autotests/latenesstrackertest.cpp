@@ -0,0 +1,157 @@
+/*
+ *  latenesstrackertest.cpp  -  test the alarm trigger lateness tracker
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "latenesstracker.h"
+#include "metrics.h"
+
+#include <QSet>
+#include <QTest>
+
+class LatenessTrackerTest : public QObject
+{
+        Q_OBJECT
+    private Q_SLOTS:
+        void init();
+        void percentiles();
+        void byCause();
+        void rollingWindow();
+        void earlyCountsAsOnTime();
+        void metrics();
+        void causeNames();
+};
+
+void LatenessTrackerTest::init()
+{
+    Metrics::clear("kalarm_trigger_lateness_seconds");
+    Metrics::clear("kalarm_trigger_lateness_p99_seconds");
+}
+
+/******************************************************************************
+* Percentiles are taken from the recorded triggers, and are zero if there are
+* none.
+*/
+void LatenessTrackerTest::percentiles()
+{
+    LatenessTracker tracker;
+    QCOMPARE(tracker.count(), 0);
+    QCOMPARE(tracker.percentile(99), 0);
+    // Record 1 to 100 seconds, in an order unrelated to their values.
+    for (int i = 0;  i < 100;  ++i)
+        tracker.record((i * 37) % 100 + 1, LatenessTracker::ON_TIME);
+    QCOMPARE(tracker.count(), 100);
+    QCOMPARE(tracker.percentile(0), 1);
+    QCOMPARE(tracker.percentile(50), 50);
+    QCOMPARE(tracker.percentile(99), 99);
+    QCOMPARE(tracker.percentile(100), 100);
+    QCOMPARE(tracker.percentile(150), 100);
+}
+
+/******************************************************************************
+* Counts and percentiles can be restricted to one cause of lateness.
+*/
+void LatenessTrackerTest::byCause()
+{
+    LatenessTracker tracker;
+    for (int i = 0;  i < 10;  ++i)
+        tracker.record(1, LatenessTracker::ON_TIME);
+    tracker.record(600, LatenessTracker::SUSPEND);
+    tracker.record(900, LatenessTracker::SUSPEND);
+    tracker.record(40, LatenessTracker::QUEUE_BACKLOG);
+    QCOMPARE(tracker.count(), 13);
+    QCOMPARE(tracker.count(LatenessTracker::ON_TIME), 10);
+    QCOMPARE(tracker.count(LatenessTracker::SUSPEND), 2);
+    QCOMPARE(tracker.count(LatenessTracker::QUEUE_BACKLOG), 1);
+    QCOMPARE(tracker.count(LatenessTracker::NOT_RUNNING), 0);
+    QCOMPARE(tracker.percentile(100, LatenessTracker::ON_TIME), 1);
+    QCOMPARE(tracker.percentile(0, LatenessTracker::SUSPEND), 600);
+    QCOMPARE(tracker.percentile(100, LatenessTracker::SUSPEND), 900);
+    QCOMPARE(tracker.percentile(50, LatenessTracker::QUEUE_BACKLOG), 40);
+    QCOMPARE(tracker.percentile(50, LatenessTracker::NOT_RUNNING), 0);
+    QCOMPARE(tracker.percentile(100), 900);
+}
+
+/******************************************************************************
+* Only the most recent triggers are held, the oldest being replaced first.
+*/
+void LatenessTrackerTest::rollingWindow()
+{
+    LatenessTracker tracker(10);
+    for (int i = 0;  i < 5;  ++i)
+        tracker.record(1000, LatenessTracker::NOT_RUNNING);
+    for (int i = 0;  i < 25;  ++i)
+        tracker.record(i, LatenessTracker::OTHER);
+    QCOMPARE(tracker.count(), 10);
+    QCOMPARE(tracker.count(LatenessTracker::NOT_RUNNING), 0);
+    QCOMPARE(tracker.count(LatenessTracker::OTHER), 10);
+    QCOMPARE(tracker.percentile(0), 15);
+    QCOMPARE(tracker.percentile(100), 24);
+
+    LatenessTracker minimal(0);   // the window holds at least one trigger
+    minimal.record(3, LatenessTracker::OTHER);
+    minimal.record(7, LatenessTracker::OTHER);
+    QCOMPARE(minimal.count(), 1);
+    QCOMPARE(minimal.percentile(50), 7);
+}
+
+/******************************************************************************
+* A trigger which is early is recorded as zero seconds late.
+*/
+void LatenessTrackerTest::earlyCountsAsOnTime()
+{
+    LatenessTracker tracker;
+    tracker.record(-5, LatenessTracker::ON_TIME);
+    QCOMPARE(tracker.count(), 1);
+    QCOMPARE(tracker.percentile(0), 0);
+}
+
+/******************************************************************************
+* Each trigger is recorded in the lateness histogram under its cause, and the
+* p99 gauge is updated.
+*/
+void LatenessTrackerTest::metrics()
+{
+    LatenessTracker tracker;
+    tracker.record(0, LatenessTracker::ON_TIME);
+    tracker.record(120, LatenessTracker::SUSPEND);
+    tracker.record(40, LatenessTracker::SUSPEND);
+    const QString text = Metrics::text();
+    QVERIFY(text.contains(QStringLiteral("kalarm_trigger_lateness_seconds_count{cause=\"on_time\"} 1\n")));
+    QVERIFY(text.contains(QStringLiteral("kalarm_trigger_lateness_seconds_count{cause=\"suspend\"} 2\n")));
+    QVERIFY(text.contains(QStringLiteral("kalarm_trigger_lateness_seconds_sum{cause=\"suspend\"} 160\n")));
+    QVERIFY(text.contains(QStringLiteral("kalarm_trigger_lateness_seconds_bucket{cause=\"suspend\",le=\"60\"} 1\n")));
+    QVERIFY(text.contains(QStringLiteral("kalarm_trigger_lateness_p99_seconds 40\n")));
+}
+
+/******************************************************************************
+* Each cause has a distinct metric label name.
+*/
+void LatenessTrackerTest::causeNames()
+{
+    QSet<QString> names;
+    for (int i = 0;  i < LatenessTracker::CAUSE_COUNT;  ++i)
+        names += LatenessTracker::causeName(static_cast<LatenessTracker::Cause>(i));
+    QCOMPARE(names.count(), static_cast<int>(LatenessTracker::CAUSE_COUNT));
+    QCOMPARE(LatenessTracker::causeName(LatenessTracker::AKONADI_NOT_READY), QStringLiteral("akonadi_not_ready"));
+}
+
+QTEST_GUILESS_MAIN(LatenessTrackerTest)
+
+#include "latenesstrackertest.moc"
+
+// vim: et sw=4:
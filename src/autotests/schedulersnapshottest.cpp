@@ -0,0 +1,189 @@
+/*
+ *  schedulersnapshottest.cpp  -  test the start-up scheduler snapshot
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "schedulersnapshot.h"
+
+#include <QColor>
+#include <QFile>
+#include <QFont>
+#include <QTemporaryDir>
+#include <QTest>
+
+namespace
+{
+const qint64 COLLECTION = 7;
+const KDateTime BASE_TIME(QDate(2030, 1, 1), QTime(10, 0), KDateTime::UTC);
+}
+
+/******************************************************************************
+* Create an active alarm stored in Akonadi, which triggers 'mins' minutes after
+* BASE_TIME.
+*/
+static KAEvent* makeEvent(int index, int mins)
+{
+    KAEvent* event = new KAEvent(BASE_TIME.addSecs(mins * 60), QStringLiteral("Alarm %1").arg(index),
+                                 Qt::white, Qt::black, QFont(), KAEvent::MESSAGE, 0, KAEvent::DEFAULT_FONT);
+    event->setEventId(QStringLiteral("snapshot-%1").arg(index));
+    event->setCollectionId(COLLECTION);
+    event->setItemId(100 + index);
+    event->endChanges();
+    return event;
+}
+
+class SchedulerSnapshotTest : public QObject
+{
+        Q_OBJECT
+    private Q_SLOTS:
+        void init();
+        void cleanup();
+        void saveAndLoad();
+        void missingFile();
+        void unknownFormat();
+        void truncatedFile();
+        void checkDueFetchesOnlyUnloaded();
+
+    private:
+        QString snapshotFile() const  { return mDir.path() + QStringLiteral("/snapshot"); }
+
+        QTemporaryDir  mDir;
+        KAEvent::List  mEvents;
+};
+
+void SchedulerSnapshotTest::init()
+{
+    QVERIFY(mDir.isValid());
+    // Add the alarms out of trigger time order.
+    mEvents << makeEvent(0, 30) << makeEvent(1, 10) << makeEvent(2, 20) << makeEvent(3, 40);
+}
+
+void SchedulerSnapshotTest::cleanup()
+{
+    qDeleteAll(mEvents);
+    mEvents.clear();
+    QFile::remove(snapshotFile());
+}
+
+/******************************************************************************
+* The saved alarms are loaded in order of trigger time, with their IDs, trigger
+* times and flags. Disabled alarms, and alarms not yet stored in Akonadi, are
+* not saved.
+*/
+void SchedulerSnapshotTest::saveAndLoad()
+{
+    KAEvent* disabled = makeEvent(4, 5);
+    disabled->setEnabled(false);
+    KAEvent* unsaved = makeEvent(5, 5);
+    unsaved->setItemId(-1);
+    mEvents << disabled << unsaved;
+
+    QVERIFY(SchedulerSnapshot::save(mEvents, snapshotFile()));
+    SchedulerSnapshot snapshot;
+    QVERIFY(snapshot.load(snapshotFile()));
+    const QVector<SchedulerSnapshot::Entry>& entries = snapshot.entries();
+    QCOMPARE(entries.count(), 4);
+    const int order[4] = { 1, 2, 0, 3 };
+    for (int i = 0;  i < 4;  ++i)
+    {
+        const KAEvent* event = mEvents[order[i]];
+        QCOMPARE(entries[i].collectionId, COLLECTION);
+        QCOMPARE(entries[i].itemId, static_cast<qint64>(event->itemId()));
+        QCOMPARE(entries[i].eventId, event->id());
+        QCOMPARE(entries[i].nextTrigger, static_cast<qint64>(event->nextTrigger(KAEvent::ALL_TRIGGER).effectiveKDateTime().toTime_t()));
+        QCOMPARE(entries[i].flags, static_cast<quint32>(event->flags()));
+        QVERIFY(!entries[i].fetched);
+    }
+}
+
+/******************************************************************************
+* A missing snapshot file loads as empty.
+*/
+void SchedulerSnapshotTest::missingFile()
+{
+    SchedulerSnapshot snapshot;
+    QVERIFY(!snapshot.load(snapshotFile()));
+    QVERIFY(snapshot.isEmpty());
+}
+
+/******************************************************************************
+* A file which is not a snapshot, or is in an unknown format, is ignored.
+*/
+void SchedulerSnapshotTest::unknownFormat()
+{
+    QFile file(snapshotFile());
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("BEGIN:VCALENDAR\r\nEND:VCALENDAR\r\n");
+    file.close();
+    SchedulerSnapshot snapshot;
+    QVERIFY(!snapshot.load(snapshotFile()));
+    QVERIFY(snapshot.isEmpty());
+}
+
+/******************************************************************************
+* A snapshot which was only partly written is ignored completely.
+*/
+void SchedulerSnapshotTest::truncatedFile()
+{
+    QVERIFY(SchedulerSnapshot::save(mEvents, snapshotFile()));
+    QFile file(snapshotFile());
+    QVERIFY(file.resize(file.size() - 6));
+    SchedulerSnapshot snapshot;
+    QVERIFY(!snapshot.load(snapshotFile()));
+    QVERIFY(snapshot.isEmpty());
+}
+
+/******************************************************************************
+* Due alarms are fetched only if they have not been loaded, and only once.
+* The reply is the trigger time of the next alarm which has not been loaded.
+*/
+void SchedulerSnapshotTest::checkDueFetchesOnlyUnloaded()
+{
+    QVERIFY(SchedulerSnapshot::save(mEvents, snapshotFile()));
+    SchedulerSnapshot snapshot;
+    QVERIFY(snapshot.load(snapshotFile()));
+    const qint64 base = BASE_TIME.toTime_t();
+
+    // Alarm 2 (due at +20 minutes) and alarm 0 (due at +30 minutes) have been loaded.
+    QHash<EventId, KAEvent*> loaded;
+    loaded[EventId(*mEvents[2])] = mEvents[2];
+    loaded[EventId(*mEvents[0])] = mEvents[0];
+
+    // Nothing is due yet.
+    QVector<qint64> fetch;
+    QCOMPARE(snapshot.checkDue(base, loaded, fetch), base + 10 * 60);
+    QVERIFY(fetch.isEmpty());
+
+    // Alarms 1 and 2 are due, but alarm 2 has been loaded.
+    QCOMPARE(snapshot.checkDue(base + 25 * 60, loaded, fetch), base + 40 * 60);
+    QCOMPARE(fetch, QVector<qint64>() << 101);
+
+    // Alarm 1 is not fetched again.
+    fetch.clear();
+    QCOMPARE(snapshot.checkDue(base + 25 * 60, loaded, fetch), base + 40 * 60);
+    QVERIFY(fetch.isEmpty());
+
+    // All alarms are due.
+    QCOMPARE(snapshot.checkDue(base + 60 * 60, loaded, fetch), qint64(-1));
+    QCOMPARE(fetch, QVector<qint64>() << 103);
+}
+
+QTEST_GUILESS_MAIN(SchedulerSnapshotTest)
+
+#include "schedulersnapshottest.moc"
+
+// vim: et sw=4:
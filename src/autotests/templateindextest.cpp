@@ -0,0 +1,176 @@
+/*
+ *  templateindextest.cpp  -  test the index of alarm templates by name
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "templateindex.h"
+
+#include <kalarmcal/kaevent.h>
+
+#include <QColor>
+#include <QFont>
+#include <QTest>
+
+using namespace KAlarmCal;
+
+/******************************************************************************
+* Create an alarm template with the specified name and action.
+*/
+static KAEvent makeTemplate(const QString& name, KAEvent::SubAction action = KAEvent::MESSAGE)
+{
+    KAEvent event(KDateTime::currentUtcDateTime(), QStringLiteral("Text"), Qt::white, Qt::black,
+                  QFont(), action, 0, KAEvent::DEFAULT_FONT);
+    event.setTemplate(name);
+    return event;
+}
+
+class TemplateIndexTest : public QObject
+{
+        Q_OBJECT
+    private Q_SLOTS:
+        void keepsNamesSorted();
+        void ignoresNonTemplates();
+        void duplicateNames();
+        void renameInPlace();
+        void actionTypeChange();
+        void unindexRemoves();
+};
+
+/******************************************************************************
+* Names are held in collation order, whatever order templates are added in.
+*/
+void TemplateIndexTest::keepsNamesSorted()
+{
+    KAEvent c = makeTemplate(QStringLiteral("Cherry"));
+    KAEvent a = makeTemplate(QStringLiteral("apple"));
+    KAEvent b = makeTemplate(QStringLiteral("Banana"));
+    TemplateIndex index;
+    QVERIFY(index.index(&c));
+    QVERIFY(index.index(&a));
+    QVERIFY(index.index(&b));
+    QCOMPARE(index.names(), QStringList() << QStringLiteral("apple") << QStringLiteral("Banana") << QStringLiteral("Cherry"));
+    QCOMPARE(index.event(QStringLiteral("Banana")), &b);
+    QCOMPARE(index.event(QStringLiteral("Damson")), static_cast<KAEvent*>(nullptr));
+    QCOMPARE(index.event(QString()), static_cast<KAEvent*>(nullptr));
+}
+
+/******************************************************************************
+* Events which are not templates are not indexed; an event which stops being
+* a template is removed from the index.
+*/
+void TemplateIndexTest::ignoresNonTemplates()
+{
+    KAEvent event(KDateTime::currentUtcDateTime(), QStringLiteral("Text"), Qt::white, Qt::black,
+                  QFont(), KAEvent::MESSAGE, 0, KAEvent::DEFAULT_FONT);
+    event.setCategory(CalEvent::ACTIVE);
+    TemplateIndex index;
+    QVERIFY(!index.index(&event));
+    QVERIFY(index.names().isEmpty());
+
+    KAEvent templ = makeTemplate(QStringLiteral("One"));
+    QVERIFY(index.index(&templ));
+    templ.setCategory(CalEvent::ACTIVE);
+    QVERIFY(index.index(&templ));
+    QVERIFY(index.names().isEmpty());
+    QCOMPARE(index.event(QStringLiteral("One")), static_cast<KAEvent*>(nullptr));
+}
+
+/******************************************************************************
+* Several templates may have the same name: each has its own entry in the
+* name list, and removing one leaves the other findable.
+*/
+void TemplateIndexTest::duplicateNames()
+{
+    KAEvent a1 = makeTemplate(QStringLiteral("Same"));
+    KAEvent a2 = makeTemplate(QStringLiteral("Same"));
+    KAEvent b  = makeTemplate(QStringLiteral("Other"));
+    TemplateIndex index;
+    index.index(&a1);
+    index.index(&b);
+    index.index(&a2);
+    QCOMPARE(index.names(), QStringList() << QStringLiteral("Other") << QStringLiteral("Same") << QStringLiteral("Same"));
+
+    QVERIFY(index.unindex(&a1));
+    QCOMPARE(index.names(), QStringList() << QStringLiteral("Other") << QStringLiteral("Same"));
+    QCOMPARE(index.event(QStringLiteral("Same")), &a2);
+    QVERIFY(index.unindex(&a2));
+    QCOMPARE(index.names(), QStringList() << QStringLiteral("Other"));
+    QCOMPARE(index.event(QStringLiteral("Same")), static_cast<KAEvent*>(nullptr));
+}
+
+/******************************************************************************
+* A template which is renamed by being updated in place is re-indexed under
+* its new name, and is no longer found under its old name. Re-indexing an
+* unchanged template reports no change.
+*/
+void TemplateIndexTest::renameInPlace()
+{
+    KAEvent a = makeTemplate(QStringLiteral("Alpha"));
+    KAEvent m = makeTemplate(QStringLiteral("Middle"));
+    TemplateIndex index;
+    index.index(&a);
+    index.index(&m);
+    QVERIFY(!index.index(&a));
+
+    a.setTemplate(QStringLiteral("Zulu"));
+    QVERIFY(index.index(&a));
+    QCOMPARE(index.names(), QStringList() << QStringLiteral("Middle") << QStringLiteral("Zulu"));
+    QCOMPARE(index.event(QStringLiteral("Zulu")), &a);
+    QCOMPARE(index.event(QStringLiteral("Alpha")), static_cast<KAEvent*>(nullptr));
+}
+
+/******************************************************************************
+* A template whose action type changes in place is reported as changed, so
+* that lists which exclude command templates are rebuilt.
+*/
+void TemplateIndexTest::actionTypeChange()
+{
+    KAEvent t = makeTemplate(QStringLiteral("Action"));
+    TemplateIndex index;
+    index.index(&t);
+    t = makeTemplate(QStringLiteral("Action"), KAEvent::COMMAND);
+    QVERIFY(index.index(&t));
+    QCOMPARE(index.names(), QStringList() << QStringLiteral("Action"));
+    QVERIFY(index.event(QStringLiteral("Action"))->actionTypes() & KAEvent::ACT_COMMAND);
+    QVERIFY(!index.index(&t));
+}
+
+/******************************************************************************
+* Removing a template which is not indexed reports no change; clear() empties
+* the index.
+*/
+void TemplateIndexTest::unindexRemoves()
+{
+    KAEvent a = makeTemplate(QStringLiteral("A"));
+    KAEvent b = makeTemplate(QStringLiteral("B"));
+    TemplateIndex index;
+    QVERIFY(!index.unindex(&a));
+    index.index(&a);
+    index.index(&b);
+    QVERIFY(index.unindex(&a));
+    QVERIFY(!index.unindex(&a));
+    QCOMPARE(index.names(), QStringList() << QStringLiteral("B"));
+    index.clear();
+    QVERIFY(index.names().isEmpty());
+    QCOMPARE(index.event(QStringLiteral("B")), static_cast<KAEvent*>(nullptr));
+}
+
+QTEST_GUILESS_MAIN(TemplateIndexTest)
+
+#include "templateindextest.moc"
+
+// vim: et sw=4:
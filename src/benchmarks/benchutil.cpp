@@ -0,0 +1,106 @@
+/*
+ *  benchutil.cpp  -  common functions for the benchmark programs
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "benchutil.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QTextStream>
+
+#include <algorithm>
+
+namespace
+{
+/******************************************************************************
+* Read a memory size field from /proc/self/status.
+*/
+qint64 procStatusKb(const QByteArray& field)
+{
+    QFile file(QStringLiteral("/proc/self/status"));
+    if (!file.open(QIODevice::ReadOnly))
+        return -1;
+    for (;;)
+    {
+        const QByteArray line = file.readLine();
+        if (line.isEmpty())
+            break;
+        if (line.startsWith(field))
+        {
+            const QByteArray value = line.mid(field.length()).trimmed();
+            const int i = value.indexOf(' ');
+            return (i > 0 ? value.left(i) : value).toLongLong();
+        }
+    }
+    return -1;
+}
+}
+
+namespace Bench
+{
+
+qint64 residentMemoryKb()
+{
+    return procStatusKb(QByteArrayLiteral("VmRSS:"));
+}
+
+qint64 peakMemoryKb()
+{
+    return procStatusKb(QByteArrayLiteral("VmHWM:"));
+}
+
+bool resetPeakMemory()
+{
+    QFile file(QStringLiteral("/proc/self/clear_refs"));
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    return file.write("5") == 1;
+}
+
+QJsonObject percentiles(QVector<qint64>& samples)
+{
+    QJsonObject result;
+    result[QStringLiteral("count")] = samples.count();
+    if (samples.isEmpty())
+        return result;
+    std::sort(samples.begin(), samples.end());
+    const int last = samples.count() - 1;
+    result[QStringLiteral("p50")] = static_cast<double>(samples[last * 50 / 100]);
+    result[QStringLiteral("p90")] = static_cast<double>(samples[last * 90 / 100]);
+    result[QStringLiteral("p99")] = static_cast<double>(samples[last * 99 / 100]);
+    result[QStringLiteral("max")] = static_cast<double>(samples[last]);
+    return result;
+}
+
+bool writeJson(const QJsonObject& results, const QString& file)
+{
+    const QByteArray json = QJsonDocument(results).toJson();
+    if (file.isEmpty())
+    {
+        QTextStream(stdout) << json;
+        return true;
+    }
+    QFile out(file);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    return out.write(json) == json.size();
+}
+
+}
+
+// vim: et sw=4:
@@ -0,0 +1,55 @@
+/*
+ *  benchutil.h  -  common functions for the benchmark programs
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef BENCHUTIL_H
+#define BENCHUTIL_H
+
+#include <QJsonObject>
+#include <QVector>
+
+class QString;
+
+namespace Bench
+{
+
+/** Return the current resident set size of the process, in kilobytes,
+ *  or -1 if it cannot be determined. */
+qint64 residentMemoryKb();
+
+/** Return the peak resident set size of the process, in kilobytes,
+ *  or -1 if it cannot be determined. */
+qint64 peakMemoryKb();
+
+/** Reset the peak resident set size to the current size, so that the peak
+ *  of a single phase can be measured. Reply = false if not supported. */
+bool resetPeakMemory();
+
+/** Return the 50th, 90th, 99th percentiles and maximum of a set of samples,
+ *  together with the sample count. The samples are sorted in place. */
+QJsonObject percentiles(QVector<qint64>& samples);
+
+/** Write a JSON object to a file, or to standard output if 'file' is empty.
+ *  Reply = false if the file could not be written. */
+bool writeJson(const QJsonObject& results, const QString& file);
+
+}
+
+#endif // BENCHUTIL_H
+
+// vim: et sw=4:
@@ -0,0 +1,249 @@
+/*
+ *  calendarbench.cpp  -  benchmark for calendar loading, import and export
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Measures the calendar file processing done by AlarmCalendar, on a calendar
+ * file such as one written by kalarm_gencalendar. The AlarmCalendar methods
+ * themselves need the running application and Akonadi, so each phase calls
+ * the CalendarFile functions which they use to process the file:
+ *   load:    AlarmCalendar::load() parsing and updateDisplayKAEvents()
+ *            KAEvent construction
+ *   import:  AlarmCalendar::importAlarms() parsing and parallel conversion,
+ *            excluding the addition of the alarms to Akonadi
+ *   save:    AlarmCalendar::saveCal()
+ *   export:  AlarmCalendar::exportAlarms() parallel serialisation and writing
+ * For each phase the elapsed time, and the resident and peak memory at the end
+ * of the phase, are written as JSON.
+ */
+
+#include "kalarm.h"
+#include "benchutil.h"
+#include "calendarfile.h"
+
+#include <kalarmcal/kacalendar.h>
+#include <kalarmcal/kaevent.h>
+
+#include <KCalCore/FileStorage>
+#include <KCalCore/ICalFormat>
+#include <KCalCore/MemoryCalendar>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QTimeZone>
+
+using namespace KCalCore;
+using namespace KAlarmCal;
+
+namespace
+{
+
+const int IMPORT_BATCH_SIZE = 200;   // as in AlarmCalendar::importAlarms()
+
+/*=============================================================================
+= Worker task to convert a range of imported events, as AlarmImport::convert().
+=============================================================================*/
+class ConvertTask : public QRunnable
+{
+    public:
+        ConvertTask(const Event::List& events, int start, int end, KACalendar::Compat compat, CalendarFile::Batch* out)
+            : mEvents(events), mStart(start), mEnd(end), mCompat(compat), mOut(out) {}
+        void run() override
+        {
+            *mOut = CalendarFile::importEvents(mEvents, mStart, mEnd, mCompat, CalEvent::ACTIVE | CalEvent::ARCHIVED | CalEvent::TEMPLATE);
+        }
+    private:
+        const Event::List&   mEvents;
+        int                  mStart;
+        int                  mEnd;
+        KACalendar::Compat   mCompat;
+        CalendarFile::Batch* mOut;
+};
+
+/******************************************************************************
+* Return the timing and memory results for a phase.
+*/
+QJsonObject phaseResult(qint64 elapsedNs, int events)
+{
+    QJsonObject obj;
+    obj[QStringLiteral("ms")]     = elapsedNs / 1000000.0;
+    obj[QStringLiteral("events")] = events;
+    obj[QStringLiteral("usPerEvent")] = events ? elapsedNs / 1000.0 / events : 0.0;
+    obj[QStringLiteral("rssKb")]  = static_cast<double>(Bench::residentMemoryKb());
+    obj[QStringLiteral("peakRssKb")] = static_cast<double>(Bench::peakMemoryKb());
+    return obj;
+}
+
+/******************************************************************************
+* Read and parse a calendar file, as AlarmCalendar::load() and
+* AlarmImport::load() do.
+*/
+MemoryCalendar::Ptr parse(const QString& file, const QTimeZone& zone, KACalendar::Compat* compat = nullptr)
+{
+    MemoryCalendar::Ptr calendar(new MemoryCalendar(zone));
+    FileStorage::Ptr storage(new FileStorage(calendar, file));
+    if (!CalendarFile::load(storage, compat))
+        return MemoryCalendar::Ptr();
+    return calendar;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(QStringLiteral("kalarm_calendarbench"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Benchmark KAlarm calendar loading, import, save and export."));
+    parser.addHelpOption();
+    const QCommandLineOption zoneOpt(QStringLiteral("timezone"), QStringLiteral("Time zone to load the calendar in."), QStringLiteral("zone"), QStringLiteral("Europe/London"));
+    const QCommandLineOption outputOpt(QStringLiteral("output"), QStringLiteral("File to write JSON results to (default: standard output)."), QStringLiteral("file"));
+    parser.addOption(zoneOpt);
+    parser.addOption(outputOpt);
+    parser.addPositionalArgument(QStringLiteral("calendar"), QStringLiteral("Calendar file to load."));
+    parser.process(app);
+    const QStringList args = parser.positionalArguments();
+    const QTimeZone zone(parser.value(zoneOpt).toLatin1());
+    if (args.count() != 1  ||  !zone.isValid())
+        parser.showHelp(1);
+    const QString file = args[0];
+    QTemporaryDir tempDir;
+    if (!tempDir.isValid())
+    {
+        QTextStream(stderr) << "Cannot create temporary directory\n";
+        return 1;
+    }
+
+    KACalendar::setProductId(KALARM_NAME, KALARM_VERSION);
+    CalFormat::setApplication(QStringLiteral(KALARM_NAME), QString::fromLatin1(KACalendar::icalProductId()));
+    QJsonObject results;
+    results[QStringLiteral("benchmark")] = QStringLiteral("calendar");
+    results[QStringLiteral("file")]      = file;
+    results[QStringLiteral("threads")]   = QThreadPool::globalInstance()->maxThreadCount();
+    const qint64 rssStart = Bench::residentMemoryKb();
+    QElapsedTimer timer;
+
+    // Load, as for the display calendar
+    Bench::resetPeakMemory();
+    timer.start();
+    MemoryCalendar::Ptr calendar = parse(file, zone);
+    const qint64 parseNs = timer.nsecsElapsed();
+    if (!calendar)
+    {
+        QTextStream(stderr) << "Error loading " << file << '\n';
+        return 1;
+    }
+    const Event::List kcalEvents = calendar->rawEvents();
+    timer.start();
+    KAEvent::List events = CalendarFile::readEvents(kcalEvents);
+    const qint64 constructNs = timer.nsecsElapsed();
+    QJsonObject load = phaseResult(parseNs + constructNs, events.count());
+    load[QStringLiteral("parseMs")]     = parseNs / 1000000.0;
+    load[QStringLiteral("constructMs")] = constructNs / 1000000.0;
+    load[QStringLiteral("bytesPerEvent")] = events.isEmpty() ? 0.0 : (Bench::residentMemoryKb() - rssStart) * 1024.0 / events.count();
+    results[QStringLiteral("load")] = load;
+
+    // Save, as for the display calendar
+    Bench::resetPeakMemory();
+    const QString saveName = tempDir.path() + QStringLiteral("/save.ics");
+    timer.start();
+    FileStorage::Ptr storage(new FileStorage(calendar, saveName, new ICalFormat));
+    const bool saved = storage->save();
+    QJsonObject save = phaseResult(timer.nsecsElapsed(), kcalEvents.count());
+    save[QStringLiteral("ok")] = saved;
+    save[QStringLiteral("bytes")] = static_cast<double>(QFileInfo(saveName).size());
+    results[QStringLiteral("save")] = save;
+
+    // Export the loaded alarms, serialising them in parallel chunks
+    Bench::resetPeakMemory();
+    const QString exportName = tempDir.path() + QStringLiteral("/export.ics");
+    timer.start();
+    QSaveFile exportFile(exportName);
+    bool exported = exportFile.open(QIODevice::WriteOnly);
+    int exportCount = 0;
+    if (exported)
+    {
+        QMap<QByteArray, QByteArray> timezones;
+        exportFile.write(CalendarFile::header(zone));
+        exported = CalendarFile::exportEvents(&exportFile, events, zone, &timezones, &exportCount);
+        exportFile.write("END:VCALENDAR\r\n");
+        exported = exportFile.commit()  &&  exported;
+    }
+    QJsonObject exprt = phaseResult(timer.nsecsElapsed(), exportCount);
+    exprt[QStringLiteral("ok")] = exported;
+    exprt[QStringLiteral("bytes")] = static_cast<double>(QFileInfo(exportName).size());
+    results[QStringLiteral("export")] = exprt;
+
+    qDeleteAll(events);
+    events.clear();
+    calendar->close();
+    calendar.clear();
+    storage.clear();
+
+    // Import, converting the events in parallel batches
+    Bench::resetPeakMemory();
+    timer.start();
+    KACalendar::Compat compat;
+    MemoryCalendar::Ptr importCal = parse(file, zone, &compat);
+    const qint64 importParseNs = timer.nsecsElapsed();
+    int imported = 0;
+    qint64 convertNs = 0;
+    if (importCal)
+    {
+        const Event::List importEvents = importCal->rawEvents();
+        QVector<CalendarFile::Batch> batches((importEvents.count() + IMPORT_BATCH_SIZE - 1) / IMPORT_BATCH_SIZE);
+        timer.start();
+        {
+            QThreadPool pool;
+            for (int b = 0, count = batches.count();  b < count;  ++b)
+                pool.start(new ConvertTask(importEvents, b * IMPORT_BATCH_SIZE, qMin((b + 1) * IMPORT_BATCH_SIZE, importEvents.count()), compat, &batches[b]));
+            pool.waitForDone();
+        }
+        convertNs = timer.nsecsElapsed();
+        for (int b = 0, count = batches.count();  b < count;  ++b)
+        {
+            for (CalendarFile::Batch::ConstIterator it = batches[b].constBegin();  it != batches[b].constEnd();  ++it)
+            {
+                imported += it.value().count();
+                qDeleteAll(it.value());
+            }
+        }
+        importCal->close();
+    }
+    QJsonObject import = phaseResult(importParseNs + convertNs, imported);
+    import[QStringLiteral("parseMs")]   = importParseNs / 1000000.0;
+    import[QStringLiteral("convertMs")] = convertNs / 1000000.0;
+    results[QStringLiteral("import")] = import;
+
+    if (!Bench::writeJson(results, parser.value(outputOpt)))
+    {
+        QTextStream(stderr) << "Error writing " << parser.value(outputOpt) << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+// vim: et sw=4:
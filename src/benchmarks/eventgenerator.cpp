@@ -0,0 +1,204 @@
+/*
+ *  eventgenerator.cpp  -  generates synthetic alarms for benchmarks
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "eventgenerator.h"
+
+#include <kalarmcal/karecurrence.h>
+#include <kalarmcal/repetition.h>
+
+#include <KCalCore/Person>
+
+#include <QBitArray>
+#include <QColor>
+#include <QFont>
+#include <QStringList>
+
+namespace
+{
+struct MixField
+{
+    const char*         name;
+    int EventGenerator::Mix::* field;
+};
+const MixField mixFields[] = {
+    { "once",       &EventGenerator::Mix::once },
+    { "minutely",   &EventGenerator::Mix::minutely },
+    { "daily",      &EventGenerator::Mix::daily },
+    { "weekly",     &EventGenerator::Mix::weekly },
+    { "monthly",    &EventGenerator::Mix::monthly },
+    { "yearly",     &EventGenerator::Mix::yearly },
+    { "reminder",   &EventGenerator::Mix::reminder },
+    { "deferral",   &EventGenerator::Mix::deferral },
+    { "worktime",   &EventGenerator::Mix::workTime },
+    { "holidays",   &EventGenerator::Mix::holidays },
+    { "repetition", &EventGenerator::Mix::repetition },
+    { "command",    &EventGenerator::Mix::command },
+    { "email",      &EventGenerator::Mix::email },
+    { "audio",      &EventGenerator::Mix::audio }
+};
+const int mixFieldCount = sizeof(mixFields) / sizeof(mixFields[0]);
+}
+
+
+EventGenerator::Mix::Mix()
+    : once(40), minutely(5), daily(25), weekly(15), monthly(10), yearly(5),
+      reminder(20), deferral(5), workTime(10), holidays(10), repetition(10),
+      command(10), email(5), audio(5)
+{
+}
+
+EventGenerator::EventGenerator(const KDateTime& start, int spanDays, quint32 seed)
+    : mRandom(seed),
+      mStart(start),
+      mSpanDays(qMax(spanDays, 1)),
+      mCount(0)
+{
+    mStart.setTime(QTime(mStart.time().hour(), mStart.time().minute(), 0));
+}
+
+/******************************************************************************
+* Parse a mix specification, e.g. "once=50,daily=50,reminder=0".
+*/
+bool EventGenerator::parseMix(const QString& spec, Mix& mix)
+{
+    const QStringList items = spec.split(QLatin1Char(','), QString::SkipEmptyParts);
+    for (int i = 0, count = items.count();  i < count;  ++i)
+    {
+        const QStringList parts = items[i].split(QLatin1Char('='));
+        if (parts.count() != 2)
+            return false;
+        bool ok;
+        const int value = parts[1].trimmed().toInt(&ok);
+        if (!ok  ||  value < 0)
+            return false;
+        const QString name = parts[0].trimmed();
+        int f = 0;
+        for ( ;  f < mixFieldCount;  ++f)
+        {
+            if (name == QLatin1String(mixFields[f].name))
+            {
+                mix.*(mixFields[f].field) = value;
+                break;
+            }
+        }
+        if (f >= mixFieldCount)
+            return false;
+    }
+    return mix.once + mix.minutely + mix.daily + mix.weekly + mix.monthly + mix.yearly > 0;
+}
+
+QJsonObject EventGenerator::mixToJson(const Mix& mix)
+{
+    QJsonObject obj;
+    for (int f = 0;  f < mixFieldCount;  ++f)
+        obj[QLatin1String(mixFields[f].name)] = mix.*(mixFields[f].field);
+    return obj;
+}
+
+/******************************************************************************
+* Generate an alarm. Its start time is spread randomly over the configured
+* span of days, and its type and options are chosen according to the mix.
+*/
+KAEvent EventGenerator::generate(CalEvent::Type type, Akonadi::Collection::Id collectionId)
+{
+    ++mCount;
+    const KDateTime dt = mStart.addSecs(static_cast<qint64>(random(mSpanDays * 24 * 60)) * 60);
+
+    KAEvent::SubAction action = KAEvent::MESSAGE;
+    QString text = QStringLiteral("Synthetic alarm %1").arg(mCount);
+    const int actionType = percent();
+    if (actionType < mMix.command)
+    {
+        action = KAEvent::COMMAND;
+        text = QStringLiteral("echo %1").arg(mCount);
+    }
+    else if (actionType < mMix.command + mMix.email)
+        action = KAEvent::EMAIL;
+    else if (actionType < mMix.command + mMix.email + mMix.audio)
+    {
+        action = KAEvent::AUDIO;
+        text = QStringLiteral("/usr/share/sounds/alarm.ogg");
+    }
+    KAEvent::Flags flags;
+    if (action == KAEvent::MESSAGE)
+        flags |= KAEvent::DEFAULT_FONT;
+
+    KAEvent event(dt, text, QColor(Qt::yellow), QColor(Qt::black), QFont(), action, 0, flags, true);
+    if (action == KAEvent::EMAIL)
+    {
+        KCalCore::Person::List addressees;
+        addressees += KCalCore::Person::Ptr(new KCalCore::Person(QStringLiteral("Test User"), QStringLiteral("user@example.com")));
+        event.setEmail(0, addressees, QStringLiteral("Alarm %1").arg(mCount), QStringList());
+    }
+    setRecurrence(event);
+    if (event.recurs())
+    {
+        if (percent() < mMix.repetition  &&  event.recurType() != KARecurrence::MINUTELY)
+            event.setRepetition(Repetition(KCalCore::Duration(10 * 60), 2));
+        if (percent() < mMix.workTime)
+            event.setWorkTimeOnly(true);
+        if (percent() < mMix.holidays)
+            event.setExcludeHolidays(true);
+    }
+    if (action == KAEvent::MESSAGE  &&  percent() < mMix.reminder)
+        event.setReminder(15 * (1 + random(4)), false);
+    event.setCategory(type);
+    event.setEventId(QStringLiteral("bench-%1").arg(mCount));
+    event.setCollectionId(collectionId);
+    event.endChanges();
+
+    if (percent() < mMix.deferral)
+        event.defer(DateTime(dt.addSecs(60 * (5 + random(60)))), false, false);
+    return event;
+}
+
+/******************************************************************************
+* Set a random recurrence, weighted according to the mix.
+*/
+void EventGenerator::setRecurrence(KAEvent& event)
+{
+    const int total = mMix.once + mMix.minutely + mMix.daily + mMix.weekly + mMix.monthly + mMix.yearly;
+    int r = random(total);
+    if ((r -= mMix.once) < 0)
+        return;
+    const QDate date = event.startDateTime().date();
+    if ((r -= mMix.minutely) < 0)
+        event.setRecurMinutely(15 * (1 + random(8)), 0, KDateTime());
+    else if ((r -= mMix.daily) < 0)
+        event.setRecurDaily(1, QBitArray(7, true), 0, QDate());
+    else if ((r -= mMix.weekly) < 0)
+    {
+        QBitArray days(7);
+        days.setBit(date.dayOfWeek() - 1);
+        event.setRecurWeekly(1, days, 0, QDate());
+    }
+    else if ((r -= mMix.monthly) < 0)
+        event.setRecurMonthlyByDate(1, QVector<int>(1, date.day()), 0, QDate());
+    else
+        event.setRecurAnnualByDate(1, QVector<int>(1, date.month()), 0, KARecurrence::defaultFeb29Type(), 0, QDate());
+}
+
+int EventGenerator::random(int max)
+{
+    if (max <= 1)
+        return 0;
+    return std::uniform_int_distribution<int>(0, max - 1)(mRandom);
+}
+
+// vim: et sw=4:
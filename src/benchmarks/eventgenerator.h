@@ -0,0 +1,79 @@
+/*
+ *  eventgenerator.h  -  generates synthetic alarms for benchmarks
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef EVENTGENERATOR_H
+#define EVENTGENERATOR_H
+
+#include <kalarmcal/kaevent.h>
+
+#include <KDateTime>
+
+#include <QJsonObject>
+
+#include <random>
+
+using namespace KAlarmCal;
+
+/*=============================================================================
+= Class EventGenerator
+= Generates a reproducible sequence of synthetic alarms, with a configurable
+= mix of recurrence types and alarm options.
+=============================================================================*/
+class EventGenerator
+{
+    public:
+        /** Relative weights of recurrence types, and percentages of alarms
+         *  which have each option. */
+        struct Mix
+        {
+            Mix();
+            int once, minutely, daily, weekly, monthly, yearly;     // weights
+            int reminder, deferral, workTime, holidays, repetition; // percentages
+            int command, email, audio;   // percentages of non-display alarms
+        };
+
+        EventGenerator(const KDateTime& start, int spanDays, quint32 seed = 1);
+        void        setMix(const Mix& mix)   { mMix = mix; }
+        const Mix&  mix() const              { return mMix; }
+
+        /** Parse a mix specification of the form "name=value,name=value...".
+         *  Names which are not specified keep their default values.
+         *  Reply = false if the specification is invalid. */
+        static bool parseMix(const QString& spec, Mix& mix);
+        static QJsonObject mixToJson(const Mix& mix);
+
+        /** Generate the next alarm, with a unique event ID and the given
+         *  collection ID. */
+        KAEvent     generate(CalEvent::Type type = CalEvent::ACTIVE, Akonadi::Collection::Id collectionId = 1);
+
+    private:
+        int         random(int max);     // random number in range 0..max-1
+        int         percent()            { return random(100); }
+        void        setRecurrence(KAEvent&);
+
+        std::mt19937 mRandom;
+        Mix          mMix;
+        KDateTime    mStart;      // earliest alarm start time
+        int          mSpanDays;   // alarm start times are spread over this many days
+        int          mCount;      // number of alarms generated so far
+};
+
+#endif // EVENTGENERATOR_H
+
+// vim: et sw=4:
@@ -0,0 +1,114 @@
+/*
+ *  gencalendar.cpp  -  generates synthetic KAlarm calendar files
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Writes an iCalendar file containing any number of synthetic alarms, in the
+ * format written by KAlarm, including its X-KDE-KALARM-* properties (see
+ * DESIGN.html). The alarms are generated with the same mix options as the
+ * scheduler benchmark, and a proportion of them may be archived alarms.
+ */
+
+#include "kalarm.h"
+#include "eventgenerator.h"
+
+#include <kalarmcal/kacalendar.h>
+
+#include <KCalCore/FileStorage>
+#include <KCalCore/ICalFormat>
+#include <KCalCore/MemoryCalendar>
+#include <ksystemtimezone.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QTextStream>
+#include <QTimeZone>
+
+#include <random>
+
+using namespace KCalCore;
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(QStringLiteral("kalarm_gencalendar"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Generate a synthetic KAlarm calendar file."));
+    parser.addHelpOption();
+    const QCommandLineOption eventsOpt(QStringLiteral("events"), QStringLiteral("Number of alarms to generate."), QStringLiteral("count"), QStringLiteral("10000"));
+    const QCommandLineOption archivedOpt(QStringLiteral("archived"), QStringLiteral("Percentage of alarms which are archived."), QStringLiteral("percent"), QStringLiteral("20"));
+    const QCommandLineOption daysOpt(QStringLiteral("days"), QStringLiteral("Number of days over which alarm start times are spread."), QStringLiteral("days"), QStringLiteral("365"));
+    const QCommandLineOption seedOpt(QStringLiteral("seed"), QStringLiteral("Random number seed."), QStringLiteral("seed"), QStringLiteral("1"));
+    const QCommandLineOption mixOpt(QStringLiteral("mix"), QStringLiteral("Alarm mix, as for kalarm_schedulerbench."), QStringLiteral("spec"));
+    const QCommandLineOption zoneOpt(QStringLiteral("timezone"), QStringLiteral("Time zone of the alarms."), QStringLiteral("zone"), QStringLiteral("Europe/London"));
+    parser.addOption(eventsOpt);
+    parser.addOption(archivedOpt);
+    parser.addOption(daysOpt);
+    parser.addOption(seedOpt);
+    parser.addOption(mixOpt);
+    parser.addOption(zoneOpt);
+    parser.addPositionalArgument(QStringLiteral("file"), QStringLiteral("Calendar file to write."));
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    const int count    = parser.value(eventsOpt).toInt();
+    const int archived = parser.value(archivedOpt).toInt();
+    const QTimeZone zone(parser.value(zoneOpt).toLatin1());
+    if (args.count() != 1  ||  count <= 0  ||  archived < 0  ||  archived > 100  ||  !zone.isValid())
+        parser.showHelp(1);
+    EventGenerator::Mix mix;
+    if (parser.isSet(mixOpt)  &&  !EventGenerator::parseMix(parser.value(mixOpt), mix))
+    {
+        QTextStream(stderr) << "Invalid --mix specification\n";
+        return 1;
+    }
+
+    KACalendar::setProductId(KALARM_NAME, KALARM_VERSION);
+    CalFormat::setApplication(QStringLiteral(KALARM_NAME), QString::fromLatin1(KACalendar::icalProductId()));
+
+    const quint32 seed = parser.value(seedOpt).toUInt();
+    const KDateTime start(QDate(2017, 1, 2), QTime(9, 0), KDateTime::Spec(KSystemTimeZones::zone(QString::fromLatin1(zone.id()))));
+    EventGenerator generator(start, parser.value(daysOpt).toInt(), seed);
+    generator.setMix(mix);
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> percent(0, 99);
+
+    MemoryCalendar::Ptr calendar(new MemoryCalendar(zone));
+    KACalendar::setKAlarmVersion(calendar);
+    for (int i = 0;  i < count;  ++i)
+    {
+        const CalEvent::Type type = (percent(random) < archived) ? CalEvent::ARCHIVED : CalEvent::ACTIVE;
+        const KAEvent event = generator.generate(type);
+        Event::Ptr kcalEvent(new Event);
+        kcalEvent->setUid(CalEvent::uid(event.id(), type));
+        event.updateKCalEvent(kcalEvent, KAEvent::UID_IGNORE);
+        calendar->addEvent(kcalEvent);
+    }
+
+    FileStorage::Ptr storage(new FileStorage(calendar, args[0], new ICalFormat));
+    if (!storage->save())
+    {
+        QTextStream(stderr) << "Error writing " << args[0] << '\n';
+        return 1;
+    }
+    calendar->close();
+    return 0;
+}
+
+// vim: et sw=4:
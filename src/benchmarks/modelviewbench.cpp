@@ -0,0 +1,433 @@
+/*
+ *  modelviewbench.cpp  -  benchmark for the alarm list model and view
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Feeds a mock entity tree of synthetic alarms into an AlarmListModel, shown
+ * in an AlarmListView painted by AlarmListDelegate, as in the main window, and
+ * times:
+ *   populate:   insertion of the alarms, in batches as the Akonadi entity tree
+ *               model inserts fetched items
+ *   sort:       sorting by each column
+ *   timeTo:     the per-minute time-to-alarm refresh (AkonadiModel::slotUpdateTimeTo)
+ *   filter:     hiding and showing archived alarms
+ *   paint:      painting the whole view
+ * AkonadiModel itself needs an Akonadi server, so the mock model stands in for
+ * it, storing the alarms as Akonadi items with KAEvent payloads, and takes the
+ * alarm data for each item from AkonadiModel::eventData(). The program runs
+ * with the offscreen platform plugin unless QT_QPA_PLATFORM is set.
+ */
+
+#include "akonadimodel.h"
+#include "alarmlistdelegate.h"
+#include "alarmlistview.h"
+#include "itemlistmodel.h"
+#include "benchutil.h"
+#include "eventgenerator.h"
+
+#include <kalarmcal/collectionattribute.h>
+#include <kalarmcal/kacalendar.h>
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QItemSelectionModel>
+#include <QTextStream>
+
+using namespace Akonadi;
+
+namespace
+{
+
+/*=============================================================================
+= Class MockEntityTreeModel
+= Stand-in for AkonadiModel, containing one collection with alarm items.
+=============================================================================*/
+class MockEntityTreeModel : public QAbstractItemModel
+{
+    public:
+        MockEntityTreeModel();
+        void addEvents(const QVector<KAEvent>& events, int batchSize);
+        void updateTimeTo();
+        QModelIndex collectionIndex() const  { return createIndex(0, 0, COLLECTION); }
+
+        QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override;
+        QModelIndex parent(const QModelIndex&) const override;
+        int      rowCount(const QModelIndex& parent = QModelIndex()) const override;
+        int      columnCount(const QModelIndex& = QModelIndex()) const override  { return AkonadiModel::ColumnCount; }
+        QVariant data(const QModelIndex&, int role = Qt::DisplayRole) const override;
+        QVariant headerData(int section, Qt::Orientation, int role = Qt::DisplayRole) const override;
+
+    private:
+        enum { COLLECTION = 0, ITEM = 1 };   // internal IDs of indexes
+        QVariant itemData(const QModelIndex&, int role) const;
+        KAEvent  event(const Item&) const;
+
+        Collection           mCollection;
+        QVector<Item>        mItems;
+        QHash<Item::Id, int> mRows;     // row of each item, by item ID
+};
+
+MockEntityTreeModel::MockEntityTreeModel()
+    : mCollection(1)
+{
+    const CalEvent::Types types = CalEvent::ACTIVE | CalEvent::ARCHIVED;
+    mCollection.setName(QStringLiteral("Alarms"));
+    mCollection.setContentMimeTypes(CalEvent::mimeTypes(types));
+    mCollection.attribute<CollectionAttribute>(Collection::AddIfMissing)->setEnabled(types);
+}
+
+/******************************************************************************
+* Add alarms to the collection, in batches.
+*/
+void MockEntityTreeModel::addEvents(const QVector<KAEvent>& events, int batchSize)
+{
+    const QModelIndex parent = collectionIndex();
+    for (int start = 0, count = events.count();  start < count;  start += batchSize)
+    {
+        const int end = qMin(start + batchSize, count);
+        beginInsertRows(parent, mItems.count(), mItems.count() + end - start - 1);
+        for (int i = start;  i < end;  ++i)
+        {
+            Item item(mItems.count() + 1);
+            item.setMimeType(CalEvent::mimeType(events[i].category()));
+            item.setParentCollection(mCollection);
+            item.setPayload<KAEvent>(events[i]);
+            mRows.insert(item.id(), mItems.count());
+            mItems += item;
+        }
+        endInsertRows();
+    }
+}
+
+/******************************************************************************
+* Signal that the time-to-alarm values have changed, in the same way as
+* AkonadiModel::signalDataChanged().
+*/
+void MockEntityTreeModel::updateTimeTo()
+{
+    const QModelIndex parent = collectionIndex();
+    int start = -1;
+    int end   = -1;
+    for (int row = 0, count = mItems.count();  row < count;  ++row)
+    {
+        if (mItems[row].mimeType() == KAlarmCal::MIME_ACTIVE)
+        {
+            if (start < 0)
+                start = row;
+            end = row;
+            continue;
+        }
+        if (start >= 0)
+            Q_EMIT dataChanged(index(start, AkonadiModel::TimeToColumn, parent), index(end, AkonadiModel::TimeToColumn, parent));
+        start = -1;
+    }
+    if (start >= 0)
+        Q_EMIT dataChanged(index(start, AkonadiModel::TimeToColumn, parent), index(end, AkonadiModel::TimeToColumn, parent));
+}
+
+QModelIndex MockEntityTreeModel::index(int row, int column, const QModelIndex& parent) const
+{
+    if (column < 0  ||  column >= AkonadiModel::ColumnCount)
+        return QModelIndex();
+    if (!parent.isValid())
+        return (row == 0) ? createIndex(0, column, COLLECTION) : QModelIndex();
+    if (parent.internalId() != COLLECTION  ||  row < 0  ||  row >= mItems.count())
+        return QModelIndex();
+    return createIndex(row, column, ITEM);
+}
+
+QModelIndex MockEntityTreeModel::parent(const QModelIndex& index) const
+{
+    if (index.isValid()  &&  index.internalId() == ITEM)
+        return collectionIndex();
+    return QModelIndex();
+}
+
+int MockEntityTreeModel::rowCount(const QModelIndex& parent) const
+{
+    if (!parent.isValid())
+        return 1;
+    if (parent.internalId() == COLLECTION  &&  parent.column() == 0)
+        return mItems.count();
+    return 0;
+}
+
+QVariant MockEntityTreeModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    // Proxy models request header data with the header group added to the role
+    role %= EntityTreeModel::TerminalUserRole;
+    if (orientation != Qt::Horizontal  ||  role != Qt::DisplayRole)
+        return QVariant();
+    switch (section)
+    {
+        case AkonadiModel::TimeColumn:    return QStringLiteral("Time");
+        case AkonadiModel::TimeToColumn:  return QStringLiteral("Time To");
+        case AkonadiModel::RepeatColumn:  return QStringLiteral("Repeat");
+        case AkonadiModel::ColourColumn:  return QString();
+        case AkonadiModel::TypeColumn:    return QString();
+        case AkonadiModel::TextColumn:    return QStringLiteral("Message, File or Command");
+        default:                          return QVariant();
+    }
+}
+
+QVariant MockEntityTreeModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+    if (index.internalId() == COLLECTION)
+    {
+        switch (role)
+        {
+            case Qt::DisplayRole:                   return mCollection.name();
+            case EntityTreeModel::CollectionRole:   return QVariant::fromValue(mCollection);
+            case EntityTreeModel::CollectionIdRole: return mCollection.id();
+            case EntityTreeModel::MimeTypeRole:     return Collection::mimeType();
+            default:                                return QVariant();
+        }
+    }
+    return itemData(index, role);
+}
+
+/******************************************************************************
+* Return the data for an item, in the same way as AkonadiModel::data().
+* The event is extracted from the item payload for each call.
+*/
+QVariant MockEntityTreeModel::itemData(const QModelIndex& index, int role) const
+{
+    const Item& item = mItems[index.row()];
+    switch (role)
+    {
+        case EntityTreeModel::ItemRole:             return QVariant::fromValue(item);
+        case EntityTreeModel::ItemIdRole:           return item.id();
+        case EntityTreeModel::MimeTypeRole:         return item.mimeType();
+        case EntityTreeModel::ParentCollectionRole: return QVariant::fromValue(mCollection);
+        case AkonadiModel::StatusRole:
+            return (item.mimeType() == KAlarmCal::MIME_ACTIVE) ? CalEvent::ACTIVE : CalEvent::ARCHIVED;
+        case Qt::BackgroundRole:
+        case Qt::ForegroundRole:
+        case Qt::DisplayRole:
+        case Qt::TextAlignmentRole:
+        case Qt::DecorationRole:
+        case Qt::SizeHintRole:
+        case Qt::AccessibleTextRole:
+        case Qt::ToolTipRole:
+        case AkonadiModel::SortRole:
+        case AkonadiModel::ValueRole:
+        case AkonadiModel::AlarmActionsRole:
+        case AkonadiModel::AlarmSubActionRole:
+        case AkonadiModel::EnabledRole:
+            break;
+        default:
+            return QVariant();
+    }
+
+    const KAEvent event = this->event(item);
+    if (!event.isValid())
+        return QVariant();
+    bool calendarColour = false;   // ignored, since the collection has no background colour
+    return AkonadiModel::eventData(event, index.column(), role, &calendarColour);
+}
+
+/******************************************************************************
+* Return the event held by an item, as AkonadiModel::event() does, including
+* its look-up of the item's index.
+*/
+KAEvent MockEntityTreeModel::event(const Item& item) const
+{
+    if (!item.isValid()  ||  !item.hasPayload<KAEvent>()  ||  !mRows.contains(item.id()))
+        return KAEvent();
+    KAEvent e = item.payload<KAEvent>();
+    if (e.isValid())
+        e.setCollectionId_const(mCollection.id());
+    return e;
+}
+
+/*=============================================================================
+= Class Timing
+= Accumulates the times taken by repetitions of an operation.
+=============================================================================*/
+class Timing
+{
+    public:
+        void     start()   { mTimer.start(); }
+        void     stop()    { mSamples += mTimer.nsecsElapsed() / 1000; }
+        QJsonObject result()
+        {
+            QJsonObject obj = Bench::percentiles(mSamples);
+            qint64 total = 0;
+            for (int i = 0, count = mSamples.count();  i < count;  ++i)
+                total += mSamples[i];
+            obj[QStringLiteral("meanUs")] = mSamples.isEmpty() ? 0.0 : static_cast<double>(total) / mSamples.count();
+            return obj;
+        }
+    private:
+        QElapsedTimer   mTimer;
+        QVector<qint64> mSamples;   // microseconds
+};
+
+}
+
+int main(int argc, char** argv)
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+    app.setApplicationName(QStringLiteral("kalarm_modelviewbench"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Benchmark the KAlarm alarm list model and view."));
+    parser.addHelpOption();
+    const QCommandLineOption eventsOpt(QStringLiteral("events"), QStringLiteral("Number of alarms in the model."), QStringLiteral("count"), QStringLiteral("10000"));
+    const QCommandLineOption archivedOpt(QStringLiteral("archived"), QStringLiteral("Percentage of alarms which are archived."), QStringLiteral("percent"), QStringLiteral("20"));
+    const QCommandLineOption batchOpt(QStringLiteral("batch"), QStringLiteral("Number of alarms inserted into the model at a time."), QStringLiteral("count"), QStringLiteral("100"));
+    const QCommandLineOption iterationsOpt(QStringLiteral("iterations"), QStringLiteral("Number of times to repeat each operation."), QStringLiteral("count"), QStringLiteral("5"));
+    const QCommandLineOption seedOpt(QStringLiteral("seed"), QStringLiteral("Random number seed."), QStringLiteral("seed"), QStringLiteral("1"));
+    const QCommandLineOption outputOpt(QStringLiteral("output"), QStringLiteral("File to write JSON results to (default: standard output)."), QStringLiteral("file"));
+    parser.addOption(eventsOpt);
+    parser.addOption(archivedOpt);
+    parser.addOption(batchOpt);
+    parser.addOption(iterationsOpt);
+    parser.addOption(seedOpt);
+    parser.addOption(outputOpt);
+    parser.process(app);
+    const int count      = parser.value(eventsOpt).toInt();
+    const int archived   = parser.value(archivedOpt).toInt();
+    const int batch      = parser.value(batchOpt).toInt();
+    const int iterations = parser.value(iterationsOpt).toInt();
+    if (count <= 0  ||  archived < 0  ||  archived > 100  ||  batch <= 0  ||  iterations <= 0)
+        parser.showHelp(1);
+
+    // Generate the alarms
+    const quint32 seed = parser.value(seedOpt).toUInt();
+    EventGenerator generator(KDateTime::currentUtcDateTime(), 365, seed);
+    QVector<KAEvent> events;
+    events.reserve(count);
+    for (int i = 0;  i < count;  ++i)
+        events += generator.generate((i * 100 / count < archived) ? CalEvent::ARCHIVED : CalEvent::ACTIVE);
+
+    // Set up the model and view, sorted by time as in AlarmListModel::all(),
+    // with the mock model's collection enabled in place of Akonadi's.
+    MockEntityTreeModel source;
+    QItemSelectionModel selection(&source);
+    selection.select(source.collectionIndex(), QItemSelectionModel::Select);
+    ItemListModel::setItemSource(&source, &selection);
+    AlarmListModel model;
+    model.sort(AlarmListModel::TimeColumn, Qt::AscendingOrder);
+    AlarmListView view("ModelViewBench");
+    view.setItemDelegate(new AlarmListDelegate(&view));
+    view.setModel(&model);
+    view.resize(1280, 1024);
+    view.show();
+    app.processEvents();
+
+    QJsonObject results;
+    results[QStringLiteral("benchmark")] = QStringLiteral("modelview");
+    results[QStringLiteral("events")]    = count;
+    results[QStringLiteral("archived")]  = archived;
+
+    const qint64 rssBefore = Bench::residentMemoryKb();
+    Timing populate;
+    populate.start();
+    source.addEvents(events, batch);
+    app.processEvents();
+    populate.stop();
+    QJsonObject populateResult = populate.result();
+    populateResult[QStringLiteral("rows")] = model.rowCount();
+    populateResult[QStringLiteral("bytesPerEvent")] = (Bench::residentMemoryKb() - rssBefore) * 1024.0 / count;
+    results[QStringLiteral("populate")] = populateResult;
+    events.clear();
+
+    // Sort by each column, in both directions
+    const char* columnNames[AlarmListModel::ColumnCount] = { "time", "timeTo", "repeat", "colour", "type", "text" };
+    QJsonObject sort;
+    for (int column = 0;  column < AlarmListModel::ColumnCount;  ++column)
+    {
+        Timing timing;
+        for (int i = 0;  i < iterations;  ++i)
+        {
+            timing.start();
+            view.sortByColumn(column, (i % 2) ? Qt::DescendingOrder : Qt::AscendingOrder);
+            app.processEvents();
+            timing.stop();
+        }
+        sort[QLatin1String(columnNames[column])] = timing.result();
+    }
+    results[QStringLiteral("sort")] = sort;
+
+    // Per-minute time-to-alarm refresh, when sorted by time and by time-to
+    QJsonObject timeTo;
+    const int timeToColumns[2] = { AlarmListModel::TimeColumn, AlarmListModel::TimeToColumn };
+    for (int c = 0;  c < 2;  ++c)
+    {
+        view.sortByColumn(timeToColumns[c], Qt::AscendingOrder);
+        app.processEvents();
+        Timing timing;
+        for (int i = 0;  i < iterations;  ++i)
+        {
+            timing.start();
+            source.updateTimeTo();
+            app.processEvents();
+            timing.stop();
+        }
+        timeTo[(c == 0) ? QStringLiteral("sortedByTime") : QStringLiteral("sortedByTimeTo")] = timing.result();
+    }
+    results[QStringLiteral("timeTo")] = timeTo;
+
+    // Show archived alarms toggle
+    view.sortByColumn(AlarmListModel::TimeColumn, Qt::AscendingOrder);
+    app.processEvents();
+    Timing hideArchived;
+    Timing showArchived;
+    for (int i = 0;  i < iterations;  ++i)
+    {
+        hideArchived.start();
+        model.setEventTypeFilter(CalEvent::ACTIVE);
+        app.processEvents();
+        hideArchived.stop();
+        showArchived.start();
+        model.setEventTypeFilter(CalEvent::ACTIVE | CalEvent::ARCHIVED);
+        app.processEvents();
+        showArchived.stop();
+    }
+    QJsonObject filter;
+    filter[QStringLiteral("hideArchived")] = hideArchived.result();
+    filter[QStringLiteral("showArchived")] = showArchived.result();
+    results[QStringLiteral("filter")] = filter;
+
+    // Paint the whole viewport
+    QImage image(view.viewport()->size(), QImage::Format_ARGB32_Premultiplied);
+    Timing paint;
+    for (int i = 0;  i < iterations;  ++i)
+    {
+        paint.start();
+        view.viewport()->render(&image);
+        paint.stop();
+    }
+    results[QStringLiteral("paint")] = paint.result();
+
+    if (!Bench::writeJson(results, parser.value(outputOpt)))
+    {
+        QTextStream(stderr) << "Error writing " << parser.value(outputOpt) << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+// vim: et sw=4:
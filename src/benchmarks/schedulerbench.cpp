@@ -0,0 +1,258 @@
+/*
+ *  schedulerbench.cpp  -  benchmark for the alarm scheduler, using simulated time
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Generates a synthetic calendar in memory, and then drives the scheduler over
+ * a number of simulated days, advancing a virtual clock in fixed steps. The
+ * results are written as JSON:
+ *   setup:     time to generate the alarms and to compute their first triggers
+ *   run:       number of alarms handled and dispatched, number skipped because
+ *              they failed or were not rescheduled, and queue throughput
+ *   latency:   wall clock time to handle each trigger (microseconds), and how
+ *              late each trigger was handled in virtual time (seconds)
+ *   memory:    resident memory per event
+ */
+
+#include "benchutil.h"
+#include "eventgenerator.h"
+#include "memoryeventstore.h"
+#include "recordingdispatcher.h"
+#include "scheduler.h"
+
+#include <KHolidays/HolidayRegion>
+
+#include <QBitArray>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTextStream>
+
+namespace
+{
+
+/*=============================================================================
+= Class SimulatedClock
+= Virtual clock which is advanced explicitly by the benchmark.
+=============================================================================*/
+class SimulatedClock : public SchedulerClock
+{
+    public:
+        explicit SimulatedClock(const KDateTime& start) : mNow(start.toUtc()) {}
+        KDateTime currentUtcDateTime() const override  { return mNow; }
+        void      advance(int secs)                    { mNow = mNow.addSecs(secs); }
+
+    private:
+        KDateTime mNow;
+};
+
+struct Options
+{
+    int     events;
+    int     days;
+    int     step;       // seconds
+    quint32 seed;
+    QString holidayRegion;
+    QString output;
+    EventGenerator::Mix mix;
+};
+
+bool parseOptions(QCoreApplication& app, Options& opts)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Benchmark the KAlarm scheduler over simulated days."));
+    parser.addHelpOption();
+    const QCommandLineOption eventsOpt(QStringLiteral("events"), QStringLiteral("Number of alarms to generate."), QStringLiteral("count"), QStringLiteral("10000"));
+    const QCommandLineOption daysOpt(QStringLiteral("days"), QStringLiteral("Number of days to simulate."), QStringLiteral("days"), QStringLiteral("7"));
+    const QCommandLineOption stepOpt(QStringLiteral("step"), QStringLiteral("Virtual clock step in seconds."), QStringLiteral("seconds"), QStringLiteral("60"));
+    const QCommandLineOption seedOpt(QStringLiteral("seed"), QStringLiteral("Random number seed."), QStringLiteral("seed"), QStringLiteral("1"));
+    const QCommandLineOption mixOpt(QStringLiteral("mix"), QStringLiteral("Alarm mix, e.g. once=40,daily=25,weekly=15,monthly=10,yearly=5,minutely=5,reminder=20,deferral=5,worktime=10,holidays=10,repetition=10,command=10,email=5,audio=5"), QStringLiteral("spec"));
+    const QCommandLineOption holidaysOpt(QStringLiteral("holiday-region"), QStringLiteral("Holiday region code used for holiday exclusions."), QStringLiteral("code"), QStringLiteral("gb-eaw_en-gb"));
+    const QCommandLineOption outputOpt(QStringLiteral("output"), QStringLiteral("File to write JSON results to (default: standard output)."), QStringLiteral("file"));
+    parser.addOption(eventsOpt);
+    parser.addOption(daysOpt);
+    parser.addOption(stepOpt);
+    parser.addOption(seedOpt);
+    parser.addOption(mixOpt);
+    parser.addOption(holidaysOpt);
+    parser.addOption(outputOpt);
+    parser.process(app);
+
+    opts.events        = parser.value(eventsOpt).toInt();
+    opts.days          = parser.value(daysOpt).toInt();
+    opts.step          = parser.value(stepOpt).toInt();
+    opts.seed          = parser.value(seedOpt).toUInt();
+    opts.holidayRegion = parser.value(holidaysOpt);
+    opts.output        = parser.value(outputOpt);
+    if (opts.events <= 0  ||  opts.days <= 0  ||  opts.step <= 0)
+    {
+        QTextStream(stderr) << "Invalid --events, --days or --step value\n";
+        return false;
+    }
+    if (parser.isSet(mixOpt)  &&  !EventGenerator::parseMix(parser.value(mixOpt), opts.mix))
+    {
+        QTextStream(stderr) << "Invalid --mix specification\n";
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(QStringLiteral("kalarm_schedulerbench"));
+    Options opts;
+    if (!parseOptions(app, opts))
+        return 1;
+
+    // Set up working hours and holidays as KAlarm does at start-up
+    const KHolidays::HolidayRegion holidays(opts.holidayRegion);
+    QBitArray workDays(7);
+    for (int i = 0;  i < 5;  ++i)
+        workDays.setBit(i);
+    KAEvent::setStartOfDay(QTime(0, 0));
+    KAEvent::setWorkTime(workDays, QTime(9, 0), QTime(17, 0));
+    KAEvent::setHolidays(holidays);
+
+    const KDateTime start(QDate(2017, 1, 2), QTime(0, 0), KDateTime::UTC);
+    SimulatedClock clock(start);
+    MemoryEventStore store;
+    RecordingDispatcher dispatcher;
+    Scheduler scheduler(&store, &dispatcher, &clock);
+    dispatcher.setScheduler(&scheduler);
+
+    // Generate the calendar. Adding each alarm to the store computes its
+    // first trigger time.
+    const qint64 rssBefore = Bench::residentMemoryKb();
+    EventGenerator generator(start, opts.days);
+    generator.setMix(opts.mix);
+    QElapsedTimer timer;
+    qint64 generateNs = 0;
+    qint64 indexNs = 0;
+    for (int i = 0;  i < opts.events;  ++i)
+    {
+        timer.start();
+        const KAEvent event = generator.generate();
+        generateNs += timer.nsecsElapsed();
+        timer.start();
+        store.addEvent(event);
+        indexNs += timer.nsecsElapsed();
+    }
+    const qint64 rssAfter = Bench::residentMemoryKb();
+
+    // Run the scheduler over the simulated days
+    QVector<qint64> handleUs;
+    QVector<qint64> latenessSecs;
+    int handled = 0;
+    int skipped = 0;
+    qint64 runNs = 0;
+    const int steps = static_cast<int>(static_cast<qint64>(opts.days) * 24 * 3600 / opts.step);
+    for (int s = 0;  s < steps;  ++s)
+    {
+        clock.advance(opts.step);
+        const KDateTime now = clock.currentUtcDateTime();
+        for (;;)
+        {
+            KAEvent* event = store.earliestAlarm();
+            if (!event)
+                break;
+            const KDateTime due = event->nextTrigger(KAEvent::ALL_TRIGGER).effectiveKDateTime();
+            if (due > now)
+                break;
+            const EventId id(*event);
+            timer.start();
+            const bool ok = scheduler.handleEvent(id, Scheduler::HANDLE);
+            const qint64 ns = timer.nsecsElapsed();
+            if (ok)
+            {
+                runNs += ns;
+                ++handled;
+                handleUs += ns / 1000;
+                latenessSecs += due.secsTo(now);
+            }
+
+            // If the event couldn't be handled or wasn't rescheduled, it would
+            // stay the earliest alarm and hold up all the others, so drop it.
+            event = store.event(id);
+            if (event
+            &&  (!ok  ||  event->nextTrigger(KAEvent::ALL_TRIGGER).effectiveKDateTime() == due))
+            {
+                ++skipped;
+                store.deleteEvent(*event, false);
+            }
+        }
+    }
+
+    QJsonObject config;
+    config[QStringLiteral("events")] = opts.events;
+    config[QStringLiteral("days")]   = opts.days;
+    config[QStringLiteral("step")]   = opts.step;
+    config[QStringLiteral("seed")]   = static_cast<double>(opts.seed);
+    config[QStringLiteral("mix")]    = EventGenerator::mixToJson(opts.mix);
+
+    QJsonObject setup;
+    setup[QStringLiteral("generateMs")]          = generateNs / 1000000.0;
+    setup[QStringLiteral("triggerComputeMs")]    = indexNs / 1000000.0;
+    setup[QStringLiteral("triggerComputeUsPerEvent")] = indexNs / 1000.0 / opts.events;
+
+    QJsonObject actions;
+    actions[QStringLiteral("message")] = dispatcher.count(KAEvent::MESSAGE);
+    actions[QStringLiteral("file")]    = dispatcher.count(KAEvent::FILE);
+    actions[QStringLiteral("command")] = dispatcher.count(KAEvent::COMMAND);
+    actions[QStringLiteral("email")]   = dispatcher.count(KAEvent::EMAIL);
+    actions[QStringLiteral("audio")]   = dispatcher.count(KAEvent::AUDIO);
+
+    QJsonObject run;
+    run[QStringLiteral("handled")]       = handled;
+    run[QStringLiteral("skipped")]       = skipped;
+    run[QStringLiteral("dispatched")]    = dispatcher.total();
+    run[QStringLiteral("actions")]       = actions;
+    run[QStringLiteral("archived")]      = store.archivedCount();
+    run[QStringLiteral("updates")]       = store.updateCount();
+    run[QStringLiteral("remaining")]     = store.count();
+    run[QStringLiteral("wallMs")]        = runNs / 1000000.0;
+    run[QStringLiteral("throughputPerSec")] = runNs ? handled * 1.0e9 / runNs : 0.0;
+
+    QJsonObject latency;
+    latency[QStringLiteral("handleUs")]    = Bench::percentiles(handleUs);
+    latency[QStringLiteral("latenessSecs")] = Bench::percentiles(latenessSecs);
+
+    QJsonObject memory;
+    memory[QStringLiteral("rssBeforeKb")]   = static_cast<double>(rssBefore);
+    memory[QStringLiteral("rssAfterKb")]    = static_cast<double>(rssAfter);
+    memory[QStringLiteral("peakKb")]        = static_cast<double>(Bench::peakMemoryKb());
+    memory[QStringLiteral("bytesPerEvent")] = (rssBefore >= 0 && rssAfter >= 0) ? (rssAfter - rssBefore) * 1024.0 / opts.events : -1.0;
+
+    QJsonObject results;
+    results[QStringLiteral("benchmark")] = QStringLiteral("scheduler");
+    results[QStringLiteral("config")]    = config;
+    results[QStringLiteral("setup")]     = setup;
+    results[QStringLiteral("run")]       = run;
+    results[QStringLiteral("latency")]   = latency;
+    results[QStringLiteral("memory")]    = memory;
+    if (!Bench::writeJson(results, opts.output))
+    {
+        QTextStream(stderr) << "Error writing " << opts.output << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+// vim: et sw=4:
@@ -268,10 +268,27 @@ QVector<KAEvent> BirthdayDlg::events() const
     int count = indexes.count();
     if (!count)
         return list;
+    list.reserve(count);
     QDate today = KDateTime::currentLocalDate();
     KDateTime todayStart(today, KDateTime::Spec(KDateTime::ClockTime));
     int thisYear = today.year();
     int reminder = mReminder->minutes();
+
+    // Fetch the settings which are common to all the events
+    const QString prefix = mPrefix->text();
+    const QString suffix = mSuffix->text();
+    const QColor  bgColour = mFontColourButton->bgColour();
+    const QColor  fgColour = mFontColourButton->fgColour();
+    const QFont   font = mFontColourButton->font();
+    const int     lateCancel = mLateCancel->minutes();
+    const QString audioFile = mSoundPicker->file().toDisplayString();
+    float fadeVolume;
+    int   fadeSecs;
+    const float volume = mSoundPicker->volume(fadeVolume, fadeSecs);
+    const int   repeatPause = mSoundPicker->repeatPause();
+    const Repetition repetition = mSubRepetition->repetition();
+    const KARecurrence::Feb29Type feb29 = KARecurrence::defaultFeb29Type();
+
     for (int i = 0;  i < count;  ++i)
     {
         const QModelIndex nameIndex = indexes.at(i).model()->index(indexes.at(i).row(), 0);
@@ -282,18 +299,13 @@ QVector<KAEvent> BirthdayDlg::events() const
         if (date <= today)
             date.setYMD(thisYear + 1, date.month(), date.day());
         KAEvent event(KDateTime(date, KDateTime::Spec(KDateTime::ClockTime)),
-                      mPrefix->text() + name + mSuffix->text(),
-                      mFontColourButton->bgColour(), mFontColourButton->fgColour(),
-                      mFontColourButton->font(), KAEvent::MESSAGE, mLateCancel->minutes(),
+                      prefix + name + suffix,
+                      bgColour, fgColour, font, KAEvent::MESSAGE, lateCancel,
                       mFlags, true);
-        float fadeVolume;
-        int   fadeSecs;
-        float volume = mSoundPicker->volume(fadeVolume, fadeSecs);
-        int   repeatPause = mSoundPicker->repeatPause();
-        event.setAudioFile(mSoundPicker->file().toDisplayString(), volume, fadeVolume, fadeSecs, repeatPause);
+        event.setAudioFile(audioFile, volume, fadeVolume, fadeSecs, repeatPause);
         QVector<int> months(1, date.month());
-        event.setRecurAnnualByDate(1, months, 0, KARecurrence::defaultFeb29Type(), -1, QDate());
-        event.setRepetition(mSubRepetition->repetition());
+        event.setRecurAnnualByDate(1, months, 0, feb29, -1, QDate());
+        event.setRepetition(repetition);
         event.setNextOccurrence(todayStart);
         if (reminder)
             event.setReminder(reminder, false);
@@ -95,15 +95,15 @@ void BirthdaySortModel::setPrefixSuffix(const QString& prefix, const QString& su
     mPrefix = prefix;
     mSuffix = suffix;
 
-    KAEvent event;
     const KAEvent::List events = AlarmCalendar::resources()->events(CalEvent::ACTIVE);
+    mContactsWithAlarm.reserve(events.count());
     for (int i = 0, end = events.count();  i < end;  ++i)
     {
         KAEvent* event = events[i];
         if (event->actionSubType() == KAEvent::MESSAGE
         &&  event->recurType() == KARecurrence::ANNUAL_DATE
         &&  (prefix.isEmpty()  ||  event->message().startsWith(prefix)))
-            mContactsWithAlarm.append(event->message());
+            mContactsWithAlarm.insert(event->message());
     }
 
     invalidateFilter();
@@ -23,6 +23,7 @@
 
 #include <Akonadi/Contact/ContactsTreeModel>
 
+#include <QSet>
 #include <QSortFilterProxyModel>
 
 namespace Akonadi
@@ -78,9 +79,9 @@ class BirthdaySortModel : public QSortFilterProxyModel
         bool filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const override;
 
     private:
-        QStringList mContactsWithAlarm;
-        QString     mPrefix;
-        QString     mSuffix;
+        QSet<QString> mContactsWithAlarm;   // texts of existing birthday alarms
+        QString       mPrefix;
+        QString       mSuffix;
 };
 
 #endif
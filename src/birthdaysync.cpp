@@ -0,0 +1,542 @@
+/*
+ *  birthdaysync.cpp  -  keep birthday alarms in step with the address book
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "birthdaysync.h"
+
+#include "alarmcalendar.h"
+#include "collectionmodel.h"
+#include "functions.h"
+#include "preferences.h"
+
+#include <AkonadiCore/changerecorder.h>
+#include <AkonadiCore/collectionfetchjob.h>
+#include <AkonadiCore/collectionfetchscope.h>
+#include <AkonadiCore/itemfetchjob.h>
+#include <AkonadiCore/itemfetchscope.h>
+#include <AkonadiCore/session.h>
+#include <kcontacts/addressee.h>
+
+#include <KLocalizedString>
+#include <kconfiggroup.h>
+
+#include <QApplication>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QTimer>
+#include "kalarm_debug.h"
+
+using namespace Akonadi;
+
+namespace
+{
+const QString SYNC_CONFIG      = QStringLiteral("kalarmbirthdaysyncrc");
+const QString RECORDER_CONFIG  = QStringLiteral("/kalarmbirthdaysyncrecorder");
+const char*   GENERAL_GROUP    = "General";
+const char*   CONTACTS_GROUP   = "Contacts";
+const QString INITIALISED_KEY  = QStringLiteral("Initialised");
+const int     ADD_BATCH_SIZE   = 200;   // number of alarms to create in each Akonadi transaction
+}
+
+BirthdaySync* BirthdaySync::mInstance = nullptr;
+
+/******************************************************************************
+* Start synchronising birthday alarms with the address book, if not already
+* started. This must only be called once the alarm calendars are populated.
+*/
+void BirthdaySync::start()
+{
+    if (!mInstance)
+        mInstance = new BirthdaySync(qApp);
+}
+
+BirthdaySync::BirthdaySync(QObject* parent)
+    : QObject(parent),
+      mConfig(KSharedConfig::openConfig(SYNC_CONFIG)),
+      mPendingFetches(0),
+      mFetchesDone(false),
+      mInitialised(false),
+      mReplaying(false)
+{
+    // Use the same alarm text as the Import Birthdays dialog
+    KConfigGroup config(KSharedConfig::openConfig(), "General");
+    mPrefix = config.readEntry("BirthdayPrefix", i18nc("@info", "Birthday: "));
+    mSuffix = config.readEntry("BirthdaySuffix");
+
+    // Load the records of the alarms created by previous runs
+    mInitialised = KConfigGroup(mConfig, GENERAL_GROUP).readEntry(INITIALISED_KEY, false);
+    const KConfigGroup contacts(mConfig, CONTACTS_GROUP);
+    const QStringList uids = contacts.keyList();
+    for (int i = 0, end = uids.count();  i < end;  ++i)
+    {
+        const QStringList values = contacts.readEntry(uids[i], QStringList());
+        if (values.count() < 4)
+            continue;
+        Record record;
+        record.eventId  = values[0];
+        record.itemId   = values[1].toLongLong();
+        record.text     = values[2];
+        record.birthday = QDate::fromString(values[3], Qt::ISODate);
+        mRecords.insert(uids[i], record);
+    }
+
+    // Record contact changes persistently, so that changes made while KAlarm
+    // is not running are replayed when it next starts.
+    ItemFetchScope scope;
+    scope.fetchFullPayload(true);
+    mRecorder = new ChangeRecorder(this);
+    mRecorder->setSession(new Session("KAlarm::BirthdaySyncSession", this));
+    mRecorder->setConfig(new QSettings(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + RECORDER_CONFIG,
+                                       QSettings::IniFormat, this));
+    mRecorder->setChangeRecordingEnabled(true);
+    mRecorder->setItemFetchScope(scope);
+    mRecorder->setMimeTypeMonitored(KContacts::Addressee::mimeType(), true);
+    connect(mRecorder, &ChangeRecorder::changesAdded, this, &BirthdaySync::slotChangesAdded);
+    connect(mRecorder, &ChangeRecorder::nothingToReplay, this, &BirthdaySync::slotNothingToReplay);
+    connect(mRecorder, &Monitor::itemAdded, this, &BirthdaySync::slotItemAdded);
+    connect(mRecorder, &Monitor::itemChanged, this, &BirthdaySync::slotItemChanged);
+    connect(mRecorder, &Monitor::itemRemoved, this, &BirthdaySync::slotItemRemoved);
+
+    if (!mInitialised)
+    {
+        // This is the first run. Adopt any birthday alarms previously created
+        // by the Import Birthdays dialog, and scan the whole address book.
+        const KAEvent::List events = AlarmCalendar::resources()->events(CalEvent::ACTIVE);
+        for (int i = 0, end = events.count();  i < end;  ++i)
+        {
+            const KAEvent* event = events[i];
+            if (event->actionSubType() == KAEvent::MESSAGE
+            &&  event->recurType() == KARecurrence::ANNUAL_DATE
+            &&  event->message().startsWith(mPrefix)  &&  event->message().endsWith(mSuffix))
+                mUnclaimedAlarms.insert(event->message(), event->id());
+        }
+
+        connect(AlarmCalendar::resources(), &AlarmCalendar::eventsAdded, this, &BirthdaySync::slotAlarmsAdded);
+        CollectionFetchJob* job = new CollectionFetchJob(Collection::root(), CollectionFetchJob::Recursive, this);
+        job->fetchScope().setContentMimeTypes(QStringList() << KContacts::Addressee::mimeType());
+        connect(job, &KJob::result, this, &BirthdaySync::slotCollectionsFetched);
+    }
+
+    if (!mRecorder->isEmpty())
+        slotChangesAdded();    // replay changes made while KAlarm was not running
+}
+
+BirthdaySync::~BirthdaySync()
+{
+    mConfig->sync();
+    if (this == mInstance)
+        mInstance = nullptr;
+}
+
+/******************************************************************************
+* Called when contact change notifications have been recorded.
+* Start replaying them, if not already doing so.
+*/
+void BirthdaySync::slotChangesAdded()
+{
+    if (!mReplaying)
+    {
+        mReplaying = true;
+        QTimer::singleShot(0, this, &BirthdaySync::replayNext);
+    }
+}
+
+/******************************************************************************
+* Replay the next recorded contact change notification.
+*/
+void BirthdaySync::replayNext()
+{
+    if (!mRecorder->replayNext())
+        mReplaying = false;
+}
+
+/******************************************************************************
+* Called when all recorded contact changes have been processed.
+*/
+void BirthdaySync::slotNothingToReplay()
+{
+    mReplaying = false;
+    mConfig->sync();
+}
+
+/******************************************************************************
+* Called when a recorded change notification has been processed.
+* Schedule the next notification to be replayed. This is done via the event
+* loop to prevent a long backlog of notifications from recursing.
+*/
+void BirthdaySync::changeProcessed()
+{
+    mRecorder->changeProcessed();
+    if (!mRecorder->isEmpty())
+        QTimer::singleShot(0, this, &BirthdaySync::replayNext);
+    else
+        slotNothingToReplay();
+}
+
+void BirthdaySync::slotItemAdded(const Item& item, const Collection&)
+{
+    contactChanged(item);
+    changeProcessed();
+}
+
+void BirthdaySync::slotItemChanged(const Item& item, const QSet<QByteArray>&)
+{
+    contactChanged(item);
+    changeProcessed();
+}
+
+/******************************************************************************
+* Called when a contact has been deleted. Its payload is no longer available,
+* so its UID is found from its Akonadi item ID.
+*/
+void BirthdaySync::slotItemRemoved(const Item& item)
+{
+    const QString uid = mRecords.uidForItem(item.id());
+    if (!uid.isEmpty())
+        retire(uid);
+    changeProcessed();
+}
+
+/******************************************************************************
+* Called when a contact has been added or changed, or has been found in the
+* initial address book scan.
+* Create, update or delete its birthday alarm as necessary.
+*/
+void BirthdaySync::contactChanged(const Item& item)
+{
+    if (!item.hasPayload<KContacts::Addressee>())
+        return;
+    const KContacts::Addressee contact = item.payload<KContacts::Addressee>();
+    const QString uid = contact.uid();
+    if (uid.isEmpty())
+        return;
+    const QDate birthday = contact.birthday().date();
+    QString name = contact.realName();
+    if (name.isEmpty())
+        name = contact.formattedName();
+    if (!birthday.isValid()  ||  name.isEmpty())
+    {
+        retire(uid);
+        return;
+    }
+    const QString text = mPrefix + name + mSuffix;
+
+    Record record;
+    switch (mRecords.contactChanged(uid, item.id(), text, birthday, record))
+    {
+        case BirthdayRecords::CREATE:
+        {
+            const QString unclaimedId = mUnclaimedAlarms.take(text);
+            if (!unclaimedId.isEmpty())
+            {
+                // An alarm already exists for this contact. Don't duplicate it.
+                // Its date is updated if the contact's birthday later changes.
+                qCDebug(KALARM_LOG) << "BirthdaySync: adopting" << unclaimedId << "for" << uid;
+                record.eventId = unclaimedId;
+            }
+            else if (mPendingFetches > 0)
+            {
+                // Create the alarms found in the initial scan in batches, since
+                // creating them one at a time is slow for a large address book.
+                mNewRecords[uid] = record;
+                return;
+            }
+            else
+            {
+                KAEvent event = birthdayEvent(text, birthday);
+                if (KAlarm::addEvent(event, nullptr, nullptr, KAlarm::NO_RESOURCE_PROMPT).status != KAlarm::UPDATE_OK)
+                {
+                    qCWarning(KALARM_LOG) << "BirthdaySync: error creating alarm for" << uid;
+                    return;
+                }
+                qCDebug(KALARM_LOG) << "BirthdaySync: created" << event.id() << "for" << uid;
+                record.eventId = event.id();
+            }
+            saveRecord(uid, record);
+            break;
+        }
+        case BirthdayRecords::UPDATE:
+            // The name or birthday has changed, so update the alarm.
+            if (updateAlarm(uid, record))
+                saveRecord(uid, record);
+            break;
+        case BirthdayRecords::WAIT:
+            // The alarm is being created, and will be updated once it has been.
+            break;
+        default:
+            // Save any change to the contact's item ID
+            saveRecord(uid, mRecords.value(uid));
+            break;
+    }
+}
+
+/******************************************************************************
+* Update a contact's birthday alarm to the text and birthday in its record.
+* If the user has deleted the alarm, it isn't recreated.
+* Reply = true if the record should be saved, with the alarm's new ID.
+*/
+bool BirthdaySync::updateAlarm(const QString& uid, Record& record)
+{
+    KAEvent* oldEvent = AlarmCalendar::resources()->event(EventId(-1, record.eventId), true);
+    if (!oldEvent)
+        return true;
+    KAEvent event = birthdayEvent(record.text, record.birthday);
+    KAEvent old(*oldEvent);
+    if (KAlarm::modifyEvent(old, event).status != KAlarm::UPDATE_OK)
+    {
+        qCWarning(KALARM_LOG) << "BirthdaySync: error updating alarm for" << uid;
+        return false;
+    }
+    qCDebug(KALARM_LOG) << "BirthdaySync: updated" << event.id() << "for" << uid;
+    record.eventId = event.id();
+    return true;
+}
+
+/******************************************************************************
+* Delete the birthday alarm for a contact which has been deleted or which no
+* longer has a birthday.
+*/
+void BirthdaySync::retire(const QString& uid)
+{
+    if (mNewRecords.remove(uid))
+        return;    // its alarm hasn't been created yet
+    Record record;
+    if (mRecords.contactRemoved(uid, record) != BirthdayRecords::DELETE)
+        return;    // it has no alarm, or it will be deleted once it has been created
+    deleteAlarm(uid, record.eventId);
+    KConfigGroup(mConfig, CONTACTS_GROUP).deleteEntry(uid);
+}
+
+/******************************************************************************
+* Delete a contact's birthday alarm.
+*/
+void BirthdaySync::deleteAlarm(const QString& uid, const QString& eventId)
+{
+    KAEvent* event = AlarmCalendar::resources()->event(EventId(-1, eventId), true);
+    if (event)
+    {
+        qCDebug(KALARM_LOG) << "BirthdaySync: deleting" << event->id() << "for" << uid;
+        KAEvent ev(*event);
+        KAlarm::deleteEvent(ev, false);
+    }
+}
+
+/******************************************************************************
+* Start creating the birthday alarms which have been found to be needed in the
+* initial scan. Each batch is created in a single Akonadi transaction, whose
+* outcome is reported to slotAlarmsAdded().
+*/
+void BirthdaySync::addNewAlarms()
+{
+    if (mNewRecords.isEmpty())
+        return;
+    AlarmCalendar* cal = AlarmCalendar::resources();
+    Collection collection = CollectionControlModel::destination(CalEvent::ACTIVE, nullptr, true);
+    AddBatch batch;
+    QVector<KAEvent> events;
+    batch.uids.reserve(ADD_BATCH_SIZE);
+    batch.records.reserve(ADD_BATCH_SIZE);
+    events.reserve(ADD_BATCH_SIZE);
+    for (QHash<QString, Record>::ConstIterator it = mNewRecords.constBegin();  it != mNewRecords.constEnd();  )
+    {
+        batch.uids    += it.key();
+        batch.records += it.value();
+        events += birthdayEvent(it.value().text, it.value().birthday);
+        if (++it != mNewRecords.constEnd()  &&  events.count() < ADD_BATCH_SIZE)
+            continue;
+        KJob* job = cal->addEvents(events, collection);
+        if (job)
+        {
+            // Hold back any changes to the contacts until their alarms exist
+            for (int i = 0, end = batch.uids.count();  i < end;  ++i)
+                mRecords.creating(batch.uids[i], batch.records[i]);
+            mAddBatches.insert(job, batch);
+        }
+        else
+            qCWarning(KALARM_LOG) << "BirthdaySync: error creating" << events.count() << "alarms";
+        batch.uids.clear();
+        batch.records.clear();
+        events.clear();
+    }
+    mNewRecords.clear();
+}
+
+/******************************************************************************
+* Called when a group of alarms has been created in the calendar.
+* If they were created by addNewAlarms(), save a record for each alarm which
+* was actually created, and apply any changes to the contacts which were made
+* while the alarms were being created.
+*/
+void BirthdaySync::slotAlarmsAdded(KJob* transaction, const QVector<KAEvent>& events)
+{
+    QHash<KJob*, AddBatch>::Iterator it = mAddBatches.find(transaction);
+    if (it == mAddBatches.end())
+        return;    // not created by BirthdaySync
+    const AddBatch batch = it.value();
+    mAddBatches.erase(it);
+    int added = 0;
+    for (int i = 0, end = qMin(events.count(), batch.uids.count());  i < end;  ++i)
+    {
+        const QString& uid = batch.uids[i];
+        if (events[i].itemId() < 0)
+        {
+            qCWarning(KALARM_LOG) << "BirthdaySync: error creating alarm for" << uid;
+            mRecords.createFailed(uid);
+            continue;
+        }
+        ++added;
+        Record record;
+        switch (mRecords.created(uid, events[i].id(), record))
+        {
+            case BirthdayRecords::DELETE:
+                // The contact was removed while the alarm was being created
+                deleteAlarm(uid, record.eventId);
+                break;
+            case BirthdayRecords::UPDATE:
+                // The contact was changed while the alarm was being created
+                saveRecord(uid, mRecords.value(uid));
+                if (updateAlarm(uid, record))
+                    saveRecord(uid, record);
+                break;
+            default:
+                saveRecord(uid, record);
+                break;
+        }
+    }
+    if (added  &&  !AlarmCalendar::resources()->save())
+        qCWarning(KALARM_LOG) << "BirthdaySync: error saving calendar";
+    qCDebug(KALARM_LOG) << "BirthdaySync: created" << added << "of" << batch.uids.count() << "alarms";
+    if (mFetchesDone  &&  mAddBatches.isEmpty())
+        initialScanDone();
+}
+
+/******************************************************************************
+* Store the record of a contact's birthday alarm, in memory and in the config
+* file.
+*/
+void BirthdaySync::saveRecord(const QString& uid, const Record& record)
+{
+    mRecords.insert(uid, record);
+    KConfigGroup(mConfig, CONTACTS_GROUP).writeEntry(uid, QStringList() << record.eventId
+                                                                        << QString::number(record.itemId)
+                                                                        << record.text
+                                                                        << record.birthday.toString(Qt::ISODate));
+}
+
+/******************************************************************************
+* Create a birthday alarm, using the same default settings as the Import
+* Birthdays dialog.
+*/
+KAEvent BirthdaySync::birthdayEvent(const QString& text, const QDate& birthday) const
+{
+    // Find the next birthday after today (which for 29th February may be
+    // several years away).
+    const QDate today = KDateTime::currentLocalDate();
+    QDate date;
+    for (int year = today.year();  !date.isValid()  ||  date <= today;  ++year)
+        date = QDate(year, birthday.month(), birthday.day());
+    KAEvent::Flags flags = KAEvent::ANY_TIME;
+    flags |= KAEvent::DEFAULT_FONT;
+    if (Preferences::defaultConfirmAck())
+        flags |= KAEvent::CONFIRM_ACK;
+    KAEvent event(KDateTime(date, KDateTime::Spec(KDateTime::ClockTime)),
+                  text, Preferences::defaultBgColour(), Preferences::defaultFgColour(),
+                  Preferences::messageFont(), KAEvent::MESSAGE, Preferences::defaultLateCancel(),
+                  flags, true);
+    QVector<int> months(1, birthday.month());
+    event.setRecurAnnualByDate(1, months, birthday.day(), KARecurrence::defaultFeb29Type(), -1, QDate());
+    event.setNextOccurrence(KDateTime(today, KDateTime::Spec(KDateTime::ClockTime)));
+    event.endChanges();
+    return event;
+}
+
+/******************************************************************************
+* Called when the address book collections have been fetched for the initial
+* scan. Fetch the contacts in each of them.
+*/
+void BirthdaySync::slotCollectionsFetched(KJob* j)
+{
+    if (j->error())
+    {
+        qCWarning(KALARM_LOG) << "BirthdaySync: address book collection fetch error:" << j->errorString();
+        return;
+    }
+    const Collection::List collections = static_cast<CollectionFetchJob*>(j)->collections();
+    const QString mimeType = KContacts::Addressee::mimeType();
+    for (int i = 0, end = collections.count();  i < end;  ++i)
+    {
+        if (!collections[i].contentMimeTypes().contains(mimeType))
+            continue;
+        ItemFetchJob* job = new ItemFetchJob(collections[i], this);
+        job->fetchScope().fetchFullPayload(true);
+        job->fetchScope().setAncestorRetrieval(ItemFetchScope::None);
+        connect(job, &ItemFetchJob::itemsReceived, this, &BirthdaySync::slotItemsReceived);
+        connect(job, &KJob::result, this, &BirthdaySync::slotItemFetchDone);
+        ++mPendingFetches;
+    }
+    if (!mPendingFetches)
+        slotItemFetchDone(nullptr);
+}
+
+/******************************************************************************
+* Called when contacts have been fetched in the initial scan.
+* Any new birthday alarms are created once a full batch is waiting.
+*/
+void BirthdaySync::slotItemsReceived(const Item::List& items)
+{
+    for (int i = 0, end = items.count();  i < end;  ++i)
+        if (items[i].mimeType() == KContacts::Addressee::mimeType())
+            contactChanged(items[i]);
+    if (mNewRecords.count() >= ADD_BATCH_SIZE)
+        addNewAlarms();
+}
+
+/******************************************************************************
+* Called when a contact fetch job in the initial scan has completed.
+* When all have completed, create the remaining alarms.
+*/
+void BirthdaySync::slotItemFetchDone(KJob* j)
+{
+    if (j)
+    {
+        if (j->error())
+            qCWarning(KALARM_LOG) << "BirthdaySync: contact fetch error:" << j->errorString();
+        if (--mPendingFetches > 0)
+            return;
+    }
+    addNewAlarms();
+    mFetchesDone = true;
+    mUnclaimedAlarms.clear();
+    if (mAddBatches.isEmpty())
+        initialScanDone();
+}
+
+/******************************************************************************
+* Called when all contacts in the initial scan have been processed, and all
+* their alarms have been created. Record that the initial scan has been done,
+* so that from now on only recorded changes need to be processed.
+*/
+void BirthdaySync::initialScanDone()
+{
+    mInitialised = true;
+    KConfigGroup(mConfig, GENERAL_GROUP).writeEntry(INITIALISED_KEY, true);
+    mConfig->sync();
+    qCDebug(KALARM_LOG) << "BirthdaySync: initial scan complete," << mRecords.count() << "birthday alarms";
+}
+
+// vim: et sw=4:
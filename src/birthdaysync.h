@@ -0,0 +1,108 @@
+/*
+ *  birthdaysync.h  -  keep birthday alarms in step with the address book
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef BIRTHDAYSYNC_H
+#define BIRTHDAYSYNC_H
+
+#include "birthdayrecords.h"
+
+#include <kalarmcal/kaevent.h>
+
+#include <AkonadiCore/collection.h>
+#include <AkonadiCore/item.h>
+
+#include <KSharedConfig>
+
+#include <QDate>
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+
+class KJob;
+namespace Akonadi { class ChangeRecorder; }
+
+using namespace KAlarmCal;
+
+/*=============================================================================
+= Class BirthdaySync
+= Creates, updates and deletes an annual birthday alarm for each contact in
+= the address book, as contacts are added, changed or removed. Contact changes
+= are recorded by Akonadi while KAlarm is not running, and are replayed when it
+= next starts, so that the address book only needs to be scanned in full the
+= first time that synchronisation is enabled.
+= Each alarm is keyed on its contact's UID, so that it follows the contact when
+= the contact's name or birthday changes.
+=============================================================================*/
+class BirthdaySync : public QObject
+{
+        Q_OBJECT
+    public:
+        ~BirthdaySync();
+        static void start();
+
+    private Q_SLOTS:
+        void slotChangesAdded();
+        void replayNext();
+        void slotNothingToReplay();
+        void slotItemAdded(const Akonadi::Item&, const Akonadi::Collection&);
+        void slotItemChanged(const Akonadi::Item&, const QSet<QByteArray>&);
+        void slotItemRemoved(const Akonadi::Item&);
+        void slotCollectionsFetched(KJob*);
+        void slotItemsReceived(const Akonadi::Item::List&);
+        void slotItemFetchDone(KJob*);
+        void slotAlarmsAdded(KJob*, const QVector<KAEvent>&);
+
+    private:
+        typedef BirthdayRecords::Record Record;
+        struct AddBatch   // alarms being created in one Akonadi transaction
+        {
+            QStringList     uids;      // contact UIDs, in the order of the alarms
+            QVector<Record> records;   // records of the alarms, in the order of the alarms
+        };
+
+        explicit BirthdaySync(QObject* parent = nullptr);
+        void    contactChanged(const Akonadi::Item&);
+        void    retire(const QString& uid);
+        bool    updateAlarm(const QString& uid, Record&);
+        void    deleteAlarm(const QString& uid, const QString& eventId);
+        void    addNewAlarms();
+        void    saveRecord(const QString& uid, const Record&);
+        KAEvent birthdayEvent(const QString& text, const QDate& birthday) const;
+        void    changeProcessed();
+        void    initialScanDone();
+
+        static BirthdaySync* mInstance;
+        Akonadi::ChangeRecorder* mRecorder;
+        KSharedConfig::Ptr   mConfig;           // persistent contact UID to alarm records
+        BirthdayRecords      mRecords;          // birthday alarms, by contact UID
+        QHash<QString, QString> mUnclaimedAlarms;     // during initial scan, existing birthday alarm IDs by text
+        QHash<QString, Record> mNewRecords;     // during initial scan, records of alarms waiting to be created, by contact UID
+        QHash<KJob*, AddBatch> mAddBatches;     // during initial scan, alarms being created, by Akonadi transaction
+        QString              mPrefix;           // alarm text prefix to contact name
+        QString              mSuffix;           // alarm text suffix to contact name
+        int                  mPendingFetches;   // number of item fetch jobs outstanding in initial scan
+        bool                 mFetchesDone;      // all contacts have been fetched in the initial scan
+        bool                 mInitialised;      // the initial address book scan has been done
+        bool                 mReplaying;        // a recorded change is currently being replayed
+};
+
+#endif // BIRTHDAYSYNC_H
+
+// vim: et sw=4:
@@ -34,6 +34,13 @@
 
 using namespace Akonadi;
 
+namespace
+{
+const int MAX_ITEM_FETCH_JOBS = 8;   // maximum number of item fetch jobs to run concurrently
+}
+
+QHash<QString, QList<Collection::Id> > CollectionSearch::mGidCollections;
+
 /******************************************************************************
 * Constructor.
 * Creates jobs to fetch all collections for resources containing the mime type.
@@ -43,17 +50,43 @@ using namespace Akonadi;
 * - Otherwise, if 'gid' is specified, it will Q_EMIT the signal items() to
 *   notify all Items with that GID.
 * - Otherwise, it will Q_EMIT the signal collections() to notify all Collections.
+* If the collections containing 'gid' are already known from a previous search,
+* only those collections are searched, and the collections are not fetched
+* unless the GID is no longer found in them.
 */
 CollectionSearch::CollectionSearch(const QString& mimeType, const QString& gid, bool remove)
     : mMimeType(mimeType),
       mGid(gid),
       mDeleteCount(0),
-      mDelete(remove && !mGid.isEmpty())
+      mDelete(remove && !mGid.isEmpty()),
+      mCached(false)
+{
+    if (!mGid.isEmpty())
+    {
+        QHash<QString, QList<Collection::Id> >::ConstIterator it = mGidCollections.constFind(mGid);
+        if (it != mGidCollections.constEnd())
+        {
+            qCDebug(KALARM_LOG) << "CollectionSearch: GID" << mGid << "cached in collections" << it.value();
+            mCached = true;
+            const QList<Collection::Id>& ids = it.value();
+            for (int i = 0, end = ids.count();  i < end;  ++i)
+                mSearchQueue.enqueue(Collection(ids[i]));
+            startItemFetches();
+            return;
+        }
+    }
+    fetchCollections();
+}
+
+/******************************************************************************
+* Create jobs to fetch all collections for resources containing the mime type.
+*/
+void CollectionSearch::fetchCollections()
 {
     const AgentInstance::List agents = AgentManager::self()->instances();
     foreach (const AgentInstance& agent, agents)
     {
-        if (agent.type().mimeTypes().contains(mimeType))
+        if (agent.type().mimeTypes().contains(mMimeType))
         {
             {
                 CollectionFetchJob* job = new CollectionFetchJob(Collection::root(), CollectionFetchJob::FirstLevel);
@@ -90,17 +123,10 @@ void CollectionSearch::collectionFetchResult(KJob* j)
                 if (mGid.isEmpty())
                     mCollections << c;
                 else
-                {
-                    // Search for all Items with the specified GID
-                    Item item;
-                    item.setGid(mGid);
-                    ItemFetchJob* ijob = new ItemFetchJob(item, this);
-                    ijob->setCollection(c);
-                    mItemFetchJobs[ijob] = c.id();
-                    connect(ijob, &ItemFetchJob::result, this, &CollectionSearch::itemFetchResult);
-                }
+                    mSearchQueue.enqueue(c);   // search for all Items with the specified GID
             }
         }
+        startItemFetches();
     }
     mCollectionJobs.removeAll(job);
 
@@ -109,36 +135,62 @@ void CollectionSearch::collectionFetchResult(KJob* j)
         // All collections have now been fetched
         if (mGid.isEmpty())
             finish();
+        else
+            checkFinished();
     }
 }
 
+/******************************************************************************
+* Start searches for the GID in queued collections, limiting the number of
+* item fetch jobs which run concurrently.
+*/
+void CollectionSearch::startItemFetches()
+{
+    while (!mSearchQueue.isEmpty()  &&  mItemFetchJobs.count() < MAX_ITEM_FETCH_JOBS)
+        searchCollection(mSearchQueue.dequeue());
+}
+
+/******************************************************************************
+* Create a job to fetch all Items with the GID from a collection.
+*/
+void CollectionSearch::searchCollection(const Collection& collection)
+{
+    Item item;
+    item.setGid(mGid);
+    ItemFetchJob* job = new ItemFetchJob(item, this);
+    job->setCollection(collection);
+    mItemFetchJobs[job] = collection.id();
+    connect(job, &ItemFetchJob::result, this, &CollectionSearch::itemFetchResult);
+}
+
 /******************************************************************************
 * Called when an ItemFetchJob has completed.
+* If deleting, delete all the Items found in the collection with a single job.
 */
 void CollectionSearch::itemFetchResult(KJob* j)
 {
     ItemFetchJob* job = static_cast<ItemFetchJob*>(j);
+    const Collection::Id collectionId = mItemFetchJobs.take(job);
     if (j->error())
-        qCDebug(KALARM_LOG) << "ItemFetchJob: collection" << mItemFetchJobs[job] << "GID" << mGid << "error: " << j->errorString();
+        qCDebug(KALARM_LOG) << "ItemFetchJob: collection" << collectionId << "GID" << mGid << "error: " << j->errorString();
     else
     {
-        if (mDelete)
+        const Item::List items = job->items();
+        if (!items.isEmpty())
         {
-            Item::List items = job->items();
-            foreach (const Item& item, items)
+            mFoundCollections << collectionId;
+            if (mDelete)
             {
-                ItemDeleteJob* djob = new ItemDeleteJob(item, this);
-                mItemDeleteJobs[djob] = mItemFetchJobs[job];
+                ItemDeleteJob* djob = new ItemDeleteJob(items, this);
+                mItemDeleteJobs[djob] = collectionId;
                 connect(djob, &ItemDeleteJob::result, this, &CollectionSearch::itemDeleteResult);
             }
+            else
+                mItems << items;
         }
-        else
-            mItems << job->items();
     }
-    mItemFetchJobs.remove(job);
-
-    if (mItemFetchJobs.isEmpty()  &&  mItemDeleteJobs.isEmpty()  &&  mCollectionJobs.isEmpty())
-        finish();  // all Items have now been fetched or deleted, so notify the result
+    startItemFetches();
+    checkFinished();
 }
 
 /******************************************************************************
@@ -147,14 +199,41 @@ void CollectionSearch::itemFetchResult(KJob* j)
 void CollectionSearch::itemDeleteResult(KJob* j)
 {
     ItemDeleteJob* job = static_cast<ItemDeleteJob*>(j);
+    const Collection::Id collectionId = mItemDeleteJobs.take(job);
     if (j->error())
-        qCDebug(KALARM_LOG) << "ItemDeleteJob: resource" << mItemDeleteJobs[job] << "GID" << mGid << "error: " << j->errorString();
+        qCDebug(KALARM_LOG) << "ItemDeleteJob: collection" << collectionId << "GID" << mGid << "error: " << j->errorString();
     else
-        ++mDeleteCount;
-    mItemDeleteJobs.remove(job);
+        mDeleteCount += job->deletedItems().count();
+    checkFinished();
+}
 
-    if (mItemFetchJobs.isEmpty()  &&  mItemDeleteJobs.isEmpty()  &&  mCollectionJobs.isEmpty())
-        finish();  // all Items have now been deleted, so notify the result
+/******************************************************************************
+* If all Items have now been fetched or deleted, notify the result.
+* If only the cached collections were searched and the GID was not found in
+* them, the cache is out of date, so search all collections instead.
+*/
+void CollectionSearch::checkFinished()
+{
+    if (!mItemFetchJobs.isEmpty()  ||  !mItemDeleteJobs.isEmpty()  ||  !mCollectionJobs.isEmpty()  ||  !mSearchQueue.isEmpty())
+        return;
+    if (mFoundCollections.isEmpty())
+    {
+        mGidCollections.remove(mGid);
+        if (mCached)
+        {
+            mCached = false;
+            fetchCollections();
+            return;
+        }
+    }
+    else
+    {
+        // Note that the location is kept even after the Items are deleted,
+        // since a replacement for a deleted Item is normally added to the
+        // same collection.
+        mGidCollections[mGid] = mFoundCollections;
+    }
+    finish();
 }
 
 /******************************************************************************
@@ -26,8 +26,9 @@
 #include <AkonadiCore/item.h>
 
 #include <QObject>
-#include <QMap>
+#include <QHash>
 #include <QList>
+#include <QQueue>
 
 class KJob;
 namespace Akonadi
@@ -41,6 +42,8 @@ class ItemDeleteJob;
 = Class: CollectionSearch
 = Fetches a list of all Akonadi collections which handle a specified mime type,
 = and then optionally fetches or deletes all Items from them with a given GID.
+= The collections in which each GID is found are cached, so that a repeated
+= search for the same GID does not need to fetch all collections again.
 =
 = Note that this class auto-deletes once it has emitted its completion signal.
 = Instances must therefore be created on the heap by operator new(), not on the
@@ -67,15 +70,25 @@ class CollectionSearch : public QObject
         void finish();
 
     private:
+        void fetchCollections();
+        void searchCollection(const Akonadi::Collection&);
+        void startItemFetches();
+        void checkFinished();
+
+        static QHash<QString, QList<Akonadi::Collection::Id> > mGidCollections;  // collections containing each GID
+
         QString                                mMimeType;
         QString                                mGid;
         QList<Akonadi::CollectionFetchJob*>    mCollectionJobs;
-        QMap<Akonadi::ItemFetchJob*, Akonadi::Collection::Id>  mItemFetchJobs;
-        QMap<Akonadi::ItemDeleteJob*, Akonadi::Collection::Id> mItemDeleteJobs;
+        QQueue<Akonadi::Collection>            mSearchQueue;      // collections waiting to be searched for the GID
+        QHash<Akonadi::ItemFetchJob*, Akonadi::Collection::Id>  mItemFetchJobs;
+        QHash<Akonadi::ItemDeleteJob*, Akonadi::Collection::Id> mItemDeleteJobs;
+        QList<Akonadi::Collection::Id>         mFoundCollections; // collections in which the GID was found
         Akonadi::Collection::List              mCollections;
         Akonadi::Item::List                    mItems;
         int                                    mDeleteCount;
         bool                                   mDelete;
+        bool                                   mCached;           // searching only the cached collections for the GID
 };
 
 #endif // COLLECTIONSEARCH_H
@@ -2,3 +2,6 @@
 
 /* Define to 1 if you have the Xlib */
 #cmakedefine01 KDEPIM_HAVE_X11
+
+/* Define to 1 if timing trace points are compiled in */
+#cmakedefine01 KALARM_TRACING
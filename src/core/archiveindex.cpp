@@ -0,0 +1,120 @@
+/*
+ *  archiveindex.cpp  -  index of archived alarms by creation date
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "archiveindex.h"
+
+const int ArchiveIndex::PURGE_BATCH_SIZE;
+
+
+/******************************************************************************
+* Add or update an archived alarm's record and its creation date index entry.
+* 'event' is the full event held by the calendar, or null if the event is held
+* only as a record.
+*/
+void ArchiveIndex::insert(const EventId& id, qint64 itemId, const QDate& created, KAEvent* event)
+{
+    QHash<EventId, Record>::Iterator it = mRecords.find(id);
+    if (it == mRecords.end())
+    {
+        it = mRecords.insert(id, Record());
+        mIndex[id.collectionId()].insert(created, id.eventId());
+    }
+    else if (it.value().created != created)
+    {
+        DateIndex& index = mIndex[id.collectionId()];
+        index.remove(it.value().created, id.eventId());
+        index.insert(created, id.eventId());
+    }
+    Record& record = it.value();
+    record.itemId  = itemId;
+    record.created = created;
+    record.event   = event;
+}
+
+/******************************************************************************
+* Remove an archived alarm's record and its creation date index entry.
+* Reply = true if the alarm was in the index.
+*/
+bool ArchiveIndex::remove(const EventId& id)
+{
+    QHash<EventId, Record>::Iterator it = mRecords.find(id);
+    if (it == mRecords.end())
+        return false;
+    QHash<qint64, DateIndex>::Iterator iit = mIndex.find(id.collectionId());
+    if (iit != mIndex.end())
+    {
+        iit.value().remove(it.value().created, id.eventId());
+        if (iit.value().isEmpty())
+            mIndex.erase(iit);
+    }
+    mRecords.erase(it);
+    return true;
+}
+
+/******************************************************************************
+* Remove the records of all archived alarms in a collection.
+*/
+void ArchiveIndex::removeCollection(qint64 collectionId)
+{
+    QHash<qint64, DateIndex>::Iterator iit = mIndex.find(collectionId);
+    if (iit == mIndex.end())
+        return;
+    const DateIndex& index = iit.value();
+    for (DateIndex::ConstIterator it = index.constBegin();  it != index.constEnd();  ++it)
+        mRecords.remove(EventId(collectionId, it.value()));
+    mIndex.erase(iit);
+}
+
+/******************************************************************************
+* Return the number of archived alarms in a collection.
+*/
+int ArchiveIndex::count(qint64 collectionId) const
+{
+    QHash<qint64, DateIndex>::ConstIterator iit = mIndex.constFind(collectionId);
+    return (iit == mIndex.constEnd()) ? 0 : iit.value().count();
+}
+
+/******************************************************************************
+* Return the IDs of the archived alarms in a collection, oldest first.
+*/
+QVector<EventId> ArchiveIndex::ids(qint64 collectionId) const
+{
+    return expired(collectionId, QDate(), count(collectionId));
+}
+
+/******************************************************************************
+* Return the IDs of the archived alarms in a collection which were created
+* before a specified date, oldest first. If 'cutoff' is invalid, all archived
+* alarms in the collection are returned.
+* At most 'maxCount' IDs are returned.
+*/
+QVector<EventId> ArchiveIndex::expired(qint64 collectionId, const QDate& cutoff, int maxCount) const
+{
+    QVector<EventId> result;
+    QHash<qint64, DateIndex>::ConstIterator iit = mIndex.constFind(collectionId);
+    if (iit == mIndex.constEnd())
+        return result;
+    const DateIndex& index = iit.value();
+    const DateIndex::ConstIterator end = cutoff.isValid() ? index.lowerBound(cutoff) : index.constEnd();
+    for (DateIndex::ConstIterator it = index.constBegin();  it != end  &&  result.count() < maxCount;  ++it)
+        result += EventId(collectionId, it.value());
+    return result;
+}
+
+// vim: et sw=4:
@@ -0,0 +1,68 @@
+/*
+ *  archiveindex.h  -  index of archived alarms by creation date
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef ARCHIVEINDEX_H
+#define ARCHIVEINDEX_H
+
+#include "eventid.h"
+
+#include <QDate>
+#include <QHash>
+#include <QMultiMap>
+#include <QVector>
+
+/*=============================================================================
+= Class ArchiveIndex
+= Compact records of the archived alarms in each collection, indexed by
+= creation date so that expired alarms can be found without scanning the
+= whole archive.
+=============================================================================*/
+class ArchiveIndex
+{
+    public:
+        struct Record
+        {
+            Record() : itemId(-1), event(nullptr) {}
+            qint64    itemId;     // Akonadi item holding the full event
+            QDate     created;    // creation date, under which the event is indexed
+            KAEvent*  event;      // full event held by the calendar, or null if not materialised
+        };
+
+        static const int PURGE_BATCH_SIZE = 500;   // maximum number of archived alarms to purge in one go
+
+        void             insert(const EventId&, qint64 itemId, const QDate& created, KAEvent* event);
+        bool             remove(const EventId&);
+        void             removeCollection(qint64 collectionId);
+        bool             contains(const EventId& id) const  { return mRecords.contains(id); }
+        Record           value(const EventId& id) const     { return mRecords.value(id); }
+        int              count(qint64 collectionId) const;
+        QList<qint64>    collections() const                { return mIndex.keys(); }
+        QVector<EventId> ids(qint64 collectionId) const;
+        QVector<EventId> expired(qint64 collectionId, const QDate& cutoff, int maxCount) const;
+
+    private:
+        typedef QMultiMap<QDate, QString> DateIndex;    // archived event IDs, by creation date
+
+        QHash<EventId, Record>    mRecords;   // all archived events, materialised or not
+        QHash<qint64, DateIndex>  mIndex;     // archived events by creation date, by collection
+};
+
+#endif // ARCHIVEINDEX_H
+
+// vim: et sw=4:
@@ -0,0 +1,162 @@
+/*
+ *  birthdayrecords.cpp  -  records of the birthday alarm for each contact
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "birthdayrecords.h"
+
+
+/******************************************************************************
+* Store the record of a contact's birthday alarm.
+*/
+void BirthdayRecords::insert(const QString& uid, const Record& record)
+{
+    QHash<QString, Record>::ConstIterator it = mRecords.constFind(uid);
+    if (it != mRecords.constEnd()  &&  it.value().itemId != record.itemId)
+        mItemUids.remove(it.value().itemId);
+    mRecords[uid] = record;
+    mItemUids[record.itemId] = uid;
+}
+
+/******************************************************************************
+* Called when a contact with a birthday has been added or changed.
+* The contact's item ID is updated in its record straight away. If its alarm
+* needs to be created or updated, 'record' is set to the new record; once the
+* alarm has been changed, the caller must store the record, with the alarm's
+* new ID, by insert().
+* Reply = CREATE if the contact has no alarm
+*       = UPDATE if the alarm's text or date needs to change
+*       = WAIT if the alarm is being created
+*       = NONE if the alarm doesn't need to change.
+*/
+BirthdayRecords::Action BirthdayRecords::contactChanged(const QString& uid, qint64 itemId, const QString& text, const QDate& birthday, Record& record)
+{
+    QHash<QString, Creation>::Iterator cit = mCreating.find(uid);
+    if (cit != mCreating.end())
+    {
+        Record& current = cit.value().current;
+        current.itemId   = itemId;
+        current.text     = text;
+        current.birthday = birthday;
+        cit.value().removed = false;
+        return WAIT;
+    }
+
+    QHash<QString, Record>::Iterator it = mRecords.find(uid);
+    if (it == mRecords.end())
+    {
+        record = Record();
+        record.itemId   = itemId;
+        record.text     = text;
+        record.birthday = birthday;
+        return CREATE;
+    }
+    if (it.value().itemId != itemId)
+    {
+        mItemUids.remove(it.value().itemId);
+        it.value().itemId = itemId;
+        mItemUids.insert(itemId, uid);
+    }
+    record = it.value();
+    if (record.text == text  &&  record.birthday == birthday)
+        return NONE;
+    record.text     = text;
+    record.birthday = birthday;
+    return UPDATE;
+}
+
+/******************************************************************************
+* Called when a contact has been deleted or no longer has a birthday.
+* Its record is removed, and returned in 'record'.
+* Reply = DELETE if its alarm must be deleted
+*       = WAIT if the alarm is being created, and will be deleted once it has
+*         been
+*       = NONE if the contact has no alarm.
+*/
+BirthdayRecords::Action BirthdayRecords::contactRemoved(const QString& uid, Record& record)
+{
+    QHash<QString, Creation>::Iterator cit = mCreating.find(uid);
+    if (cit != mCreating.end())
+    {
+        cit.value().removed = true;
+        return WAIT;
+    }
+    QHash<QString, Record>::Iterator it = mRecords.find(uid);
+    if (it == mRecords.end())
+        return NONE;
+    record = it.value();
+    mItemUids.remove(record.itemId);
+    mRecords.erase(it);
+    return DELETE;
+}
+
+/******************************************************************************
+* Note that an alarm is being created for a contact. Until created() or
+* createFailed() is called, changes to the contact are held back.
+*/
+void BirthdayRecords::creating(const QString& uid, const Record& record)
+{
+    Creation& creation = mCreating[uid];
+    creation.submitted = record;
+    creation.current   = record;
+    creation.removed   = false;
+}
+
+/******************************************************************************
+* Called when a contact's alarm has been created.
+* The record of the alarm as created is stored. If the contact has changed
+* since creation started, 'record' is set to the record as it now needs to be.
+* Reply = UPDATE if the alarm needs to be updated with the contact's changes;
+*         the caller must store the record by insert() once it has done so
+*       = DELETE if the contact has been removed, so the alarm must be deleted;
+*         no record is stored
+*       = NONE if the alarm is up to date.
+*/
+BirthdayRecords::Action BirthdayRecords::created(const QString& uid, const QString& eventId, Record& record)
+{
+    QHash<QString, Creation>::Iterator cit = mCreating.find(uid);
+    if (cit == mCreating.end())
+        return NONE;
+    const Creation creation = cit.value();
+    mCreating.erase(cit);
+    record = creation.submitted;
+    record.eventId = eventId;
+    if (creation.removed)
+        return DELETE;
+    insert(uid, record);
+    const Record& current = creation.current;
+    if (current.itemId != record.itemId)
+    {
+        record.itemId = current.itemId;
+        insert(uid, record);
+    }
+    if (current.text == record.text  &&  current.birthday == record.birthday)
+        return NONE;
+    record.text     = current.text;
+    record.birthday = current.birthday;
+    return UPDATE;
+}
+
+/******************************************************************************
+* Called when a contact's alarm could not be created.
+*/
+void BirthdayRecords::createFailed(const QString& uid)
+{
+    mCreating.remove(uid);
+}
+
+// vim: et sw=4:
@@ -0,0 +1,84 @@
+/*
+ *  birthdayrecords.h  -  records of the birthday alarm for each contact
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef BIRTHDAYRECORDS_H
+#define BIRTHDAYRECORDS_H
+
+#include <QDate>
+#include <QHash>
+#include <QString>
+
+/*=============================================================================
+= Class BirthdayRecords
+= Records the birthday alarm which belongs to each contact, keyed on the
+= contact's UID so that the alarm follows the contact when its name or birthday
+= changes. It also tracks the contacts whose alarms are still being created,
+= so that changes made to them in the meantime are not lost.
+= It decides what needs to be done to the alarms as contacts change; the
+= caller carries out the decisions and then updates the records.
+=============================================================================*/
+class BirthdayRecords
+{
+    public:
+        struct Record   // the birthday alarm for one contact
+        {
+            Record() : itemId(-1) {}
+            QString eventId;   // ID of the alarm
+            qint64  itemId;    // Akonadi item ID of the contact
+            QString text;      // alarm message text
+            QDate   birthday;  // the contact's birthday
+        };
+        enum Action
+        {
+            NONE,     // the alarm doesn't need to change
+            CREATE,   // create an alarm for the contact
+            UPDATE,   // update the alarm to the record's text and birthday
+            DELETE,   // delete the alarm
+            WAIT      // the alarm is being created, and the change will be applied once it has been
+        };
+
+        void    insert(const QString& uid, const Record&);
+        bool    contains(const QString& uid) const  { return mRecords.contains(uid); }
+        Record  value(const QString& uid) const     { return mRecords.value(uid); }
+        int     count() const                       { return mRecords.count(); }
+        QString uidForItem(qint64 itemId) const     { return mItemUids.value(itemId); }
+        Action  contactChanged(const QString& uid, qint64 itemId, const QString& text, const QDate& birthday, Record&);
+        Action  contactRemoved(const QString& uid, Record&);
+        void    creating(const QString& uid, const Record&);
+        bool    isCreating(const QString& uid) const  { return mCreating.contains(uid); }
+        Action  created(const QString& uid, const QString& eventId, Record&);
+        void    createFailed(const QString& uid);
+
+    private:
+        struct Creation   // an alarm which is being created
+        {
+            Creation() : removed(false) {}
+            Record  submitted;   // the record as it was when creation started
+            Record  current;     // the record updated with later contact changes
+            bool    removed;     // the contact has been deleted, or no longer has a birthday
+        };
+
+        QHash<QString, Record>   mRecords;    // birthday alarms, by contact UID
+        QHash<qint64, QString>   mItemUids;   // contact UIDs, by Akonadi item ID
+        QHash<QString, Creation> mCreating;   // alarms being created, by contact UID
+};
+
+#endif // BIRTHDAYRECORDS_H
+
+// vim: et sw=4:
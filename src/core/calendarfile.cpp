@@ -0,0 +1,385 @@
+/*
+ *  calendarfile.cpp  -  reading and writing of KAlarm calendar files
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "calendarfile.h"
+
+#include <KCalCore/ICalFormat>
+#include <KCalCore/MemoryCalendar>
+
+#include <QFile>
+#include <QIODevice>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QThreadPool>
+#include <QTimeZone>
+#include <QVector>
+#include <QWaitCondition>
+#include "kalarm_debug.h"
+
+using namespace KCalCore;
+
+namespace
+{
+
+const int EXPORT_BATCH_SIZE = 200;   // number of alarms to serialise in each export task
+
+/*=============================================================================
+= Data shared between CalendarFile::exportEvents() and its worker tasks.
+=============================================================================*/
+struct ExportChunk
+{
+    ExportChunk() : exported(0), failed(false), done(false) {}
+    QByteArray                   events;      // serialised VEVENT components
+    QMap<QByteArray, QByteArray> timezones;   // VTIMEZONE components used, by TZID
+    int                          exported;    // number of alarms serialised
+    bool                         failed;      // some alarms could not be serialised
+    bool                         done;        // the chunk has been serialised
+};
+
+struct ExportData
+{
+    KAEvent::List        events;
+    QTimeZone            timeZone;
+    QVector<ExportChunk> chunks;
+    QMutex               mutex;     // protects 'chunks'
+    QWaitCondition       chunkDone;
+};
+
+/*=============================================================================
+= Worker thread task to serialise one chunk of exported alarms.
+=============================================================================*/
+class ExportTask : public QRunnable
+{
+    public:
+        ExportTask(ExportData* data, int chunk) : mData(data), mChunk(chunk) {}
+        void run() override;
+    private:
+        ExportData* mData;
+        int         mChunk;
+};
+
+void ExportTask::run()
+{
+    ExportChunk chunk;
+    MemoryCalendar::Ptr calendar(new MemoryCalendar(mData->timeZone));
+    const int start = mChunk * EXPORT_BATCH_SIZE;
+    const int end = qMin(start + EXPORT_BATCH_SIZE, mData->events.count());
+    for (int i = start;  i < end;  ++i)
+    {
+        const KAEvent* event = mData->events[i];
+        Event::Ptr kcalEvent(new Event);
+        CalEvent::Type type = event->category();
+        QString id = CalEvent::uid(kcalEvent->uid(), type);
+        kcalEvent->setUid(id);
+        event->updateKCalEvent(kcalEvent, KAEvent::UID_IGNORE);
+        if (calendar->addEvent(kcalEvent))
+            ++chunk.exported;
+        else
+            chunk.failed = true;
+    }
+    if (chunk.exported)
+    {
+        ICalFormat format;
+        CalendarFile::splitComponents(format.toString(calendar).toUtf8(), &chunk.events, &chunk.timezones);
+    }
+    calendar->close();
+
+    QMutexLocker locker(&mData->mutex);
+    chunk.done = true;
+    mData->chunks[mChunk] = chunk;
+    mData->chunkDone.wakeAll();
+}
+
+}
+
+namespace CalendarFile
+{
+
+/******************************************************************************
+* Load a calendar file. Find the version of KAlarm which wrote it, and do any
+* necessary conversions to the current format.
+*/
+bool load(const FileStorage::Ptr& fileStorage, KACalendar::Compat* compat)
+{
+    if (!fileStorage->load())
+        return false;
+    QString versionString;
+    const int version = KACalendar::updateVersion(fileStorage, versionString);
+    if (compat)
+    {
+        // If the calendar was created by another program, or an unknown
+        // version of KAlarm, it is incompatible.
+        *compat = (version == KACalendar::IncompatibleFormat) ? KACalendar::Incompatible : KACalendar::Current;
+    }
+    return true;
+}
+
+/******************************************************************************
+* Create KAEvents for the events read from a calendar file.
+*/
+KAEvent::List readEvents(const Event::List& kcalevents)
+{
+    KAEvent::List events;
+    for (int i = 0, end = kcalevents.count();  i < end;  ++i)
+    {
+        const Event::Ptr kcalevent = kcalevents[i];
+        if (kcalevent->alarms().isEmpty())
+            continue;    // ignore events without alarms
+
+        KAEvent* event = new KAEvent(kcalevent);
+        if (!event->isValid())
+        {
+            qCWarning(KALARM_LOG) << "Ignoring unusable event" << kcalevent->uid();
+            delete event;
+            continue;    // ignore events without usable alarms
+        }
+        events += event;
+    }
+    return events;
+}
+
+/******************************************************************************
+* Convert a range of the events read from a calendar file into KAEvents for
+* import. The events are not modified, so that they can safely be read by more
+* than one thread.
+*/
+Batch importEvents(const Event::List& events, int start, int end, KACalendar::Compat compat, CalEvent::Types wanted)
+{
+    Batch batch;
+    for (int i = start;  i < end;  ++i)
+    {
+        const Event::Ptr event = events[i];
+        if (event->alarms().isEmpty())
+            continue;    // ignore events without alarms
+        CalEvent::Type type = CalEvent::status(event);
+        if (type == CalEvent::TEMPLATE)
+        {
+            // If we know the event was not created by KAlarm, don't treat it as a template
+            if (compat == KACalendar::Incompatible)
+                type = CalEvent::ACTIVE;
+        }
+        if (!(type & wanted))
+            continue;
+
+        Event::Ptr newev(new Event(*event));
+
+        // If there is a display alarm without display text, use the event
+        // summary text instead.
+        if (type == CalEvent::ACTIVE  &&  !newev->summary().isEmpty())
+        {
+            const Alarm::List& alarms = newev->alarms();
+            for (int ai = 0, aend = alarms.count();  ai < aend;  ++ai)
+            {
+                Alarm::Ptr alarm = alarms[ai];
+                if (alarm->type() == Alarm::Display  &&  alarm->text().isEmpty())
+                    alarm->setText(newev->summary());
+            }
+            newev->setSummary(QString());   // KAlarm only uses summary for template names
+        }
+
+        // Give the event a new ID
+        newev->setUid(CalEvent::uid(CalFormat::createUniqueId(), type));
+        KAEvent* newEvent = new KAEvent(newev);
+        if (!newEvent->isValid())
+        {
+            delete newEvent;
+            continue;    // ignore events without usable alarms
+        }
+        batch[type] += newEvent;
+    }
+    return batch;
+}
+
+/******************************************************************************
+* Return the start of a KAlarm iCalendar file, up to but not including the
+* END:VCALENDAR line.
+*/
+QByteArray header(const QTimeZone& timeZone)
+{
+    MemoryCalendar::Ptr calendar(new MemoryCalendar(timeZone));
+    KACalendar::setKAlarmVersion(calendar);
+    ICalFormat format;
+    QByteArray ical = format.toString(calendar).toUtf8();
+    const int i = ical.lastIndexOf("END:VCALENDAR");
+    if (i >= 0)
+        ical.truncate(i);
+    return ical;
+}
+
+/******************************************************************************
+* Split the top level components of an iCalendar text into events and time
+* zone definitions, without parsing the component contents.
+*/
+void splitComponents(const QByteArray& ical, QByteArray* events, QMap<QByteArray, QByteArray>* timezones)
+{
+    int depth = 0;
+    bool isTimezone = false;
+    QByteArray component;
+    QByteArray tzid;
+    for (int pos = 0, length = ical.length();  pos < length;  )
+    {
+        int next = ical.indexOf('\n', pos);
+        next = (next < 0) ? length : next + 1;
+        const QByteArray line = ical.mid(pos, next - pos);
+        pos = next;
+        // Folded continuation lines start with white space
+        const bool continuation = line.startsWith(' ')  ||  line.startsWith('\t');
+        const QByteArray text = continuation ? QByteArray() : line.trimmed();
+        if (text.startsWith("BEGIN:"))
+        {
+            if (++depth == 2)
+            {
+                isTimezone = (text == "BEGIN:VTIMEZONE");
+                component.clear();
+                tzid.clear();
+            }
+        }
+        if (depth < 2)
+            continue;    // ignore VCALENDAR properties
+        if (depth == 2  &&  isTimezone  &&  text.startsWith("TZID:"))
+            tzid = text.mid(5);
+        if (isTimezone ? timezones != nullptr : events != nullptr)
+            component += line;
+        if (text.startsWith("END:")  &&  depth-- == 2)
+        {
+            if (!isTimezone)
+            {
+                if (events)
+                    *events += component;
+            }
+            else if (timezones)
+                timezones->insert(tzid, component);
+        }
+    }
+}
+
+/******************************************************************************
+* Serialise alarms for export in parallel chunks, and write each chunk to the
+* file in turn as soon as it is ready.
+*/
+bool exportEvents(QIODevice* file, const KAEvent::List& events, const QTimeZone& timeZone,
+                  QMap<QByteArray, QByteArray>* timezones, int* exported)
+{
+    ExportData data;
+    data.events = events;
+    data.timeZone = timeZone;
+    data.chunks.resize((events.count() + EXPORT_BATCH_SIZE - 1) / EXPORT_BATCH_SIZE);
+    QThreadPool pool;
+    for (int c = 0, count = data.chunks.count();  c < count;  ++c)
+        pool.start(new ExportTask(&data, c));
+
+    bool success = true;
+    *exported = 0;
+    for (int c = 0, count = data.chunks.count();  c < count;  ++c)
+    {
+        ExportChunk chunk;
+        {
+            QMutexLocker locker(&data.mutex);
+            while (!data.chunks[c].done)
+                data.chunkDone.wait(&data.mutex);
+            chunk = data.chunks[c];
+            data.chunks[c] = ExportChunk();   // release the chunk's memory
+        }
+        if (chunk.failed)
+            success = false;
+        if (!chunk.exported)
+            continue;
+        *exported += chunk.exported;
+        // Write any time zone definitions which are not already in the file
+        for (QMap<QByteArray, QByteArray>::ConstIterator it = chunk.timezones.constBegin();  it != chunk.timezones.constEnd();  ++it)
+        {
+            if (!timezones->contains(it.key()))
+            {
+                file->write(it.value());
+                timezones->insert(it.key(), QByteArray());
+            }
+        }
+        file->write(chunk.events);
+    }
+    pool.waitForDone();
+    return success;
+}
+
+/******************************************************************************
+* Export alarms to a calendar file, optionally appending them to the calendar
+* which is already in the file.
+*/
+ExportStatus exportToFile(const QString& fileName, bool append, const KAEvent::List& events, const QTimeZone& timeZone,
+                          int* exported)
+{
+    if (exported)
+        *exported = 0;
+    // If appending, find where to insert the alarms into the existing calendar.
+    QByteArray existing;
+    int insertPos = -1;
+    QMap<QByteArray, QByteArray> timezones;   // time zones already in the calendar, by TZID
+    if (append)
+    {
+        QFile existingFile(fileName);
+        if (existingFile.open(QIODevice::ReadOnly))
+            existing = existingFile.readAll();
+        if (!existing.trimmed().isEmpty())
+        {
+            insertPos = existing.lastIndexOf("END:VCALENDAR");
+            if (insertPos < 0  ||  (insertPos > 0  &&  existing[insertPos - 1] != '\n'))
+            {
+                qCCritical(KALARM_LOG) << "Error loading calendar file" << fileName << "for append";
+                return EXPORT_BAD_APPEND;
+            }
+            splitComponents(existing.left(insertPos), nullptr, &timezones);
+        }
+    }
+
+    QSaveFile saveFile(fileName);
+    if (!saveFile.open(QIODevice::WriteOnly))
+    {
+        qCCritical(KALARM_LOG) << fileName << ": failed";
+        return EXPORT_WRITE_ERROR;
+    }
+    if (insertPos >= 0)
+        saveFile.write(existing.constData(), insertPos);
+    else
+        saveFile.write(header(timeZone));
+    existing.clear();
+
+    // Serialise the alarms in parallel chunks, and write each chunk to the
+    // file in turn as soon as it is ready.
+    int count = 0;
+    const bool success = exportEvents(&saveFile, events, timeZone, &timezones, &count);
+    if (!count)
+    {
+        saveFile.cancelWriting();
+        return success ? EXPORT_NONE : EXPORT_FAILED_ALARMS;
+    }
+    saveFile.write("END:VCALENDAR\r\n");
+    if (!saveFile.commit())
+    {
+        qCCritical(KALARM_LOG) << fileName << ": failed";
+        return EXPORT_WRITE_ERROR;
+    }
+    if (exported)
+        *exported = count;
+    return success ? EXPORT_OK : EXPORT_FAILED_ALARMS;
+}
+
+}
+
+// vim: et sw=4:
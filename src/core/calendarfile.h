@@ -0,0 +1,120 @@
+/*
+ *  calendarfile.h  -  reading and writing of KAlarm calendar files
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef CALENDARFILE_H
+#define CALENDARFILE_H
+
+/* The processing of calendar files which is done by AlarmCalendar when it
+ * loads the display calendar, and imports and exports alarms. None of these
+ * functions need the application or Akonadi, so that they can also be used by
+ * the calendar benchmark. The functions which are marked as thread safe may be
+ * called from worker threads.
+ */
+
+#include <kalarmcal/kacalendar.h>
+#include <kalarmcal/kaevent.h>
+
+#include <KCalCore/Event>
+#include <KCalCore/FileStorage>
+
+#include <QByteArray>
+#include <QMap>
+#include <QString>
+
+class QIODevice;
+class QTimeZone;
+
+using namespace KAlarmCal;
+
+namespace CalendarFile
+{
+
+typedef QMap<CalEvent::Type, KAEvent::List> Batch;   // alarms, by alarm type
+
+enum ExportStatus
+{
+    EXPORT_OK,             // all alarms were exported
+    EXPORT_NONE,           // there were no alarms to export; the file is unchanged
+    EXPORT_FAILED_ALARMS,  // some alarms could not be serialised; the file is only changed if others were exported
+    EXPORT_BAD_APPEND,     // the file to append to is not a calendar; it is unchanged
+    EXPORT_WRITE_ERROR     // the file could not be written; it is unchanged
+};
+
+/** Load a calendar file, and find the version of KAlarm which wrote it.
+ *  Any necessary conversions to the current KAlarm format are done.
+ *  @param compat  if non-null, receives the compatibility of the file with KAlarm.
+ *  Reply = false if the file could not be loaded.
+ */
+bool load(const KCalCore::FileStorage::Ptr&, KACalendar::Compat* compat = nullptr);
+
+/** Create KAEvents for the events read from a calendar file, keeping their IDs.
+ *  Events without usable alarms are ignored.
+ *  Thread safe.
+ */
+KAEvent::List readEvents(const KCalCore::Event::List&);
+
+/** Convert a range of the events read from a calendar file into KAEvents for
+ *  import, giving each a new unique ID. The events are not modified.
+ *  @param compat  the compatibility of the file with KAlarm.
+ *  @param wanted  the alarm types to import; others are ignored.
+ *  Reply = the new alarms, by alarm type. The caller must delete them.
+ *  Thread safe.
+ */
+Batch importEvents(const KCalCore::Event::List&, int start, int end, KACalendar::Compat compat, CalEvent::Types wanted);
+
+/** Return the start of a KAlarm iCalendar file, up to but not including the
+ *  END:VCALENDAR line.
+ */
+QByteArray header(const QTimeZone&);
+
+/** Split the top level components of an iCalendar text into events and time
+ *  zone definitions, without parsing the component contents.
+ *  @param events     receives all components other than time zones, concatenated.
+ *  @param timezones  receives the time zone components, indexed by TZID.
+ *  Either may be null if it is not required.
+ *  Thread safe.
+ */
+void splitComponents(const QByteArray& ical, QByteArray* events, QMap<QByteArray, QByteArray>* timezones);
+
+/** Serialise alarms for export, in parallel chunks, and write the components
+ *  to a file in order as each chunk becomes ready. The calendar header and
+ *  END:VCALENDAR line are not written.
+ *  @param timezones  the time zone definitions already in the file, by TZID.
+ *                    Definitions which are written are added to it.
+ *  @param exported   receives the number of alarms written.
+ *  Reply = false if any alarms could not be serialised.
+ */
+bool exportEvents(QIODevice* file, const KAEvent::List&, const QTimeZone&,
+                  QMap<QByteArray, QByteArray>* timezones, int* exported);
+
+/** Export alarms to a calendar file. The file is replaced atomically, so that
+ *  it is left unchanged if the export fails.
+ *  @param append  if true, and the file already has contents, the alarms are
+ *                 inserted before its END:VCALENDAR line. The existing contents
+ *                 are copied unchanged, without being parsed.
+ *  @param exported  if non-null, receives the number of alarms written.
+ */
+ExportStatus exportToFile(const QString& fileName, bool append, const KAEvent::List&, const QTimeZone&,
+                          int* exported = nullptr);
+
+}
+
+#endif // CALENDARFILE_H
+
+// vim: et sw=4:
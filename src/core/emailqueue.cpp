@@ -0,0 +1,373 @@
+/*
+ *  emailqueue.cpp  -  ordering and retrying of queued emails
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "emailqueue.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QTimer>
+#include "kalarm_debug.h"
+
+namespace
+{
+const quint32 SPOOL_VERSION = 1;   // format version of spool files
+}
+
+EmailQueue::EmailQueue(Transport* transport, QObject* parent)
+    : QObject(parent),
+      mTransport(transport),
+      mNextId(1),
+      mSpoolCount(0),
+      mWorkers(1),
+      mRetries(0),
+      mRetryDelay(5000),
+      mStartPending(false)
+{
+}
+
+EmailQueue::~EmailQueue()
+{
+    qDeleteAll(mEntries);
+}
+
+/******************************************************************************
+* Set the maximum number of emails to send at once for each transport.
+*/
+void EmailQueue::setWorkers(int count)
+{
+    mWorkers = qMax(count, 1);
+}
+
+/******************************************************************************
+* Set how many times a failed send is retried.
+*/
+void EmailQueue::setRetries(int count)
+{
+    mRetries = qMax(count, 0);
+}
+
+/******************************************************************************
+* Set the delay before the first retry of a failed send. The delay doubles for
+* each subsequent retry.
+*/
+void EmailQueue::setRetryDelay(int msecs)
+{
+    mRetryDelay = qMax(msecs, 1);
+}
+
+/******************************************************************************
+* Set the directory in which to keep the data of queued emails until they have
+* been sent. It is created if necessary.
+*/
+void EmailQueue::setSpoolDirectory(const QString& path)
+{
+    mSpoolDir = path;
+    if (!QDir().mkpath(path))
+        qCWarning(KALARM_LOG) << "EmailQueue: cannot create spool directory" << path;
+}
+
+/******************************************************************************
+* Add an email to the send queue for its transport. Sending is started from the
+* event loop, so that the caller can record the returned ID before the
+* transport is asked to send it.
+* If a spool directory is set, 'data' is written to it until the email has been
+* sent or has finally failed.
+* Reply = ID of the queued email, to be passed to sendDone().
+*/
+quint64 EmailQueue::enqueue(int transportId, const QStringList& recipients, const QByteArray& data)
+{
+    Entry* entry = addEntry(transportId, recipients);
+    if (!mSpoolDir.isEmpty())
+        entry->spoolFile = spool(transportId, recipients, data);
+    return entry->id;
+}
+
+/******************************************************************************
+* Queue again any emails left in the spool directory when the program last
+* exited, in the order in which they were originally queued. Files belonging
+* to emails which are already queued are ignored, and unreadable files are
+* deleted.
+* Reply = IDs of the restored emails, in queuing order.
+*/
+QList<quint64> EmailQueue::restore()
+{
+    QList<quint64> ids;
+    if (mSpoolDir.isEmpty())
+        return ids;
+    QSet<QString> queued;   // spool files of emails already in the queue
+    for (QHash<quint64, Entry*>::ConstIterator it = mEntries.constBegin();  it != mEntries.constEnd();  ++it)
+        queued.insert(it.value()->spoolFile);
+
+    const QDir dir(mSpoolDir);
+    const QStringList files = dir.entryList(QDir::Files, QDir::Name);
+    for (int i = 0, count = files.count();  i < count;  ++i)
+    {
+        if (files[i].contains(QLatin1Char('.')))
+            continue;    // ignore any temporary file left by QSaveFile
+        const QString path = dir.absoluteFilePath(files[i]);
+        if (queued.contains(path))
+            continue;
+        quint32 version = 0;
+        qint32 transportId = -1;
+        QStringList recipients;
+        {
+            QFile file(path);
+            if (file.open(QIODevice::ReadOnly))
+            {
+                QDataStream stream(&file);
+                stream >> version >> transportId >> recipients;
+                if (stream.status() != QDataStream::Ok)
+                    version = 0;
+            }
+        }
+        if (version != SPOOL_VERSION)
+        {
+            qCWarning(KALARM_LOG) << "EmailQueue: discarding unreadable spool file" << path;
+            QFile::remove(path);
+            continue;
+        }
+        Entry* entry = addEntry(transportId, recipients);
+        entry->spoolFile = path;
+        ids += entry->id;
+    }
+    if (!ids.isEmpty())
+        qCDebug(KALARM_LOG) << "EmailQueue: restored" << ids.count() << "emails";
+    return ids;
+}
+
+/******************************************************************************
+* Return the data which was passed to enqueue() for a queued email.
+* Reply = the data, or null if there is no spool directory or it can't be read.
+*/
+QByteArray EmailQueue::data(quint64 id) const
+{
+    const Entry* entry = mEntries.value(id);
+    if (!entry  ||  entry->spoolFile.isEmpty())
+        return QByteArray();
+    QFile file(entry->spoolFile);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    QDataStream stream(&file);
+    quint32 version;
+    qint32 transportId;
+    QStringList recipients;
+    QByteArray data;
+    stream >> version >> transportId >> recipients >> data;
+    return (stream.status() == QDataStream::Ok) ? data : QByteArray();
+}
+
+/******************************************************************************
+* Remove an email which is not currently being sent from the queue, without
+* sending it. finished() is not emitted.
+*/
+void EmailQueue::cancel(quint64 id)
+{
+    Entry* entry = mEntries.value(id);
+    if (!entry  ||  entry->sending)
+        return;
+    const int transportId = entry->transportId;
+    removeEntry(entry);
+    startSends(transportId);
+}
+
+/******************************************************************************
+* Create a queue entry for an email, and schedule sending to start.
+*/
+EmailQueue::Entry* EmailQueue::addEntry(int transportId, const QStringList& recipients)
+{
+    Entry* entry = new Entry;
+    entry->id          = mNextId++;
+    entry->transportId = transportId;
+    for (int i = 0, count = recipients.count();  i < count;  ++i)
+        entry->recipients.insert(recipients[i].toLower());
+    entry->queuedTime.start();
+    mEntries.insert(entry->id, entry);
+    mQueues[transportId].append(entry);
+    if (!mStartPending)
+    {
+        mStartPending = true;
+        QTimer::singleShot(0, this, &EmailQueue::slotStartSends);
+    }
+    return entry;
+}
+
+/******************************************************************************
+* Remove an email from the queue, and delete its spool file.
+*/
+void EmailQueue::removeEntry(Entry* entry)
+{
+    mEntries.remove(entry->id);
+    QList<Entry*>& queue = mQueues[entry->transportId];
+    queue.removeAll(entry);
+    if (queue.isEmpty())
+        mQueues.remove(entry->transportId);
+    if (!entry->spoolFile.isEmpty())
+        QFile::remove(entry->spoolFile);
+    delete entry;
+}
+
+/******************************************************************************
+* Write an email's data to a new file in the spool directory. The file names
+* sort in the order in which the emails were queued.
+* Reply = path of the file, or empty if error.
+*/
+QString EmailQueue::spool(int transportId, const QStringList& recipients, const QByteArray& data)
+{
+    const QString path = mSpoolDir + QLatin1Char('/')
+                       + QStringLiteral("%1-%2").arg(QDateTime::currentMSecsSinceEpoch(), 15, 10, QLatin1Char('0'))
+                                                .arg(++mSpoolCount, 6, 10, QLatin1Char('0'));
+    QSaveFile file(path);
+    if (file.open(QIODevice::WriteOnly))
+    {
+        QDataStream stream(&file);
+        stream << SPOOL_VERSION << qint32(transportId) << recipients << data;
+        if (stream.status() == QDataStream::Ok  &&  file.commit())
+            return path;
+    }
+    qCWarning(KALARM_LOG) << "EmailQueue: error writing spool file" << path;
+    return QString();
+}
+
+/******************************************************************************
+* Start sending newly queued emails, for all transports.
+*/
+void EmailQueue::slotStartSends()
+{
+    mStartPending = false;
+    const QList<int> transportIds = mQueues.keys();
+    for (int i = 0, count = transportIds.count();  i < count;  ++i)
+        startSends(transportIds[i]);
+}
+
+/******************************************************************************
+* Return the number of send attempts made so far for a queued email.
+*/
+int EmailQueue::attempts(quint64 id) const
+{
+    const Entry* entry = mEntries.value(id);
+    return entry ? entry->attempts : 0;
+}
+
+/******************************************************************************
+* Start sending as many queued emails for a transport as the number of
+* parallel send workers allows.
+* An email is held back while any earlier queued email to one of its recipients
+* is still waiting or being sent, so that emails to each recipient are always
+* sent in the order they were queued.
+*/
+void EmailQueue::startSends(int transportId)
+{
+    const QList<Entry*> queue = mQueues.value(transportId);
+    int active = 0;
+    for (int i = 0, count = queue.count();  i < count;  ++i)
+        if (queue[i]->sending)
+            ++active;
+    QSet<QString> busy;   // recipients of emails earlier in the queue
+    for (int i = 0, count = queue.count();  i < count  &&  active < mWorkers;  ++i)
+    {
+        Entry* entry = queue[i];
+        const bool blocked = busy.intersects(entry->recipients);
+        busy.unite(entry->recipients);
+        if (blocked  ||  entry->sending  ||  entry->retryDelay)
+            continue;
+        ++entry->attempts;
+        entry->sending = true;
+        ++active;
+        mTransport->startSend(entry->id);
+    }
+}
+
+/******************************************************************************
+* Called by the transport when an attempt to send an email has completed.
+* If it failed, it is retried after a delay which doubles with each attempt.
+* Otherwise, finished() is emitted and the email is removed from the queue.
+*/
+void EmailQueue::sendDone(quint64 id, bool success, const QString& error)
+{
+    Entry* entry = mEntries.value(id);
+    if (!entry  ||  !entry->sending)
+    {
+        qCCritical(KALARM_LOG) << "EmailQueue: unknown email completed:" << id;
+        return;
+    }
+    entry->sending = false;
+    const int transportId = entry->transportId;
+    if (!success)
+    {
+        qCWarning(KALARM_LOG) << "EmailQueue: send failed:" << error;
+        if (entry->attempts <= mRetries)
+        {
+            // Retry after a delay, leaving the email in the queue so that
+            // later emails to the same recipients continue to wait for it.
+            ++mStatistics.retries;
+            entry->retryDelay = mRetryDelay << qMin(entry->attempts - 1, 8);
+            entry->retryTimer.start();
+            qCDebug(KALARM_LOG) << "EmailQueue: retrying in" << entry->retryDelay << "ms";
+            QTimer::singleShot(entry->retryDelay, Qt::PreciseTimer, this, &EmailQueue::slotRetry);
+            startSends(transportId);
+            return;
+        }
+        ++mStatistics.failed;
+    }
+    else
+    {
+        const qint64 latency = entry->queuedTime.elapsed();
+        ++mStatistics.sent;
+        mStatistics.totalLatency += latency;
+        mStatistics.maxLatency = qMax(mStatistics.maxLatency, latency);
+    }
+
+    removeEntry(entry);
+    Q_EMIT finished(id, success, error);
+    startSends(transportId);
+}
+
+/******************************************************************************
+* Called when the retry delay for a failed email has expired.
+* Make due emails available for sending again. If any other email is still
+* waiting to retry, make sure that this is called again when it is due.
+*/
+void EmailQueue::slotRetry()
+{
+    int nextDelay = -1;
+    const QList<int> transportIds = mQueues.keys();
+    for (int t = 0, tcount = transportIds.count();  t < tcount;  ++t)
+    {
+        const QList<Entry*> queue = mQueues.value(transportIds[t]);
+        for (int i = 0, count = queue.count();  i < count;  ++i)
+        {
+            Entry* entry = queue[i];
+            if (!entry->retryDelay)
+                continue;
+            const qint64 remaining = entry->retryDelay - entry->retryTimer.elapsed();
+            if (remaining <= 0)
+                entry->retryDelay = 0;
+            else if (nextDelay < 0  ||  remaining < nextDelay)
+                nextDelay = static_cast<int>(remaining);
+        }
+        startSends(transportIds[t]);
+    }
+    if (nextDelay >= 0)
+        QTimer::singleShot(nextDelay, Qt::PreciseTimer, this, &EmailQueue::slotRetry);
+}
+
+// vim: et sw=4:
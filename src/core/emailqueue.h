@@ -0,0 +1,129 @@
+/*
+ *  emailqueue.h  -  ordering and retrying of queued emails
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef EMAILQUEUE_H
+#define EMAILQUEUE_H
+
+#include <QElapsedTimer>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+
+/*=============================================================================
+= Class EmailQueue
+= Decides when each queued email is handed to its mail transport. For each
+= transport, up to a set number of emails are sent at once, but an email is
+= held back while an earlier email to any of its recipients is still queued,
+= so that emails to each recipient are always sent in order. Failed sends are
+= retried a set number of times, with a delay which doubles after each attempt.
+= If a spool directory is set, each email's data is written to a file there
+= until it has been sent or has finally failed, so that emails which are still
+= waiting or retrying when the program exits can be restored at its next start.
+= The actual sending is done by a Transport, so that the queue can be driven
+= by a stand-in transport for testing.
+=============================================================================*/
+class EmailQueue : public QObject
+{
+        Q_OBJECT
+    public:
+        // Sends emails on behalf of the queue.
+        class Transport
+        {
+            public:
+                virtual ~Transport() {}
+                /** Start sending an email. When it completes, EmailQueue::sendDone()
+                 *  must be called, but not from within this method.
+                 */
+                virtual void startSend(quint64 id) = 0;
+        };
+
+        struct Statistics
+        {
+            Statistics() : sent(0), failed(0), retries(0), totalLatency(0), maxLatency(0) {}
+            int     sent;           // number of emails successfully sent
+            int     failed;         // number of emails which failed after all retries
+            int     retries;        // number of send retries
+            qint64  totalLatency;   // total milliseconds from queuing to successful send
+            qint64  maxLatency;     // longest time in milliseconds from queuing to successful send
+        };
+
+        explicit EmailQueue(Transport*, QObject* parent = nullptr);
+        ~EmailQueue();
+        void     setWorkers(int count);
+        void     setRetries(int count);
+        void     setRetryDelay(int msecs);
+        void     setSpoolDirectory(const QString& path);
+        quint64  enqueue(int transportId, const QStringList& recipients, const QByteArray& data = QByteArray());
+        QList<quint64> restore();
+        QByteArray data(quint64 id) const;
+        void     cancel(quint64 id);
+        void     sendDone(quint64 id, bool success, const QString& error = QString());
+        int      count() const       { return mEntries.count(); }
+        int      attempts(quint64 id) const;
+        const Statistics& statistics() const  { return mStatistics; }
+
+    Q_SIGNALS:
+        /** Emitted when an email has been sent, or has failed after all retries.
+         *  The email is no longer in the queue.
+         */
+        void finished(quint64 id, bool success, const QString& error);
+
+    private Q_SLOTS:
+        void     slotStartSends();
+        void     slotRetry();
+
+    private:
+        struct Entry
+        {
+            Entry() : id(0), transportId(-1), attempts(0), retryDelay(0), sending(false) {}
+            quint64        id;
+            int            transportId;
+            QSet<QString>  recipients;   // all recipients, lower case
+            QElapsedTimer  queuedTime;   // when the email was queued
+            QElapsedTimer  retryTimer;   // when the last send attempt failed
+            QString        spoolFile;    // file holding the email's data, or empty
+            int            attempts;     // number of send attempts made so far
+            int            retryDelay;   // milliseconds to wait before retrying, or 0 if not waiting
+            bool           sending;      // the email is being sent by the transport
+        };
+
+        void     startSends(int transportId);
+        Entry*   addEntry(int transportId, const QStringList& recipients);
+        void     removeEntry(Entry*);
+        QString  spool(int transportId, const QStringList& recipients, const QByteArray& data);
+
+        Transport*                  mTransport;
+        QHash<int, QList<Entry*> >  mQueues;       // queued emails, by transport ID, in queuing order
+        QHash<quint64, Entry*>      mEntries;      // queued emails, by ID
+        QString                     mSpoolDir;     // directory holding queued emails' data, or empty
+        Statistics                  mStatistics;
+        quint64                     mNextId;
+        int                         mSpoolCount;   // number of spool files written, to keep their names in order
+        int                         mWorkers;      // maximum number of emails to send at once per transport
+        int                         mRetries;      // number of times to retry a failed send
+        int                         mRetryDelay;   // milliseconds to wait before the first retry
+        bool                        mStartPending; // slotStartSends() has been scheduled
+};
+
+#endif // EMAILQUEUE_H
+
+// vim: et sw=4:
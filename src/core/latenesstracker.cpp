@@ -0,0 +1,109 @@
+/*
+ *  latenesstracker.cpp  -  rolling record of how late alarms trigger
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "latenesstracker.h"
+#include "metrics.h"
+
+#include <algorithm>
+
+
+LatenessTracker::LatenessTracker(int windowSize)
+    : mNext(0),
+      mWindowSize(qMax(windowSize, 1))
+{
+    mSamples.reserve(mWindowSize);
+    Metrics::describe("kalarm_trigger_lateness_seconds", Metrics::HISTOGRAM,
+                      "Time between when an alarm was scheduled and when it was executed, by cause of lateness",
+                      QVector<double>() << 1 << 5 << 15 << 30 << 60 << 300 << 900 << 3600 << 86400);
+    Metrics::describe("kalarm_trigger_lateness_p99_seconds", Metrics::GAUGE,
+                      "99th percentile of the lateness of the most recent alarm triggers");
+}
+
+/******************************************************************************
+* Record the lateness of an alarm which has just been executed.
+*/
+void LatenessTracker::record(int secs, Cause cause)
+{
+    Sample sample;
+    sample.secs  = qMax(secs, 0);
+    sample.cause = cause;
+    if (mSamples.count() < mWindowSize)
+        mSamples += sample;
+    else
+    {
+        mSamples[mNext] = sample;
+        mNext = (mNext + 1) % mWindowSize;
+    }
+    Metrics::observe("kalarm_trigger_lateness_seconds", sample.secs, Metrics::label("cause", causeName(cause)));
+    Metrics::set("kalarm_trigger_lateness_p99_seconds", percentile(99));
+}
+
+/******************************************************************************
+* Return the number of triggers in the rolling window with a given cause, or
+* with any cause if 'cause' is CAUSE_COUNT.
+*/
+int LatenessTracker::count(Cause cause) const
+{
+    if (cause == CAUSE_COUNT)
+        return mSamples.count();
+    int n = 0;
+    for (int i = 0, end = mSamples.count();  i < end;  ++i)
+        if (mSamples[i].cause == cause)
+            ++n;
+    return n;
+}
+
+/******************************************************************************
+* Return a percentile of the lateness of the triggers in the rolling window,
+* for a given cause, or for all causes if 'cause' is CAUSE_COUNT.
+* Reply = seconds, or 0 if there are no triggers.
+*/
+int LatenessTracker::percentile(int percent, Cause cause) const
+{
+    QVector<int> secs;
+    secs.reserve(mSamples.count());
+    for (int i = 0, end = mSamples.count();  i < end;  ++i)
+        if (cause == CAUSE_COUNT  ||  mSamples[i].cause == cause)
+            secs += mSamples[i].secs;
+    if (secs.isEmpty())
+        return 0;
+    const int index = (secs.count() - 1) * qBound(0, percent, 100) / 100;
+    std::nth_element(secs.begin(), secs.begin() + index, secs.end());
+    return secs[index];
+}
+
+/******************************************************************************
+* Return the name of a cause of lateness, as used in metric labels.
+*/
+QString LatenessTracker::causeName(Cause cause)
+{
+    switch (cause)
+    {
+        case ON_TIME:            return QStringLiteral("on_time");
+        case NOT_RUNNING:        return QStringLiteral("not_running");
+        case SUSPEND:            return QStringLiteral("suspend");
+        case AKONADI_NOT_READY:  return QStringLiteral("akonadi_not_ready");
+        case QUEUE_BACKLOG:      return QStringLiteral("queue_backlog");
+        case PRE_ACTION:         return QStringLiteral("pre_action");
+        case OTHER:
+        default:                 return QStringLiteral("other");
+    }
+}
+
+// vim: et sw=4:
@@ -0,0 +1,67 @@
+/*
+ *  latenesstracker.h  -  rolling record of how late alarms trigger
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef LATENESSTRACKER_H
+#define LATENESSTRACKER_H
+
+#include <QString>
+#include <QVector>
+
+/*=============================================================================
+= Class LatenessTracker
+= Records how many seconds after their scheduled times alarms are executed,
+= and the cause of any lateness. The most recent triggers are held in a
+= rolling window from which percentiles are calculated; all triggers are also
+= recorded in the kalarm_trigger_lateness_seconds metric.
+=============================================================================*/
+class LatenessTracker
+{
+    public:
+        enum Cause
+        {
+            ON_TIME,            // not late, apart from normal timer leeway
+            NOT_RUNNING,        // the alarm was due before KAlarm started
+            SUSPEND,            // the alarm was due while the system was suspended
+            AKONADI_NOT_READY,  // the alarm was due before the calendars were populated
+            QUEUE_BACKLOG,      // the alarm waited in the action queue behind other actions
+            PRE_ACTION,         // the alarm waited for its pre-alarm action to complete
+            OTHER,              // the cause is unknown
+            CAUSE_COUNT
+        };
+
+        explicit LatenessTracker(int windowSize = 1000);
+        void     record(int secs, Cause);
+        int      count(Cause = CAUSE_COUNT) const;
+        int      percentile(int percent, Cause = CAUSE_COUNT) const;
+        static QString causeName(Cause);
+
+    private:
+        struct Sample
+        {
+            int   secs;
+            Cause cause;
+        };
+        QVector<Sample> mSamples;    // rolling window of the most recent triggers
+        int             mNext;       // index in mSamples to hold the next trigger, once full
+        int             mWindowSize; // maximum number of triggers held in mSamples
+};
+
+#endif // LATENESSTRACKER_H
+
+// vim: et sw=4:
@@ -0,0 +1,109 @@
+/*
+ *  memoryeventstore.cpp  -  in-memory event store for the scheduler
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "memoryeventstore.h"
+
+#include "kalarm_debug.h"
+
+
+MemoryEventStore::~MemoryEventStore()
+{
+    clear();
+}
+
+/******************************************************************************
+* Add a copy of an event to the store. Any existing event with the same ID is
+* replaced.
+* Reply = the stored event.
+*/
+KAEvent* MemoryEventStore::addEvent(const KAEvent& evnt)
+{
+    const EventId id(evnt);
+    KAEvent* event = mEvents.value(id, nullptr);
+    if (event)
+        *event = evnt;
+    else
+    {
+        event = new KAEvent(evnt);
+        mEvents.insert(id, event);
+    }
+    mIndex.update(*event);
+    return event;
+}
+
+void MemoryEventStore::clear()
+{
+    qDeleteAll(mEvents);
+    mEvents.clear();
+    mIndex.clear();
+}
+
+KAEvent* MemoryEventStore::event(const EventId& id, bool checkDuplicates)
+{
+    if (id.collectionId() == -1  &&  checkDuplicates)
+    {
+        KAEvent* found = nullptr;
+        for (QHash<EventId, KAEvent*>::ConstIterator it = mEvents.constBegin();  it != mEvents.constEnd();  ++it)
+        {
+            if (it.key().eventId() == id.eventId())
+            {
+                if (found)
+                {
+                    qCWarning(KALARM_LOG) << "Multiple events found with ID" << id.eventId();
+                    return nullptr;
+                }
+                found = it.value();
+            }
+        }
+        return found;
+    }
+    return mEvents.value(id, nullptr);
+}
+
+KAEvent* MemoryEventStore::earliestAlarm()
+{
+    return mEvents.value(mIndex.earliest(), nullptr);
+}
+
+void MemoryEventStore::updateEvent(KAEvent& event)
+{
+    ++mUpdateCount;
+    mIndex.update(event);
+}
+
+/******************************************************************************
+* Delete an event. Note that 'event' is normally the stored instance, which is
+* destroyed.
+*/
+void MemoryEventStore::deleteEvent(KAEvent& event, bool archive)
+{
+    if (archive  &&  event.toBeArchived())
+        archiveEvent(event);
+    const EventId id(event);
+    mIndex.remove(id);
+    KAEvent* stored = mEvents.take(id);
+    delete stored;
+}
+
+void MemoryEventStore::archiveEvent(KAEvent&)
+{
+    ++mArchivedCount;
+}
+
+// vim: et sw=4:
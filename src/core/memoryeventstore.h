@@ -0,0 +1,61 @@
+/*
+ *  memoryeventstore.h  -  in-memory event store for the scheduler
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef MEMORYEVENTSTORE_H
+#define MEMORYEVENTSTORE_H
+
+#include "schedulerbackends.h"
+#include "triggerindex.h"
+
+#include <QHash>
+
+/*=============================================================================
+= Class MemoryEventStore
+= Stand-in event store which holds alarms in memory, without Akonadi.
+= Archived events are only counted.
+=============================================================================*/
+class MemoryEventStore : public EventStore
+{
+    public:
+        MemoryEventStore() : mArchivedCount(0), mUpdateCount(0) {}
+        ~MemoryEventStore();
+
+        KAEvent* addEvent(const KAEvent&);
+        void     clear();
+        int      count() const          { return mEvents.count(); }
+        int      archivedCount() const  { return mArchivedCount; }
+        int      updateCount() const    { return mUpdateCount; }
+        const TriggerIndex& triggerIndex() const  { return mIndex; }
+
+        KAEvent* event(const EventId&, bool checkDuplicates = false) override;
+        KAEvent* earliestAlarm() override;
+        void     updateEvent(KAEvent&) override;
+        void     deleteEvent(KAEvent&, bool archive) override;
+        void     archiveEvent(KAEvent&) override;
+
+    private:
+        QHash<EventId, KAEvent*> mEvents;
+        TriggerIndex             mIndex;
+        int                      mArchivedCount;   // number of events archived
+        int                      mUpdateCount;     // number of event updates saved
+};
+
+#endif // MEMORYEVENTSTORE_H
+
+// vim: et sw=4:
@@ -0,0 +1,208 @@
+/*
+ *  metrics.cpp  -  counters, gauges and histograms describing scheduler health
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "metrics.h"
+
+#include "kalarm_debug.h"
+
+#include <QMap>
+#include <QMutex>
+#include <QSaveFile>
+
+#include <cmath>
+
+namespace
+{
+
+struct Series
+{
+    Series() : value(0), sum(0), count(0) {}
+    double           value;      // counter or gauge value
+    QVector<quint64> buckets;    // histogram: number of values in each bucket (not cumulative)
+    double           sum;        // histogram: total of all values
+    quint64          count;      // histogram: number of values
+};
+
+struct Family
+{
+    Family() : type(Metrics::COUNTER), help(nullptr) {}
+    Metrics::Type          type;
+    const char*            help;
+    QVector<double>        bounds;    // histogram bucket upper bounds
+    QMap<QString, Series>  series;    // indexed by label specification
+};
+
+QMutex                        registryMutex;    // protects 'registry'
+QMap<QByteArray, Family>      registry;         // all declared metrics, by name
+
+/******************************************************************************
+* Format a value as a Prometheus sample value.
+*/
+QString formatValue(double value)
+{
+    if (std::isinf(value))
+        return value > 0 ? QStringLiteral("+Inf") : QStringLiteral("-Inf");
+    if (value == std::floor(value)  &&  std::fabs(value) < 1e15)
+        return QString::number(static_cast<qint64>(value));
+    return QString::number(value, 'g', 12);
+}
+
+/******************************************************************************
+* Format a series name with its labels, optionally adding an extra label.
+*/
+QString seriesName(const QByteArray& name, const char* suffix, const QString& labels, const QString& extra = QString())
+{
+    QString result = QString::fromLatin1(name) + QLatin1String(suffix);
+    if (labels.isEmpty()  &&  extra.isEmpty())
+        return result;
+    result += QLatin1Char('{') + labels;
+    if (!labels.isEmpty()  &&  !extra.isEmpty())
+        result += QLatin1Char(',');
+    result += extra + QLatin1Char('}');
+    return result;
+}
+
+}
+
+namespace Metrics
+{
+
+void describe(const char* name, Type type, const char* help, const QVector<double>& buckets)
+{
+    QMutexLocker locker(&registryMutex);
+    Family& family = registry[QByteArray(name)];
+    family.type = type;
+    family.help = help;
+    if (type == HISTOGRAM)
+        family.bounds = buckets;
+}
+
+void increment(const char* name, const QString& labels, double amount)
+{
+    QMutexLocker locker(&registryMutex);
+    QMap<QByteArray, Family>::Iterator it = registry.find(QByteArray::fromRawData(name, qstrlen(name)));
+    if (it != registry.end()  &&  it.value().type == COUNTER)
+        it.value().series[labels].value += amount;
+}
+
+void set(const char* name, double value, const QString& labels)
+{
+    QMutexLocker locker(&registryMutex);
+    QMap<QByteArray, Family>::Iterator it = registry.find(QByteArray::fromRawData(name, qstrlen(name)));
+    if (it != registry.end()  &&  it.value().type == GAUGE)
+        it.value().series[labels].value = value;
+}
+
+void clear(const char* name)
+{
+    QMutexLocker locker(&registryMutex);
+    QMap<QByteArray, Family>::Iterator it = registry.find(QByteArray::fromRawData(name, qstrlen(name)));
+    if (it != registry.end())
+        it.value().series.clear();
+}
+
+void observe(const char* name, double value, const QString& labels)
+{
+    QMutexLocker locker(&registryMutex);
+    QMap<QByteArray, Family>::Iterator it = registry.find(QByteArray::fromRawData(name, qstrlen(name)));
+    if (it == registry.end()  ||  it.value().type != HISTOGRAM)
+        return;
+    const QVector<double>& bounds = it.value().bounds;
+    Series& series = it.value().series[labels];
+    if (series.buckets.isEmpty())
+        series.buckets.fill(0, bounds.count() + 1);   // the final bucket is +Inf
+    int i = 0;
+    while (i < bounds.count()  &&  value > bounds[i])
+        ++i;
+    ++series.buckets[i];
+    series.sum += value;
+    ++series.count;
+}
+
+QString label(const char* labelName, const QString& value)
+{
+    QString escaped = value;
+    escaped.replace(QLatin1Char('\\'), QLatin1String("\\\\"))
+           .replace(QLatin1Char('"'), QLatin1String("\\\""))
+           .replace(QLatin1Char('\n'), QLatin1String("\\n"));
+    return QLatin1String(labelName) + QLatin1String("=\"") + escaped + QLatin1Char('"');
+}
+
+/******************************************************************************
+* Return all metrics in Prometheus text exposition format.
+*/
+QString text()
+{
+    QMutexLocker locker(&registryMutex);
+    QString out;
+    for (QMap<QByteArray, Family>::ConstIterator it = registry.constBegin();  it != registry.constEnd();  ++it)
+    {
+        const QByteArray& name = it.key();
+        const Family& family = it.value();
+        const char* type = (family.type == COUNTER) ? "counter" : (family.type == GAUGE) ? "gauge" : "histogram";
+        out += QLatin1String("# HELP ") + QString::fromLatin1(name) + QLatin1Char(' ') + QString::fromUtf8(family.help) + QLatin1Char('\n');
+        out += QLatin1String("# TYPE ") + QString::fromLatin1(name) + QLatin1Char(' ') + QLatin1String(type) + QLatin1Char('\n');
+        for (QMap<QString, Series>::ConstIterator sit = family.series.constBegin();  sit != family.series.constEnd();  ++sit)
+        {
+            const QString& labels = sit.key();
+            const Series& series = sit.value();
+            if (family.type != HISTOGRAM)
+            {
+                out += seriesName(name, "", labels) + QLatin1Char(' ') + formatValue(series.value) + QLatin1Char('\n');
+                continue;
+            }
+            quint64 cumulative = 0;
+            for (int i = 0, count = series.buckets.count();  i < count;  ++i)
+            {
+                cumulative += series.buckets[i];
+                const double bound = (i < family.bounds.count()) ? family.bounds[i] : INFINITY;
+                out += seriesName(name, "_bucket", labels, label("le", formatValue(bound)))
+                     + QLatin1Char(' ') + QString::number(cumulative) + QLatin1Char('\n');
+            }
+            out += seriesName(name, "_sum", labels) + QLatin1Char(' ') + formatValue(series.sum) + QLatin1Char('\n');
+            out += seriesName(name, "_count", labels) + QLatin1Char(' ') + QString::number(series.count) + QLatin1Char('\n');
+        }
+    }
+    return out;
+}
+
+/******************************************************************************
+* Write all metrics to a file in Prometheus text exposition format.
+*/
+bool writeFile(const QString& file)
+{
+    const QByteArray data = text().toUtf8();
+    QSaveFile out(file);
+    if (!out.open(QIODevice::WriteOnly))
+    {
+        qCWarning(KALARM_LOG) << "Metrics::writeFile: cannot open" << file;
+        return false;
+    }
+    out.write(data);
+    if (!out.commit())
+    {
+        qCWarning(KALARM_LOG) << "Metrics::writeFile: error writing" << file;
+        return false;
+    }
+    return true;
+}
+
+}
+
+// vim: et sw=4:
@@ -0,0 +1,77 @@
+/*
+ *  metrics.h  -  counters, gauges and histograms describing scheduler health
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+/* A process wide registry of named metrics, which can be written out in the
+ * Prometheus text exposition format. Each metric must be declared by
+ * describe() before values are recorded for it; values recorded for an
+ * undeclared metric are ignored. A metric may have several series, each
+ * identified by a label string in Prometheus syntax, e.g.
+ *   collection="3",category="active"
+ * which may be built using label(). All functions are thread safe.
+ */
+
+#include <QString>
+#include <QVector>
+
+namespace Metrics
+{
+
+enum Type { COUNTER, GAUGE, HISTOGRAM };
+
+/** Declare a metric.
+ *  @param name     metric name, which must be a string literal.
+ *  @param help     description of the metric, which must be a string literal.
+ *  @param buckets  upper bounds of the histogram buckets, in ascending order.
+ *                  Ignored unless 'type' is HISTOGRAM.
+ */
+void describe(const char* name, Type type, const char* help, const QVector<double>& buckets = QVector<double>());
+
+/** Add to a counter. */
+void increment(const char* name, const QString& labels = QString(), double amount = 1);
+
+/** Set the value of a gauge. */
+void set(const char* name, double value, const QString& labels = QString());
+
+/** Remove all series of a gauge, before setting the current set of series. */
+void clear(const char* name);
+
+/** Record a value in a histogram. */
+void observe(const char* name, double value, const QString& labels = QString());
+
+/** Return a label specification for use as a 'labels' parameter. Labels may
+ *  be combined by joining them with commas.
+ */
+QString label(const char* labelName, const QString& value);
+
+/** Return all metrics in Prometheus text exposition format. */
+QString text();
+
+/** Write all metrics to a file in Prometheus text exposition format. The file
+ *  is replaced atomically, so that a reader never sees a partial file.
+ */
+bool writeFile(const QString& file);
+
+}
+
+#endif // METRICS_H
+
+// vim: et sw=4:
@@ -0,0 +1,55 @@
+/*
+ *  recordingdispatcher.h  -  alarm action dispatcher which only records actions
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef RECORDINGDISPATCHER_H
+#define RECORDINGDISPATCHER_H
+
+#include "schedulerbackends.h"
+
+#include <QHash>
+
+class Scheduler;
+
+/*=============================================================================
+= Class RecordingDispatcher
+= Stand-in action dispatcher which counts the alarms executed, by action type,
+= instead of displaying messages or running commands. Alarms are rescheduled
+= immediately, as if their actions had completed at once.
+=============================================================================*/
+class RecordingDispatcher : public ActionDispatcher
+{
+    public:
+        explicit RecordingDispatcher(Scheduler* scheduler = nullptr) : mScheduler(scheduler), mTotal(0) {}
+        void     setScheduler(Scheduler* scheduler)  { mScheduler = scheduler; }
+        int      count(KAEvent::SubAction action) const  { return mCounts.value(action, 0); }
+        int      total() const                        { return mTotal; }
+        void     reset()                              { mCounts.clear();  mTotal = 0; }
+
+        void     dispatchAlarm(KAEvent&, const KAAlarm&, bool reschedule, bool allowDefer) override;
+        void     eventDeleted(const QString&) override  {}
+
+    private:
+        Scheduler*    mScheduler;
+        QHash<int, int> mCounts;   // number of alarms executed, by KAEvent::SubAction
+        int           mTotal;      // total number of alarms executed
+};
+
+#endif // RECORDINGDISPATCHER_H
+
+// vim: et sw=4:
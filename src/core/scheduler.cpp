@@ -0,0 +1,479 @@
+/*
+ *  scheduler.cpp  -  alarm triggering and rescheduling
+ *  Program:  kalarm
+ *  Copyright © 2001-2017 by David Jarvie <djarvie@kde.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "scheduler.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <kalarmcal/datetime.h>
+#include "kalarm_debug.h"
+
+namespace
+{
+SchedulerClock systemClock;   // default clock, using the system time
+}
+
+
+Scheduler::Scheduler(EventStore* store, ActionDispatcher* dispatcher, SchedulerClock* clock)
+    : mStore(store),
+      mDispatcher(dispatcher),
+      mClock(clock ? clock : &systemClock)
+{
+    Metrics::describe("kalarm_late_cancelled_total", Metrics::COUNTER,
+                      "Alarms cancelled because they were too late to trigger");
+}
+
+/******************************************************************************
+* Set the clock used to determine the current time. If null, the system clock
+* is used.
+*/
+void Scheduler::setClock(SchedulerClock* clock)
+{
+    mClock = clock ? clock : &systemClock;
+}
+
+/******************************************************************************
+* Return the maximum number of seconds by which an alarm may be late before it
+* is cancelled, given its late-cancellation period in minutes.
+*/
+int Scheduler::maxLateness(int lateCancel)
+{
+    static const int LATENESS_LEEWAY = 5;
+    int lc = (lateCancel >= 1) ? (lateCancel - 1)*60 : 0;
+    return LATENESS_LEEWAY + lc;
+}
+
+/******************************************************************************
+* Either:
+* a) Display the event and then delete it if it has no outstanding repetitions.
+* b) Delete the event.
+* c) Reschedule the event for its next repetition. If none remain, delete it.
+* If the event is deleted, it is removed from the event store.
+* Reply = false if event ID not found, or if more than one event with the same
+*         ID is found.
+*/
+bool Scheduler::handleEvent(const EventId& id, Function function, bool checkDuplicates)
+{
+    KALARM_TRACE_SCOPE("scheduler", "handleEvent");
+    const QString eventID(id.eventId());
+    KAEvent* event = mStore->event(id, checkDuplicates);
+    if (!event)
+    {
+        if (id.collectionId() != -1)
+            qCWarning(KALARM_LOG) << "Event ID not found, or duplicated:" << eventID;
+        else
+            qCWarning(KALARM_LOG) << "Event ID not found:" << eventID;
+        return false;
+    }
+    switch (function)
+    {
+        case CANCEL:
+            qCDebug(KALARM_LOG) << eventID << ", CANCEL";
+            mStore->deleteEvent(*event, true);
+            break;
+
+        case TRIGGER:    // handle it if it's due, else execute it regardless
+        case HANDLE:     // handle it if it's due
+        {
+            KDateTime now = currentUtcDateTime();
+            qCDebug(KALARM_LOG) << eventID << "," << (function==TRIGGER?"TRIGGER:":"HANDLE:") << qPrintable(now.dateTime().toString(QStringLiteral("yyyy-MM-dd hh:mm"))) << "UTC";
+            bool updateCalAndDisplay = false;
+            bool alarmToExecuteValid = false;
+            KAAlarm alarmToExecute;
+            KDateTime alarmToExecuteDue;
+            int alarmToExecuteLateness = 0;
+            bool restart = false;
+            // Check all the alarms in turn.
+            // Note that the main alarm is fetched before any other alarms.
+            for (KAAlarm alarm = event->firstAlarm();
+                 alarm.isValid();
+                 alarm = (restart ? event->firstAlarm() : event->nextAlarm(alarm)), restart = false)
+            {
+                // Check if the alarm is due yet.
+                KDateTime nextDT = alarm.dateTime(true).effectiveKDateTime();
+                int secs = nextDT.secsTo(now);
+                if (secs < 0)
+                {
+                    // The alarm appears to be in the future.
+                    // Check if it's an invalid local clock time during a daylight
+                    // saving time shift, which has actually passed.
+                    if (alarm.dateTime().timeSpec() != KDateTime::ClockTime
+                    ||  nextDT > now.toTimeSpec(KDateTime::ClockTime))
+                    {
+                        // This alarm is definitely not due yet
+                        qCDebug(KALARM_LOG) << "Alarm" << alarm.type() << "at" << nextDT.dateTime() << ": not due";
+                        continue;
+                    }
+                }
+                bool reschedule = false;
+                bool rescheduleWork = false;
+                if ((event->workTimeOnly() || event->holidaysExcluded())  &&  !alarm.deferred())
+                {
+                    // The alarm is restricted to working hours and/or non-holidays
+                    // (apart from deferrals). This needs to be re-evaluated every
+                    // time it triggers, since working hours could change.
+                    if (alarm.dateTime().isDateOnly())
+                    {
+                        KDateTime dt(nextDT);
+                        dt.setDateOnly(true);
+                        reschedule = !event->isWorkingTime(dt);
+                    }
+                    else
+                        reschedule = !event->isWorkingTime(nextDT);
+                    rescheduleWork = reschedule;
+                    if (reschedule)
+                        qCDebug(KALARM_LOG) << "Alarm" << alarm.type() << "at" << nextDT.dateTime() << ": not during working hours";
+                }
+                if (!reschedule  &&  alarm.repeatAtLogin())
+                {
+                    // Alarm is to be displayed at every login.
+                    qCDebug(KALARM_LOG) << "REPEAT_AT_LOGIN";
+                    // Check if the main alarm is already being displayed.
+                    // (We don't want to display both at the same time.)
+                    if (alarmToExecute.isValid())
+                        continue;
+
+                    // Set the time to display if it's a display alarm
+                    alarm.setTime(now);
+                }
+                if (!reschedule  &&  event->lateCancel())
+                {
+                    // Alarm is due, and it is to be cancelled if too late.
+                    qCDebug(KALARM_LOG) << "LATE_CANCEL";
+                    bool cancel = false;
+                    if (alarm.dateTime().isDateOnly())
+                    {
+                        // The alarm has no time, so cancel it if its date is too far past
+                        int maxlate = event->lateCancel() / 1440;    // maximum lateness in days
+                        KDateTime limit(DateTime(nextDT.addDays(maxlate + 1)).effectiveKDateTime());
+                        if (now >= limit)
+                        {
+                            // It's too late to display the scheduled occurrence.
+                            // Find the last previous occurrence of the alarm.
+                            DateTime next;
+                            KAEvent::OccurType type = event->previousOccurrence(now, next, true);
+                            switch (type & ~KAEvent::OCCURRENCE_REPEAT)
+                            {
+                                case KAEvent::FIRST_OR_ONLY_OCCURRENCE:
+                                case KAEvent::RECURRENCE_DATE:
+                                case KAEvent::RECURRENCE_DATE_TIME:
+                                case KAEvent::LAST_RECURRENCE:
+                                    limit.setDate(next.date().addDays(maxlate + 1));
+                                    if (now >= limit)
+                                    {
+                                        if (type == KAEvent::LAST_RECURRENCE
+                                        ||  (type == KAEvent::FIRST_OR_ONLY_OCCURRENCE && !event->recurs()))
+                                            cancel = true;   // last occurrence (and there are no repetitions)
+                                        else
+                                            reschedule = true;
+                                    }
+                                    break;
+                                case KAEvent::NO_OCCURRENCE:
+                                default:
+                                    reschedule = true;
+                                    break;
+                            }
+                        }
+                    }
+                    else
+                    {
+                        // The alarm is timed. Allow it to be the permitted amount late before cancelling it.
+                        int maxlate = maxLateness(event->lateCancel());
+                        if (secs > maxlate)
+                        {
+                            // It's over the maximum interval late.
+                            // Find the most recent occurrence of the alarm.
+                            DateTime next;
+                            KAEvent::OccurType type = event->previousOccurrence(now, next, true);
+                            switch (type & ~KAEvent::OCCURRENCE_REPEAT)
+                            {
+                                case KAEvent::FIRST_OR_ONLY_OCCURRENCE:
+                                case KAEvent::RECURRENCE_DATE:
+                                case KAEvent::RECURRENCE_DATE_TIME:
+                                case KAEvent::LAST_RECURRENCE:
+                                    if (next.effectiveKDateTime().secsTo(now) > maxlate)
+                                    {
+                                        if (type == KAEvent::LAST_RECURRENCE
+                                        ||  (type == KAEvent::FIRST_OR_ONLY_OCCURRENCE && !event->recurs()))
+                                            cancel = true;   // last occurrence (and there are no repetitions)
+                                        else
+                                            reschedule = true;
+                                    }
+                                    break;
+                                case KAEvent::NO_OCCURRENCE:
+                                default:
+                                    reschedule = true;
+                                    break;
+                            }
+                        }
+                    }
+
+                    if (cancel)
+                    {
+                        // All recurrences are finished, so cancel the event
+                        Metrics::increment("kalarm_late_cancelled_total");
+                        event->setArchive();
+                        if (cancelAlarm(*event, alarm.type(), false))
+                            return true;   // event has been deleted
+                        updateCalAndDisplay = true;
+                        continue;
+                    }
+                }
+                if (reschedule)
+                {
+                    // The latest repetition was too long ago, so schedule the next one
+                    switch (rescheduleAlarm(*event, alarm, false, (rescheduleWork ? nextDT : KDateTime())))
+                    {
+                        case 1:
+                            // A working-time-only alarm has been rescheduled and the
+                            // rescheduled time is already due. Start processing the
+                            // event again.
+                            alarmToExecuteValid = false;
+                            restart = true;
+                            break;
+                        case -1:
+                            return true;   // event has been deleted
+                        default:
+                            break;
+                    }
+                    updateCalAndDisplay = true;
+                    continue;
+                }
+                if (!alarmToExecuteValid)
+                {
+                    qCDebug(KALARM_LOG) << "Alarm" << alarm.type() << ": execute";
+                    alarmToExecute = alarm;             // note the alarm to be displayed
+                    alarmToExecuteValid = true;         // only trigger one alarm for the event
+                    alarmToExecuteDue = nextDT;
+                    alarmToExecuteLateness = qMax(secs, 0);
+                }
+                else
+                    qCDebug(KALARM_LOG) << "Alarm" << alarm.type() << ": skip";
+            }
+
+            // If there is an alarm to execute, do this last after rescheduling/cancelling
+            // any others. This ensures that the updated event is only saved once to the calendar.
+            if (alarmToExecute.isValid())
+            {
+                if (!alarmToExecute.repeatAtLogin())
+                    mDispatcher->alarmDue(*event, alarmToExecute, alarmToExecuteDue, alarmToExecuteLateness);
+                mDispatcher->dispatchAlarm(*event, alarmToExecute, true, !alarmToExecute.repeatAtLogin());
+            }
+            else
+            {
+                if (function == TRIGGER)
+                {
+                    // The alarm is to be executed regardless of whether it's due.
+                    // Only trigger one alarm from the event - we don't want multiple
+                    // identical messages, for example.
+                    KAAlarm alarm = event->firstAlarm();
+                    if (alarm.isValid())
+                        mDispatcher->dispatchAlarm(*event, alarm, false, true);
+                }
+                if (updateCalAndDisplay)
+                    mStore->updateEvent(*event);     // save the changes to the event
+                else if (function != TRIGGER) { qCDebug(KALARM_LOG) << "No action"; }
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+/******************************************************************************
+* Reschedule the alarm for its next recurrence after now. If none remain,
+* delete it.  If the alarm is deleted and it is the last alarm for its event,
+* the event is removed from the event store.
+* If 'nextDt' is valid, the event is rescheduled for the next non-working
+* time occurrence after that.
+* Reply = 1 if 'nextDt' is valid and the rescheduled event is already due
+*       = -1 if the event has been deleted
+*       = 0 otherwise.
+*/
+int Scheduler::rescheduleAlarm(KAEvent& event, const KAAlarm& alarm, bool updateCalAndDisplay, const KDateTime& nextDt)
+{
+    KALARM_TRACE_SCOPE("scheduler", "rescheduleAlarm");
+    qCDebug(KALARM_LOG) << "Alarm type:" << alarm.type();
+    int reply = 0;
+    bool update = false;
+    event.startChanges();
+    if (alarm.repeatAtLogin())
+    {
+        // Leave an alarm which repeats at every login until its main alarm triggers
+        if (!event.reminderActive()  &&  event.reminderMinutes() < 0)
+        {
+            // Executing an at-login alarm: first schedule the reminder
+            // which occurs AFTER the main alarm.
+            event.activateReminderAfter(currentUtcDateTime());
+            update = true;
+        }
+    }
+    else if (alarm.isReminder()  ||  alarm.deferred())
+    {
+        // It's a reminder alarm or an extra deferred alarm, so delete it
+        event.removeExpiredAlarm(alarm.type());
+        update = true;
+    }
+    else
+    {
+        // Reschedule the alarm for its next occurrence.
+        bool cancelled = false;
+        DateTime last = event.mainDateTime(false);   // note this trigger time
+        if (last != event.mainDateTime(true))
+            last = DateTime();                       // but ignore sub-repetition triggers
+        bool next = nextDt.isValid();
+        KDateTime next_dt = nextDt;
+        KDateTime now = currentUtcDateTime();
+        do
+        {
+            KAEvent::OccurType type = event.setNextOccurrence(next ? next_dt : now);
+            switch (type)
+            {
+                case KAEvent::NO_OCCURRENCE:
+                    // All repetitions are finished, so cancel the event
+                    qCDebug(KALARM_LOG) << "No occurrence";
+                    if (event.reminderMinutes() < 0  &&  last.isValid()
+                    &&  alarm.type() != KAAlarm::AT_LOGIN_ALARM  &&  !event.mainExpired())
+                    {
+                        // Set the reminder which is now due after the last main alarm trigger.
+                        // Note that at-login reminders are scheduled when the alarm is executed.
+                        event.activateReminderAfter(last);
+                        updateCalAndDisplay = true;
+                    }
+                    if (cancelAlarm(event, alarm.type(), updateCalAndDisplay))
+                        return -1;
+                    break;
+                default:
+                    if (!(type & KAEvent::OCCURRENCE_REPEAT))
+                        break;
+                    // Next occurrence is a repeat, so fall through to recurrence handling
+                case KAEvent::RECURRENCE_DATE:
+                case KAEvent::RECURRENCE_DATE_TIME:
+                case KAEvent::LAST_RECURRENCE:
+                    // The event is due by now and repetitions still remain, so rewrite the event
+                    if (updateCalAndDisplay)
+                        update = true;
+                    break;
+                case KAEvent::FIRST_OR_ONLY_OCCURRENCE:
+                    // The first occurrence is still due?!?, so don't do anything
+                    break;
+            }
+            if (cancelled)
+                break;
+            if (event.deferred())
+            {
+                // Just in case there's also a deferred alarm, ensure it's removed
+                event.removeExpiredAlarm(KAAlarm::DEFERRED_ALARM);
+                update = true;
+            }
+            if (next)
+            {
+                // The alarm is restricted to working hours and/or non-holidays.
+                // Check if the calculated next time is valid.
+                next_dt = event.mainDateTime(true).effectiveKDateTime();
+                if (event.mainDateTime(false).isDateOnly())
+                {
+                    KDateTime dt(next_dt);
+                    dt.setDateOnly(true);
+                    next = !event.isWorkingTime(dt);
+                }
+                else
+                    next = !event.isWorkingTime(next_dt);
+            }
+        } while (next && next_dt <= now);
+        reply = (!cancelled && next_dt.isValid() && (next_dt <= now)) ? 1 : 0;
+
+        if (event.reminderMinutes() < 0  &&  last.isValid()
+        &&  alarm.type() != KAAlarm::AT_LOGIN_ALARM)
+        {
+            // Set the reminder which is now due after the last main alarm trigger.
+            // Note that at-login reminders are scheduled when the alarm is executed.
+            event.activateReminderAfter(last);
+        }
+    }
+    event.endChanges();
+    if (update)
+        mStore->updateEvent(event);     // save the changes to the event
+    return reply;
+}
+
+/******************************************************************************
+* Delete the alarm. If it is the last alarm for its event, the event is removed
+* from the event store.
+* Reply = true if event has been deleted.
+*/
+bool Scheduler::cancelAlarm(KAEvent& event, KAAlarm::Type alarmType, bool updateCalAndDisplay)
+{
+    KALARM_TRACE_SCOPE("scheduler", "cancelAlarm");
+    qCDebug(KALARM_LOG);
+    if (alarmType == KAAlarm::MAIN_ALARM  &&  !event.displaying()  &&  event.toBeArchived())
+    {
+        // The event is being deleted. Save it in the archived resources first.
+        KAEvent ev(event);
+        mStore->archiveEvent(ev);
+    }
+    event.removeExpiredAlarm(alarmType);
+    if (!event.alarmCount())
+    {
+        // If it's a command alarm being executed, mark it as deleted
+        mDispatcher->eventDeleted(event.id());
+
+        // Delete it
+        mStore->deleteEvent(event, false);
+        return true;
+    }
+    if (updateCalAndDisplay)
+        mStore->updateEvent(event);    // save the changes to the event
+    return false;
+}
+
+/******************************************************************************
+* Handle all alarms which are due at the current time, in trigger time order.
+* This is the equivalent of KAlarmApp's alarm timer and action queue, for use
+* when the scheduler is run on its own.
+* Reply = number of events handled.
+*/
+int Scheduler::processDue()
+{
+    const KDateTime now = currentUtcDateTime();
+    int handled = 0;
+    for (;;)
+    {
+        KAEvent* event = mStore->earliestAlarm();
+        if (!event)
+            break;
+        const KDateTime next = event->nextTrigger(KAEvent::ALL_TRIGGER).effectiveKDateTime();
+        if (next > now)
+            break;
+        const EventId id(*event);
+        if (!handleEvent(id, HANDLE))
+            break;
+        ++handled;
+
+        // Don't loop indefinitely if the event wasn't rescheduled
+        event = mStore->earliestAlarm();
+        if (event  &&  EventId(*event) == id
+        &&  event->nextTrigger(KAEvent::ALL_TRIGGER).effectiveKDateTime() == next)
+            break;
+    }
+    return handled;
+}
+
+// vim: et sw=4:
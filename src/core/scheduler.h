@@ -0,0 +1,66 @@
+/*
+ *  scheduler.h  -  alarm triggering and rescheduling
+ *  Program:  kalarm
+ *  Copyright © 2001-2017 by David Jarvie <djarvie@kde.org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "schedulerbackends.h"
+
+#include <kalarmcal/kaevent.h>
+
+using namespace KAlarmCal;
+
+/*=============================================================================
+= Class Scheduler
+= Decides which of an event's alarms are due, executes them through an
+= ActionDispatcher, and reschedules or cancels them in an EventStore.
+= It has no dependency on the user interface or on Akonadi.
+=============================================================================*/
+class Scheduler
+{
+    public:
+        enum Function
+        {
+            HANDLE,    // if the alarm is due, execute it and then reschedule it
+            TRIGGER,   // execute the alarm regardless, and then reschedule it if it already due
+            CANCEL     // delete the alarm
+        };
+
+        Scheduler(EventStore*, ActionDispatcher*, SchedulerClock* = nullptr);
+        void      setClock(SchedulerClock*);
+        KDateTime currentUtcDateTime() const   { return mClock->currentUtcDateTime(); }
+
+        bool      handleEvent(const EventId&, Function, bool checkDuplicates = false);
+        int       rescheduleAlarm(KAEvent&, const KAAlarm&, bool updateCalAndDisplay,
+                                  const KDateTime& nextDt = KDateTime());
+        bool      cancelAlarm(KAEvent&, KAAlarm::Type, bool updateCalAndDisplay);
+        int       processDue();
+
+        static int maxLateness(int lateCancel);
+
+    private:
+        EventStore*       mStore;
+        ActionDispatcher* mDispatcher;
+        SchedulerClock*   mClock;
+};
+
+#endif // SCHEDULER_H
+
+// vim: et sw=4:
@@ -0,0 +1,108 @@
+/*
+ *  schedulerbackends.h  -  interfaces between the scheduler and its environment
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef SCHEDULERBACKENDS_H
+#define SCHEDULERBACKENDS_H
+
+/*  The scheduler core uses these interfaces to access the stored alarms, to
+ *  execute alarm actions and to read the current time. The application
+ *  implements them using Akonadi and its windows; stand-in implementations
+ *  allow the scheduler to be run without either.
+ */
+
+#include "eventid.h"
+
+#include <kalarmcal/kaevent.h>
+
+#include <KDateTime>
+
+using namespace KAlarmCal;
+
+/*=============================================================================
+= Class EventStore
+= Storage for the alarms handled by the scheduler.
+=============================================================================*/
+class EventStore
+{
+    public:
+        virtual ~EventStore() {}
+
+        /** Return the event with the specified ID, or null if not found.
+         *  If 'checkDuplicates' is true and the collection ID is invalid, the
+         *  event is returned if its event ID is unique among all collections.
+         */
+        virtual KAEvent* event(const EventId&, bool checkDuplicates = false) = 0;
+
+        /** Return the enabled active alarm with the earliest trigger time,
+         *  or null if none. */
+        virtual KAEvent* earliestAlarm() = 0;
+
+        /** Save a changed event. 'event' is the instance returned by event(). */
+        virtual void updateEvent(KAEvent& event) = 0;
+
+        /** Delete an event, optionally archiving it first. */
+        virtual void deleteEvent(KAEvent& event, bool archive) = 0;
+
+        /** Save a copy of an expired event in the archive. */
+        virtual void archiveEvent(KAEvent& event) = 0;
+};
+
+/*=============================================================================
+= Class ActionDispatcher
+= Executes the actions of alarms when they trigger: displaying messages,
+= running commands, sending emails and playing audio files.
+=============================================================================*/
+class ActionDispatcher
+{
+    public:
+        virtual ~ActionDispatcher() {}
+
+        /** Execute an alarm's action.
+         *  @param reschedule  reschedule the alarm once it has been executed
+         *  @param allowDefer  allow the user to defer the alarm
+         */
+        virtual void dispatchAlarm(KAEvent& event, const KAAlarm& alarm, bool reschedule, bool allowDefer) = 0;
+
+        /** Called just before a due alarm is dispatched, with the time at
+         *  which it was scheduled and how many seconds late it is.
+         *  The default implementation does nothing.
+         */
+        virtual void alarmDue(const KAEvent& event, const KAAlarm& alarm, const KDateTime& due, int lateness)
+                                  { Q_UNUSED(event); Q_UNUSED(alarm); Q_UNUSED(due); Q_UNUSED(lateness); }
+
+        /** Called when an event has been deleted, in case its action is still
+         *  in progress. */
+        virtual void eventDeleted(const QString& eventId) = 0;
+};
+
+/*=============================================================================
+= Class SchedulerClock
+= Provides the current time to the scheduler. The default implementation uses
+= the system clock.
+=============================================================================*/
+class SchedulerClock
+{
+    public:
+        virtual ~SchedulerClock() {}
+        virtual KDateTime currentUtcDateTime() const  { return KDateTime::currentUtcDateTime(); }
+};
+
+#endif // SCHEDULERBACKENDS_H
+
+// vim: et sw=4:
@@ -0,0 +1,160 @@
+/*
+ *  schedulersnapshot.cpp  -  snapshot of pending alarms, for fast start-up
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "schedulersnapshot.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QMultiMap>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include "kalarm_debug.h"
+
+static const quint32 SNAPSHOT_MAGIC   = 0x4b415353;   // "KASS"
+static const quint32 SNAPSHOT_VERSION = 1;            // format version of snapshot file
+
+
+/******************************************************************************
+* Read the snapshot file, or the default snapshot file if 'fileName' is empty.
+* The file is memory mapped while it is read.
+* Reply = true if the snapshot was read successfully.
+*/
+bool SchedulerSnapshot::load(const QString& fileName)
+{
+    clear();
+    QFile file(fileName.isEmpty() ? path() : fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    const qint64 size = file.size();
+    uchar* data = size ? file.map(0, size) : nullptr;
+    if (!data)
+        return false;
+    const QByteArray bytes = QByteArray::fromRawData(reinterpret_cast<const char*>(data), static_cast<int>(size));
+    QDataStream stream(bytes);
+    quint32 magic, version;
+    QDateTime written;
+    quint32 count;
+    stream >> magic >> version;
+    if (magic != SNAPSHOT_MAGIC  ||  version != SNAPSHOT_VERSION)
+    {
+        qCWarning(KALARM_LOG) << "Ignoring scheduler snapshot with unknown format" << version;
+        file.unmap(data);
+        return false;
+    }
+    stream >> written >> count;
+    mEntries.reserve(count);
+    for (quint32 i = 0;  i < count  &&  stream.status() == QDataStream::Ok;  ++i)
+    {
+        Entry entry;
+        qint64 collectionId, itemId;
+        stream >> collectionId >> itemId >> entry.eventId >> entry.nextTrigger >> entry.flags;
+        entry.collectionId = collectionId;
+        entry.itemId       = itemId;
+        entry.fetched      = false;
+        mEntries += entry;
+    }
+    file.unmap(data);
+    if (stream.status() != QDataStream::Ok)
+    {
+        qCWarning(KALARM_LOG) << "Error reading scheduler snapshot";
+        mEntries.clear();
+        return false;
+    }
+    qCDebug(KALARM_LOG) << "Scheduler snapshot from" << written << ":" << mEntries.count() << "alarms";
+    return true;
+}
+
+/******************************************************************************
+* Write a snapshot of the pending alarms in a list of active events, to the
+* default snapshot file if 'fileName' is empty.
+* Reply = true if the snapshot was written successfully.
+*/
+bool SchedulerSnapshot::save(const KAEvent::List& events, const QString& fileName)
+{
+    // Sort the pending alarms by trigger time
+    QMultiMap<qint64, const KAEvent*> pending;
+    for (int i = 0, end = events.count();  i < end;  ++i)
+    {
+        const KAEvent* event = events[i];
+        if (!event->enabled()  ||  event->itemId() < 0)
+            continue;
+        const KDateTime dt = event->nextTrigger(KAEvent::ALL_TRIGGER).effectiveKDateTime();
+        if (dt.isValid())
+            pending.insert(dt.toTime_t(), event);
+    }
+
+    QSaveFile file(fileName.isEmpty() ? path() : fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qCWarning(KALARM_LOG) << "Error creating scheduler snapshot" << file.fileName();
+        return false;
+    }
+    QDataStream stream(&file);
+    stream << SNAPSHOT_MAGIC << SNAPSHOT_VERSION << QDateTime::currentDateTimeUtc()
+           << static_cast<quint32>(pending.count());
+    for (QMultiMap<qint64, const KAEvent*>::ConstIterator it = pending.constBegin();  it != pending.constEnd();  ++it)
+    {
+        const KAEvent* event = it.value();
+        stream << static_cast<qint64>(event->collectionId()) << static_cast<qint64>(event->itemId())
+               << event->id() << it.key() << static_cast<quint32>(event->flags());
+    }
+    if (stream.status() != QDataStream::Ok  ||  !file.commit())
+    {
+        qCWarning(KALARM_LOG) << "Error writing scheduler snapshot" << file.fileName();
+        return false;
+    }
+    return true;
+}
+
+/******************************************************************************
+* Check the entries which have not yet been loaded, in trigger time order, up
+* to the first one which is not yet due. The item IDs of due entries which are
+* not in 'loaded' are appended to 'fetch', and those entries are marked as
+* fetched. Entries which have been dealt with are not checked again.
+* Reply = next trigger time of an entry not yet loaded, or -1 if none.
+*/
+qint64 SchedulerSnapshot::checkDue(qint64 now, const QHash<EventId, KAEvent*>& loaded, QVector<qint64>& fetch)
+{
+    for (int i = mNext, end = mEntries.count();  i < end;  ++i)
+    {
+        Entry& entry = mEntries[i];
+        if (!entry.fetched  &&  !loaded.contains(EventId(entry.collectionId, entry.eventId)))
+        {
+            if (entry.nextTrigger > now)
+                return entry.nextTrigger;
+            // The alarm is due, but its calendar hasn't been loaded yet
+            fetch += entry.itemId;
+            entry.fetched = true;
+        }
+        if (i == mNext)
+            ++mNext;
+    }
+    return -1;
+}
+
+/******************************************************************************
+* Return the path of the snapshot file.
+*/
+QString SchedulerSnapshot::path()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::DataLocation) + QStringLiteral("/schedulersnapshot");
+}
+
+// vim: et sw=4:
@@ -0,0 +1,69 @@
+/*
+ *  schedulersnapshot.h  -  snapshot of pending alarms, for fast start-up
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef SCHEDULERSNAPSHOT_H
+#define SCHEDULERSNAPSHOT_H
+
+#include "eventid.h"
+
+#include <kalarmcal/kaevent.h>
+
+#include <QHash>
+#include <QVector>
+
+using namespace KAlarmCal;
+
+/*=============================================================================
+= Class SchedulerSnapshot
+= A compact record of the pending active alarms, written to file when KAlarm
+= exits and periodically while it runs. At start-up, it allows alarms to be
+= scheduled before Akonadi has finished loading the calendars.
+=============================================================================*/
+class SchedulerSnapshot
+{
+    public:
+        struct Entry
+        {
+            qint64   collectionId;
+            qint64   itemId;
+            QString  eventId;
+            qint64   nextTrigger;   // next trigger time, in seconds since the epoch (UTC)
+            quint32  flags;         // KAEvent::Flags
+            bool     fetched;       // the event has been fetched (not stored in file)
+        };
+
+        SchedulerSnapshot() : mNext(0) {}
+        bool            load(const QString& fileName = QString());
+        const QVector<Entry>& entries() const  { return mEntries; }
+        bool            isEmpty() const  { return mEntries.isEmpty(); }
+        void            clear()          { mEntries.clear();  mNext = 0; }
+        qint64          checkDue(qint64 now, const QHash<EventId, KAEvent*>& loaded, QVector<qint64>& fetch);
+
+        static bool     save(const KAEvent::List& events, const QString& fileName = QString());
+
+    private:
+        static QString  path();
+
+        QVector<Entry>  mEntries;   // entries in order of next trigger time
+        int             mNext;      // index of first entry still to be checked by checkDue()
+};
+
+#endif // SCHEDULERSNAPSHOT_H
+
+// vim: et sw=4:
@@ -0,0 +1,130 @@
+/*
+ *  templateindex.cpp  -  index of alarm templates by name
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "templateindex.h"
+
+#include <kalarmcal/kaevent.h>
+
+using namespace KAlarmCal;
+
+
+TemplateIndex::TemplateIndex()
+{
+}
+
+/******************************************************************************
+* Add or update an alarm template in the index.
+* If the event is not a template, it is removed from the index.
+* Reply = true if the index has changed, i.e. a template has been added or
+*         removed, or its name or action types have changed.
+*/
+bool TemplateIndex::index(KAEvent* event)
+{
+    if (event->category() != CalEvent::TEMPLATE)
+        return unindex(event);
+    Entry entry;
+    entry.name        = event->templateName();
+    entry.actionTypes = event->actionTypes();
+    QHash<KAEvent*, Entry>::Iterator it = mEntries.find(event);
+    if (it != mEntries.end())
+    {
+        if (it.value().name == entry.name)
+        {
+            if (it.value().actionTypes == entry.actionTypes)
+                return false;    // nothing has changed
+            it.value().actionTypes = entry.actionTypes;
+            return true;
+        }
+        unindex(event);
+    }
+    mEntries[event] = entry;
+    mEvents.insert(entry.name, event);
+    const QCollatorSortKey key = mCollator.sortKey(entry.name);
+    const int i = nameIndex(key);
+    mNames.insert(i, entry.name);
+    mSortKeys.insert(i, key);
+    return true;
+}
+
+/******************************************************************************
+* Remove an alarm template from the index.
+* Reply = true if it was in the index.
+*/
+bool TemplateIndex::unindex(KAEvent* event)
+{
+    QHash<KAEvent*, Entry>::Iterator it = mEntries.find(event);
+    if (it == mEntries.end())
+        return false;
+    const QString name = it.value().name;
+    mEntries.erase(it);
+    mEvents.remove(name, event);
+    for (int i = nameIndex(mCollator.sortKey(name)), end = mNames.count();  i < end;  ++i)
+    {
+        if (mNames[i] == name)
+        {
+            mNames.removeAt(i);
+            mSortKeys.removeAt(i);
+            break;
+        }
+    }
+    return true;
+}
+
+/******************************************************************************
+* Remove all templates from the index.
+*/
+void TemplateIndex::clear()
+{
+    mEntries.clear();
+    mEvents.clear();
+    mNames.clear();
+    mSortKeys.clear();
+}
+
+/******************************************************************************
+* Find the alarm template with the specified name.
+* Reply = 0 if not found.
+*/
+KAEvent* TemplateIndex::event(const QString& name) const
+{
+    if (name.isEmpty())
+        return nullptr;
+    return mEvents.value(name, nullptr);
+}
+
+/******************************************************************************
+* Find the position in the sorted name list of the first name which does not
+* sort before the specified collation key.
+*/
+int TemplateIndex::nameIndex(const QCollatorSortKey& key) const
+{
+    int lo = 0;
+    int hi = mSortKeys.count();
+    while (lo < hi)
+    {
+        const int mid = (lo + hi) / 2;
+        if (mSortKeys[mid].compare(key) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// vim: et sw=4:
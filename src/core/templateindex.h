@@ -0,0 +1,65 @@
+/*
+ *  templateindex.h  -  index of alarm templates by name
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef TEMPLATEINDEX_H
+#define TEMPLATEINDEX_H
+
+#include <QCollator>
+#include <QHash>
+#include <QList>
+#include <QStringList>
+
+namespace KAlarmCal { class KAEvent; }
+using KAlarmCal::KAEvent;
+
+/*=============================================================================
+= Class TemplateIndex
+= Index of alarm templates by name, which also holds the template names in
+= collation order. Several templates may have the same name.
+= Events may be updated in place, so each template's name and action types are
+= recorded as they were when it was last indexed.
+=============================================================================*/
+class TemplateIndex
+{
+    public:
+        TemplateIndex();
+        bool        index(KAEvent*);
+        bool        unindex(KAEvent*);
+        void        clear();
+        KAEvent*    event(const QString& name) const;
+        QStringList names() const  { return mNames; }
+
+    private:
+        struct Entry
+        {
+            QString name;
+            int     actionTypes;
+        };
+        int         nameIndex(const QCollatorSortKey&) const;
+
+        QHash<KAEvent*, Entry>         mEntries;    // name and action types under which each template is indexed
+        QMultiHash<QString, KAEvent*>  mEvents;     // lookup of templates by name
+        QStringList                    mNames;      // template names, in collation order
+        QList<QCollatorSortKey>        mSortKeys;   // collation sort keys for mNames
+        QCollator                      mCollator;   // collator for sorting template names
+};
+
+#endif // TEMPLATEINDEX_H
+
+// vim: et sw=4:
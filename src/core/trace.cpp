@@ -0,0 +1,205 @@
+/*
+ *  trace.cpp  -  low overhead timing trace points
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "trace.h"
+
+#include "kalarm_debug.h"
+
+#if KALARM_TRACING
+#include <QAtomicInteger>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QSaveFile>
+#include <QThread>
+#include <QVector>
+
+namespace
+{
+
+const int RING_SIZE = 16384;    // number of events held per thread (must be a power of 2)
+
+struct TraceEvent
+{
+    const char* category;
+    const char* name;
+    qint64      start;       // nanoseconds
+    qint64      duration;    // nanoseconds, or -1 for an instant event
+};
+
+/*=============================================================================
+= Ring buffer holding the most recent trace events recorded by one thread.
+= Only the owning thread writes to it. 'written' is published after each
+= event is complete, so that dump() can detect events which were overwritten
+= while it was copying them.
+=============================================================================*/
+struct RingBuffer
+{
+    explicit RingBuffer(quint64 tid) : threadId(tid), written(0) {}
+    TraceEvent              events[RING_SIZE];
+    quint64                 threadId;
+    QAtomicInteger<quint64> written;    // total number of events ever written
+};
+
+QMutex               registryMutex;     // protects 'registry'
+QVector<RingBuffer*> registry;          // buffers for all threads which have recorded events
+thread_local RingBuffer* threadBuffer = nullptr;
+
+/******************************************************************************
+* Create the ring buffer for the current thread. Buffers are never deleted, so
+* that events recorded by threads which have since finished can still be
+* dumped.
+*/
+RingBuffer* createThreadBuffer()
+{
+    threadBuffer = new RingBuffer(reinterpret_cast<quintptr>(QThread::currentThreadId()));
+    QMutexLocker locker(&registryMutex);
+    registry += threadBuffer;
+    return threadBuffer;
+}
+
+QElapsedTimer startedTimer()
+{
+    QElapsedTimer timer;
+    timer.start();
+    return timer;
+}
+
+}
+
+namespace Trace
+{
+
+bool isEnabled()
+{
+    return true;
+}
+
+qint64 now()
+{
+    static const QElapsedTimer timer = startedTimer();
+    return timer.nsecsElapsed();
+}
+
+void record(const char* category, const char* name, qint64 start, qint64 duration)
+{
+    RingBuffer* buffer = threadBuffer ? threadBuffer : createThreadBuffer();
+    const quint64 n = buffer->written.load();
+    TraceEvent& event = buffer->events[n & (RING_SIZE - 1)];
+    event.category = category;
+    event.name     = name;
+    event.start    = start;
+    event.duration = duration;
+    buffer->written.storeRelease(n + 1);
+}
+
+/******************************************************************************
+* Write the events in all the ring buffers to a file.
+*/
+bool dump(const QString& file)
+{
+    QVector<RingBuffer*> buffers;
+    {
+        QMutexLocker locker(&registryMutex);
+        buffers = registry;
+    }
+    const qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray traceEvents;
+    QVector<TraceEvent> copy;
+    for (int b = 0, count = buffers.count();  b < count;  ++b)
+    {
+        RingBuffer* buffer = buffers[b];
+        const quint64 end = buffer->written.loadAcquire();
+        quint64 begin = (end > RING_SIZE) ? end - RING_SIZE : 0;
+        copy.resize(static_cast<int>(end - begin));
+        for (quint64 i = begin;  i < end;  ++i)
+            copy[static_cast<int>(i - begin)] = buffer->events[i & (RING_SIZE - 1)];
+        // Discard any events which were overwritten during the copy, and the
+        // oldest remaining one, whose slot may be being overwritten by an
+        // event which is still being recorded.
+        const quint64 written = buffer->written.loadAcquire();
+        const quint64 firstValid = (written + 1 > RING_SIZE) ? written + 1 - RING_SIZE : 0;
+        for (quint64 i = qMax(begin, firstValid);  i < end;  ++i)
+        {
+            const TraceEvent& event = copy[static_cast<int>(i - begin)];
+            QJsonObject obj;
+            obj[QStringLiteral("name")] = QLatin1String(event.name);
+            obj[QStringLiteral("cat")]  = QLatin1String(event.category);
+            obj[QStringLiteral("pid")]  = pid;
+            obj[QStringLiteral("tid")]  = static_cast<double>(buffer->threadId);
+            obj[QStringLiteral("ts")]   = event.start / 1000.0;
+            if (event.duration >= 0)
+            {
+                obj[QStringLiteral("ph")]  = QStringLiteral("X");
+                obj[QStringLiteral("dur")] = event.duration / 1000.0;
+            }
+            else
+            {
+                obj[QStringLiteral("ph")] = QStringLiteral("i");
+                obj[QStringLiteral("s")]  = QStringLiteral("t");
+            }
+            traceEvents.append(obj);
+        }
+    }
+
+    QJsonObject trace;
+    trace[QStringLiteral("traceEvents")] = traceEvents;
+    trace[QStringLiteral("displayTimeUnit")] = QStringLiteral("ms");
+    QSaveFile out(file);
+    if (!out.open(QIODevice::WriteOnly))
+    {
+        qCWarning(KALARM_LOG) << "Trace::dump: cannot open" << file;
+        return false;
+    }
+    out.write(QJsonDocument(trace).toJson(QJsonDocument::Compact));
+    if (!out.commit())
+    {
+        qCWarning(KALARM_LOG) << "Trace::dump: error writing" << file;
+        return false;
+    }
+    qCDebug(KALARM_LOG) << "Trace::dump:" << traceEvents.count() << "events written to" << file;
+    return true;
+}
+
+}
+
+#else
+
+namespace Trace
+{
+
+bool isEnabled()
+{
+    return false;
+}
+
+bool dump(const QString&)
+{
+    qCWarning(KALARM_LOG) << "Trace::dump: tracing is not compiled in";
+    return false;
+}
+
+}
+
+#endif // KALARM_TRACING
+
+// vim: et sw=4:
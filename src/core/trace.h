@@ -0,0 +1,92 @@
+/*
+ *  trace.h  -  low overhead timing trace points
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Trace points are only compiled in if KAlarm is built with the CMake option
+ * KALARM_TRACING. Each thread records its trace events in its own fixed size
+ * ring buffer, so that recording needs no locking or memory allocation. The
+ * most recent events can be written to a file in Chrome trace event JSON
+ * format (viewable in chrome://tracing or Perfetto) by Trace::dump(), which is
+ * available over D-Bus as dumpTrace().
+ *
+ * Usage, where the category and name must be string literals:
+ *   KALARM_TRACE_SCOPE("scheduler", "handleEvent");   // times the enclosing scope
+ *   KALARM_TRACE_INSTANT("action", "commandExited");  // records a single point in time
+ */
+
+#include "config-kalarm.h"
+
+#include <QtGlobal>
+
+class QString;
+
+namespace Trace
+{
+
+/** Return whether trace points are compiled in. */
+bool isEnabled();
+
+/** Write the trace events recorded by all threads to a file in Chrome trace
+ *  event JSON format.
+ *  Reply = false if tracing is not compiled in, or the file could not be written.
+ */
+bool dump(const QString& file);
+
+#if KALARM_TRACING
+/** Return the monotonic time in nanoseconds used for trace events. */
+qint64 now();
+
+/** Record a trace event in the current thread's ring buffer.
+ *  @param duration  duration in nanoseconds, or -1 for an instant event.
+ */
+void record(const char* category, const char* name, qint64 start, qint64 duration);
+
+/** Records the time between its construction and destruction. */
+class Scope
+{
+    public:
+        Scope(const char* category, const char* name)
+            : mCategory(category), mName(name), mStart(now()) {}
+        ~Scope()  { record(mCategory, mName, mStart, now() - mStart); }
+
+    private:
+        Q_DISABLE_COPY(Scope)
+        const char* mCategory;
+        const char* mName;
+        qint64      mStart;
+};
+#endif
+
+}
+
+#if KALARM_TRACING
+#define KALARM_TRACE_CONCAT2(a, b)  a##b
+#define KALARM_TRACE_CONCAT(a, b)   KALARM_TRACE_CONCAT2(a, b)
+#define KALARM_TRACE_SCOPE(category, name)    Trace::Scope KALARM_TRACE_CONCAT(traceScope_, __LINE__)(category, name)
+#define KALARM_TRACE_INSTANT(category, name)  Trace::record(category, name, Trace::now(), -1)
+#else
+#define KALARM_TRACE_SCOPE(category, name)
+#define KALARM_TRACE_INSTANT(category, name)
+#endif
+
+#endif // TRACE_H
+
+// vim: et sw=4:
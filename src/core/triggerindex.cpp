@@ -0,0 +1,81 @@
+/*
+ *  triggerindex.cpp  -  index of alarms by next trigger time
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "triggerindex.h"
+
+#include <QDateTime>
+
+
+/******************************************************************************
+* Add or update an event's position in the index. Events which are not enabled
+* active alarms, or which have no next trigger, are removed from the index.
+*/
+void TriggerIndex::update(const KAEvent& event)
+{
+    const EventId id(event);
+    KDateTime dt;
+    if (event.category() == CalEvent::ACTIVE  &&  event.enabled())
+        dt = event.nextTrigger(KAEvent::ALL_TRIGGER).effectiveKDateTime();
+    if (!dt.isValid())
+    {
+        remove(id);
+        return;
+    }
+    const KDateTime utc = dt.toUtc();
+    const qint64 trigger = QDateTime(utc.date(), utc.time(), Qt::UTC).toMSecsSinceEpoch();
+    QHash<EventId, qint64>::Iterator it = mTriggers.find(id);
+    if (it != mTriggers.end())
+    {
+        if (it.value() == trigger)
+            return;
+        mIndex.remove(it.value(), id);
+        it.value() = trigger;
+    }
+    else
+        mTriggers.insert(id, trigger);
+    mIndex.insert(trigger, id);
+}
+
+/******************************************************************************
+* Remove an event from the index.
+*/
+void TriggerIndex::remove(const EventId& id)
+{
+    QHash<EventId, qint64>::Iterator it = mTriggers.find(id);
+    if (it == mTriggers.end())
+        return;
+    mIndex.remove(it.value(), id);
+    mTriggers.erase(it);
+}
+
+void TriggerIndex::clear()
+{
+    mIndex.clear();
+    mTriggers.clear();
+}
+
+/******************************************************************************
+* Return the ID of the event with the earliest next trigger time.
+*/
+EventId TriggerIndex::earliest() const
+{
+    return mIndex.isEmpty() ? EventId() : mIndex.constBegin().value();
+}
+
+// vim: et sw=4:
@@ -0,0 +1,54 @@
+/*
+ *  triggerindex.h  -  index of alarms by next trigger time
+ *  Program:  kalarm
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef TRIGGERINDEX_H
+#define TRIGGERINDEX_H
+
+#include "eventid.h"
+
+#include <kalarmcal/kaevent.h>
+
+#include <QHash>
+#include <QMultiMap>
+
+using namespace KAlarmCal;
+
+/*=============================================================================
+= Class TriggerIndex
+= Orders enabled active alarms by their next trigger time, so that the earliest
+= can be found, and each event's position updated, in O(log N).
+=============================================================================*/
+class TriggerIndex
+{
+    public:
+        void     update(const KAEvent&);
+        void     remove(const EventId&);
+        void     clear();
+        EventId  earliest() const;
+        int      count() const     { return mTriggers.count(); }
+        bool     isEmpty() const   { return mTriggers.isEmpty(); }
+
+    private:
+        QMultiMap<qint64, EventId> mIndex;      // event IDs, by next trigger time
+        QHash<EventId, qint64>     mTriggers;   // next trigger time (UTC msecs) of each indexed event
+};
+
+#endif // TRIGGERINDEX_H
+
+// vim: et sw=4:
@@ -27,6 +27,7 @@
 #include "kamail.h"
 #include "mainwindow.h"
 #include "preferences.h"
+#include "trace.h"
 #include "dbushandler.h"
 #include <kalarmadaptor.h>
 
@@ -285,6 +286,23 @@ bool DBusHandler::editNew(const QString& templateName)
     return KAlarm::editNewAlarm(templateName);
 }
 
+/******************************************************************************
+* Write the recorded trace events to a file in Chrome trace event format.
+* This only works if KAlarm was built with tracing enabled.
+*/
+bool DBusHandler::dumpTrace(const QString& file)
+{
+    return Trace::dump(file);
+}
+
+/******************************************************************************
+* Return scheduler health metrics in Prometheus text exposition format.
+*/
+QString DBusHandler::metrics()
+{
+    return theApp()->metrics();
+}
+
 
 /******************************************************************************
 * Schedule a message alarm, after converting the parameters from strings.
@@ -85,6 +85,13 @@ class DBusHandler : public QObject, public KAlarmIface
         Q_SCRIPTABLE bool edit(const QString& eventID);
         Q_SCRIPTABLE bool editNew(int type);
         Q_SCRIPTABLE bool editNew(const QString& templateName);
+        Q_SCRIPTABLE bool dumpTrace(const QString& file);
+        Q_SCRIPTABLE QString metrics();
+
+    Q_SIGNALS:
+        /** Emitted when the 99th percentile lateness of recently triggered
+         *  alarms exceeds the LatenessAlertThreshold configuration setting. */
+        Q_SCRIPTABLE void latenessThresholdExceeded(int p99Seconds);
 
     private:
         static bool scheduleMessage(const QString& message, const KDateTime& start, int lateCancel, unsigned flags,
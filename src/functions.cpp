@@ -22,9 +22,11 @@
 #include "functions.h"
 #include "functions_p.h"
 
+#include "akonadimodel.h"
 #include "collectionmodel.h"
 #include "collectionsearch.h"
 #include "alarmcalendar.h"
+#include "archiveindex.h"
 #include "alarmtime.h"
 #include "autoqpointer.h"
 #include "alarmlistview.h"
@@ -33,8 +35,10 @@
 #include "kamail.h"
 #include "mainwindow.h"
 #include "messagebox.h"
+#include "metrics.h"
 #include "messagewin.h"
 #include "preferences.h"
+#include "rtcwakeaction.h"
 #include "shellprocess.h"
 #include "templatelistview.h"
 #include "templatemenuaction.h"
@@ -81,6 +85,8 @@ using namespace KCalCore;
 #include <QDir>
 #include <QRegExp>
 #include <QDesktopWidget>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
 #include <QtDBus/QtDBus>
 #include <QTimer>
 #include <qglobal.h>
@@ -138,6 +144,7 @@ const QLatin1String KORGANIZER_UID("-korg");
 
 const QLatin1String ALARM_OPTS_FILE("alarmopts");
 const char*         DONT_SHOW_ERRORS_GROUP = "DontShowErrors";
+const int           DONT_SHOW_ERRORS_SAVE_DELAY = 2000;   // milliseconds to wait before writing changes
 
 void editNewTemplate(EditAlarmDlg::Type, const KAEvent* preset, QWidget* parent);
 void displayUpdateError(QWidget* parent, KAlarm::UpdateError, const UpdateStatusData&, bool showKOrgError = true);
@@ -145,6 +152,8 @@ KAlarm::UpdateResult sendToKOrganizer(const KAEvent&);
 KAlarm::UpdateResult deleteFromKOrganizer(const QString& eventID);
 KAlarm::UpdateResult runKOrganizer();
 QString uidKOrganizer(const QString& eventID);
+KAuth::Action rtcWakeAction(unsigned triggerTime, QWidget* parent);
+bool writeRtcWakeTestFile(unsigned triggerTime);
 }
 
 
@@ -264,11 +273,15 @@ UpdateResult addEvent(KAEvent& event, Collection* calendar, QWidget* msgParent,
 }
 
 /******************************************************************************
-* Add a list of new active (non-archived) alarms.
-* Save them in the calendar file and add them to every main window instance.
-* The events are updated with their actual event IDs.
+* Add a list of new active (non-archived) alarms, as a single group update.
+* This only starts the update. When it has completed, the alarms which were
+* added are saved in the calendar file and added to every main window
+* instance, and any errors are reported. If 'undoText' is non-empty, the added
+* alarms are also recorded for undo under that description.
+* Reply = UPDATE_OK if the update has been started
+*       = error status (already reported) if it could not be started.
 */
-UpdateResult addEvents(QVector<KAEvent>& events, QWidget* msgParent, bool allowKOrgUpdate, bool showKOrgErr)
+UpdateResult addEvents(const QVector<KAEvent>& events, QWidget* msgParent, bool allowKOrgUpdate, bool showKOrgErr, const QString& undoText)
 {
     qCDebug(KALARM_LOG) << events.count();
     if (events.isEmpty())
@@ -288,33 +301,77 @@ UpdateResult addEvents(QVector<KAEvent>& events, QWidget* msgParent, bool allowK
     }
     if (status.status == UPDATE_OK)
     {
+        // Start saving the event details in the calendar. The outcome for each
+        // event is reported to Private::eventsAdded() once Akonadi has
+        // finished with the update.
         AlarmCalendar* cal = AlarmCalendar::resources();
-        for (int i = 0, end = events.count();  i < end;  ++i)
+        KJob* job = cal->addEvents(events, collection);
+        if (job)
         {
-            // Save the event details in the calendar file, and get the new event ID
-            if (!cal->addEvent(events[i], msgParent, false, &collection))
-            {
-                status.setError(UPDATE_ERROR);
-                continue;
-            }
-            if (allowKOrgUpdate  &&  events[i].copyToKOrganizer())
-            {
-                UpdateResult st = sendToKOrganizer(events[i]);    // tell KOrganizer to show the event
-                status.korgUpdate(st);
-            }
-
+            Private* priv = Private::instance();
+            QObject::connect(cal, &AlarmCalendar::eventsAdded, priv, &Private::eventsAdded, Qt::UniqueConnection);
+            Private::AddEventsData& data = priv->mAddEvents[job];
+            data.msgParent       = msgParent;
+            data.collection      = collection;
+            data.undoText        = undoText;
+            data.allowKOrgUpdate = allowKOrgUpdate;
+            data.showKOrgErr     = showKOrgErr;
+            return UpdateResult(UPDATE_OK);
         }
-        if (status.warnErr == events.count())
-            status.status = UPDATE_FAILED;
-        else if (!cal->save())
-            status.setError(SAVE_FAILED, events.count());  // everything failed
+        status.setError(UPDATE_FAILED, events.count());
     }
 
-    if (status.status != UPDATE_OK  &&  msgParent)
+    if (msgParent)
         displayUpdateError(msgParent, ERR_ADD, status, showKOrgErr);
     return status.status;
 }
 
+/******************************************************************************
+* Called when a group update started by addEvents() has completed.
+* Notify KOrganizer of the new alarms, save the calendar, record the alarms for
+* undo, and report any errors.
+*/
+void Private::eventsAdded(KJob* transaction, const QVector<KAEvent>& events)
+{
+    QHash<KJob*, AddEventsData>::Iterator it = mAddEvents.find(transaction);
+    if (it == mAddEvents.end())
+        return;    // not started by addEvents()
+    const AddEventsData data = it.value();
+    mAddEvents.erase(it);
+
+    UpdateStatusData status;
+    Undo::EventList undos;
+    int added = 0;
+    for (int i = 0, end = events.count();  i < end;  ++i)
+    {
+        if (events[i].itemId() < 0)
+            continue;    // the alarm wasn't added
+        ++added;
+        if (data.allowKOrgUpdate  &&  events[i].copyToKOrganizer())
+        {
+            UpdateResult st = sendToKOrganizer(events[i]);    // tell KOrganizer to show the event
+            status.korgUpdate(st);
+        }
+        if (!data.undoText.isEmpty())
+            undos.append(events[i], data.collection);
+    }
+    if (added < events.count())
+        status.setError(UPDATE_ERROR, events.count() - added);
+    if (!added)
+        status.status = UPDATE_FAILED;
+    else if (!AlarmCalendar::resources()->save())
+        status.setError(SAVE_FAILED, events.count());  // everything failed
+    if (!undos.isEmpty())
+        Undo::saveAdds(undos, data.undoText);
+
+    // The original message parent may have been closed by now
+    QWidget* msgParent = data.msgParent ? data.msgParent.data() : MainWindow::mainMainWindow();
+    if (status.status != UPDATE_OK  &&  msgParent)
+        displayUpdateError(msgParent, ERR_ADD, status, data.showKOrgErr);
+    if (status.status != UPDATE_FAILED  &&  data.msgParent)
+        outputAlarmWarnings(data.msgParent);
+}
+
 /******************************************************************************
 * Save the event in the archived calendar and adjust every main window instance.
 * The event's ID is changed to an archived ID if necessary.
@@ -732,26 +789,28 @@ UpdateResult enableEvents(QVector<KAEvent>& events, bool enable, QWidget* msgPar
 * Purge all archived events from the default archived alarm resource whose end
 * time is longer ago than 'purgeDays'. All events are deleted if 'purgeDays' is
 * zero.
+* To avoid blocking for long periods, at most ArchiveIndex::PURGE_BATCH_SIZE
+* events are deleted in each call, oldest first. Progress is recorded in the
+* kalarm_archive_purged_total and kalarm_archive_purge_pending metrics.
+* Reply = true if more events remain to be purged.
 */
-void purgeArchive(int purgeDays)
+bool purgeArchive(int purgeDays)
 {
     if (purgeDays < 0)
-        return;
-    qCDebug(KALARM_LOG) << purgeDays;
-    QDate cutoff = KDateTime::currentLocalDate().addDays(-purgeDays);
+        return false;
     Collection collection = CollectionControlModel::getStandard(CalEvent::ARCHIVED);
     if (!collection.isValid())
-        return;
-    KAEvent::List events = AlarmCalendar::resources()->events(collection);
-    for (int i = 0;  i < events.count();  )
     {
-        if (purgeDays  &&  events[i]->createdDateTime().date() >= cutoff)
-            events.remove(i);
-        else
-            ++i;
+        Metrics::set("kalarm_archive_purge_pending", 0);
+        return false;
     }
-    if (!events.isEmpty())
-        AlarmCalendar::resources()->purgeEvents(events);   // delete the events and save the calendar
+    const QDate cutoff = purgeDays ? KDateTime::currentLocalDate().addDays(-purgeDays) : QDate();
+    const int count = AlarmCalendar::resources()->purgeArchived(collection.id(), cutoff, ArchiveIndex::PURGE_BATCH_SIZE);
+    qCDebug(KALARM_LOG) << purgeDays << ": purged" << count << "alarms";
+    const bool more = (count == ArchiveIndex::PURGE_BATCH_SIZE);
+    Metrics::increment("kalarm_archive_purged_total", QString(), count);
+    Metrics::set("kalarm_archive_purge_pending", more ? 1 : 0);
+    return more;
 }
 
 /******************************************************************************
@@ -1000,6 +1059,8 @@ Desktop currentDesktopIdentity()
 /******************************************************************************
 * Check the config as to whether there is a wake-on-suspend alarm pending, and
 * if so, delete it from the config if it has expired.
+* The config entry is cached in memory, so that no config file access is needed
+* unless it has expired.
 * If 'checkExists' is true, the config entry will only be returned if the
 * event exists.
 * Reply = config entry: [0] = event's collection ID (Akonadi only),
@@ -1009,8 +1070,8 @@ Desktop currentDesktopIdentity()
 */
 QStringList checkRtcWakeConfig(bool checkEventExists)
 {
-    KConfigGroup config(KSharedConfig::openConfig(), "General");
-    QStringList params = config.readEntry("RtcWake", QStringList());
+    Private* priv = Private::instance();
+    const QStringList params = priv->rtcWakeConfig();
     if (params.count() == 3  &&  params[2].toUInt() > KDateTime::currentUtcDateTime().toTime_t())
     {
         if (checkEventExists  &&  !AlarmCalendar::getEvent(EventId(params[0].toLongLong(), params[1])))
@@ -1018,21 +1079,96 @@ QStringList checkRtcWakeConfig(bool checkEventExists)
         return params;                   // config entry is valid
     }
     if (!params.isEmpty())
-    {
-        config.deleteEntry("RtcWake");   // delete the expired config entry
-        config.sync();
-    }
+        priv->setRtcWakeConfig(QStringList());   // delete the expired config entry
     return QStringList();
 }
 
+/******************************************************************************
+* Store a wake-on-suspend alarm in the config.
+*/
+void setRtcWakeConfig(Akonadi::Collection::Id collectionId, const QString& eventId, unsigned triggerTime)
+{
+    QStringList params;
+    params << QString::number(collectionId) << eventId << QString::number(triggerTime);
+    Private::instance()->setRtcWakeConfig(params);
+}
+
 /******************************************************************************
 * Delete any wake-on-suspend alarm from the config.
 */
 void deleteRtcWakeConfig()
 {
+    Private::instance()->setRtcWakeConfig(QStringList());
+}
+
+/******************************************************************************
+* Return the wake-on-suspend config entry, reading it from the config file the
+* first time this is called.
+*/
+const QStringList& Private::rtcWakeConfig()
+{
+    if (!mRtcWakeRead)
+    {
+        KConfigGroup config(KSharedConfig::openConfig(), "General");
+        mRtcWake = config.readEntry("RtcWake", QStringList());
+        mRtcWakeRead = true;
+        startRtcWakeTimer();
+    }
+    return mRtcWake;
+}
+
+/******************************************************************************
+* Set or delete the wake-on-suspend config entry, in both the cache and the
+* config file.
+*/
+void Private::setRtcWakeConfig(const QStringList& params)
+{
+    // When the user's wakeup goes, the automatic wakeup (which it overrides)
+    // needs to be set again.
+    if (params.isEmpty()  &&  !mRtcWake.isEmpty())
+        QTimer::singleShot(0, theApp(), &KAlarmApp::checkNextDueAlarm);
+    mRtcWake = params;
+    mRtcWakeRead = true;
     KConfigGroup config(KSharedConfig::openConfig(), "General");
-    config.deleteEntry("RtcWake");
+    if (params.isEmpty())
+        config.deleteEntry("RtcWake");
+    else
+        config.writeEntry("RtcWake", params);
     config.sync();
+    startRtcWakeTimer();
+}
+
+/******************************************************************************
+* Start a timer to expire the wake-on-suspend config entry at its trigger time.
+*/
+void Private::startRtcWakeTimer()
+{
+    if (mRtcWake.count() != 3)
+    {
+        if (mRtcWakeTimer)
+            mRtcWakeTimer->stop();
+        return;
+    }
+    if (!mRtcWakeTimer)
+    {
+        mRtcWakeTimer = new QTimer(this);
+        mRtcWakeTimer->setSingleShot(true);
+        connect(mRtcWakeTimer, &QTimer::timeout, this, &Private::rtcWakeExpired);
+    }
+    const qint64 secs = static_cast<qint64>(mRtcWake[2].toUInt()) - KDateTime::currentUtcDateTime().toTime_t();
+    // Limit the interval to a day, to avoid timer overflow
+    mRtcWakeTimer->start(static_cast<int>(qBound(qint64(0), secs, qint64(86400)) * 1000));
+}
+
+/******************************************************************************
+* Called when the wake-on-suspend config entry may have expired.
+*/
+void Private::rtcWakeExpired()
+{
+    if (mRtcWake.count() == 3  &&  mRtcWake[2].toUInt() > KDateTime::currentUtcDateTime().toTime_t())
+        startRtcWakeTimer();   // not expired yet
+    else if (!mRtcWake.isEmpty())
+        setRtcWakeConfig(QStringList());
 }
 
 /******************************************************************************
@@ -1066,54 +1202,95 @@ void Private::cancelRtcWake()
 */
 bool setRtcWakeTime(unsigned triggerTime, QWidget* parent)
 {
-#if 0 //QT5
-    QVariantMap args;
-    args[QLatin1String("time")] = triggerTime;
-    KAuth::Action action(QLatin1String("org.kde.kalarmrtcwake.settimer"));
-    action.setHelperID(QLatin1String("org.kde.kalarmrtcwake"));
-    action.setParentWidget(parent);
-    action.setArguments(args);
-    KAuth::ActionReply reply = action.execute();
-    if (reply.failed())
+    if (!Preferences::rtcWakeTestFile().isEmpty())
+        return writeRtcWakeTestFile(triggerTime);
+    KAuth::ExecuteJob* job = rtcWakeAction(triggerTime, parent).execute();
+    if (!job->exec())
     {
-        QString errmsg = reply.errorDescription();
-        qCDebug(KALARM_LOG) << "Error code=" << reply.errorCode() << errmsg;
-        if (errmsg.isEmpty())
+        QString errmsg = job->errorString();
+        const int errcode = job->error();
+        qCDebug(KALARM_LOG) << "Error code=" << errcode << errmsg;
+        switch (errcode)
         {
-            int errcode = reply.errorCode();
-            switch (reply.type())
-            {
-                case KAuth::ActionReply::KAuthErrorType:
-                    qCDebug(KALARM_LOG) << "Authorization error:" << errcode;
-                    switch (errcode)
-                    {
-                        case KAuth::ActionReply::AuthorizationDeniedError:
-                        case KAuth::ActionReply::UserCancelledError:
-                            return false;   // the user should already know about this
-                        default:
-                            break;
-                    }
-                    break;
-                case KAuth::ActionReply::HelperErrorType:
-                    qCDebug(KALARM_LOG) << "Helper error:" << errcode;
-                    errcode += 100;    // make code distinguishable from KAuthError type
-                    break;
-                default:
-                    break;
-            }
-            errmsg = i18nc("@info", "Error obtaining authorization (%1)", errcode);
+            case KAuth::ActionReply::AuthorizationDeniedError:
+            case KAuth::ActionReply::UserCancelledError:
+                return false;   // the user should already know about this
+            default:
+                break;
         }
+        if (errmsg.isEmpty())
+            errmsg = i18nc("@info", "Error obtaining authorization (%1)", errcode);
         KAMessageBox::information(parent, errmsg);
         return false;
     }
-#endif
     return true;
 }
 
+/******************************************************************************
+* Set the wakeup time for the system, without waiting for the result.
+* This is used when the wakeup time is set automatically, so any error is
+* logged rather than displayed.
+* Set 'triggerTime' to zero to cancel the wakeup.
+*/
+void setRtcWakeTimeAsync(unsigned triggerTime)
+{
+    if (!Preferences::rtcWakeTestFile().isEmpty())
+    {
+        writeRtcWakeTestFile(triggerTime);
+        return;
+    }
+    KAuth::ExecuteJob* job = rtcWakeAction(triggerTime, MainWindow::mainMainWindow()).execute();
+    QObject::connect(job, &KJob::result, Private::instance(), &Private::rtcWakeJobDone);
+    job->start();
+}
+
+/******************************************************************************
+* Called when an asynchronous job to set the system wakeup time has completed.
+*/
+void Private::rtcWakeJobDone(KJob* job)
+{
+    if (job->error())
+        qCWarning(KALARM_LOG) << "Error setting wake from suspend: code=" << job->error() << job->errorString();
+}
+
 } // namespace KAlarm
 namespace
 {
 
+/******************************************************************************
+* Create the KAuth action to set the wakeup time for the system.
+*/
+KAuth::Action rtcWakeAction(unsigned triggerTime, QWidget* parent)
+{
+    QVariantMap args;
+    args[QStringLiteral("time")] = triggerTime;
+    KAuth::Action action(QStringLiteral("org.kde.kalarmrtcwake.settimer"));
+    action.setHelperId(QStringLiteral("org.kde.kalarmrtcwake"));
+    action.setParentWidget(parent);
+    action.setArguments(args);
+    return action;
+}
+
+/******************************************************************************
+* Write the wakeup to the stand-in file which is used instead of the system's
+* real time clock, for testing. The value written is the same as the KAuth
+* helper writes to the real time clock's wakealarm file: "+seconds" from now,
+* or 0 to cancel.
+* Reply = true if successful.
+*/
+bool writeRtcWakeTestFile(unsigned triggerTime)
+{
+    const QByteArray value = triggerTime ? '+' + QByteArray::number(RtcWakeAction::wakeDelay(triggerTime)) : QByteArray("0");
+    QFile file(Preferences::rtcWakeTestFile());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+    ||  file.write(value + '\n') < 0)
+    {
+        qCWarning(KALARM_LOG) << "Error writing wake from suspend test file" << file.fileName();
+        return false;
+    }
+    return true;
+}
+
 /******************************************************************************
 * Create a new template.
 * 'preset' is non-null to base it on an existing event or template; otherwise,
@@ -1375,29 +1552,39 @@ void refreshAlarms()
 * This method must only be called from the main KAlarm queue processing loop,
 * to prevent asynchronous calendar operations interfering with one another.
 *
-* If refreshAlarms() has been called, reload the calendars.
+* If refreshAlarms() has been called, reload any calendars whose alarms have
+* changed in Akonadi storage.
 */
 void refreshAlarmsIfQueued()
 {
     if (refreshAlarmsQueued)
     {
         qCDebug(KALARM_LOG);
-        AlarmCalendar::resources()->reload();
+        // Disabled alarms' message windows are closed once the changes have
+        // been fetched.
+        QObject::connect(AkonadiModel::instance(), &AkonadiModel::reloadChangedDone,
+                         Private::instance(), &Private::reloadChangedDone, Qt::UniqueConnection);
+        AkonadiModel::instance()->reloadChanged();
+        refreshAlarmsQueued = false;
+    }
+}
 
-        // Close any message windows for alarms which are now disabled
-        KAEvent::List events = AlarmCalendar::resources()->events(CalEvent::ACTIVE);
-        for (int i = 0, end = events.count();  i < end;  ++i)
+/******************************************************************************
+* Called when AkonadiModel has fetched the alarms which have changed since
+* they were loaded.
+* Close any message windows for alarms which are now disabled.
+*/
+void Private::reloadChangedDone(int)
+{
+    KAEvent::List events = AlarmCalendar::resources()->events(CalEvent::ACTIVE);
+    for (int i = 0, end = events.count();  i < end;  ++i)
+    {
+        KAEvent* event = events[i];
+        if (!event->enabled()  &&  (event->actionTypes() & KAEvent::ACT_DISPLAY))
         {
-            KAEvent* event = events[i];
-            if (!event->enabled()  &&  (event->actionTypes() & KAEvent::ACT_DISPLAY))
-            {
-                MessageWin* win = MessageWin::findEvent(EventId(*event));
-                delete win;
-            }
+            MessageWin* win = MessageWin::findEvent(EventId(*event));
+            delete win;
         }
-
-        MainWindow::refresh();
-        refreshAlarmsQueued = false;
     }
 }
 
@@ -1529,10 +1716,7 @@ QStringList dontShowErrors(const EventId& eventId)
 {
     if (eventId.isEmpty())
         return QStringList();
-    KConfig config(QStandardPaths::writableLocation(QStandardPaths::DataLocation) + QLatin1Char('/') + ALARM_OPTS_FILE);
-    KConfigGroup group(&config, DONT_SHOW_ERRORS_GROUP);
-    const QString id = QStringLiteral("%1:%2").arg(eventId.collectionId()).arg(eventId.eventId());
-    return group.readEntry(id, QStringList());
+    return DontShowErrorsStore::instance()->tags(eventId);
 }
 
 /******************************************************************************
@@ -1555,14 +1739,7 @@ void setDontShowErrors(const EventId& eventId, const QStringList& tags)
 {
     if (eventId.isEmpty())
         return;
-    KConfig config(QStandardPaths::writableLocation(QStandardPaths::DataLocation) + QLatin1Char('/') + ALARM_OPTS_FILE);
-    KConfigGroup group(&config, DONT_SHOW_ERRORS_GROUP);
-    const QString id = QStringLiteral("%1:%2").arg(eventId.collectionId()).arg(eventId.eventId());
-    if (tags.isEmpty())
-        group.deleteEntry(id);
-    else
-        group.writeEntry(id, tags);
-    group.sync();
+    DontShowErrorsStore::instance()->setTags(eventId, tags);
 }
 
 /******************************************************************************
@@ -1573,16 +1750,107 @@ void setDontShowErrors(const EventId& eventId, const QString& tag)
 {
     if (eventId.isEmpty()  ||  tag.isEmpty())
         return;
-    KConfig config(QStandardPaths::writableLocation(QStandardPaths::DataLocation) + QLatin1Char('/') + ALARM_OPTS_FILE);
-    KConfigGroup group(&config, DONT_SHOW_ERRORS_GROUP);
-    const QString id = QStringLiteral("%1:%2").arg(eventId.collectionId()).arg(eventId.eventId());
-    QStringList tags = group.readEntry(id, QStringList());
+    DontShowErrorsStore* store = DontShowErrorsStore::instance();
+    QStringList tags = store->tags(eventId);
     if (tags.indexOf(tag) < 0)
     {
         tags += tag;
+        store->setTags(eventId, tags);
+    }
+}
+
+DontShowErrorsStore* DontShowErrorsStore::mInstance = nullptr;
+
+DontShowErrorsStore* DontShowErrorsStore::instance()
+{
+    if (!mInstance)
+        mInstance = new DontShowErrorsStore;
+    return mInstance;
+}
+
+DontShowErrorsStore::DontShowErrorsStore()
+    : QObject(qApp),
+      mPath(QStandardPaths::writableLocation(QStandardPaths::DataLocation) + QLatin1Char('/') + ALARM_OPTS_FILE),
+      mWatcher(new QFileSystemWatcher(this)),
+      mSaveTimer(new QTimer(this)),
+      mLastWriteSize(-1)
+{
+    mConfig = KSharedConfig::openConfig(mPath, KConfig::SimpleConfig);
+    mSaveTimer->setSingleShot(true);
+    connect(mSaveTimer, &QTimer::timeout, this, &DontShowErrorsStore::save);
+    connect(mWatcher, &QFileSystemWatcher::fileChanged, this, &DontShowErrorsStore::fileChanged);
+    connect(qApp, &QCoreApplication::aboutToQuit, this, &DontShowErrorsStore::save);
+    watchFile();
+}
+
+/******************************************************************************
+* Return the tags for an alarm ID.
+*/
+QStringList DontShowErrorsStore::tags(const EventId& eventId) const
+{
+    const KConfigGroup group(mConfig, DONT_SHOW_ERRORS_GROUP);
+    const QString id = QStringLiteral("%1:%2").arg(eventId.collectionId()).arg(eventId.eventId());
+    return group.readEntry(id, QStringList());
+}
+
+/******************************************************************************
+* Set the tags for an alarm ID, and schedule the file to be written.
+* If 'tags' is empty, the config entry is deleted.
+*/
+void DontShowErrorsStore::setTags(const EventId& eventId, const QStringList& tags)
+{
+    KConfigGroup group(mConfig, DONT_SHOW_ERRORS_GROUP);
+    const QString id = QStringLiteral("%1:%2").arg(eventId.collectionId()).arg(eventId.eventId());
+    if (tags.isEmpty())
+        group.deleteEntry(id);
+    else
         group.writeEntry(id, tags);
-        group.sync();
+    if (!mSaveTimer->isActive())
+        mSaveTimer->start(DONT_SHOW_ERRORS_SAVE_DELAY);
+}
+
+/******************************************************************************
+* Write any changes to the file.
+*/
+void DontShowErrorsStore::save()
+{
+    mSaveTimer->stop();
+    if (mConfig->isDirty())
+    {
+        mConfig->sync();
+        const QFileInfo info(mPath);
+        mLastWrite = info.lastModified();
+        mLastWriteSize = info.size();
+        watchFile();   // the file may have been created or replaced
+    }
+}
+
+/******************************************************************************
+* Called when the file has been changed, either externally or by save().
+* If it is still as save() last wrote it, there is nothing to reread.
+* Otherwise, reread it, after first writing any pending changes so that they
+* are not lost.
+*/
+void DontShowErrorsStore::fileChanged()
+{
+    const QFileInfo info(mPath);
+    if (info.exists()  &&  info.lastModified() == mLastWrite  &&  info.size() == mLastWriteSize)
+    {
+        watchFile();   // the file may have been replaced, so watch the new one
+        return;
     }
+    save();
+    mConfig->reparseConfiguration();
+    watchFile();   // the file may have been replaced, so watch the new one
+}
+
+/******************************************************************************
+* Ensure that the file is being watched for changes.
+*/
+void DontShowErrorsStore::watchFile()
+{
+    if (!mWatcher->files().contains(mPath)  &&  QFile::exists(mPath))
+        mWatcher->addPath(mPath);
 }
 
 /******************************************************************************
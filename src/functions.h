@@ -155,7 +155,8 @@ enum         // 'options' parameter values for addEvent(). May be OR'ed together
     ALLOW_KORG_UPDATE  = 0x04    // allow change to be sent to KOrganizer
 };
 UpdateResult        addEvent(KAEvent&, Akonadi::Collection* = nullptr, QWidget* msgParent = nullptr, int options = ALLOW_KORG_UPDATE, bool showKOrgErr = true);
-UpdateResult        addEvents(QVector<KAEvent>&, QWidget* msgParent = nullptr, bool allowKOrgUpdate = true, bool showKOrgErr = true);
+UpdateResult        addEvents(const QVector<KAEvent>&, QWidget* msgParent = nullptr, bool allowKOrgUpdate = true, bool showKOrgErr = true,
+                              const QString& undoText = QString());
 bool                addArchivedEvent(KAEvent&, Akonadi::Collection* = nullptr);
 UpdateResult        addTemplate(KAEvent&, Akonadi::Collection* = nullptr, QWidget* msgParent = nullptr);
 UpdateResult        modifyEvent(KAEvent& oldEvent, KAEvent& newEvent, QWidget* msgParent = nullptr, bool showKOrgErr = true);
@@ -171,14 +172,16 @@ UpdateResult        reactivateEvent(KAEvent&, Akonadi::Collection* = nullptr, QW
 UpdateResult        reactivateEvents(QVector<KAEvent>&, QVector<EventId>& ineligibleIDs, Akonadi::Collection* = nullptr, QWidget* msgParent = nullptr, bool showKOrgErr = true);
 UpdateResult        enableEvents(QVector<KAEvent>&, bool enable, QWidget* msgParent = nullptr);
 QVector<KAEvent>    getSortedActiveEvents(QObject* parent, AlarmListModel** model = nullptr);
-void                purgeArchive(int purgeDays);    // must only be called from KAlarmApp::processQueue()
+bool                purgeArchive(int purgeDays);    // must only be called from KAlarmApp::processQueue()
 void                displayKOrgUpdateError(QWidget* parent, UpdateError, UpdateResult korgError, int nAlarms = 0);
 Desktop             currentDesktopIdentity();
 QString             currentDesktopIdentityName();
 QStringList         checkRtcWakeConfig(bool checkEventExists = false);
+void                setRtcWakeConfig(Akonadi::Collection::Id, const QString& eventId, unsigned triggerTime);
 void                deleteRtcWakeConfig();
 void                cancelRtcWake(QWidget* msgParent, const QString& eventId = QString());
 bool                setRtcWakeTime(unsigned triggerTime, QWidget* parent);
+void                setRtcWakeTimeAsync(unsigned triggerTime);
 
 /** Return a prompt string to ask the user whether to convert the calendar to the
  *  current format.
@@ -22,9 +22,19 @@
 #define FUNCTIONS_P_H
 
 #include "kalarm.h"   //krazy:exclude=includes (kalarm.h must be first)
+#include "eventid.h"
 #include <kwindowsystem.h>
+#include <KSharedConfig>
+#include <AkonadiCore/collection.h>
+#include <QDateTime>
+#include <QHash>
 #include <QObject>
+#include <QPointer>
+#include <QStringList>
 
+class QFileSystemWatcher;
+class KJob;
+class QTimer;
 class EditAlarmDlg;
 
 namespace KAlarm
@@ -35,7 +45,8 @@ class Private : public QObject
 {
         Q_OBJECT
     public:
-        explicit Private(QObject* parent = nullptr) : QObject(parent), mMsgParent(nullptr) {}
+        explicit Private(QObject* parent = nullptr)
+            : QObject(parent), mMsgParent(nullptr), mRtcWakeTimer(nullptr), mRtcWakeRead(false) {}
         static bool startKMailMinimised();
         static Private* instance()
         {
@@ -43,15 +54,69 @@ class Private : public QObject
                 mInstance = new Private;
             return mInstance;
         }
+        const QStringList& rtcWakeConfig();
+        void setRtcWakeConfig(const QStringList& params);
+
+        struct AddEventsData   // group update started by addEvents(), in progress
+        {
+            AddEventsData() : allowKOrgUpdate(false), showKOrgErr(false) {}
+            QPointer<QWidget>   msgParent;        // parent for error messages
+            Akonadi::Collection collection;       // collection the events are added to
+            QString             undoText;         // undo description, or empty for no undo
+            bool                allowKOrgUpdate;  // notify KOrganizer of the new events
+            bool                showKOrgErr;      // report KOrganizer errors
+        };
 
         QWidget* mMsgParent;
+        QHash<KJob*, AddEventsData> mAddEvents;   // group updates in progress
 
     public Q_SLOTS:
         void windowAdded(WId);
         void cancelRtcWake();
+        void rtcWakeJobDone(KJob*);
+        void reloadChangedDone(int changes);
+        void eventsAdded(KJob* transaction, const QVector<KAEvent>& events);
+
+    private Q_SLOTS:
+        void rtcWakeExpired();
 
     private:
+        void startRtcWakeTimer();
+
         static Private* mInstance;
+        QStringList mRtcWake;        // cached wake-from-suspend config entry
+        QTimer*     mRtcWakeTimer;   // fires when the wake-from-suspend entry expires
+        bool        mRtcWakeRead;    // mRtcWake has been read from the config file
+};
+
+// Private class to hold the Don't-show-again error message tags for alarms.
+// The file is read once, changes are written back after a short delay, and
+// the file is reread if it is changed externally.
+class DontShowErrorsStore : public QObject
+{
+        Q_OBJECT
+    public:
+        static DontShowErrorsStore* instance();
+        QStringList tags(const EventId&) const;
+        void        setTags(const EventId&, const QStringList& tags);
+
+    public Q_SLOTS:
+        void        save();
+
+    private Q_SLOTS:
+        void        fileChanged();
+
+    private:
+        DontShowErrorsStore();
+        void        watchFile();
+
+        static DontShowErrorsStore* mInstance;
+        QString             mPath;        // path of the config file
+        KSharedConfig::Ptr  mConfig;      // cached contents of the config file
+        QFileSystemWatcher* mWatcher;     // watches for external changes to the file
+        QTimer*             mSaveTimer;   // delays writing changes to the file
+        QDateTime           mLastWrite;   // modification time of the file when last written by save()
+        qint64              mLastWriteSize;  // size of the file when last written by save()
 };
 
 // Private class to handle Edit New Alarm dialog OK button.
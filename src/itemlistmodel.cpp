@@ -21,12 +21,15 @@
 #include "itemlistmodel.h"
 #include "collectionmodel.h"
 
+#include <kalarmcal/collectionattribute.h>
 #include <kalarmcal/kaevent.h>
 
 #include <kselectionproxymodel.h>
 
 using namespace Akonadi;
 
+QAbstractItemModel*  ItemListModel::mItemSource = nullptr;
+QItemSelectionModel* ItemListModel::mCollectionSelection = nullptr;
 
 /*=============================================================================
 = Class: ItemListModel
@@ -38,8 +41,17 @@ ItemListModel::ItemListModel(CalEvent::Types allowed, QObject* parent)
       mAllowedTypes(allowed),
       mHaveEvents(false)
 {
-    KSelectionProxyModel* selectionModel = new KSelectionProxyModel(CollectionControlModel::instance()->selectionModel(), this);
-    selectionModel->setSourceModel(AkonadiModel::instance());
+    KSelectionProxyModel* selectionModel;
+    if (mItemSource)
+    {
+        selectionModel = new KSelectionProxyModel(mCollectionSelection, this);
+        selectionModel->setSourceModel(mItemSource);
+    }
+    else
+    {
+        selectionModel = new KSelectionProxyModel(CollectionControlModel::instance()->selectionModel(), this);
+        selectionModel->setSourceModel(AkonadiModel::instance());
+    }
     selectionModel->setFilterBehavior(KSelectionProxyModel::ChildrenOfExactSelection);
     setSourceModel(selectionModel);
 
@@ -56,8 +68,18 @@ ItemListModel::ItemListModel(CalEvent::Types allowed, QObject* parent)
     setDynamicSortFilter(true);
     connect(this, &ItemListModel::rowsInserted, this, &ItemListModel::slotRowsInserted);
     connect(this, &ItemListModel::rowsRemoved, this, &ItemListModel::slotRowsRemoved);
-    connect(AkonadiModel::instance(), &AkonadiModel::collectionStatusChanged,
-                                      this, &ItemListModel::collectionStatusChanged);
+    if (!mItemSource)
+        connect(AkonadiModel::instance(), &AkonadiModel::collectionStatusChanged,
+                                          this, &ItemListModel::collectionStatusChanged);
+}
+
+/******************************************************************************
+* Set the models to use in place of AkonadiModel and CollectionControlModel.
+*/
+void ItemListModel::setItemSource(QAbstractItemModel* items, QItemSelectionModel* collectionSelection)
+{
+    mItemSource          = items;
+    mCollectionSelection = collectionSelection;
 }
 
 int ItemListModel::columnCount(const QModelIndex& /*parent*/) const
@@ -115,6 +137,9 @@ bool ItemListModel::filterAcceptsRow(int sourceRow, const QModelIndex& sourcePar
     QModelIndex sourceIndex = sourceModel()->index(sourceRow, 0, sourceParent);
     CalEvent::Type type = static_cast<CalEvent::Type>(sourceModel()->data(sourceIndex, AkonadiModel::StatusRole).toInt());
     Collection parent = sourceIndex.data(AkonadiModel::ParentCollectionRole).value<Collection>();
+    if (mItemSource)
+        return parent.hasAttribute<CollectionAttribute>()
+           &&  parent.attribute<CollectionAttribute>()->isEnabled(type);
     return CollectionControlModel::isEnabled(parent, type);
 }
 
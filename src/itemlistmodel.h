@@ -28,6 +28,8 @@
 
 #include <AkonadiCore/entitymimetypefiltermodel.h>
 
+class QItemSelectionModel;
+
 using namespace KAlarmCal;
 
 /*=============================================================================
@@ -58,6 +60,15 @@ class ItemListModel : public Akonadi::EntityMimeTypeFilterModel
 
         static int   iconWidth()  { return AkonadiModel::iconSize().width(); }
 
+        /** Set the models to use in place of AkonadiModel and the collection
+         *  selection of CollectionControlModel, so that item list models can be
+         *  used without an Akonadi server. The items must supply the same data
+         *  roles as AkonadiModel. Alarm types are then enabled according to the
+         *  CollectionAttribute of each collection.
+         *  This must be called before any item list model is created.
+         */
+        static void  setItemSource(QAbstractItemModel* items, QItemSelectionModel* collectionSelection);
+
     Q_SIGNALS:
         /** Signal emitted when either the first item is added to the model,
          *  or when the last item is deleted from the model.
@@ -73,6 +84,9 @@ class ItemListModel : public Akonadi::EntityMimeTypeFilterModel
         void         collectionStatusChanged(const Akonadi::Collection& collection, AkonadiModel::Change change, const QVariant&, bool inserted);
 
     private:
+        static QAbstractItemModel*  mItemSource;           // item model to use instead of AkonadiModel, or null
+        static QItemSelectionModel* mCollectionSelection;  // selected collections in mItemSource
+
         CalEvent::Types mAllowedTypes; // types of events allowed in this model
         bool            mHaveEvents;   // there are events in this model
 };
@@ -24,6 +24,7 @@
 #include "alarmcalendar.h"
 #include "alarmlistview.h"
 #include "alarmtime.h"
+#include "birthdaysync.h"
 #include "commandoptions.h"
 #include "dbushandler.h"
 #include "editdlgtypes.h"
@@ -34,8 +35,11 @@
 #include "messagebox.h"
 #include "messagewin.h"
 #include "kalarmmigrateapplication.h"
+#include "metrics.h"
 #include "preferences.h"
 #include "prefdlg.h"
+#include "scheduler.h"
+#include "trace.h"
 #include "shellprocess.h"
 #include "startdaytimer.h"
 #include "traywindow.h"
@@ -58,6 +62,7 @@
 #include <ksystemtimezone.h>
 
 #include <QObject>
+#include <QElapsedTimer>
 #include <QTimer>
 #include <QFile>
 #include <QTextStream>
@@ -73,17 +78,57 @@
 #include <climits>
 
 static const int AKONADI_TIMEOUT = 30;   // timeout (seconds) for Akonadi collections to be populated
+static const int SUSPEND_MIN_GAP = 10;   // minimum clock discrepancy (seconds) to indicate a system suspension
+static const int LATENESS_ALERT_MIN_COUNT = 20;   // minimum number of triggers before alerting on lateness
 
 /******************************************************************************
 * Find the maximum number of seconds late which a late-cancel alarm is allowed
 * to be. This is calculated as the late cancel interval, plus a few seconds
 * leeway to cater for any timing irregularities.
 */
-static inline int maxLateness(int lateCancel)
-{
-    static const int LATENESS_LEEWAY = 5;
-    int lc = (lateCancel >= 1) ? (lateCancel - 1)*60 : 0;
-    return LATENESS_LEEWAY + lc;
+namespace
+{
+/*=============================================================================
+= Class ResourcesEventStore
+= Gives the scheduler access to the alarms in the calendar resources.
+= Changes are saved, and the alarm lists updated, by the KAlarm functions.
+=============================================================================*/
+class ResourcesEventStore : public EventStore
+{
+    public:
+        KAEvent* event(const EventId& id, bool checkDuplicates) override
+                                            { return AlarmCalendar::resources()->event(id, checkDuplicates); }
+        KAEvent* earliestAlarm() override   { return AlarmCalendar::resources()->earliestAlarm(); }
+        void     updateEvent(KAEvent& event) override   { KAlarm::updateEvent(event); }
+        void     deleteEvent(KAEvent& event, bool archive) override  { KAlarm::deleteEvent(event, archive); }
+        void     archiveEvent(KAEvent& event) override  { KAlarm::addArchivedEvent(event); }
+};
+
+/******************************************************************************
+* Declare the scheduler health metrics which are recorded by KAlarmApp and by
+* the calendar classes.
+*/
+void describeMetrics()
+{
+    Metrics::describe("kalarm_action_queue_depth", Metrics::GAUGE,
+                      "Number of queued alarm actions awaiting processing");
+    Metrics::describe("kalarm_process_queue_seconds", Metrics::HISTOGRAM,
+                      "Time taken by each run of the action queue",
+                      QVector<double>() << 0.001 << 0.005 << 0.01 << 0.05 << 0.1 << 0.5 << 1 << 5);
+    Metrics::describe("kalarm_command_processes", Metrics::GAUGE,
+                      "Number of command alarm processes currently running");
+    Metrics::describe("kalarm_email_queue_length", Metrics::GAUGE,
+                      "Number of email alarms queued or being sent");
+    Metrics::describe("kalarm_calendar_save_seconds", Metrics::HISTOGRAM,
+                      "Time taken to write alarm changes to a calendar",
+                      QVector<double>() << 0.01 << 0.05 << 0.1 << 0.5 << 1 << 5 << 30);
+    Metrics::describe("kalarm_events", Metrics::GAUGE,
+                      "Number of alarms, by collection and category");
+    Metrics::describe("kalarm_archive_purged_total", Metrics::COUNTER,
+                      "Number of expired archived alarms purged");
+    Metrics::describe("kalarm_archive_purge_pending", Metrics::GAUGE,
+                      "1 while a purge of expired archived alarms is in progress, else 0");
+}
 }
 
 
@@ -106,14 +151,25 @@ KAlarmApp::KAlarmApp(int& argc, char** argv)
       mDBusHandler(new DBusHandler()),
       mTrayWindow(nullptr),
       mAlarmTimer(nullptr),
+      mMetricsTimer(nullptr),
+      mEventStore(new ResourcesEventStore),
+      mScheduler(nullptr),
+      mStartTime(KDateTime::currentUtcDateTime()),
+      mQueueWait(-1),
+      mLatenessAlerted(false),
       mArchivedPurgeDays(-1),      // default to not purging
       mPurgeDaysQueued(-1),
+      mAutoRtcWakeTime(0),
       mPendingQuit(false),
       mCancelRtcWake(false),
       mProcessingQueue(false),
       mAlarmsEnabled(true)
 {
     qCDebug(KALARM_LOG);
+    describeMetrics();
+    mScheduler = new Scheduler(mEventStore, this);
+    checkForSuspend();
+    connect(this, &KAlarmApp::latenessThresholdExceeded, mDBusHandler, &DBusHandler::latenessThresholdExceeded);
     KAlarmMigrateApplication migrate;
     migrate.migrate();
 
@@ -152,12 +208,22 @@ KAlarmApp::KAlarmApp(int& argc, char** argv)
                                           this, &KAlarmApp::checkWritableCalendar);
         connect(AkonadiModel::instance(), &AkonadiModel::migrationCompleted,
                                           this, &KAlarmApp::checkWritableCalendar);
+        connect(AkonadiModel::instance(), &Akonadi::EntityTreeModel::collectionPopulated,
+                                          this, &KAlarmApp::slotCollectionPopulated);
 
         KConfigGroup config(KSharedConfig::openConfig(), "General");
         mNoSystemTray        = config.readEntry("NoSystemTray", false);
         mOldShowInSystemTray = wantShowInSystemTray();
         DateTime::setStartOfDay(Preferences::startOfDay());
         mPrefsArchivedColour = Preferences::archivedColour();
+
+        if (!Preferences::metricsFile().isEmpty())
+        {
+            // Periodically write scheduler metrics for collection by a node exporter
+            mMetricsTimer = new QTimer(this);
+            connect(mMetricsTimer, &QTimer::timeout, this, &KAlarmApp::writeMetricsFile);
+            mMetricsTimer->start(Preferences::metricsFileInterval() * 1000);
+        }
     }
 
     // Check if KOrganizer is installed
@@ -179,6 +245,8 @@ KAlarmApp::~KAlarmApp()
         mCommandProcesses.pop_front();
         delete pd;
     }
+    delete mScheduler;
+    delete mEventStore;
     AlarmCalendar::terminateCalendars();
 }
 
@@ -715,7 +783,7 @@ bool KAlarmApp::quitIf(int exitCode, bool force)
     MessageWin::stopAudio(true);
     if (mCancelRtcWake)
     {
-        KAlarm::setRtcWakeTime(0, nullptr);
+        KAlarm::setRtcWakeTime(0, MainWindow::mainMainWindow());
         KAlarm::deleteRtcWakeConfig();
     }
     delete mAlarmTimer;     // prevent checking for alarms after deleting calendars
@@ -824,17 +892,33 @@ void KAlarmApp::quitFatal()
 */
 void KAlarmApp::checkNextDueAlarm()
 {
+    KALARM_TRACE_SCOPE("scheduler", "checkNextDueAlarm");
+    checkForSuspend();
     if (!mAlarmsEnabled)
+    {
+        updateAutoRtcWake(KDateTime());
         return;
+    }
     // Find the first alarm due
     KAEvent* nextEvent = AlarmCalendar::resources()->earliestAlarm();
-    if (!nextEvent)
+    KDateTime nextDt = nextEvent ? nextEvent->nextTrigger(KAEvent::ALL_TRIGGER).effectiveKDateTime() : KDateTime();
+    // Until the calendars have been loaded, an alarm which was pending when
+    // KAlarm last exited may be due before any which have been loaded so far.
+    // If so, wake when it's due, so that it can be fetched and triggered.
+    const KDateTime snapshotDt = AlarmCalendar::resources()->checkSnapshot();
+    const bool fromSnapshot = snapshotDt.isValid()  &&  (!nextEvent || snapshotDt < nextDt);
+    if (fromSnapshot)
+        nextDt = snapshotDt;
+    else if (!nextEvent)
+    {
+        updateAutoRtcWake(KDateTime());
         return;   // there are no alarms pending
-    KDateTime nextDt = nextEvent->nextTrigger(KAEvent::ALL_TRIGGER).effectiveKDateTime();
+    }
+    updateAutoRtcWake(nextDt);
     KDateTime now = KDateTime::currentDateTime(Preferences::timeZone());
     qint64 interval = now.secsTo(nextDt);
     qCDebug(KALARM_LOG) << "now:" << qPrintable(now.toString(QStringLiteral("%Y-%m-%d %H:%M %:Z"))) << ", next:" << qPrintable(nextDt.toString(QStringLiteral("%Y-%m-%d %H:%M %:Z"))) << ", due:" << interval;
-    if (interval <= 0)
+    if (interval <= 0  &&  !fromSnapshot)
     {
         // Queue the alarm
         queueAlarmId(*nextEvent);
@@ -857,14 +941,47 @@ void KAlarmApp::checkNextDueAlarm()
         if (interval > 60)    // 1 minute
             interval = 60;
 #endif
+        if (interval < 1)
+            interval = 1;
         interval *= 1000;
         if (interval > INT_MAX)
             interval = INT_MAX;
-        qCDebug(KALARM_LOG) << nextEvent->id() << "wait" << interval/1000 << "seconds";
+        qCDebug(KALARM_LOG) << (fromSnapshot ? QStringLiteral("Snapshot alarm") : nextEvent->id()) << "wait" << interval/1000 << "seconds";
         mAlarmTimer->start(static_cast<int>(interval));
     }
 }
 
+/******************************************************************************
+* If automatic wake from suspend is enabled, set the system to wake up before
+* the earliest alarm is due. 'nextDt' is invalid if there is no alarm pending.
+* The system wakeup time is only changed when it differs from the last time
+* set, so that authorization is not requested every time the alarm timer fires.
+* A wakeup which the user has set for a specific alarm (held in the RtcWake
+* config entry) takes precedence: the system has only one wakeup time, so the
+* automatic wakeup is not set until the user's wakeup is cancelled or expires.
+*/
+void KAlarmApp::updateAutoRtcWake(const KDateTime& nextDt)
+{
+    if (!KAlarm::checkRtcWakeConfig().isEmpty())
+    {
+        mAutoRtcWakeTime = 0;   // set the automatic wakeup again once the user's has gone
+        return;
+    }
+    unsigned wakeTime = 0;
+    if (Preferences::autoWakeFromSuspend()  &&  nextDt.isValid())
+    {
+        const KDateTime wakeDt = nextDt.addSecs(-60 * Preferences::wakeFromSuspendAdvance());
+        if (wakeDt <= KDateTime::currentUtcDateTime())
+            return;   // too late to change the wakeup time: leave it as it is
+        wakeTime = wakeDt.toTime_t();
+    }
+    if (wakeTime == mAutoRtcWakeTime)
+        return;
+    qCDebug(KALARM_LOG) << "Wake from suspend at" << wakeTime;
+    mAutoRtcWakeTime = wakeTime;
+    KAlarm::setRtcWakeTimeAsync(wakeTime);
+}
+
 /******************************************************************************
 * Called by the alarm timer when the next alarm is due.
 * Also called when the execution queue has finished processing to check for the
@@ -909,8 +1026,11 @@ void KAlarmApp::processQueue()
 {
     if (mInitialised  &&  !mProcessingQueue)
     {
+        KALARM_TRACE_SCOPE("scheduler", "processQueue");
         qCDebug(KALARM_LOG);
         mProcessingQueue = true;
+        QElapsedTimer runTimer;
+        runTimer.start();
 
         // Refresh alarms if that's been queued
         KAlarm::refreshAlarmsIfQueued();
@@ -953,15 +1073,22 @@ void KAlarmApp::processQueue()
                 }
             }
             else
+            {
+                mQueueWait = entry.queued.elapsed();
                 handleEvent(entry.eventId, entry.function);
+                mQueueWait = -1;
+            }
             mActionQueue.dequeue();
         }
 
-        // Purge the default archived alarms resource if it's time to do so
+        // Purge the default archived alarms resource if it's time to do so.
+        // This is done in batches, with the queue being processed in between.
         if (mPurgeDaysQueued >= 0)
         {
-            KAlarm::purgeArchive(mPurgeDaysQueued);
-            mPurgeDaysQueued = -1;
+            if (KAlarm::purgeArchive(mPurgeDaysQueued))
+                QTimer::singleShot(0, this, &KAlarmApp::processQueue);
+            else
+                mPurgeDaysQueued = -1;
         }
 
         // Now that the queue has been processed, quit if a quit was queued
@@ -972,6 +1099,7 @@ void KAlarmApp::processQueue()
         }
 
         mProcessingQueue = false;
+        Metrics::observe("kalarm_process_queue_seconds", runTimer.nsecsElapsed() / 1e9);
 
         // Schedule the application to be woken when the next alarm is due
         checkNextDueAlarm();
@@ -1379,7 +1507,7 @@ bool KAlarmApp::scheduleEvent(KAEvent::SubAction action, const QString& text, co
     if (!dateTime.isValid())
         return false;
     KDateTime now = KDateTime::currentUtcDateTime();
-    if (lateCancel  &&  dateTime < now.addSecs(-maxLateness(lateCancel)))
+    if (lateCancel  &&  dateTime < now.addSecs(-Scheduler::maxLateness(lateCancel)))
         return true;               // alarm time was already archived too long ago
     KDateTime alarmTime = dateTime;
     // Round down to the nearest minute to avoid scheduling being messed up
@@ -1445,6 +1573,63 @@ QString KAlarmApp::dbusList()
     return scheduledAlarmList().join(QStringLiteral("\n")) + QLatin1Char('\n');
 }
 
+/******************************************************************************
+* Return the current scheduler health metrics, in Prometheus text format.
+*/
+QString KAlarmApp::metrics()
+{
+    updateMetrics();
+    return Metrics::text();
+}
+
+/******************************************************************************
+* Called periodically to write the scheduler health metrics to the file set in
+* the configuration.
+*/
+void KAlarmApp::writeMetricsFile()
+{
+    const QString file = Preferences::metricsFile();
+    if (file.isEmpty())
+        return;
+    updateMetrics();
+    Metrics::writeFile(file);
+}
+
+/******************************************************************************
+* Update the metrics which record the current state, rather than being
+* recorded as events occur.
+*/
+void KAlarmApp::updateMetrics()
+{
+    Metrics::set("kalarm_action_queue_depth", mActionQueue.count());
+    Metrics::set("kalarm_command_processes", mCommandProcesses.count());
+    Metrics::set("kalarm_email_queue_length", KAMail::queueLength());
+
+    Metrics::clear("kalarm_events");
+    AlarmCalendar* resources = AlarmCalendar::resources();
+    if (!resources)
+        return;
+    typedef QMap<CalEvent::Type, int> CategoryCounts;
+    const QMap<Akonadi::Collection::Id, CategoryCounts> counts = resources->eventCounts();
+    for (QMap<Akonadi::Collection::Id, CategoryCounts>::ConstIterator it = counts.constBegin();  it != counts.constEnd();  ++it)
+    {
+        const QString collection = Metrics::label("collection", QString::number(it.key()));
+        for (CategoryCounts::ConstIterator cit = it.value().constBegin();  cit != it.value().constEnd();  ++cit)
+        {
+            QString category;
+            switch (cit.key())
+            {
+                case CalEvent::ACTIVE:      category = QStringLiteral("active");  break;
+                case CalEvent::ARCHIVED:    category = QStringLiteral("archived");  break;
+                case CalEvent::TEMPLATE:    category = QStringLiteral("template");  break;
+                case CalEvent::DISPLAYING:  category = QStringLiteral("displaying");  break;
+                default:  continue;
+            }
+            Metrics::set("kalarm_events", cit.value(), collection + QLatin1Char(',') + Metrics::label("category", category));
+        }
+    }
+}
+
 /******************************************************************************
 * Either:
 * a) Display the event and then delete it if it has no outstanding repetitions.
@@ -1457,223 +1642,15 @@ QString KAlarmApp::dbusList()
 */
 bool KAlarmApp::handleEvent(const EventId& id, EventFunc function, bool checkDuplicates)
 {
-    // Delete any expired wake-on-suspend config data
-    KAlarm::checkRtcWakeConfig();
-
-    const QString eventID(id.eventId());
-    KAEvent* event = AlarmCalendar::resources()->event(id, checkDuplicates);
-    if (!event)
-    {
-        if (id.collectionId() != -1)
-            qCWarning(KALARM_LOG) << "Event ID not found, or duplicated:" << eventID;
-        else
-            qCWarning(KALARM_LOG) << "Event ID not found:" << eventID;
-        return false;
-    }
+    Scheduler::Function func;
     switch (function)
     {
-        case EVENT_CANCEL:
-            qCDebug(KALARM_LOG) << eventID << ", CANCEL";
-            KAlarm::deleteEvent(*event, true);
-            break;
-
-        case EVENT_TRIGGER:    // handle it if it's due, else execute it regardless
-        case EVENT_HANDLE:     // handle it if it's due
-        {
-            KDateTime now = KDateTime::currentUtcDateTime();
-            qCDebug(KALARM_LOG) << eventID << "," << (function==EVENT_TRIGGER?"TRIGGER:":"HANDLE:") << qPrintable(now.dateTime().toString(QStringLiteral("yyyy-MM-dd hh:mm"))) << "UTC";
-            bool updateCalAndDisplay = false;
-            bool alarmToExecuteValid = false;
-            KAAlarm alarmToExecute;
-            bool restart = false;
-            // Check all the alarms in turn.
-            // Note that the main alarm is fetched before any other alarms.
-            for (KAAlarm alarm = event->firstAlarm();
-                 alarm.isValid();
-                 alarm = (restart ? event->firstAlarm() : event->nextAlarm(alarm)), restart = false)
-            {
-                // Check if the alarm is due yet.
-                KDateTime nextDT = alarm.dateTime(true).effectiveKDateTime();
-                int secs = nextDT.secsTo(now);
-                if (secs < 0)
-                {
-                    // The alarm appears to be in the future.
-                    // Check if it's an invalid local clock time during a daylight
-                    // saving time shift, which has actually passed.
-                    if (alarm.dateTime().timeSpec() != KDateTime::ClockTime
-                    ||  nextDT > now.toTimeSpec(KDateTime::ClockTime))
-                    {
-                        // This alarm is definitely not due yet
-                        qCDebug(KALARM_LOG) << "Alarm" << alarm.type() << "at" << nextDT.dateTime() << ": not due";
-                        continue;
-                    }
-                }
-                bool reschedule = false;
-                bool rescheduleWork = false;
-                if ((event->workTimeOnly() || event->holidaysExcluded())  &&  !alarm.deferred())
-                {
-                    // The alarm is restricted to working hours and/or non-holidays
-                    // (apart from deferrals). This needs to be re-evaluated every
-                    // time it triggers, since working hours could change.
-                    if (alarm.dateTime().isDateOnly())
-                    {
-                        KDateTime dt(nextDT);
-                        dt.setDateOnly(true);
-                        reschedule = !event->isWorkingTime(dt);
-                    }
-                    else
-                        reschedule = !event->isWorkingTime(nextDT);
-                    rescheduleWork = reschedule;
-                    if (reschedule)
-                        qCDebug(KALARM_LOG) << "Alarm" << alarm.type() << "at" << nextDT.dateTime() << ": not during working hours";
-                }
-                if (!reschedule  &&  alarm.repeatAtLogin())
-                {
-                    // Alarm is to be displayed at every login.
-                    qCDebug(KALARM_LOG) << "REPEAT_AT_LOGIN";
-                    // Check if the main alarm is already being displayed.
-                    // (We don't want to display both at the same time.)
-                    if (alarmToExecute.isValid())
-                        continue;
-
-                    // Set the time to display if it's a display alarm
-                    alarm.setTime(now);
-                }
-                if (!reschedule  &&  event->lateCancel())
-                {
-                    // Alarm is due, and it is to be cancelled if too late.
-                    qCDebug(KALARM_LOG) << "LATE_CANCEL";
-                    bool cancel = false;
-                    if (alarm.dateTime().isDateOnly())
-                    {
-                        // The alarm has no time, so cancel it if its date is too far past
-                        int maxlate = event->lateCancel() / 1440;    // maximum lateness in days
-                        KDateTime limit(DateTime(nextDT.addDays(maxlate + 1)).effectiveKDateTime());
-                        if (now >= limit)
-                        {
-                            // It's too late to display the scheduled occurrence.
-                            // Find the last previous occurrence of the alarm.
-                            DateTime next;
-                            KAEvent::OccurType type = event->previousOccurrence(now, next, true);
-                            switch (type & ~KAEvent::OCCURRENCE_REPEAT)
-                            {
-                                case KAEvent::FIRST_OR_ONLY_OCCURRENCE:
-                                case KAEvent::RECURRENCE_DATE:
-                                case KAEvent::RECURRENCE_DATE_TIME:
-                                case KAEvent::LAST_RECURRENCE:
-                                    limit.setDate(next.date().addDays(maxlate + 1));
-                                    if (now >= limit)
-                                    {
-                                        if (type == KAEvent::LAST_RECURRENCE
-                                        ||  (type == KAEvent::FIRST_OR_ONLY_OCCURRENCE && !event->recurs()))
-                                            cancel = true;   // last occurrence (and there are no repetitions)
-                                        else
-                                            reschedule = true;
-                                    }
-                                    break;
-                                case KAEvent::NO_OCCURRENCE:
-                                default:
-                                    reschedule = true;
-                                    break;
-                            }
-                        }
-                    }
-                    else
-                    {
-                        // The alarm is timed. Allow it to be the permitted amount late before cancelling it.
-                        int maxlate = maxLateness(event->lateCancel());
-                        if (secs > maxlate)
-                        {
-                            // It's over the maximum interval late.
-                            // Find the most recent occurrence of the alarm.
-                            DateTime next;
-                            KAEvent::OccurType type = event->previousOccurrence(now, next, true);
-                            switch (type & ~KAEvent::OCCURRENCE_REPEAT)
-                            {
-                                case KAEvent::FIRST_OR_ONLY_OCCURRENCE:
-                                case KAEvent::RECURRENCE_DATE:
-                                case KAEvent::RECURRENCE_DATE_TIME:
-                                case KAEvent::LAST_RECURRENCE:
-                                    if (next.effectiveKDateTime().secsTo(now) > maxlate)
-                                    {
-                                        if (type == KAEvent::LAST_RECURRENCE
-                                        ||  (type == KAEvent::FIRST_OR_ONLY_OCCURRENCE && !event->recurs()))
-                                            cancel = true;   // last occurrence (and there are no repetitions)
-                                        else
-                                            reschedule = true;
-                                    }
-                                    break;
-                                case KAEvent::NO_OCCURRENCE:
-                                default:
-                                    reschedule = true;
-                                    break;
-                            }
-                        }
-                    }
-
-                    if (cancel)
-                    {
-                        // All recurrences are finished, so cancel the event
-                        event->setArchive();
-                        if (cancelAlarm(*event, alarm.type(), false))
-                            return true;   // event has been deleted
-                        updateCalAndDisplay = true;
-                        continue;
-                    }
-                }
-                if (reschedule)
-                {
-                    // The latest repetition was too long ago, so schedule the next one
-                    switch (rescheduleAlarm(*event, alarm, false, (rescheduleWork ? nextDT : KDateTime())))
-                    {
-                        case 1:
-                            // A working-time-only alarm has been rescheduled and the
-                            // rescheduled time is already due. Start processing the
-                            // event again.
-                            alarmToExecuteValid = false;
-                            restart = true;
-                            break;
-                        case -1:
-                            return true;   // event has been deleted
-                        default:
-                            break;
-                    }
-                    updateCalAndDisplay = true;
-                    continue;
-                }
-                if (!alarmToExecuteValid)
-                {
-                    qCDebug(KALARM_LOG) << "Alarm" << alarm.type() << ": execute";
-                    alarmToExecute = alarm;             // note the alarm to be displayed
-                    alarmToExecuteValid = true;         // only trigger one alarm for the event
-                }
-                else
-                    qCDebug(KALARM_LOG) << "Alarm" << alarm.type() << ": skip";
-            }
-
-            // If there is an alarm to execute, do this last after rescheduling/cancelling
-            // any others. This ensures that the updated event is only saved once to the calendar.
-            if (alarmToExecute.isValid())
-                execAlarm(*event, alarmToExecute, true, !alarmToExecute.repeatAtLogin());
-            else
-            {
-                if (function == EVENT_TRIGGER)
-                {
-                    // The alarm is to be executed regardless of whether it's due.
-                    // Only trigger one alarm from the event - we don't want multiple
-                    // identical messages, for example.
-                    KAAlarm alarm = event->firstAlarm();
-                    if (alarm.isValid())
-                        execAlarm(*event, alarm, false);
-                }
-                if (updateCalAndDisplay)
-                    KAlarm::updateEvent(*event);     // update the window lists and calendar file
-                else if (function != EVENT_TRIGGER) { qCDebug(KALARM_LOG) << "No action"; }
-            }
-            break;
-        }
+        case EVENT_CANCEL:   func = Scheduler::CANCEL;  break;
+        case EVENT_TRIGGER:  func = Scheduler::TRIGGER;  break;
+        case EVENT_HANDLE:
+        default:             func = Scheduler::HANDLE;  break;
     }
-    return true;
+    return mScheduler->handleEvent(id, func, checkDuplicates);
 }
 
 /******************************************************************************
@@ -1704,139 +1681,137 @@ void KAlarmApp::alarmCompleted(const KAEvent& event)
 */
 int KAlarmApp::rescheduleAlarm(KAEvent& event, const KAAlarm& alarm, bool updateCalAndDisplay, const KDateTime& nextDt)
 {
-    qCDebug(KALARM_LOG) << "Alarm type:" << alarm.type();
-    int reply = 0;
-    bool update = false;
-    event.startChanges();
-    if (alarm.repeatAtLogin())
+    return mScheduler->rescheduleAlarm(event, alarm, updateCalAndDisplay, nextDt);
+}
+
+/******************************************************************************
+* Delete the alarm. If it is the last alarm for its event, the event is removed
+* from the calendar file and from every main window instance.
+* Reply = true if event has been deleted.
+*/
+bool KAlarmApp::cancelAlarm(KAEvent& event, KAAlarm::Type alarmType, bool updateCalAndDisplay)
+{
+    return mScheduler->cancelAlarm(event, alarmType, updateCalAndDisplay);
+}
+
+/******************************************************************************
+* Called by the scheduler to execute an alarm.
+*/
+void KAlarmApp::dispatchAlarm(KAEvent& event, const KAAlarm& alarm, bool reschedule, bool allowDefer)
+{
+    execAlarm(event, alarm, reschedule, allowDefer);
+    if (mDueAlarm.due.isValid())
     {
-        // Leave an alarm which repeats at every login until its main alarm triggers
-        if (!event.reminderActive()  &&  event.reminderMinutes() < 0)
-        {
-            // Executing an at-login alarm: first schedule the reminder
-            // which occurs AFTER the main alarm.
-            event.activateReminderAfter(KDateTime::currentUtcDateTime());
-            update = true;
-        }
+        // The alarm has been executed without waiting for a pre-alarm action
+        recordLateness(mDueAlarm.lateness, mDueAlarm.cause);
+        mDueAlarm = DueAlarm();
     }
-    else if (alarm.isReminder()  ||  alarm.deferred())
+}
+
+/******************************************************************************
+* Called by the scheduler just before a due alarm is dispatched.
+* Note how late it is, and why, so that it can be recorded once the alarm has
+* been executed.
+*/
+void KAlarmApp::alarmDue(const KAEvent&, const KAAlarm&, const KDateTime& due, int lateness)
+{
+    checkForSuspend();
+    mDueAlarm.due      = due;
+    mDueAlarm.lateness = lateness;
+    mDueAlarm.cause    = latenessCause(due, lateness);
+}
+
+/******************************************************************************
+* Determine the most likely cause of an alarm being executed late.
+*/
+LatenessTracker::Cause KAlarmApp::latenessCause(const KDateTime& due, int lateness) const
+{
+    if (lateness <= Scheduler::maxLateness(0))
+        return LatenessTracker::ON_TIME;
+    if (due < mStartTime)
+        return LatenessTracker::NOT_RUNNING;
+    if (mSuspendEnd.isValid()  &&  due >= mSuspendStart  &&  due <= mSuspendEnd)
+        return LatenessTracker::SUSPEND;
+    if (!mPopulatedTime.isValid()  ||  due < mPopulatedTime)
+        return LatenessTracker::AKONADI_NOT_READY;
+    if (mQueueWait >= 0  &&  mQueueWait * 2 >= static_cast<qint64>(lateness) * 1000)
+        return LatenessTracker::QUEUE_BACKLOG;
+    return LatenessTracker::OTHER;
+}
+
+/******************************************************************************
+* Record the lateness of an executed alarm. If the 99th percentile lateness of
+* recent alarms has exceeded the configured threshold, notify it over D-Bus.
+* Only one notification is given until lateness falls below the threshold
+* again.
+*/
+void KAlarmApp::recordLateness(int lateness, LatenessTracker::Cause cause)
+{
+    mLateness.record(lateness, cause);
+    if (cause != LatenessTracker::ON_TIME)
+        qCDebug(KALARM_LOG) << "Alarm executed" << lateness << "seconds late, cause:" << LatenessTracker::causeName(cause);
+    const int threshold = Preferences::latenessAlertThreshold();
+    if (threshold <= 0  ||  mLateness.count() < LATENESS_ALERT_MIN_COUNT)
+        return;
+    const int p99 = mLateness.percentile(99);
+    if (p99 <= threshold)
+        mLatenessAlerted = false;
+    else if (!mLatenessAlerted)
     {
-        // It's a reminder alarm or an extra deferred alarm, so delete it
-        event.removeExpiredAlarm(alarm.type());
-        update = true;
+        qCWarning(KALARM_LOG) << "99th percentile alarm lateness" << p99 << "seconds exceeds threshold" << threshold;
+        mLatenessAlerted = true;
+        Q_EMIT latenessThresholdExceeded(p99);
     }
-    else
-    {
-        // Reschedule the alarm for its next occurrence.
-        bool cancelled = false;
-        DateTime last = event.mainDateTime(false);   // note this trigger time
-        if (last != event.mainDateTime(true))
-            last = DateTime();                       // but ignore sub-repetition triggers
-        bool next = nextDt.isValid();
-        KDateTime next_dt = nextDt;
-        KDateTime now = KDateTime::currentUtcDateTime();
-        do
-        {
-            KAEvent::OccurType type = event.setNextOccurrence(next ? next_dt : now);
-            switch (type)
-            {
-                case KAEvent::NO_OCCURRENCE:
-                    // All repetitions are finished, so cancel the event
-                    qCDebug(KALARM_LOG) << "No occurrence";
-                    if (event.reminderMinutes() < 0  &&  last.isValid()
-                    &&  alarm.type() != KAAlarm::AT_LOGIN_ALARM  &&  !event.mainExpired())
-                    {
-                        // Set the reminder which is now due after the last main alarm trigger.
-                        // Note that at-login reminders are scheduled in execAlarm().
-                        event.activateReminderAfter(last);
-                        updateCalAndDisplay = true;
-                    }
-                    if (cancelAlarm(event, alarm.type(), updateCalAndDisplay))
-                        return -1;
-                    break;
-                default:
-                    if (!(type & KAEvent::OCCURRENCE_REPEAT))
-                        break;
-                    // Next occurrence is a repeat, so fall through to recurrence handling
-                case KAEvent::RECURRENCE_DATE:
-                case KAEvent::RECURRENCE_DATE_TIME:
-                case KAEvent::LAST_RECURRENCE:
-                    // The event is due by now and repetitions still remain, so rewrite the event
-                    if (updateCalAndDisplay)
-                        update = true;
-                    break;
-                case KAEvent::FIRST_OR_ONLY_OCCURRENCE:
-                    // The first occurrence is still due?!?, so don't do anything
-                    break;
-            }
-            if (cancelled)
-                break;
-            if (event.deferred())
-            {
-                // Just in case there's also a deferred alarm, ensure it's removed
-                event.removeExpiredAlarm(KAAlarm::DEFERRED_ALARM);
-                update = true;
-            }
-            if (next)
-            {
-                // The alarm is restricted to working hours and/or non-holidays.
-                // Check if the calculated next time is valid.
-                next_dt = event.mainDateTime(true).effectiveKDateTime();
-                if (event.mainDateTime(false).isDateOnly())
-                {
-                    KDateTime dt(next_dt);
-                    dt.setDateOnly(true);
-                    next = !event.isWorkingTime(dt);
-                }
-                else
-                    next = !event.isWorkingTime(next_dt);
-            }
-        } while (next && next_dt <= now);
-        reply = (!cancelled && next_dt.isValid() && (next_dt <= now)) ? 1 : 0;
+}
 
-        if (event.reminderMinutes() < 0  &&  last.isValid()
-        &&  alarm.type() != KAAlarm::AT_LOGIN_ALARM)
+/******************************************************************************
+* Check whether the system has been suspended since the last check. The
+* monotonic clock doesn't advance while the system is suspended, so a suspension
+* shows up as a discrepancy between it and the system clock. (A change to the
+* system clock looks the same, and is treated as a suspension.)
+*/
+void KAlarmApp::checkForSuspend()
+{
+    const KDateTime now = KDateTime::currentUtcDateTime();
+    if (mSuspendCheckTimer.isValid())
+    {
+        const qint64 gap = mSuspendCheckTime.secsTo(now) - mSuspendCheckTimer.elapsed() / 1000;
+        if (gap >= SUSPEND_MIN_GAP)
         {
-            // Set the reminder which is now due after the last main alarm trigger.
-            // Note that at-login reminders are scheduled in execAlarm().
-            event.activateReminderAfter(last);
+            qCDebug(KALARM_LOG) << "System suspended for about" << gap << "seconds";
+            mSuspendStart = mSuspendCheckTime;
+            mSuspendEnd   = now;
         }
     }
-    event.endChanges();
-    if (update)
-        KAlarm::updateEvent(event);     // update the window lists and calendar file
-    return reply;
+    mSuspendCheckTime = now;
+    mSuspendCheckTimer.start();
 }
 
 /******************************************************************************
-* Delete the alarm. If it is the last alarm for its event, the event is removed
-* from the calendar file and from every main window instance.
-* Reply = true if event has been deleted.
+* Called when an Akonadi collection has been populated.
+* Note when all collections have first been populated, to identify alarms
+* which are late because their calendars had not yet been loaded, and start
+* birthday alarm synchronisation if enabled.
 */
-bool KAlarmApp::cancelAlarm(KAEvent& event, KAAlarm::Type alarmType, bool updateCalAndDisplay)
+void KAlarmApp::slotCollectionPopulated()
 {
-    qCDebug(KALARM_LOG);
-    if (alarmType == KAAlarm::MAIN_ALARM  &&  !event.displaying()  &&  event.toBeArchived())
+    if (!mPopulatedTime.isValid()  &&  CollectionControlModel::isPopulated(-1))
     {
-        // The event is being deleted. Save it in the archived resources first.
-        KAEvent ev(event);
-        KAlarm::addArchivedEvent(ev);
+        mPopulatedTime = KDateTime::currentUtcDateTime();
+        if (Preferences::birthdaySync())
+            BirthdaySync::start();    // keep birthday alarms in step with the address book
     }
-    event.removeExpiredAlarm(alarmType);
-    if (!event.alarmCount())
-    {
-        // If it's a command alarm being executed, mark it as deleted
-        ProcData* pd = findCommandProcess(event.id());
-        if (pd)
-            pd->eventDeleted = true;
+}
 
-        // Delete it
-        KAlarm::deleteEvent(event, false);
-        return true;
-    }
-    if (updateCalAndDisplay)
-        KAlarm::updateEvent(event);    // update the window lists and calendar file
-    return false;
+/******************************************************************************
+* Called by the scheduler when an event has been deleted.
+* If it's a command alarm being executed, mark it as deleted.
+*/
+void KAlarmApp::eventDeleted(const QString& eventId)
+{
+    ProcData* pd = findCommandProcess(eventId);
+    if (pd)
+        pd->eventDeleted = true;
 }
 
 /******************************************************************************
@@ -1863,6 +1838,7 @@ bool KAlarmApp::cancelReminderAndDeferral(KAEvent& event)
 */
 void* KAlarmApp::execAlarm(KAEvent& event, const KAAlarm& alarm, bool reschedule, bool allowDefer, bool noPreAction)
 {
+    KALARM_TRACE_SCOPE("action", "execAlarm");
     if (!mAlarmsEnabled  ||  !event.enabled())
     {
         // The event (or all events) is disabled
@@ -1928,6 +1904,7 @@ void* KAlarmApp::execAlarm(KAEvent& event, const KAAlarm& alarm, bool reschedule
                 if (doShellCommand(command, event, &alarm, (flags | ProcData::PRE_ACTION)))
                 {
                     AlarmCalendar::resources()->setAlarmPending(&event);
+                    mDueAlarm = DueAlarm();   // lateness is recorded when the pre-action completes
                     return result;     // display the message after the command completes
                 }
                 // Error executing command
@@ -1978,18 +1955,18 @@ void* KAlarmApp::execAlarm(KAEvent& event, const KAAlarm& alarm, bool reschedule
             QStringList errmsgs;
             KAMail::JobData data(event, alarm, reschedule, (reschedule || allowDefer));
             data.queued = true;
-            int ans = KAMail::send(data, errmsgs);
-            if (ans)
+            if (KAMail::send(data, errmsgs) < 0)
             {
-                // The email has either been sent or failed - not queued
-                if (ans < 0)
-                    result = nullptr;  // failure
+                // The email could not be queued for sending
+                result = nullptr;  // failure
                 data.queued = false;
-                emailSent(data, errmsgs, (ans > 0));
+                emailSent(data, errmsgs);
             }
             else
             {
-                result = (void*)-1;   // email has been queued
+                // The email has been queued. emailSent() is called once it
+                // has been sent or has failed.
+                result = (void*)-1;
             }
             if (reschedule)
                 rescheduleAlarm(event, alarm, true);
@@ -2141,6 +2118,8 @@ ShellProcess* KAlarmApp::doShellCommand(const QString& command, const KAEvent& e
             proc->setStandardOutputFile(event.logFile(), QIODevice::Append);
         }
         pd = new ProcData(proc, new KAEvent(event), (alarm ? new KAAlarm(*alarm) : nullptr), flags);
+        if (flags & ProcData::PRE_ACTION)
+            pd->dueAlarm = mDueAlarm;
         if (flags & ProcData::TEMP_FILE)
             pd->tempFiles += command;
         if (!tmpXtermFile.isEmpty())
@@ -2306,7 +2285,20 @@ void KAlarmApp::slotCommandExited(ShellProcess* proc)
             if (pd->preAction())
                 AlarmCalendar::resources()->setAlarmPending(pd->event, false);
             if (executeAlarm)
+            {
+                if (pd->dueAlarm.due.isValid())
+                {
+                    // Attribute the lateness to the pre-action if waiting for
+                    // it made the alarm more late than it already was.
+                    const DueAlarm& due = pd->dueAlarm;
+                    const int lateness = qMax(due.due.secsTo(KDateTime::currentUtcDateTime()), 0);
+                    LatenessTracker::Cause cause = due.cause;
+                    if (lateness > Scheduler::maxLateness(0)  &&  lateness - due.lateness > due.lateness)
+                        cause = LatenessTracker::PRE_ACTION;
+                    recordLateness(lateness, cause);
+                }
                 execAlarm(*pd->event, *pd->alarm, pd->reschedule(), pd->allowDefer(), true);
+            }
             mCommandProcesses.removeAt(i);
             delete pd;
             break;
@@ -2406,6 +2398,13 @@ bool KAlarmApp::initCheck(bool calendarOnly, bool waitForCollection, Akonadi::Co
         // Warn the user if there are no writable active alarm calendars
         checkWritableCalendar();
 
+        // Delete any expired wake-on-suspend config data, and arrange for
+        // the current one to be deleted when it expires
+        KAlarm::checkRtcWakeConfig();
+
+        // Send any emails which were still queued when KAlarm last exited
+        KAMail::resendOutbox();
+
         firstTime = false;
     }
 
@@ -25,11 +25,14 @@
 
 #include "eventid.h"
 #include "kamail.h"
+#include "latenesstracker.h"
 #include "preferences.h"
+#include "schedulerbackends.h"
 
 #include <kalarmcal/kaevent.h>
 
 #include <QApplication>
+#include <QElapsedTimer>
 #include <QPointer>
 #include <QQueue>
 #include <QList>
@@ -41,11 +44,12 @@ class DBusHandler;
 class MainWindow;
 class TrayWindow;
 class ShellProcess;
+class Scheduler;
 
 using namespace KAlarmCal;
 
 
-class KAlarmApp : public QApplication
+class KAlarmApp : public QApplication, private ActionDispatcher
 {
         Q_OBJECT
     public:
@@ -92,10 +96,12 @@ class KAlarmApp : public QApplication
         bool               dbusTriggerEvent(const EventId& eventID)   { return dbusHandleEvent(eventID, EVENT_TRIGGER); }
         bool               dbusDeleteEvent(const EventId& eventID)    { return dbusHandleEvent(eventID, EVENT_CANCEL); }
         QString            dbusList();
+        QString            metrics();
 
     public Q_SLOTS:
         void               activateByDBus(const QStringList& args, const QString& workingDirectory);
         void               processQueue();
+        void               checkNextDueAlarm();
         void               setAlarmsEnabled(bool);
         void               purgeNewArchivedDefault(const Akonadi::Collection&);
         void               atLoginEventAdded(const KAEvent&);
@@ -110,13 +116,13 @@ class KAlarmApp : public QApplication
         void               audioPlaying(bool);
         void               spreadWindowsToggled(bool);
         void               execAlarmSuccess();
+        void               latenessThresholdExceeded(int p99Seconds);
 
     private:
         typedef Preferences::Feb29Type Feb29Type;   // allow it to be used in SIGNAL mechanism
 
     private Q_SLOTS:
         void               quitFatal();
-        void               checkNextDueAlarm();
         void               checkKtimezoned();
         void               slotShowInSystemTrayChanged();
         void               changeStartOfDay();
@@ -129,6 +135,8 @@ class KAlarmApp : public QApplication
         void               slotPurge()                     { purge(mArchivedPurgeDays); }
         void               purgeAfterDelay();
         void               slotCommandExited(ShellProcess*);
+        void               writeMetricsFile();
+        void               slotCollectionPopulated();
 
     private:
         enum EventFunc
@@ -137,6 +145,13 @@ class KAlarmApp : public QApplication
             EVENT_TRIGGER,   // execute the alarm regardless, and then reschedule it if it already due
             EVENT_CANCEL     // delete the alarm
         };
+        struct DueAlarm   // lateness of a due alarm being executed, until it is recorded
+        {
+            DueAlarm() : lateness(0), cause(LatenessTracker::ON_TIME) {}
+            KDateTime              due;        // time the alarm was scheduled for, or invalid if none
+            int                    lateness;   // seconds late when the alarm was dispatched
+            LatenessTracker::Cause cause;      // cause of the lateness when dispatched
+        };
         struct ProcData
         {
             ProcData(ShellProcess*, KAEvent*, KAAlarm*, int flags = 0);
@@ -155,23 +170,26 @@ class KAlarmApp : public QApplication
             KAAlarm*          alarm;
             QPointer<QWidget> messageBoxParent;
             QStringList       tempFiles;
+            DueAlarm          dueAlarm;     // for a pre-action, the alarm waiting for it to complete
             int               flags;
             bool              eventDeleted;
         };
         struct ActionQEntry
         {
-            ActionQEntry(EventFunc f, const EventId& id) : function(f), eventId(id) { }
-            ActionQEntry(const KAEvent& e, EventFunc f = EVENT_HANDLE) : function(f), event(e) { }
+            ActionQEntry(EventFunc f, const EventId& id) : function(f), eventId(id) { queued.start(); }
+            ActionQEntry(const KAEvent& e, EventFunc f = EVENT_HANDLE) : function(f), event(e) { queued.start(); }
             ActionQEntry() { }
-            EventFunc  function;
-            EventId    eventId;
-            KAEvent    event;
+            EventFunc     function;
+            EventId       eventId;
+            KAEvent       event;
+            QElapsedTimer queued;     // time since the entry was queued
         };
 
         KAlarmApp(int& argc, char** argv);
         bool               initialise();
         int                activateInstance(const QStringList& args, const QString& workingDirectory, QString* outputText);
         bool               initCheck(bool calendarOnly = false, bool waitForCollection = false, Akonadi::Collection::Id = -1);
+        void               updateAutoRtcWake(const KDateTime& nextDt);
         bool               quitIf(int exitCode, bool force = false);
         bool               checkSystemTray();
         void               startProcessQueue();
@@ -193,6 +211,13 @@ class KAlarmApp : public QApplication
         void               setEventCommandError(const KAEvent&, KAEvent::CmdErrType) const;
         void               clearEventCommandError(const KAEvent&, KAEvent::CmdErrType) const;
         ProcData*          findCommandProcess(const QString& eventId) const;
+        void               updateMetrics();
+        void               checkForSuspend();
+        LatenessTracker::Cause latenessCause(const KDateTime& due, int lateness) const;
+        void               recordLateness(int lateness, LatenessTracker::Cause);
+        void               alarmDue(const KAEvent&, const KAAlarm&, const KDateTime& due, int lateness) override;
+        void               dispatchAlarm(KAEvent&, const KAAlarm&, bool reschedule, bool allowDefer) override;
+        void               eventDeleted(const QString& eventId) override;
 
         static KAlarmApp*  mInstance;            // the one and only KAlarmApp instance
         static int         mActiveCount;         // number of active instances without main windows
@@ -207,9 +232,23 @@ class KAlarmApp : public QApplication
         DBusHandler*       mDBusHandler;         // the parent of the main DCOP receiver object
         TrayWindow*        mTrayWindow;          // active system tray icon
         QTimer*            mAlarmTimer;          // activates KAlarm when next alarm is due
+        QTimer*            mMetricsTimer;        // triggers writes of the metrics file, or null
+        EventStore*        mEventStore;          // access to the calendar resources for mScheduler
+        Scheduler*         mScheduler;           // decides which alarms to trigger and reschedules them
+        LatenessTracker    mLateness;            // how late recent alarms have been executed
+        DueAlarm           mDueAlarm;            // the due alarm currently being dispatched by mScheduler
+        KDateTime          mStartTime;           // when KAlarm started (UTC)
+        KDateTime          mPopulatedTime;       // when all Akonadi collections were populated (UTC), or invalid
+        KDateTime          mSuspendCheckTime;    // system time at last check for a system suspension (UTC)
+        QElapsedTimer      mSuspendCheckTimer;   // monotonic time since last check for a system suspension
+        KDateTime          mSuspendStart;        // start of the period containing the last system suspension
+        KDateTime          mSuspendEnd;          // end of the period containing the last system suspension
+        qint64             mQueueWait;           // milliseconds the action being processed waited in the queue, or -1
+        bool               mLatenessAlerted;     // the lateness threshold has been exceeded, and not yet recovered
         QColor             mPrefsArchivedColour; // archived alarms text colour
         int                mArchivedPurgeDays;   // how long to keep archived alarms, 0 = don't keep, -1 = keep indefinitely
         int                mPurgeDaysQueued;     // >= 0 to purge the archive calendar from KAlarmApp::processLoop()
+        unsigned           mAutoRtcWakeTime;     // automatically set RTC wake time, or 0 if none
         QList<ProcData*>   mCommandProcesses;    // currently active command alarm processes
         QQueue<ActionQEntry> mActionQueue;       // queued commands and actions
         int                mPendingQuitCode;     // exit code for a pending quit
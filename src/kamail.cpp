@@ -26,12 +26,14 @@
 #include "mainwindow.h"
 #include "messagebox.h"
 #include "preferences.h"
+#include "trace.h"
 
 #include <kalarmcal/identities.h>
 #include <KIdentityManagement/kidentitymanagement/identitymanager.h>
 #include <KIdentityManagement/kidentitymanagement/identity.h>
 #include <mailtransport/transportmanager.h>
 #include <mailtransport/transport.h>
+#include <mailtransport/transportjob.h>
 #include <mailtransportakonadi/messagequeuejob.h>
 #include <KCalCore/Person>
 #include <kmime/kmime_header_parsing.h>
@@ -48,14 +50,19 @@
 #include <kemailsettings.h>
 #include <kcodecs.h>
 #include <kcharsets.h>
-#include <kshell.h>
 
 #include <QUrl>
+#include <QCache>
+#include <QProcess>
+#include <QDataStream>
 #include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
 #include <QHostInfo>
 #include <QList>
 #include <QByteArray>
 #include <QTextCodec>
+#include <QTimer>
 #include <QStandardPaths>
 #include <QtDBus/QtDBus>
 #include "kalarm_debug.h"
@@ -67,6 +74,12 @@
 static const QLatin1String KMAIL_DBUS_SERVICE("org.kde.kmail");
 //static const QLatin1String KMAIL_DBUS_PATH("/KMail");
 
+static const QLatin1String OUTBOX_DIR("/outbox");  // directory holding emails not yet handed to a transport
+static const int     RETRY_DELAY     = 5000;       // initial delay (milliseconds) before retrying a failed send
+static const int     SENDMAIL_CHUNK  = 65536;      // maximum bytes to buffer for writing to sendmail
+static const int     SENDMAIL_TIMEOUT = 300000;    // milliseconds to allow sendmail to run before killing it
+static const int     ATTACHMENT_CACHE_SIZE = 32768;   // maximum size (KiB) of cached encoded attachments
+
 namespace HeaderParsing
 {
 bool parseAddress( const char* & scursor, const char * const send,
@@ -79,6 +92,21 @@ static QString     extractEmailAndNormalize(const QString& emailAddress);
 static QStringList extractEmailsAndNormalize(const QString& emailAddresses);
 static QByteArray autoDetectCharset(const QString& text);
 static const QTextCodec* codecForName(const QByteArray& str);
+static QString     attachmentCacheKey(const QUrl&, const QDateTime& modified, qint64 size);
+
+// An email queued for sending via a KDE mail transport.
+struct KAMail::QueueEntry
+{
+    QueueEntry() : transportId(-1), sentBehaviour(0), recovered(false) {}
+    JobData                         data;
+    KMime::Message::Ptr             message;
+    QString                         from;          // pure 'From' address
+    QStringList                     to;            // pure 'To' addresses
+    QStringList                     bcc;           // pure 'Bcc' addresses
+    int                             transportId;
+    int                             sentBehaviour; // MailTransport::SentBehaviourAttribute::SentBehaviour
+    bool                            recovered;     // restored from the outbox: there is no alarm to notify
+};
 
 QString KAMail::i18n_NeedFromEmailAddress()
 { return i18nc("@info", "A 'From' email address must be configured in order to execute email alarms."); }
@@ -86,9 +114,12 @@ QString KAMail::i18n_NeedFromEmailAddress()
 QString KAMail::i18n_sent_mail()
 { return i18nc("@info KMail folder name: this should be translated the same as in kmail", "sent-mail"); }
 
-KAMail*                              KAMail::mInstance = nullptr;   // used only to enable signals/slots to work
-QQueue<MailTransport::MessageQueueJob*> KAMail::mJobs;
-QQueue<KAMail::JobData>                 KAMail::mJobData;
+KAMail*                                      KAMail::mInstance = nullptr;   // used only to enable signals/slots to work
+EmailQueue*                                  KAMail::mQueue = nullptr;
+QHash<quint64, KAMail::QueueEntry*>          KAMail::mEntries;
+QHash<KJob*, quint64>                        KAMail::mActiveJobs;
+QHash<QProcess*, KAMail::SendmailData>       KAMail::mSendmailJobs;
+QCache<QString, QByteArray>                  KAMail::mAttachmentCache(ATTACHMENT_CACHE_SIZE);
 
 KAMail* KAMail::instance()
 {
@@ -99,12 +130,13 @@ KAMail* KAMail::instance()
 
 /******************************************************************************
 * Send the email message specified in an event.
-* Reply = 1 if the message was sent - 'errmsgs' may contain copy error messages.
-*       = 0 if the message is queued for sending.
+* Reply = 0 if the message is queued for sending. The outcome is reported later
+*           by KAlarmApp::emailSent().
 *       = -1 if the message was not sent - 'errmsgs' contains the error messages.
 */
 int KAMail::send(JobData& jobdata, QStringList& errmsgs)
 {
+    KALARM_TRACE_SCOPE("action", "sendEmail");
     QString err;
     KIdentityManagement::Identity identity;
     jobdata.from = Preferences::emailAddress();
@@ -159,12 +191,12 @@ int KAMail::send(JobData& jobdata, QStringList& errmsgs)
         qCDebug(KALARM_LOG) << "Sending via sendmail";
         QStringList paths;
         paths << QStringLiteral("/sbin") << QStringLiteral("/usr/sbin") << QStringLiteral("/usr/lib");
+        QStringList args;
         QString command = QStandardPaths::findExecutable(QStringLiteral("sendmail"), paths);
         if (!command.isNull())
         {
-            command += QStringLiteral(" -f ");
-            command += extractEmailAndNormalize(jobdata.from);
-            command += QStringLiteral(" -oi -t ");
+            args << QStringLiteral("-f") << extractEmailAndNormalize(jobdata.from)
+                 << QStringLiteral("-oi") << QStringLiteral("-t");
             initHeaders(*message, jobdata);
         }
         else
@@ -177,17 +209,10 @@ int KAMail::send(JobData& jobdata, QStringList& errmsgs)
                 return -1;
             }
 
-            command += QStringLiteral(" -s ");
-            command += KShell::quoteArg(jobdata.event.emailSubject());
-
+            args << QStringLiteral("-s") << jobdata.event.emailSubject();
             if (!jobdata.bcc.isEmpty())
-            {
-                command += QStringLiteral(" -b ");
-                command += extractEmailAndNormalize(jobdata.bcc);
-            }
-
-            command += QLatin1Char(' ');
-            command += jobdata.event.emailPureAddresses(QStringLiteral(" ")); // locally provided, okay
+                args << QStringLiteral("-b") << extractEmailAndNormalize(jobdata.bcc);
+            args += jobdata.event.emailPureAddresses(); // locally provided, okay
         }
         // Add the body and attachments to the message.
         // (Sendmail requires attachments to have already been included in the message.)
@@ -199,33 +224,32 @@ int KAMail::send(JobData& jobdata, QStringList& errmsgs)
             return -1;
         }
 
-        // Execute the send command
-        FILE* fd = ::popen(command.toLocal8Bit(), "w");
-        if (!fd)
-        {
-            qCCritical(KALARM_LOG) << "Unable to open a pipe to " << command;
-            errmsgs = errors();
-            return -1;
-        }
+        // Execute the send command asynchronously, so as not to block while
+        // the mail transport agent processes the message.
         message->assemble();
-        QByteArray encoded = message->encodedContent();
-        fwrite(encoded, encoded.length(), 1, fd);
-        pclose(fd);
-
-#ifdef KMAIL_SUPPORTED
-        if (Preferences::emailCopyToKMail())
+        QProcess* proc = new QProcess(instance());
+        SendmailData& sdata = mSendmailJobs[proc];
+        sdata.data    = jobdata;
         {
-            // Create a copy of the sent email in KMail's 'sent-mail' folder,
-            // or if there was a send error, in KMail's 'outbox' folder.
-            err = addToKMailFolder(jobdata, "sent-mail", true);
-            if (!err.isNull())
-                errmsgs += errors(err, COPY_ERROR);    // not a fatal error - continue
+            // Split the message into the chunks to write, so that each can be
+            // released once sendmail has received it.
+            const QByteArray encoded = message->encodedContent();
+            message.clear();
+            for (int i = 0, size = encoded.size();  i < size;  i += SENDMAIL_CHUNK)
+                sdata.chunks += encoded.mid(i, SENDMAIL_CHUNK);
         }
-#endif
-
-        if (jobdata.allowNotify)
-            notifyQueued(jobdata.event);
-        return 1;
+        // Don't let a hung mail program hold on to the message for ever.
+        QTimer* timer = new QTimer(proc);
+        timer->setSingleShot(true);
+        connect(timer, &QTimer::timeout, instance(), &KAMail::slotSendmailTimeout);
+        timer->start(SENDMAIL_TIMEOUT);
+        connect(proc, &QProcess::started, instance(), &KAMail::slotSendmailWrite);
+        connect(proc, &QProcess::bytesWritten, instance(), &KAMail::slotSendmailWrite);
+        connect(proc, static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(&QProcess::finished), instance(), &KAMail::slotSendmailExited);
+        connect(proc, &QProcess::errorOccurred, instance(), &KAMail::slotSendmailError);
+        proc->setProcessChannelMode(QProcess::ForwardedChannels);
+        proc->start(command, args, QIODevice::WriteOnly);
+        return 0;
     }
     else
     {
@@ -249,69 +273,287 @@ int KAMail::send(JobData& jobdata, QStringList& errmsgs)
             return -1;
         }
 
-        MailTransport::MessageQueueJob* mailjob = new MailTransport::MessageQueueJob(qApp);
-        mailjob->setMessage(message);
-        mailjob->transportAttribute().setTransportId(transport->id());
         // MessageQueueJob email addresses must be pure, i.e. without display name. Note
         // that display names are included in the actual headers set up by initHeaders().
-        mailjob->addressAttribute().setFrom(extractEmailAndNormalize(jobdata.from));
-        mailjob->addressAttribute().setTo(extractEmailsAndNormalize(jobdata.event.emailAddresses(QStringLiteral(","))));
+        QueueEntry* entry = new QueueEntry;
+        entry->data        = jobdata;
+        entry->message     = message;
+        entry->transportId = transport->id();
+        entry->from        = extractEmailAndNormalize(jobdata.from);
+        entry->to          = extractEmailsAndNormalize(jobdata.event.emailAddresses(QStringLiteral(",")));
         if (!jobdata.bcc.isEmpty())
-            mailjob->addressAttribute().setBcc(extractEmailsAndNormalize(jobdata.bcc));
-        MailTransport::SentBehaviourAttribute::SentBehaviour sentAction =
-                             (Preferences::emailClient() == Preferences::kmail || Preferences::emailCopyToKMail())
+            entry->bcc = extractEmailsAndNormalize(jobdata.bcc);
+        entry->sentBehaviour = (Preferences::emailClient() == Preferences::kmail || Preferences::emailCopyToKMail())
                              ? MailTransport::SentBehaviourAttribute::MoveToDefaultSentCollection : MailTransport::SentBehaviourAttribute::Delete;
-        mailjob->sentBehaviourAttribute().setSentBehaviour(sentAction);
-        mJobs.enqueue(mailjob);
-        mJobData.enqueue(jobdata);
-        if (mJobs.count() == 1)
+        // Keep a copy of the email in the outbox until it has been sent, in
+        // case KAlarm exits before then.
+        QByteArray spoolData;
+        QDataStream stream(&spoolData, QIODevice::WriteOnly);
+        stream << qint32(entry->transportId) << qint32(entry->sentBehaviour)
+               << entry->from << entry->to << entry->bcc << message->encodedContent();
+        mEntries[queue()->enqueue(entry->transportId, entry->to + entry->bcc, spoolData)] = entry;
+    }
+    return 0;
+}
+
+/******************************************************************************
+* Return the queue which decides when emails are handed to KDE mail transports.
+*/
+EmailQueue* KAMail::queue()
+{
+    if (!mQueue)
+    {
+        mQueue = new EmailQueue(instance(), instance());
+        mQueue->setRetryDelay(RETRY_DELAY);
+        mQueue->setSpoolDirectory(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + OUTBOX_DIR);
+        connect(mQueue, &EmailQueue::finished, instance(), &KAMail::slotEmailFinished);
+    }
+    mQueue->setWorkers(Preferences::emailSendWorkers());
+    mQueue->setRetries(Preferences::emailSendRetries());
+    return mQueue;
+}
+
+/******************************************************************************
+* Queue again for sending any emails which were still in the outbox when
+* KAlarm last exited. Their alarms have already been processed, so the outcome
+* is not reported to them.
+*/
+void KAMail::resendOutbox()
+{
+    EmailQueue* q = queue();
+    const QList<quint64> ids = q->restore();
+    for (int i = 0, count = ids.count();  i < count;  ++i)
+    {
+        QueueEntry* entry = new QueueEntry;
+        qint32 transportId = -1;
+        qint32 sentBehaviour = 0;
+        QByteArray content;
+        QDataStream stream(q->data(ids[i]));
+        stream >> transportId >> sentBehaviour >> entry->from >> entry->to >> entry->bcc >> content;
+        if (stream.status() != QDataStream::Ok  ||  content.isEmpty())
         {
-            // There are no jobs already active or queued, so send now
-            connect(mailjob, &KJob::result, instance(), &KAMail::slotEmailSent);
-            mailjob->start();
+            qCWarning(KALARM_LOG) << "Discarding unreadable email from outbox";
+            delete entry;
+            q->cancel(ids[i]);
+            continue;
         }
+        entry->message = KMime::Message::Ptr(new KMime::Message);
+        entry->message->setContent(content);
+        entry->message->parse();
+        entry->transportId   = transportId;
+        entry->sentBehaviour = sentBehaviour;
+        entry->recovered     = true;
+        mEntries[ids[i]] = entry;
     }
-    return 0;
 }
 
 /******************************************************************************
-* Called when sending an email is complete.
+* Return the number of emails queued or being sent.
+*/
+int KAMail::queueLength()
+{
+    return mSendmailJobs.count() + (mQueue ? mQueue->count() : 0);
+}
+
+/******************************************************************************
+* Return statistics for emails sent via KDE mail transports.
+*/
+EmailQueue::Statistics KAMail::statistics()
+{
+    return mQueue ? mQueue->statistics() : EmailQueue::Statistics();
+}
+
+/******************************************************************************
+* Called by the email queue to send a queued email.
+* If no copy of the email is to be kept, it is sent directly by the mail
+* transport, so that as many emails are sent at once as the queue allows.
+* Otherwise, a job is started to add it to the Akonadi outbox, from which the
+* mail transport agent sends it and then files it in the sent-mail folder.
+*/
+void KAMail::startSend(quint64 id)
+{
+    const QueueEntry* entry = mEntries.value(id);
+    if (!entry)
+        return;
+    MailTransport::TransportJob* transportJob = nullptr;
+    if (entry->sentBehaviour == MailTransport::SentBehaviourAttribute::Delete)
+        transportJob = MailTransport::TransportManager::self()->createTransportJob(entry->transportId);
+    KJob* job;
+    if (transportJob)
+    {
+        transportJob->setSender(entry->from);
+        transportJob->setTo(entry->to);
+        transportJob->setBcc(entry->bcc);
+        transportJob->setData(entry->message->encodedContent(true));
+        job = transportJob;
+    }
+    else
+    {
+        MailTransport::MessageQueueJob* mailjob = new MailTransport::MessageQueueJob(qApp);
+        mailjob->setMessage(entry->message);
+        mailjob->transportAttribute().setTransportId(entry->transportId);
+        mailjob->addressAttribute().setFrom(entry->from);
+        mailjob->addressAttribute().setTo(entry->to);
+        if (!entry->bcc.isEmpty())
+            mailjob->addressAttribute().setBcc(entry->bcc);
+        mailjob->sentBehaviourAttribute().setSentBehaviour(static_cast<MailTransport::SentBehaviourAttribute::SentBehaviour>(entry->sentBehaviour));
+        job = mailjob;
+    }
+    mActiveJobs[job] = id;
+    connect(job, &KJob::result, this, &KAMail::slotEmailSent);
+    job->start();
+}
+
+/******************************************************************************
+* Called when a job to send an email, or to add it to the Akonadi outbox, is
+* complete.
 */
 void KAMail::slotEmailSent(KJob* job)
 {
-    bool copyerr = false;
-    QStringList errmsgs;
-    if (job->error())
+    QHash<KJob*, quint64>::Iterator it = mActiveJobs.find(job);
+    if (it == mActiveJobs.end())
     {
+        qCCritical(KALARM_LOG) << "Unknown email job completed";
+        return;
+    }
+    const quint64 id = it.value();
+    mActiveJobs.erase(it);
+    if (job->error())
         qCCritical(KALARM_LOG) << "Failed:" << job->errorString();
-        errmsgs = errors(job->errorString(), SEND_ERROR);
+    mQueue->sendDone(id, !job->error(), job->errorString());
+}
+
+/******************************************************************************
+* Called when an email has been sent or added to the Akonadi outbox, or has
+* failed after all retries. It has now been removed from KAlarm's outbox.
+*/
+void KAMail::slotEmailFinished(quint64 id, bool success, const QString& error)
+{
+    QueueEntry* entry = mEntries.take(id);
+    if (!entry)
+        return;
+    if (entry->recovered)
+    {
+        if (!success)
+            qCCritical(KALARM_LOG) << "Failed to send email from outbox:" << error;
+        delete entry;
+        return;
     }
-    JobData jobdata;
-    if (mJobs.isEmpty()  ||  mJobData.isEmpty()  ||  job != mJobs.head())
+    QStringList errmsgs;
+    if (!success)
+        errmsgs = errors(error, SEND_ERROR);
+    if (entry->data.allowNotify)
+        notifyQueued(entry->data.event);
+    theApp()->emailSent(entry->data, errmsgs, false);
+    delete entry;
+}
+
+/******************************************************************************
+* Called when the sendmail process has started, or has consumed data written
+* to its standard input.
+* Write the next chunk of the message, so that no more than a limited amount
+* is buffered at any one time, and release it; close the process's standard
+* input once the whole message has been written.
+*/
+void KAMail::slotSendmailWrite()
+{
+    QProcess* proc = qobject_cast<QProcess*>(sender());
+    QHash<QProcess*, SendmailData>::Iterator it = mSendmailJobs.find(proc);
+    if (it == mSendmailJobs.end())
+        return;
+    SendmailData& sdata = it.value();
+    if (proc->bytesToWrite() >= SENDMAIL_CHUNK)
+        return;   // wait until more of the existing data has been consumed
+    if (!sdata.chunks.isEmpty())
+        proc->write(sdata.chunks.takeFirst());
+    if (sdata.chunks.isEmpty())
+        proc->closeWriteChannel();
+}
+
+/******************************************************************************
+* Called when the sendmail process has exited.
+*/
+void KAMail::slotSendmailExited(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    QProcess* proc = qobject_cast<QProcess*>(sender());
+    QStringList errmsgs;
+    if (exitStatus != QProcess::NormalExit)
     {
-        // The queue has been corrupted, so we can't locate the job's data
-        qCCritical(KALARM_LOG) << "Wrong job at head of queue: wiping queue";
-        mJobs.clear();
-        mJobData.clear();
-        if (!errmsgs.isEmpty())
-            theApp()->emailSent(jobdata, errmsgs);
-        errmsgs.clear();
-        errmsgs += i18nc("@info", "Emails may not have been sent");
-        errmsgs += i18nc("@info", "Program error");
-        theApp()->emailSent(jobdata, errmsgs);
+        qCCritical(KALARM_LOG) << "sendmail crashed";
+        errmsgs = errors(i18nc("@info", "The mail program exited abnormally"), SEND_ERROR);
+    }
+    else if (exitCode)
+    {
+        qCCritical(KALARM_LOG) << "sendmail failed: exit code" << exitCode;
+        errmsgs = errors(i18nc("@info", "The mail program exited with code %1", exitCode), SEND_ERROR);
+    }
+    sendmailDone(proc, errmsgs);
+}
+
+/******************************************************************************
+* Called when the sendmail process could not be started, or failed while
+* writing to it.
+*/
+void KAMail::slotSendmailError(QProcess::ProcessError error)
+{
+    QProcess* proc = qobject_cast<QProcess*>(sender());
+    if (error == QProcess::FailedToStart)
+    {
+        // The process never started, so finished() will not be emitted
+        qCCritical(KALARM_LOG) << "Unable to start" << proc->program();
+        sendmailDone(proc, errors());
+    }
+    else
+        qCWarning(KALARM_LOG) << "sendmail error:" << proc->errorString();
+}
+
+/******************************************************************************
+* Called when the sendmail process has run for too long. Kill it, and report
+* that the email failed.
+*/
+void KAMail::slotSendmailTimeout()
+{
+    QTimer* timer = qobject_cast<QTimer*>(sender());
+    QProcess* proc = timer ? qobject_cast<QProcess*>(timer->parent()) : nullptr;
+    if (!proc  ||  !mSendmailJobs.contains(proc))
+        return;
+    qCCritical(KALARM_LOG) << proc->program() << "timed out";
+    proc->disconnect(instance());
+    proc->kill();
+    sendmailDone(proc, errors(i18nc("@info", "The mail program did not respond"), SEND_ERROR));
+}
+
+/******************************************************************************
+* Finish processing after the sendmail process has exited or failed to start.
+*/
+void KAMail::sendmailDone(QProcess* proc, QStringList errmsgs)
+{
+    QHash<QProcess*, SendmailData>::Iterator it = mSendmailJobs.find(proc);
+    if (it == mSendmailJobs.end())
         return;
+    JobData jobdata = it.value().data;
+    mSendmailJobs.erase(it);
+    proc->deleteLater();
+
+#ifdef KMAIL_SUPPORTED
+    bool copyerr = false;
+    if (errmsgs.isEmpty()  &&  Preferences::emailCopyToKMail())
+    {
+        // Create a copy of the sent email in KMail's 'sent-mail' folder.
+        QString err = addToKMailFolder(jobdata, "sent-mail", true);
+        if (!err.isNull())
+        {
+            errmsgs += errors(err, COPY_ERROR);    // not a fatal error - continue
+            copyerr = true;
+        }
     }
-    mJobs.dequeue();
-    jobdata = mJobData.dequeue();
+#else
+    const bool copyerr = false;
+#endif
+
     if (jobdata.allowNotify)
         notifyQueued(jobdata.event);
     theApp()->emailSent(jobdata, errmsgs, copyerr);
-    if (!mJobs.isEmpty())
-    {
-        // Send the next queued email
-        connect(mJobs.head(), &KJob::result, instance(), &KAMail::slotEmailSent);
-        mJobs.head()->start();
-    }
 }
 
 /******************************************************************************
@@ -400,7 +642,9 @@ QString KAMail::appendBodyAttachments(KMime::Message& message, JobData& data)
             QString attachment = QString::fromLatin1((*at).toLocal8Bit());
             QUrl url = QUrl::fromUserInput(attachment, QString(), QUrl::AssumeLocalFile);
             QString attachError = xi18nc("@info", "Error attaching file: <filename>%1</filename>", attachment);
-            QByteArray contents;
+            QString cacheKey;
+            QByteArray* coded = nullptr;   // encoded contents with terminating blank line
+            bool fromCache = false;
             bool atterror = false;
             if (!url.isLocalFile())
             {
@@ -419,35 +663,55 @@ QString KAMail::appendBodyAttachments(KMime::Message& message, JobData& data)
                     return attachError;
                 }
 
-                // Read the file contents
-                auto downloadJob = KIO::storedGet(url);
-                KJobWidgets::setWindow(downloadJob, MainWindow::mainMainWindow());
-                if (!downloadJob->exec())
+                cacheKey = attachmentCacheKey(url, fi.time(KFileItem::ModificationTime), fi.size());
+                coded = mAttachmentCache.object(cacheKey);
+                fromCache = coded;
+                if (!coded)
                 {
-                    qCCritical(KALARM_LOG) << "Load failure:" << attachment;
-                    return attachError;
-                }
-                contents = downloadJob->data();
-                if (static_cast<unsigned>(contents.size()) < fi.size())
-                {
-                    qCDebug(KALARM_LOG) << "Read error:" << attachment;
-                    atterror = true;
+                    // Read the file contents
+                    auto downloadJob = KIO::storedGet(url);
+                    KJobWidgets::setWindow(downloadJob, MainWindow::mainMainWindow());
+                    if (!downloadJob->exec())
+                    {
+                        qCCritical(KALARM_LOG) << "Load failure:" << attachment;
+                        return attachError;
+                    }
+                    const QByteArray contents = downloadJob->data();
+                    if (static_cast<unsigned>(contents.size()) < fi.size())
+                    {
+                        qCDebug(KALARM_LOG) << "Read error:" << attachment;
+                        atterror = true;
+                    }
+                    coded = new QByteArray(KCodecs::base64Encode(contents) + "\n\n");
                 }
             }
             else
             {
                 QFile f(url.toLocalFile());
-                if (!f.open(QIODevice::ReadOnly))
+                const QFileInfo fi(f);
+                cacheKey = attachmentCacheKey(url, fi.lastModified(), fi.size());
+                coded = mAttachmentCache.object(cacheKey);
+                fromCache = coded;
+                if (!coded)
                 {
-                    qCCritical(KALARM_LOG) << "Load failure:" << attachment;
-                    return attachError;
+                    if (!f.open(QIODevice::ReadOnly))
+                    {
+                        qCCritical(KALARM_LOG) << "Load failure:" << attachment;
+                        return attachError;
+                    }
+                    coded = new QByteArray(KCodecs::base64Encode(f.readAll()) + "\n\n");
                 }
-                contents = f.readAll();
             }
 
-            QByteArray coded = KCodecs::base64Encode(contents);
             KMime::Content* content = new KMime::Content();
-            content->setBody(coded + "\n\n");
+            content->setBody(*coded);   // implicitly shared with the cached copy
+            if (!fromCache)
+            {
+                if (atterror)
+                    delete coded;
+                else
+                    mAttachmentCache.insert(cacheKey, coded, coded->size() / 1024 + 1);
+            }
 
             // Set the content type
             QMimeDatabase mimeDb;
@@ -472,6 +736,17 @@ QString KAMail::appendBodyAttachments(KMime::Message& message, JobData& data)
     return QString();
 }
 
+/******************************************************************************
+* Return the key under which an attachment's encoded contents are cached.
+* The modification time and size are included so that any change to the file
+* invalidates the cached copy.
+*/
+QString attachmentCacheKey(const QUrl& url, const QDateTime& modified, qint64 size)
+{
+    return url.toString() + QLatin1Char('\n') + QString::number(modified.toMSecsSinceEpoch())
+                          + QLatin1Char('\n') + QString::number(size);
+}
+
 /******************************************************************************
 * If any of the destination email addresses are non-local, display a
 * notification message saying that an email has been queued for sending.
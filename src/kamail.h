@@ -21,14 +21,19 @@
 #ifndef KAMAIL_H
 #define KAMAIL_H
 
+#include "emailqueue.h"
+
 #include <kalarmcal/kaevent.h>
 
 #include <KCalCore/Person>
 
+#include <QCache>
 #include <QObject>
+#include <QProcess>
 #include <QString>
 #include <QStringList>
-#include <QQueue>
+#include <QHash>
+#include <QList>
 
 class QUrl;
 class KJob;
@@ -40,7 +45,7 @@ namespace KMime {
 
 using namespace KAlarmCal;
 
-class KAMail : public QObject
+class KAMail : public QObject, public EmailQueue::Transport
 {
         Q_OBJECT
     public:
@@ -69,21 +74,43 @@ class KAMail : public QObject
         static QString     getMailBody(quint32 serialNumber);
         static QString     i18n_NeedFromEmailAddress();
         static QString     i18n_sent_mail();
+        static int         queueLength();
+        static EmailQueue::Statistics statistics();
+        static void        resendOutbox();
 
     private Q_SLOTS:
         void               slotEmailSent(KJob*);
+        void               slotEmailFinished(quint64 id, bool success, const QString& error);
+        void               slotSendmailWrite();
+        void               slotSendmailExited(int exitCode, QProcess::ExitStatus);
+        void               slotSendmailError(QProcess::ProcessError);
+        void               slotSendmailTimeout();
 
     private:
+        struct QueueEntry;
+        // Data for an email being sent by sendmail.
+        struct SendmailData
+        {
+            JobData     data;
+            QList<QByteArray> chunks;   // parts of the encoded message not yet written
+        };
+
         KAMail() {}
         static KAMail*     instance();
+        static EmailQueue* queue();
+        void               startSend(quint64 id) override;
         static QString     appendBodyAttachments(KMime::Message& message, JobData&);
         static void        notifyQueued(const KAEvent&);
+        static void        sendmailDone(QProcess*, QStringList errmsgs);
         enum ErrType { SEND_FAIL, SEND_ERROR };
         static QStringList errors(const QString& error = QString(), ErrType = SEND_FAIL);
 
         static KAMail*     mInstance;
-        static QQueue<MailTransport::MessageQueueJob*> mJobs;
-        static QQueue<JobData>                         mJobData;
+        static EmailQueue*                      mQueue;       // orders and retries emails sent via KDE mail transports
+        static QHash<quint64, QueueEntry*>      mEntries;     // emails queued for KDE mail transports, by queue ID
+        static QHash<KJob*, quint64>            mActiveJobs;  // emails currently being sent, by job
+        static QHash<QProcess*, SendmailData>   mSendmailJobs; // emails being sent by sendmail
+        static QCache<QString, QByteArray>      mAttachmentCache;  // base64 encoded attachments
 };
 
 #endif // KAMAIL_H
@@ -937,20 +937,11 @@ void MainWindow::slotBirthdays()
         if (!events.isEmpty())
         {
             mListView->clearSelection();
-            // Add alarm to the displayed lists and to the calendar file
-            KAlarm::UpdateResult status = KAlarm::addEvents(events, dlg, true, true);
-
-            Undo::EventList undos;
-            AlarmCalendar* resources = AlarmCalendar::resources();
-            for (int i = 0, end = events.count();  i < end;  ++i)
-            {
-                Akonadi::Collection c = resources->collectionForEvent(events[i].itemId());
-                undos.append(events[i], c);
-            }
-            Undo::saveAdds(undos, i18nc("@info", "Import birthdays"));
-
-            if (status != KAlarm::UPDATE_FAILED)
-                KAlarm::outputAlarmWarnings(dlg);
+            // Add alarms to the displayed lists and to the calendar file.
+            // The dialog will have closed by the time the outcome is known, so
+            // report it relative to this window. The alarms which are added
+            // are recorded for undo once Akonadi has finished.
+            KAlarm::addEvents(events, this, true, true, i18nc("@info", "Import birthdays"));
         }
     }
 }
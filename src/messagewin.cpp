@@ -154,6 +154,7 @@ enum {
 
 
 QList<MessageWin*> MessageWin::mWindowList;
+QMultiHash<EventId, MessageWin*> MessageWin::mEventWindows;
 QMap<EventId, unsigned> MessageWin::mErrorMessages;
 bool                    MessageWin::mRedisplayed = false;
 // There can only be one audio thread at a time: trying to play multiple
@@ -244,6 +245,8 @@ MessageWin::MessageWin(const KAEvent* event, const KAAlarm& alarm, int flags)
     // File alarm window size is saved elsewhere.
     setAutoSaveSettings(QStringLiteral("MessageWin"), false);
     mWindowList.append(this);
+    if (!mEventId.isEmpty())
+        mEventWindows.insert(mEventId, this);
     if (event->autoClose())
         mCloseTime = alarm.dateTime().effectiveKDateTime().toUtc().dateTime().addSecs(event->lateCancel() * 60);
     if (mAlwaysHide)
@@ -376,6 +379,8 @@ MessageWin::~MessageWin()
         mAudioThread->quit();
     mErrorMessages.remove(mEventId);
     mWindowList.removeAll(this);
+    if (!mErrorWindow)
+        mEventWindows.remove(mEventId, this);
     if (!mRecreating)
     {
         if (!mNoPostAction  &&  !mEvent.postAction().isEmpty())
@@ -1059,7 +1064,7 @@ void MessageWin::readProperties(const KConfigGroup& config)
     mShowEdit            = false;
     // Temporarily initialise mCollection and mEventId - they will be set by redisplayAlarm()
     mCollection          = Akonadi::Collection();
-    mEventId             = EventId(mCollection.id(), eventId);
+    setEventId(EventId(mCollection.id(), eventId));
     qCDebug(KALARM_LOG) << eventId;
     if (mAlarmType != KAAlarm::INVALID_ALARM)
     {
@@ -1096,7 +1101,7 @@ void MessageWin::showRestoredAlarm()
 void MessageWin::redisplayAlarm()
 {
     mCollection = AkonadiModel::instance()->collectionForItem(mEventItemId);
-    mEventId.setCollectionId(mCollection.id());
+    setEventId(EventId(mCollection.id(), mEventId.eventId()));
     qCDebug(KALARM_LOG) << mEventId;
     // Delete any already existing window for the same event
     MessageWin* duplicate = findEvent(mEventId, this);
@@ -1244,7 +1249,7 @@ void MessageWin::alarmShowing(KAEvent& event)
         {
             cal->deleteDisplayEvent(dispEvent.id());   // in case it already exists
             cal->addEvent(dispEvent);
-            cal->save();
+            cal->saveDelayed();   // batch up saves when many alarms are displayed together
         }
     }
     theApp()->rescheduleAlarm(event, alarm);
@@ -1332,16 +1337,34 @@ MessageWin* MessageWin::findEvent(const EventId& eventId, MessageWin* exclude)
 {
     if (!eventId.isEmpty())
     {
-        for (int i = 0, end = mWindowList.count();  i < end;  ++i)
+        // Error windows are not held in mEventWindows, so they are excluded.
+        // Values are returned most recently inserted first, so search from
+        // the end to find the oldest window for the event.
+        const QList<MessageWin*> wins = mEventWindows.values(eventId);
+        for (int i = wins.count();  --i >= 0;  )
         {
-            MessageWin* w = mWindowList[i];
-            if (w != exclude  &&  w->mEventId == eventId  &&  !w->mErrorWindow)
+            MessageWin* w = wins[i];
+            if (w != exclude)
                 return w;
         }
     }
     return nullptr;
 }
 
+/******************************************************************************
+* Set the event ID for the window, and update the event ID index.
+*/
+void MessageWin::setEventId(const EventId& eventId)
+{
+    if (!mErrorWindow)
+    {
+        mEventWindows.remove(mEventId, this);
+        if (!eventId.isEmpty())
+            mEventWindows.insert(eventId, this);
+    }
+    mEventId = eventId;
+}
+
 /******************************************************************************
 * Beep and play the audio file, as appropriate.
 */
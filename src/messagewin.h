@@ -32,6 +32,7 @@
 #include <AkonadiCore/collection.h>
 #include <AkonadiCore/item.h>
 
+#include <QHash>
 #include <QList>
 #include <QMap>
 #include <QPointer>
@@ -135,10 +136,12 @@ class MessageWin : public MainWindowBase
         bool                haveErrorMessage(unsigned msg) const;
         void                clearErrorMessage(unsigned msg) const;
         void                redisplayAlarm();
+        void                setEventId(const EventId&);
         static bool         reinstateFromDisplaying(const KCalCore::Event::Ptr&, KAEvent&, Akonadi::Collection&, bool& showEdit, bool& showDefer);
         static bool         isSpread(const QPoint& topLeft);
 
         static QList<MessageWin*>      mWindowList;    // list of existing message windows
+        static QMultiHash<EventId, MessageWin*> mEventWindows;  // non-error message windows, by event ID
         static QMap<EventId, unsigned> mErrorMessages; // error messages currently displayed, by event ID
         static bool         mRedisplayed;     // redisplayAlarms() was called
         // Sound file playing
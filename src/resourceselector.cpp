@@ -525,7 +525,16 @@ void ResourceSelector::exportCalendar()
 {
     Collection calendar = currentResource();
     if (calendar.isValid())
-        AlarmCalendar::exportAlarms(AlarmCalendar::resources()->events(calendar), this);
+    {
+        // Archived alarms which are not held in full by the calendar are
+        // fetched only for the duration of the export.
+        AlarmCalendar* resources = AlarmCalendar::resources();
+        KAEvent::List events = resources->events(calendar);
+        QVector<KAEvent> archived = resources->archivedRecordEvents(calendar);
+        for (int i = 0, end = archived.count();  i < end;  ++i)
+            events += &archived[i];
+        AlarmCalendar::exportAlarms(events, this);
+    }
 }
 
 /******************************************************************************
@@ -27,9 +27,17 @@
 
 #include <QProcess>
 #include <QDateTime>
+#include <QFile>
 
 #include <stdio.h>
 
+namespace
+{
+const char* RTC_WAKEALARM = "/sys/class/rtc/rtc0/wakealarm";
+
+bool writeWakeAlarm(const QByteArray& value);
+}
+
 RtcWakeAction::RtcWakeAction()
 {
     KLocalizedString::setApplicationDomain("kalarm");
@@ -40,6 +48,15 @@ ActionReply RtcWakeAction::settimer(const QVariantMap& args)
     unsigned t = args[QStringLiteral("time")].toUInt();
     qCDebug(KALARM_LOG) << "RtcWakeAction::settimer(" << t << ")";
 
+    // Set the wakeup directly in the real time clock if possible. This avoids
+    // the cost of running an external command each time the wakeup changes.
+    // Any existing wakeup must be cleared before a new one can be set.
+    // As with rtcwake below, the wakeup is set relative to the current time
+    // ("+seconds").
+    const unsigned delay = wakeDelay(t);
+    if (writeWakeAlarm("0")  &&  (!t || writeWakeAlarm('+' + QByteArray::number(delay))))
+        return ActionReply::SuccessReply();
+
     // Find the rtcwake executable
     QString exe(QStringLiteral("/usr/sbin/rtcwake"));   // default location
     FILE* wh = popen("whereis -b rtcwake", "r");
@@ -77,18 +94,19 @@ ActionReply RtcWakeAction::settimer(const QVariantMap& args)
 
         // If 't' is zero, the current wakeup is cancelled by setting a new wakeup
         // time 2 seconds from now, which will then expire.
-        unsigned now = QDateTime::currentDateTimeUtc().toTime_t();
         proc.setProgram(exe);
-        proc.setArguments({ QStringLiteral("-m"), QStringLiteral("no"), QStringLiteral("-s"), QString::number(t ? t - now : 2) });
+        proc.setArguments({ QStringLiteral("-m"), QStringLiteral("no"), QStringLiteral("-s"), QString::number(delay) });
         proc.start();
-        proc.waitForStarted(5000); // allow a timeout of 5 seconds
-        result = proc.exitCode();
+        if (proc.waitForFinished(5000)) // allow a timeout of 5 seconds
+            result = proc.exitCode();
+        else if (proc.error() != QProcess::FailedToStart)
+            result = -1;
     }
     QString errmsg;
     switch (result)
     {
         case 0:
-            return ActionReply::SuccessType;
+            return ActionReply::SuccessReply();
         case -2:
             errmsg = xi18nc("@text/plain", "Could not run <command>%1</command> to set wake from suspend", QStringLiteral("rtcwake"));
             break;
@@ -96,15 +114,27 @@ ActionReply RtcWakeAction::settimer(const QVariantMap& args)
             errmsg = xi18nc("@text/plain", "Error setting wake from suspend.<nl/>Command was: <command>%1 %2</command><nl/>Error code: %3.", proc.program(), proc.arguments().join(QStringLiteral(" ")), result);
             break;
     }
-#if 0 //QT5
-    ActionReply reply(ActionReply::HelperErrorReply);
-    reply.setErrorCode(result);
+    ActionReply reply = ActionReply::HelperErrorReply(result);
     reply.setErrorDescription(errmsg);
-    qCDebug(KALARM_LOG) , "RtcWakeAction::settimer: Code=" , reply.errorCode() , reply.errorDescription();
+    qCDebug(KALARM_LOG) << "RtcWakeAction::settimer: Code=" << reply.errorCode() << reply.errorDescription();
     return reply;
-#else
-    return 0;
-#endif
+}
+
+namespace
+{
+
+/******************************************************************************
+* Write a value to the real time clock's wakeup alarm.
+* Reply = true if successful.
+*/
+bool writeWakeAlarm(const QByteArray& value)
+{
+    QFile file(QString::fromLatin1(RTC_WAKEALARM));
+    if (!file.open(QIODevice::WriteOnly)  ||  file.write(value + '\n') < 0)
+        return false;
+    return file.flush();
+}
+
 }
 
 KAUTH_HELPER_MAIN("org.kde.kalarmrtcwake", RtcWakeAction)
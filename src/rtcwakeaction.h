@@ -23,6 +23,8 @@
 
 #include <kauth.h>
 
+#include <QDateTime>
+
 using namespace KAuth;
 
 class RtcWakeAction : public QObject
@@ -31,6 +33,19 @@ class RtcWakeAction : public QObject
     public:
         RtcWakeAction();
 
+        /** Return the number of seconds from now until a wakeup time. The real
+         *  time clock is always set relative to the current time, so that the
+         *  wakeup is correct even if the hardware clock is in local time or is
+         *  not in sync with the system clock. A wakeup time which has passed
+         *  gives a short delay, after which the wakeup expires.
+         *  @param triggerTime  wakeup time, in seconds since the epoch.
+         */
+        static unsigned wakeDelay(unsigned triggerTime)
+        {
+            const unsigned now = QDateTime::currentDateTimeUtc().toTime_t();
+            return (triggerTime > now) ? triggerTime - now : 2;
+        }
+
     public Q_SLOTS:
         ActionReply settimer(const QVariantMap& args);
 };
@@ -21,7 +21,7 @@
 #include "kalarm.h"
 
 #include "alarmcalendar.h"
-#include "functions.h"
+#include "shellprocess.h"
 #include "templatemenuaction.h"
 
 #include <kalarmcal/kaevent.h>
@@ -32,7 +32,10 @@
 
 
 TemplateMenuAction::TemplateMenuAction(const QIcon& icon, const QString& label, QObject* parent)
-    : KActionMenu(icon, label, parent)
+    : KActionMenu(icon, label, parent),
+      mMenuValid(false),
+      mCmdAlarmsShown(false),
+      mCalendarConnected(false)
 {
     setDelayed(false);
     connect(menu(), &QMenu::aboutToShow, this, &TemplateMenuAction::slotInitMenu);
@@ -42,32 +45,42 @@ TemplateMenuAction::TemplateMenuAction(const QIcon& icon, const QString& label,
 /******************************************************************************
 * Called when the New From Template action is clicked.
 * Creates a popup menu listing all alarm templates, in sorted name order.
+* The menu is only rebuilt if the templates (including their action types) or
+* the authorisation to run commands have changed since it was last shown.
 */
 void TemplateMenuAction::slotInitMenu()
 {
+    const bool includeCmdAlarms = ShellProcess::authorised();
+    if (mMenuValid  &&  includeCmdAlarms == mCmdAlarmsShown)
+        return;
     QMenu* m = menu();
     m->clear();
     mOriginalTexts.clear();
 
-    // Compile a sorted list of template names
-    int i, end;
-    QStringList sorted;
-    KAEvent::List templates = KAlarm::templateList();
-    for (i = 0, end = templates.count();  i < end;  ++i)
+    AlarmCalendar* cal = AlarmCalendar::resources();
+    if (!cal)
+        return;
+    if (!mCalendarConnected)
     {
-        QString name = templates[i]->templateName();
-        int j = 0;
-        for (int jend = sorted.count();
-             j < jend  &&  QString::localeAwareCompare(name, sorted[j]) > 0;
-             ++j) ;
-        sorted.insert(j, name);
+        // The calendar may not have existed when this action was constructed
+        connect(cal, &AlarmCalendar::templatesChanged, this, &TemplateMenuAction::slotTemplatesChanged);
+        mCalendarConnected = true;
     }
-
-    for (i = 0, end = sorted.count();  i < end;  ++i)
+    // The calendar holds the template names already sorted
+    const QStringList sorted = cal->templateNames();
+    for (int i = 0, end = sorted.count();  i < end;  ++i)
     {
+        if (!includeCmdAlarms)
+        {
+            const KAEvent* templ = cal->templateEvent(sorted[i]);
+            if (templ  &&  (templ->actionTypes() & KAEvent::ACT_COMMAND))
+                continue;
+        }
         QAction* act = m->addAction(sorted[i]);
         mOriginalTexts[act] = sorted[i];   // keep original text, since action text has shortcuts added
     }
+    mCmdAlarmsShown = includeCmdAlarms;
+    mMenuValid = true;
 }
 
 /******************************************************************************
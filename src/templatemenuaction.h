@@ -39,9 +39,13 @@ class TemplateMenuAction : public KActionMenu
     private Q_SLOTS:
         void   slotInitMenu();
         void   slotSelected(QAction*);
+        void   slotTemplatesChanged()   { mMenuValid = false; }
 
     private:
         QMap<QAction*, QString> mOriginalTexts;   // menu item texts without added ampersands
+        bool                    mMenuValid;       // the menu is up to date with the template list
+        bool                    mCmdAlarmsShown;  // command alarm templates were included in the menu
+        bool                    mCalendarConnected; // templatesChanged() is connected
 };
 
 #endif // TEMPLATEMENUACTION_H